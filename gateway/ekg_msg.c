@@ -0,0 +1,810 @@
+#include "ekg_msg.h"
+
+
+/*
+ *******************************************************************************
+ *           Generated by tools/msggen.py from tools/msg_schema.json           *
+ *                            Do not edit this file                            *
+ *******************************************************************************
+*/
+
+
+/*
+ *******************************************************************************
+ *                          Internal Global Variables                          *
+ *******************************************************************************
+*/
+
+
+// CRC-16/CCITT lookup table (polynomial 0x1021)
+static const uint16_t g_ekg_msg_crc_tab[256] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+	0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+	0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+	0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+	0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+	0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+	0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+	0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+	0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+	0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+	0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+	0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+	0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+	0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+	0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+	0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+	0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+	0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+	0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+	0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+	0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+	0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+	0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+	0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+	0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+	0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+	0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+	0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+	0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+	0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+	0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Computes the CRC-16/CCITT (initial value 0xFFFF) of a buffer, a byte at a
+// time (frames are checked at every offset while resynchronizing)
+static uint16_t ekg_msg_crc (const uint8_t *buffer, size_t len) {
+	uint16_t crc = 0xFFFF;
+
+	while (len-- > 0) {
+		crc = (crc << 8) ^ g_ekg_msg_crc_tab[(crc >> 8) ^ *buffer++];
+	}
+
+	return crc;
+}
+
+
+/*
+ *******************************************************************************
+ *                         Message Unpacking Functions                         *
+ *******************************************************************************
+*/
+
+
+// Unpacks a status message
+static int unpack_msg_status (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_status.status = buffer[offset++];
+
+	return 0;
+}
+
+
+// Unpacks a train data message
+static int unpack_msg_train_data (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	for (size_t i = 0; i < 20; ++i) {
+		msg->body.msg_train.n_periods[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+	for (size_t i = 0; i < 20; ++i) {
+		msg->body.msg_train.n_amplitudes[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		msg->body.msg_train.a_periods[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		msg->body.msg_train.a_amplitudes[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		msg->body.msg_train.v_periods[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		msg->body.msg_train.v_amplitudes[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+
+	return 0;
+}
+
+
+// Unpacks a sample data message
+static int unpack_msg_sample_data (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_sample.label = buffer[offset++];
+	msg->body.msg_sample.amplitude = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_sample.period = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+
+	return 0;
+}
+
+
+// Unpacks a instruction message
+static int unpack_msg_instruction (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_instruction.inst = buffer[offset++];
+
+	return 0;
+}
+
+
+// Unpacks a configuration message
+static int unpack_msg_configuration (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_configuration.cfg_comp = buffer[offset++];
+	msg->body.msg_configuration.cfg_val = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+
+	return 0;
+}
+
+
+// Unpacks a model data message
+static int unpack_msg_model_data (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+
+	msg->body.msg_model.model = buffer[offset++];
+	msg->body.msg_model.size = buffer[offset++];
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_model.size > MSG_MODEL_DATA_MAX ||
+		1 * (size_t)msg->body.msg_model.size > (len - offset)) {
+		return -1;
+	}
+	for (size_t i = 0; i < msg->body.msg_model.size; ++i) {
+		msg->body.msg_model.data[i] = buffer[offset++];
+	}
+
+	return 0;
+}
+
+
+// Unpacks a feedback message
+static int unpack_msg_feedback (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_feedback.label = buffer[offset++];
+	msg->body.msg_feedback.amplitude = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_feedback.period = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+
+	return 0;
+}
+
+
+// Unpacks a escalation message
+static int unpack_msg_escalation (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+
+	msg->body.msg_escalation.label = buffer[offset++];
+	msg->body.msg_escalation.confidence = buffer[offset++];
+	msg->body.msg_escalation.amplitude = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_escalation.period = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_escalation.n_samples = buffer[offset++];
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_escalation.n_samples > MSG_SNIPPET_MAX ||
+		2 * (size_t)msg->body.msg_escalation.n_samples > (len - offset)) {
+		return -1;
+	}
+	for (size_t i = 0; i < msg->body.msg_escalation.n_samples; ++i) {
+		msg->body.msg_escalation.samples[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+
+	return 0;
+}
+
+
+// Unpacks a summary message
+static int unpack_msg_summary (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_summary.count = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_summary.amplitude = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_summary.period = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+
+	return 0;
+}
+
+
+// Unpacks a policy message
+static int unpack_msg_policy (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_policy.enabled = buffer[offset++];
+	msg->body.msg_policy.min_confidence = buffer[offset++];
+	msg->body.msg_policy.snippet_len = buffer[offset++];
+	msg->body.msg_policy.summary_blocks = buffer[offset++];
+
+	return 0;
+}
+
+
+// Unpacks a sample batch message
+static int unpack_msg_sample_batch (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+
+	msg->body.msg_sample_batch.timestamp = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_sample_batch.n_beats = buffer[offset++];
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_sample_batch.n_beats > MSG_BATCH_MAX ||
+		1 * (size_t)msg->body.msg_sample_batch.n_beats > (len - offset)) {
+		return -1;
+	}
+	for (size_t i = 0; i < msg->body.msg_sample_batch.n_beats; ++i) {
+		msg->body.msg_sample_batch.labels[i] = buffer[offset++];
+	}
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_sample_batch.n_beats > MSG_BATCH_MAX ||
+		2 * (size_t)msg->body.msg_sample_batch.n_beats > (len - offset)) {
+		return -1;
+	}
+	for (size_t i = 0; i < msg->body.msg_sample_batch.n_beats; ++i) {
+		msg->body.msg_sample_batch.amplitudes[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_sample_batch.n_beats > MSG_BATCH_MAX ||
+		2 * (size_t)msg->body.msg_sample_batch.n_beats > (len - offset)) {
+		return -1;
+	}
+	for (size_t i = 0; i < msg->body.msg_sample_batch.n_beats; ++i) {
+		msg->body.msg_sample_batch.periods[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+
+	return 0;
+}
+
+
+// Unpacks a batching message
+static int unpack_msg_batching (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_batching.count = buffer[offset++];
+	msg->body.msg_batching.age = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_batching.encoding = buffer[offset++];
+	msg->body.msg_batching.keyframe = buffer[offset++];
+
+	return 0;
+}
+
+
+// Unpacks a beat stream message
+static int unpack_msg_beat_stream (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+
+	msg->body.msg_beat_stream.timestamp = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_beat_stream.keyframe = buffer[offset++];
+	msg->body.msg_beat_stream.n_beats = buffer[offset++];
+	msg->body.msg_beat_stream.size = buffer[offset++];
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_beat_stream.size > MSG_STREAM_MAX ||
+		1 * (size_t)msg->body.msg_beat_stream.size > (len - offset)) {
+		return -1;
+	}
+	for (size_t i = 0; i < msg->body.msg_beat_stream.size; ++i) {
+		msg->body.msg_beat_stream.data[i] = buffer[offset++];
+	}
+
+	return 0;
+}
+
+
+// Unpacks a waveform message
+static int unpack_msg_waveform (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+
+	msg->body.msg_waveform.timestamp = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_waveform.first = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_waveform.k = buffer[offset++];
+	msg->body.msg_waveform.n_samples = buffer[offset++];
+	msg->body.msg_waveform.size = buffer[offset++];
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_waveform.size > MSG_WAVE_MAX ||
+		1 * (size_t)msg->body.msg_waveform.size > (len - offset)) {
+		return -1;
+	}
+	for (size_t i = 0; i < msg->body.msg_waveform.size; ++i) {
+		msg->body.msg_waveform.data[i] = buffer[offset++];
+	}
+
+	return 0;
+}
+
+
+// Unpacks a hello message
+static int unpack_msg_hello (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_hello.version = buffer[offset++];
+	msg->body.msg_hello.types = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_hello.encodings = buffer[offset++];
+	msg->body.msg_hello.batch_max = buffer[offset++];
+	msg->body.msg_hello.mtu = buffer[offset] | ((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+
+	return 0;
+}
+
+
+// Unpacks a telemetry message
+static int unpack_msg_telemetry (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_telemetry.queue = buffer[offset++];
+	msg->body.msg_telemetry.depth = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_telemetry.high_water = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_telemetry.queued = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_telemetry.evicted = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_telemetry.refused = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_telemetry.coalesced = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_telemetry.expired = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_telemetry.bytes = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	for (size_t i = 0; i < MSG_LATENCY_BUCKETS; ++i) {
+		msg->body.msg_telemetry.latency[i] = buffer[offset] |
+			((uint32_t)buffer[offset + 1] << 8) |
+			((uint32_t)buffer[offset + 2] << 16) |
+			((uint32_t)buffer[offset + 3] << 24);
+		offset += 4;
+	}
+
+	return 0;
+}
+
+
+// Unpacks a log status message
+static int unpack_msg_log_status (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_log_status.first = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_log_status.next = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_log_status.overwritten = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+
+	return 0;
+}
+
+
+// Unpacks a log ack message
+static int unpack_msg_log_ack (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_log_ack.next = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+
+	return 0;
+}
+
+
+// Unpacks a link status message
+static int unpack_msg_link_status (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_link_status.mtu = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.tx_len = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.rx_len = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.interval = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.latency = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.timeout = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.mode = buffer[offset++];
+	msg->body.msg_link_status.sent = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_link_status.deferred = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_link_status.rejected = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_link_status.failed = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_link_status.congested = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+
+	return 0;
+}
+
+
+/*
+ *******************************************************************************
+ *                        External Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+int ekg_msg_decode (const uint8_t *buffer, size_t len, msg_t *msg,
+    ekg_msg_frame_t *frame) {
+	size_t body, z;
+	int err = -1;
+
+	// Check the markers as far as they were received
+	if ((len > 0 && buffer[0] != EKG_MSG_HEAD) ||
+		(len > 1 && buffer[1] != EKG_MSG_HEAD)) {
+		return -1;
+	}
+	if (len < EKG_MSG_HEADER_SIZE) {
+		return 0;
+	}
+
+	// Check the length, then the CRC and type once the frame is complete
+	body = buffer[10] | (buffer[11] << 8);
+	z = EKG_MSG_HEADER_SIZE + body + EKG_MSG_TRAILER_SIZE;
+	if (z > EKG_MSG_FRAME_MAX) {
+		return -1;
+	}
+	if (len < z) {
+		return 0;
+	}
+	if (ekg_msg_crc(buffer + 2, z - 4) !=
+		(buffer[z - 2] | (buffer[z - 1] << 8)) || buffer[2] >= MSG_TYPE_MAX ||
+		buffer[3] >= MSG_CHANNEL_MAX) {
+		return -1;
+	}
+
+	msg->type = buffer[2];
+	if (frame != NULL) {
+		frame->channel = buffer[3];
+		frame->seq     = buffer[4] | (buffer[5] << 8);
+		frame->time    = buffer[6] | (buffer[7] << 8) |
+			((uint32_t)buffer[8] << 16) | ((uint32_t)buffer[9] << 24);
+	}
+	buffer += EKG_MSG_HEADER_SIZE;
+
+	switch (msg->type) {
+		case MSG_TYPE_STATUS: {
+			if (body >= 1) {
+				err = unpack_msg_status(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_TRAIN_DATA: {
+			if (body >= 160) {
+				err = unpack_msg_train_data(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_SAMPLE_DATA: {
+			if (body >= 5) {
+				err = unpack_msg_sample_data(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_INSTRUCTION: {
+			if (body >= 1) {
+				err = unpack_msg_instruction(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_CONFIGURATION: {
+			if (body >= 3) {
+				err = unpack_msg_configuration(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_MODEL_DATA: {
+			if (body >= 2) {
+				err = unpack_msg_model_data(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_FEEDBACK: {
+			if (body >= 5) {
+				err = unpack_msg_feedback(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_ESCALATION: {
+			if (body >= 7) {
+				err = unpack_msg_escalation(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_SUMMARY: {
+			if (body >= 6) {
+				err = unpack_msg_summary(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_POLICY: {
+			if (body >= 4) {
+				err = unpack_msg_policy(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_SAMPLE_BATCH: {
+			if (body >= 5) {
+				err = unpack_msg_sample_batch(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_BATCHING: {
+			if (body >= 5) {
+				err = unpack_msg_batching(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_BEAT_STREAM: {
+			if (body >= 7) {
+				err = unpack_msg_beat_stream(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_WAVEFORM: {
+			if (body >= 9) {
+				err = unpack_msg_waveform(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_HELLO: {
+			if (body >= 9) {
+				err = unpack_msg_hello(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_TELEMETRY: {
+			if (body >= 77) {
+				err = unpack_msg_telemetry(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_LOG_STATUS: {
+			if (body >= 12) {
+				err = unpack_msg_log_status(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_LOG_ACK: {
+			if (body >= 4) {
+				err = unpack_msg_log_ack(msg, buffer, body);
+			}
+		}
+		break;
+		case MSG_TYPE_LINK_STATUS: {
+			if (body >= 33) {
+				err = unpack_msg_link_status(msg, buffer, body);
+			}
+		}
+		break;
+		default:
+		break;
+	}
+
+	return (err == 0) ? (int)z : -1;
+}
+
+
+size_t ekg_msg_decode_stream (const uint8_t *buffer, size_t len,
+    ekg_msg_handler_t handler, void *ctx) {
+	size_t offset = 0;
+	ekg_msg_frame_t frame;
+	msg_t msg;
+	int z;
+
+	while (offset < len) {
+		if ((z = ekg_msg_decode(buffer + offset, len - offset, &msg,
+			&frame)) == 0) {
+			break;
+		}
+		if (z < 0) {
+			offset++;
+			continue;
+		}
+		handler(&msg, &frame, ctx);
+		offset += z;
+	}
+
+	return offset;
+}
+
+
+int ekg_msg_track (ekg_msg_stats_t *stats, uint16_t seq) {
+	uint16_t ahead = seq - stats->seq;
+	uint8_t bit = 1 << (seq % 8);
+	uint8_t *byte = stats->seen + (seq % EKG_MSG_TRACK_WINDOW) / 8;
+
+	// A frame more than half the sequence space ahead is behind instead
+	if (stats->synced && ahead >= 0x8000) {
+		if ((uint16_t)-ahead <= EKG_MSG_TRACK_WINDOW && (*byte & bit)) {
+			stats->duplicates++;
+			return 0;
+		}
+		if ((uint16_t)-ahead <= EKG_MSG_TRACK_WINDOW) {
+			*byte |= bit;
+		}
+		stats->frames++;
+		stats->reordered++;
+		return 1;
+	}
+	if (stats->synced) {
+		stats->lost += ahead;
+	}
+
+	// Forget the frames the window moves past
+	if (!stats->synced || ahead >= EKG_MSG_TRACK_WINDOW) {
+		for (size_t i = 0; i < sizeof(stats->seen); ++i) {
+			stats->seen[i] = 0;
+		}
+	} else {
+		for (uint16_t s = stats->seq; s != seq; ++s) {
+			stats->seen[(s % EKG_MSG_TRACK_WINDOW) / 8] &= ~(1 << (s % 8));
+		}
+	}
+	*byte |= bit;
+
+	stats->frames++;
+	stats->synced = 1;
+	stats->seq = seq + 1;
+
+	return 1;
+}
@@ -0,0 +1,415 @@
+#if !defined(EKG_MSG_H)
+#define EKG_MSG_H
+
+
+/*
+ *******************************************************************************
+ *           Generated by tools/msggen.py from tools/msg_schema.json           *
+ *                            Do not edit this file                            *
+ *******************************************************************************
+*/
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/*
+ *******************************************************************************
+ *                              Framing Constants                              *
+ *******************************************************************************
+*/
+
+
+// Byte value used for marking message headers
+#define     EKG_MSG_HEAD                        0xFF
+
+// Size of the message header (markers, type, channel, sequence, time, length)
+#define     EKG_MSG_HEADER_SIZE                 12
+
+// Size of the message trailer (CRC-16/CCITT of all but the markers)
+#define     EKG_MSG_TRAILER_SIZE                2
+
+// Size of the largest valid frame
+#define     EKG_MSG_FRAME_MAX                   (EKG_MSG_HEADER_SIZE + \
+                                                 sizeof(msg_body_t) + \
+                                                 EKG_MSG_TRAILER_SIZE)
+
+// Frames per channel tracked, to drop those received before (more than the
+// notifications the device sends again after a loss may hold)
+#define     EKG_MSG_TRACK_WINDOW                256
+
+
+/*
+ *******************************************************************************
+ *                         Generated Symbolic Constants                        *
+ *******************************************************************************
+*/
+
+
+// Protocol version advertised in hello messages
+#define     MSG_PROTOCOL_VERSION                2
+
+// Channel carrying hellos, instructions, configuration and status
+#define     MSG_CHANNEL_CONTROL                 0
+
+// Channel carrying relayed beats and summaries
+#define     MSG_CHANNEL_BEATS                   1
+
+// Channel carrying escalated beats
+#define     MSG_CHANNEL_ALERTS                  2
+
+// Channel carrying raw waveform frames
+#define     MSG_CHANNEL_WAVEFORM                3
+
+// Channel carrying device statistics
+#define     MSG_CHANNEL_TELEMETRY               4
+
+// Channel carrying beats logged while disconnected (sequence = record)
+#define     MSG_CHANNEL_BACKLOG                 5
+
+// Number of logical channels
+#define     MSG_CHANNEL_MAX                     6
+
+// Maximum size of a model blob carried in a model data message
+#define     MSG_MODEL_DATA_MAX                  200
+
+// Maximum number of waveform samples carried in an escalation message
+#define     MSG_SNIPPET_MAX                     32
+
+// Maximum number of beats carried in a sample batch message
+#define     MSG_BATCH_MAX                       48
+
+// Maximum size of the coded beats carried in a beat stream message
+#define     MSG_STREAM_MAX                      192
+
+// Maximum size of the coded samples carried in a waveform message
+#define     MSG_WAVE_MAX                        192
+
+// Number of buckets in a queue latency histogram (< 1 ms, then doubling)
+#define     MSG_LATENCY_BUCKETS                 12
+
+
+/*
+ *******************************************************************************
+ *                          Generated Type Definitions                         *
+ *******************************************************************************
+*/
+
+
+// Enumeration describing the type of the message received (treated as 8-bits)
+typedef enum {
+    MSG_TYPE_STATUS = 0,        // Message contains status bit-field only
+    MSG_TYPE_TRAIN_DATA,        // Message containing all training data
+    MSG_TYPE_SAMPLE_DATA,       // Message containing a data sample
+    MSG_TYPE_INSTRUCTION,       // Message contains a device instruction
+    MSG_TYPE_CONFIGURATION,     // Message contains configuration data
+    MSG_TYPE_MODEL_DATA,        // Message selects a classifier (+ model blob)
+    MSG_TYPE_FEEDBACK,          // Message contains a correctly labeled beat
+    MSG_TYPE_ESCALATION,        // Message contains an uncertain/abnormal beat
+    MSG_TYPE_SUMMARY,           // Message summarizes locally counted beats
+    MSG_TYPE_POLICY,            // Message configures the escalation policy
+    MSG_TYPE_SAMPLE_BATCH,      // Message containing several data samples
+    MSG_TYPE_BATCHING,          // Message configures sample batching
+    MSG_TYPE_BEAT_STREAM,       // Message containing delta coded data samples
+    MSG_TYPE_WAVEFORM,          // Message containing coded raw samples
+    MSG_TYPE_HELLO,             // Message advertises protocol capabilities
+    MSG_TYPE_TELEMETRY,         // Message reports the counters of an IPC queue
+    MSG_TYPE_LOG_STATUS,        // Message announces the beat log records to follow
+    MSG_TYPE_LOG_ACK,           // Message acknowledges beat log records
+    MSG_TYPE_LINK_STATUS,       // Message reports the BLE link in effect
+
+    MSG_TYPE_MAX                // Upper boundary value for the message type
+} msg_type_t;
+
+
+// Structure describing a status message (contains single 8-bit status)
+typedef struct {
+    uint8_t  status;            // Status bit-field
+} msg_status_t;
+
+
+// Structure describing a message containing training data (12-bit normalized)
+typedef struct {
+    uint16_t n_periods[20];     // Periods of normal waveforms
+    uint16_t n_amplitudes[20];  // Amplitudes of normal waveforms
+    uint16_t a_periods[10];     // Periods of atrial premature beat
+    uint16_t a_amplitudes[10];  // Amplitudes of atrial premature beat
+    uint16_t v_periods[10];     // Periods of premature ventricular contractions
+    uint16_t v_amplitudes[10];  // Amplitudes of premature ventricular contractions
+} msg_train_data_t;
+
+
+// Structure describing a message containing a data sample
+typedef struct {
+    uint8_t  label;             // Sample label (sample_label_t)
+    uint16_t amplitude;         // Contains the amplitude of the sample
+    uint16_t period;            // Contains the period since the last sample
+} msg_sample_data_t;
+
+
+// Structure describing a message containing an instruction
+typedef struct {
+    uint8_t  inst;              // Holds value of msg_instruction_type_t
+} msg_instruction_data_t;
+
+
+// Structure describing a configuration message
+typedef struct {
+    uint8_t  cfg_comp;          // Comparator flag (0x0 = GTE, 0x1 = LTE)
+    uint16_t cfg_val;           // Comparator value
+} msg_configuration_data_t;
+
+
+// Structure describing a classifier model message (size 0 = select only)
+typedef struct {
+    uint8_t  model;                     // Holds value of classifier_type_t
+    uint8_t  size;                      // Size of the model blob
+    uint8_t  data[MSG_MODEL_DATA_MAX];  // Model blob (backend specific)
+} msg_model_data_t;
+
+
+// Structure describing a labeled beat used for online learning
+typedef struct {
+    uint8_t  label;             // Correct label (sample_label_t)
+    uint16_t amplitude;         // Amplitude of the beat
+    uint16_t period;            // RR period of the beat
+} msg_feedback_data_t;
+
+
+// Structure describing a beat escalated for heavier analysis
+typedef struct {
+    uint8_t  label;                     // Label given (sample_label_t)
+    uint8_t  confidence;                // Confidence in the label (0-255)
+    uint16_t amplitude;                 // Amplitude of the beat
+    uint16_t period;                    // RR period of the beat
+    uint8_t  n_samples;                 // Number of waveform samples
+    uint16_t samples[MSG_SNIPPET_MAX];  // Waveform around the peak
+} msg_escalation_data_t;
+
+
+// Structure describing a summary of beats that were only counted locally
+typedef struct {
+    uint16_t count;             // Number of beats counted
+    uint16_t amplitude;         // Mean amplitude of the counted beats
+    uint16_t period;            // Mean RR period of the counted beats
+} msg_summary_data_t;
+
+
+// Structure describing the escalation policy (enabled = 0 relays every beat)
+typedef struct {
+    uint8_t  enabled;           // Only escalate beats if nonzero
+    uint8_t  min_confidence;    // Normal beats at or over this are counted
+    uint8_t  snippet_len;       // Waveform samples sent with an escalation
+    uint8_t  summary_blocks;    // Sample blocks between summaries
+} msg_policy_data_t;
+
+
+// Structure describing a batch of data samples (beat i peaks period[i] ms after beat i - 1)
+typedef struct {
+    uint32_t timestamp;                  // Time (ms since boot) of the first peak
+    uint8_t  n_beats;                    // Number of beats
+    uint8_t  labels[MSG_BATCH_MAX];      // Sample labels (sample_label_t)
+    uint16_t amplitudes[MSG_BATCH_MAX];  // Amplitudes of the samples
+    uint16_t periods[MSG_BATCH_MAX];     // Periods since the last sample
+} msg_sample_batch_data_t;
+
+
+// Structure describing when sample batches are flushed (count <= 1 = unbatched)
+typedef struct {
+    uint8_t  count;             // Flush once this many beats are held
+    uint16_t age;               // Flush once the oldest beat is this old (ms)
+    uint8_t  encoding;          // Holds value of msg_encoding_type_t
+    uint8_t  keyframe;          // Coded frames between keyframes
+} msg_batching_data_t;
+
+
+// Structure describing a frame of the coded beat stream (see beat_codec.h)
+typedef struct {
+    uint32_t timestamp;             // Time (ms since boot) of the first peak
+    uint8_t  keyframe;              // Nonzero if the stream state was reset
+    uint8_t  n_beats;               // Number of beats
+    uint8_t  size;                  // Size of the coded beats
+    uint8_t  data[MSG_STREAM_MAX];  // Coded beats
+} msg_beat_stream_data_t;
+
+
+// Structure describing a frame of raw samples (see wave_codec.h)
+typedef struct {
+    uint32_t timestamp;           // Time (ms since boot) of the first sample
+    uint16_t first;               // First sample
+    uint8_t  k;                   // Rice parameter
+    uint8_t  n_samples;           // Number of samples (including the first)
+    uint8_t  size;                // Size of the coded residuals
+    uint8_t  data[MSG_WAVE_MAX];  // Coded residuals
+} msg_waveform_data_t;
+
+
+// Structure describing the capabilities of one side of a connection
+typedef struct {
+    uint8_t  version;           // Protocol version (MSG_PROTOCOL_VERSION)
+    uint32_t types;             // Bit i set if msg_type_t i is understood
+    uint8_t  encodings;         // Bit i set if msg_encoding_type_t i is supported
+    uint8_t  batch_max;         // Largest sample batch accepted (beats)
+    uint16_t mtu;               // Negotiated ATT MTU
+} msg_hello_data_t;
+
+
+// Structure describing the counters of an IPC queue since boot
+typedef struct {
+    uint8_t  queue;                         // Transmit channel (MSG_CHANNEL_*), or MSG_CHANNEL_MAX for the receive queue
+    uint16_t depth;                         // Messages queued now
+    uint16_t high_water;                    // Most messages queued at once
+    uint32_t queued;                        // Messages queued
+    uint32_t evicted;                       // Queued messages evicted when full
+    uint32_t refused;                       // Messages refused when full
+    uint32_t coalesced;                     // Messages refused to be summarized
+    uint32_t expired;                       // Messages dropped past their deadline
+    uint32_t bytes;                         // Bytes dequeued (throughput between two reports)
+    uint32_t latency[MSG_LATENCY_BUCKETS];  // Messages dequeued after < 1 ms, < 2 ms, < 4 ms ... (last: the rest)
+} msg_telemetry_data_t;
+
+
+// Structure describing the records of the beat log about to be sent on the backlog channel
+typedef struct {
+    uint32_t first;             // Record sent first (its backlog sequence is the low 16 bits)
+    uint32_t next;              // Record after the last one held
+    uint32_t overwritten;       // Records overwritten before acknowledgement since boot
+} msg_log_status_data_t;
+
+
+// Structure describing the beat log records received by a client
+typedef struct {
+    uint32_t next;              // Record after the last one received (all before it were)
+} msg_log_ack_data_t;
+
+
+// Structure describing the BLE link negotiated with the client, and the notification counters since boot
+typedef struct {
+    uint16_t mtu;               // ATT MTU
+    uint16_t tx_len;            // Link-layer payload (bytes) sent per packet (27 without data length extension)
+    uint16_t rx_len;            // Link-layer payload (bytes) received per packet
+    uint16_t interval;          // Connection interval (1.25 ms units)
+    uint16_t latency;           // Events the device may skip
+    uint16_t timeout;           // Supervision timeout (10 ms units)
+    uint8_t  mode;              // Connection parameters requested last (0 monitor, 1 stream, 2 none)
+    uint32_t sent;              // Notifications handed to the stack
+    uint32_t deferred;          // Sends put off (no credit, or congested)
+    uint32_t rejected;          // Sends refused by the stack (retried)
+    uint32_t failed;            // Notifications lost (confirmed with an error)
+    uint32_t congested;         // Times the stack reported congestion
+} msg_link_status_data_t;
+
+
+// Union describing a message body in general (used for buffer sizing)
+typedef union {
+    msg_status_t                 msg_status;
+    msg_train_data_t             msg_train;
+    msg_sample_data_t            msg_sample;
+    msg_instruction_data_t       msg_instruction;
+    msg_configuration_data_t     msg_configuration;
+    msg_model_data_t             msg_model;
+    msg_feedback_data_t          msg_feedback;
+    msg_escalation_data_t        msg_escalation;
+    msg_summary_data_t           msg_summary;
+    msg_policy_data_t            msg_policy;
+    msg_sample_batch_data_t      msg_sample_batch;
+    msg_batching_data_t          msg_batching;
+    msg_beat_stream_data_t       msg_beat_stream;
+    msg_waveform_data_t          msg_waveform;
+    msg_hello_data_t             msg_hello;
+    msg_telemetry_data_t         msg_telemetry;
+    msg_log_status_data_t        msg_log_status;
+    msg_log_ack_data_t           msg_log_ack;
+    msg_link_status_data_t       msg_link_status;
+} msg_body_t;
+
+
+// Structure describing the general message
+typedef struct {
+    msg_type_t type;
+    msg_body_t body;
+} msg_t;
+
+
+// Structure describing the header fields of a decoded frame
+typedef struct {
+    uint8_t  channel;               // Logical channel (MSG_CHANNEL_*)
+    uint16_t seq;                   // Sequence number in the channel
+    uint32_t time;                  // Device time (ms since boot) when sent
+} ekg_msg_frame_t;
+
+
+// Structure counting the frames lost or reordered in a received channel
+typedef struct {
+    uint16_t seq;                   // Sequence number expected next
+    uint8_t  seen[EKG_MSG_TRACK_WINDOW / 8]; // Bit s % window if tracked
+    uint8_t  synced;                // Nonzero once a frame was tracked
+    uint32_t frames;                // Frames tracked
+    uint32_t lost;                  // Frames skipped (incl. late ones)
+    uint32_t reordered;             // Frames arriving behind the sequence
+    uint32_t duplicates;            // Frames tracked before (to be dropped)
+} ekg_msg_stats_t;
+
+
+// Callback invoked for each message decoded from a stream
+typedef void (*ekg_msg_handler_t)(const msg_t *msg, 
+    const ekg_msg_frame_t *frame, void *ctx);
+
+
+/*
+ *******************************************************************************
+ *                            Function Declarations                            *
+ *******************************************************************************
+*/
+
+
+/* @brief Decodes the frame at the start of a buffer.
+ *
+ * @param
+ * - buffer: Received data
+ * - len:    Length of the received data
+ * - msg:    Receives the decoded message
+ * - frame:  Receives the header fields of the frame (may be NULL)
+ *
+ * @return Bytes consumed (> 0), 0 if the frame is incomplete, or -1 if the
+ *         buffer doesn't start with an intact frame of a known type
+*/
+int ekg_msg_decode (const uint8_t *buffer, size_t len, msg_t *msg,
+    ekg_msg_frame_t *frame);
+
+
+/* @brief Decodes every complete frame in a buffer, skipping over bytes
+ *        that don't start an intact frame.
+ *
+ * @param
+ * - buffer:  Received data
+ * - len:     Length of the received data
+ * - handler: Invoked with each decoded message
+ * - ctx:     Passed to the handler
+ *
+ * @return Bytes consumed. The rest is an incomplete message to be retried
+ *         once more data is appended
+*/
+size_t ekg_msg_decode_stream (const uint8_t *buffer, size_t len,
+    ekg_msg_handler_t handler, void *ctx);
+
+
+/* @brief Tracks the sequence number of a received frame. Numbers that jump
+ *        ahead count the frames skipped as lost, and numbers that fall
+ *        behind count as reordered. A number tracked before (one of the
+ *        last EKG_MSG_TRACK_WINDOW) is a duplicate: the device sends
+ *        notifications again after a loss, and the client drops the frames
+ *        it already has. Keep one set of counters per channel, and zero
+ *        them to start a new connection
+ *
+ * @param
+ * - stats: The counters of the frame's channel
+ * - seq:   Sequence number of the received frame
+ *
+ * @return 1 to keep the frame, or 0 to drop it (a duplicate)
+*/
+int ekg_msg_track (ekg_msg_stats_t *stats, uint16_t seq);
+
+
+#endif
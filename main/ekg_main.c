@@ -48,6 +48,23 @@
 
 
 
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing how and where a task is launched
+typedef struct {
+	TaskFunction_t  task;           // Task function
+	const char     *name;           // Task name
+	uint32_t        stack_size;     // Stack size (words)
+	UBaseType_t     priority;       // Task priority
+	BaseType_t      core;           // Core the task is pinned to
+} task_cfg_t;
+
+
 /*
  *******************************************************************************
  *                              Global Variables                               *
@@ -55,6 +72,17 @@
 */
 
 
+// Update this table to change the placement of the pipeline stages (config.h)
+static const task_cfg_t g_task_cfg_tab[] = {
+	{ task_ble_manager,    "BLE Manager",    STACK_SIZE_BLE_MANAGER,
+	  PRIORITY_BLE_MANAGER,    CORE_BLE_MANAGER    },
+	{ task_ekg_manager,    "EKG Manager",    STACK_SIZE_EKG_MANAGER,
+	  PRIORITY_EKG_MANAGER,    CORE_EKG_MANAGER    },
+	{ task_sample_manager, "Sample Manager", STACK_SIZE_SAMPLE_MANAGER,
+	  PRIORITY_SAMPLE_MANAGER, CORE_SAMPLE_MANAGER },
+};
+
+
 // Global state flag (see msg.h for bits)
 uint8_t g_state_flag;
 
@@ -66,15 +94,15 @@ uint32_t g_state_data;
 // Global mutex for controlled access to the state flag
 portMUX_TYPE g_state_mutex = portMUX_INITIALIZER_UNLOCKED;
 
-// Global mutex for controlled access to the sensor buffer
-portMUX_TYPE g_sample_buffer_mutex = portMUX_INITIALIZER_UNLOCKED;
-
 // Global variables (comparator type, comparator value)
 uint8_t g_cfg_comp = 0x1;
 uint16_t g_cfg_val = 930;
 
-// Global variable holding the sensor sample buffer
-uint16_t g_sample_buffer[DEVICE_SENSOR_PUSH_BUF_SIZE];
+// Global variable holding the sensor sample blocks
+uint16_t g_sample_blocks[DEVICE_SAMPLE_BLOCKS][DEVICE_SENSOR_PUSH_BUF_SIZE];
+
+// Global variable holding the time (ms since boot) each block started
+uint32_t g_sample_block_time[DEVICE_SAMPLE_BLOCKS];
 
 // Global variables holding the normal wave training data set
 uint16_t g_n_periods[20];
@@ -88,6 +116,27 @@ uint16_t g_a_amplitudes[10];
 uint16_t g_v_periods[10];
 uint16_t g_v_amplitudes[10];
 
+// Global variables holding the requested classifier and its model blob
+uint8_t g_model_type = CLASSIFIER_KNN;
+uint8_t g_model_size = 0;
+uint8_t g_model_data[MSG_MODEL_DATA_MAX];
+
+// Global variable holding the escalation policy (disabled: relay every beat)
+msg_policy_data_t g_policy = {
+	.enabled        = 0,
+	.min_confidence = 128,
+	.snippet_len    = 0,
+	.summary_blocks = 4
+};
+
+// Global variable holding the sample batching configuration (unbatched)
+msg_batching_data_t g_batching = {
+	.count    = 1,
+	.age      = 2000,
+	.encoding = MSG_ENCODING_PLAIN,
+	.keyframe = 8
+};
+
 
 /*
  *******************************************************************************
@@ -164,29 +213,15 @@ void app_main (void) {
 
     /***************************** Init User Tasks ****************************/
 
-    /* Experimental
-     * We pin Bluetooth and EKG tasks to Core 0
-     * We pin Sample task to Core 1
-    */
-
-	// Launch BLE task (default priority - core 0 or PROTOCOL CPU)
-    if (xTaskCreatePinnedToCore(task_ble_manager, "BLE Manager", 
-        STACK_SIZE_BLE_MANAGER, NULL, tskIDLE_PRIORITY, NULL, 0x0) != pdPASS) {
-        ESP_LOGE("MAIN", "Couldn't register BLE task");
-        return;
-    }
-
-    // Launch EKG task (pinned to core 0x0 or PROTOCOL CPU)
-    if (xTaskCreatePinnedToCore(task_ekg_manager, "EKG Manager", 
-        STACK_SIZE_EKG_MANAGER, NULL, tskIDLE_PRIORITY, NULL, 0x0) != pdPASS) {
-        ESP_LOGE("MAIN", "Couldn't register Telemetry task");
-        return;
-    }
+    // Launch the pipeline stages (see config.h for their placement)
+    for (size_t i = 0; i < sizeof(g_task_cfg_tab) / sizeof(task_cfg_t); ++i) {
+        const task_cfg_t *cfg = g_task_cfg_tab + i;
 
-    // Launch Sample task (highest priority - core 1 or APP CPU)
-    if (xTaskCreatePinnedToCore(task_sample_manager, "Sample Manager",
-        STACK_SIZE_SAMPLE_MANAGER, NULL, 0, NULL, 0x1) != pdPASS) {
-        ESP_LOGE("MAIN", "Couldn't register Sample task");
+        if (xTaskCreatePinnedToCore(cfg->task, cfg->name, cfg->stack_size,
+            NULL, cfg->priority, NULL, cfg->core) != pdPASS) {
+            ESP_LOGE("MAIN", "Couldn't register %s task", cfg->name);
+            return;
+        }
     }
 
 
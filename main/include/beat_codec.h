@@ -0,0 +1,117 @@
+#if !defined(BEAT_CODEC_H)
+#define BEAT_CODEC_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 19/11/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Compressed beat stream encoding. Each beat is coded as the difference to  *
+ *  the previous beat of the stream, using zigzag variable-length integers    *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include <inttypes.h>
+#include <stddef.h>
+
+
+/* A beat is coded as two variable-length integers (7 bits per byte, least
+ * significant group first, high bit set on all but the last byte)
+ *
+ * [ zigzag(amplitude delta) << 2 | label ] [ zigzag(period delta) ]
+ *
+ * Deltas are taken against the previous beat of the stream. A keyframe resets
+ * the stream state to zero, so the first beat after it carries absolute values
+ * and a decoder that lost a frame can resume from it. Beats with a steady
+ * rhythm take two bytes, while the worst case is six.
+ *
+ * This module has no dependencies on the device, so gateways may build it
+*/
+
+
+/*
+ *******************************************************************************
+ *                         External Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Maximum size (in bytes) of a single coded beat
+#define     BEAT_CODEC_BEAT_MAX                 6
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing the state of an encoder or decoder (the last beat)
+typedef struct {
+	uint16_t amplitude;                     // Amplitude of the previous beat
+	uint16_t period;                        // RR period of the previous beat
+} beat_codec_t;
+
+
+/*
+ *******************************************************************************
+ *                            Function Declarations                            *
+ *******************************************************************************
+*/
+
+
+/* @brief Resets the state of an encoder or decoder (a keyframe)
+ *
+ * @param
+ * - codec: The codec state
+ *
+ * @return None
+*/
+void beat_codec_reset (beat_codec_t *codec);
+
+
+/* @brief Appends a coded beat to a buffer. The state is only advanced if the
+ *        beat fits
+ *
+ * @param
+ * - codec:     The encoder state
+ * - label:     Label of the beat (two bits)
+ * - amplitude: Amplitude of the beat
+ * - period:    RR period of the beat
+ * - buffer:    Buffer to which the beat is written
+ * - cap:       Space (in bytes) left in the buffer
+ *
+ * @return Size (in bytes) of the coded beat, or zero if it doesn't fit
+*/
+size_t beat_encode (beat_codec_t *codec, uint8_t label, uint16_t amplitude,
+	uint16_t period, uint8_t *buffer, size_t cap);
+
+
+/* @brief Reads a coded beat from a buffer. The state is only advanced if a
+ *        complete beat was read
+ *
+ * @param
+ * - codec:     The decoder state
+ * - buffer:    Buffer from which the beat is read
+ * - len:       Bytes left in the buffer
+ * - label:     Set to the label of the beat
+ * - amplitude: Set to the amplitude of the beat
+ * - period:    Set to the RR period of the beat
+ *
+ * @return Size (in bytes) of the coded beat, or zero if it is truncated or
+ *         malformed
+*/
+size_t beat_decode (beat_codec_t *codec, const uint8_t *buffer, size_t len,
+	uint8_t *label, uint16_t *amplitude, uint16_t *period);
+
+
+#endif
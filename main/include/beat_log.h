@@ -0,0 +1,218 @@
+#if !defined(BEAT_LOG_H)
+#define BEAT_LOG_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 28/11/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Append-only log of beat frames in a flash partition. Holds the beats       *
+ *  relayed while no client is connected, until they are synchronized          *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "msg.h"
+
+
+/* The partition is divided into segments of one flash sector. Each segment
+ * starts with a header, followed by frames back to back
+ *
+ * [ MAGIC x4 | SEQ x4 | FRAME | FRAME | ... | erased ]
+ *
+ * SEQ numbers the first record of the segment, and records count up from
+ * there across segments. Frames are moved onto the backlog channel as they
+ * are logged (their sequence number is the low 16 bits of the record), so
+ * they are sent from flash unchanged. Segments are used in turn, so all
+ * sectors wear evenly. The segment after the one being appended to is erased
+ * ahead (beat_log_prepare), so appending only programs pages. When the log is
+ * full the oldest segment is dropped as the one after it is erased. Bytes are
+ * buffered and programmed a flash page at a time
+ *
+ * Erasing a sector takes about 45 ms, and up to 400 ms (SPI NOR flash data
+ * sheets). Flash operations disable the caches of both cores, so the sample
+ * task is held for up to 40 periods of DEVICE_SENSOR_POLL_PERIOD_MS. A
+ * segment holds about 200 beat frames, so this happens every few minutes of
+ * disconnection. Appending never erases, and the sample task keeps its
+ * period, so only the samples due during an erase are taken late
+*/
+
+
+/*
+ *******************************************************************************
+ *                         External Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Label and subtype of the data partition holding the log (partitions.csv)
+#define     BEAT_LOG_PARTITION                  "beatlog"
+#define     BEAT_LOG_SUBTYPE                    0x40
+
+// Size (in bytes) of a segment (one flash sector, the unit of erasure)
+#define     BEAT_LOG_SEGMENT_SIZE               4096
+
+// Size (in bytes) of a flash page (the unit of programming)
+#define     BEAT_LOG_PAGE_SIZE                  256
+
+// Size (in bytes) of the header of a segment
+#define     BEAT_LOG_HEADER_SIZE                8
+
+// Marker of a segment in use ("BLOG")
+#define     BEAT_LOG_MAGIC                      0x474F4C42
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing the beat log (a writer and a reader)
+typedef struct {
+	const esp_partition_t *partition;       // Partition (NULL if unavailable)
+	uint32_t segments;                      // Number of segments
+	uint32_t head;                          // Segment with the oldest records
+	uint32_t tail;                          // Segment being appended to
+	uint32_t spare;                         // Segment erased ahead (if any)
+	uint32_t first;                         // Oldest record held
+	uint32_t next;                          // Record appended next
+	uint32_t acked;                         // Records before it were received
+	uint32_t overwritten;                   // Records lost before acked
+	msg_stream_t stream;                    // Backlog channel (seq = next)
+	size_t   write;                         // Offset of the buffered bytes
+	size_t   fill;                          // Bytes buffered
+	uint8_t  page[BEAT_LOG_PAGE_SIZE];      // Bytes yet to be programmed
+	uint32_t read_segment;                  // Segment of the record read next
+	size_t   read_offset;                   // Offset of the record read next
+	uint32_t read_seq;                      // Record read next
+} beat_log_t;
+
+
+/*
+ *******************************************************************************
+ *                            Function Declarations                            *
+ *******************************************************************************
+*/
+
+
+/* @brief Opens the log in its partition, and recovers the records written
+ *        before the last reset. Records cut short by a reset are dropped
+ *
+ * @param
+ * - log:    The log
+ *
+ * @return
+ * - ESP_OK: Success
+ * - ESP_ERR_NOT_FOUND: The partition table has no log partition
+ * - ESP_ERR_INVALID_SIZE: The partition holds fewer than two segments
+ * - Other: The flash couldn't be read or erased
+*/
+esp_err_t beat_log_init (beat_log_t *log);
+
+
+/* @brief Appends a frame to the log. The frame is moved onto the backlog
+ *        channel in place, and is only buffered until a page is filled
+ *
+ * @param
+ * - log:    The log
+ * - frame:  The frame (as returned by msg_pack_into)
+ * - len:    Size (in bytes) of the frame
+ *
+ * @return
+ * - ESP_OK: Success (possibly overwriting the oldest segment, if the next
+ *   one wasn't prepared)
+ * - ESP_ERR_INVALID_STATE: The log isn't open
+ * - ESP_ERR_INVALID_SIZE: The frame is larger than MSG_BUFFER_MAX
+ * - Other: The flash couldn't be written or erased
+*/
+esp_err_t beat_log_append (beat_log_t *log, uint8_t *frame, size_t len);
+
+
+/* @brief Erases the segment that appending continues in, unless that was
+ *        done already. If it holds the oldest records, they are dropped.
+ *        Call it off the append path, whenever a stall of a sector erase is
+ *        least harmful
+ *
+ * @param
+ * - log:    The log
+ *
+ * @return
+ * - ESP_OK: Success
+ * - ESP_ERR_INVALID_STATE: The log isn't open
+ * - Other: The flash couldn't be read or erased
+*/
+esp_err_t beat_log_prepare (beat_log_t *log);
+
+
+/* @brief Programs the buffered bytes, so they may be read and survive a
+ *        reset
+ *
+ * @param
+ * - log:    The log
+ *
+ * @return
+ * - ESP_OK: Success
+ * - Other: The flash couldn't be written
+*/
+esp_err_t beat_log_flush (beat_log_t *log);
+
+
+/* @brief Moves the reader to the oldest record not yet acknowledged
+ *
+ * @param
+ * - log:    The log
+ *
+ * @return None
+*/
+void beat_log_rewind (beat_log_t *log);
+
+
+/* @brief Returns the size of the record read next (programmed bytes only)
+ *
+ * @param
+ * - log:    The log
+ *
+ * @return Size (in bytes) of the frame, or zero if all records were read
+*/
+size_t beat_log_peek (beat_log_t *log);
+
+
+/* @brief Reads the record returned by beat_log_peek, and moves past it
+ *
+ * @param
+ * - log:    The log
+ * - buffer: Receives the frame
+ * - len:    Size (in bytes) returned by beat_log_peek
+ *
+ * @return
+ * - ESP_OK: Success
+ * - Other: The flash couldn't be read
+*/
+esp_err_t beat_log_read (beat_log_t *log, uint8_t *buffer, size_t len);
+
+
+/* @brief Marks the records before the given one as received
+ *
+ * @param
+ * - log:    The log
+ * - next:   Record after the last one received
+ *
+ * @return None
+*/
+void beat_log_ack (beat_log_t *log, uint32_t next);
+
+
+#endif
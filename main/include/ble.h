@@ -27,6 +27,7 @@
 #include "freertos/event_groups.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 
 #include "esp_bt.h"
@@ -59,9 +60,53 @@
 // The Message-Transmission-Unit to use with clients
 #define BLE_MTU_SIZE			512
 
+// The Message-Transmission-Unit in effect until a client negotiates another
+#define BLE_MTU_DEFAULT			23
+
 // The maximum size (in bytes) of the response/indicate message (< MTU size) 
 #define BLE_RSP_MSG_MAX_SIZE	20
 
+// Bytes of each notification taken by the ATT header (opcode and handle)
+#define BLE_ATT_HEADER_SIZE		3
+
+// Link-layer payload (in bytes) of a packet without data length extension
+#define BLE_DATA_LEN_DEFAULT	27
+
+// Link-layer payload (in bytes) requested with data length extension (the 
+// largest the specification allows)
+#define BLE_DATA_LEN_MAX		251
+
+// Notifications that may be in flight (handed to the stack, not confirmed),
+// and copies kept of them to send again after a loss
+#define BLE_TX_CREDITS			4
+
+// Time (in ms) after which a notification refused by the stack is retried,
+// and for which sending pauses after one was lost, before it is sent again
+// (doubling with each loss in a row, up to BLE_TX_PAUSE_MAX_MS)
+#define BLE_TX_RETRY_MS			20
+#define BLE_TX_PAUSE_MAX_MS		160
+
+// Connection parameters requested while streaming samples or synchronizing
+// the beat log: short intervals (15 to 30 ms, in 1.25 ms units), no latency
+#define BLE_CONN_STREAM_MIN_INT		12
+#define BLE_CONN_STREAM_MAX_INT		24
+#define BLE_CONN_STREAM_LATENCY		0
+
+// Connection parameters requested while only beats are relayed: long 
+// intervals (200 to 400 ms), and up to 3 events skipped with nothing to send
+#define BLE_CONN_MONITOR_MIN_INT	160
+#define BLE_CONN_MONITOR_MAX_INT	320
+#define BLE_CONN_MONITOR_LATENCY	3
+
+// Supervision timeout (in 10 ms units) requested with either set
+#define BLE_CONN_TIMEOUT			600
+
+// Frames waiting for transmission at which the stream parameters are wanted
+#define BLE_CONN_STREAM_DEPTH		4
+
+// Time (in ms) the queues must stay shallow before monitoring parameters
+#define BLE_CONN_IDLE_MS			5000
+
 
 /*
  *******************************************************************************
@@ -81,6 +126,39 @@ enum {
 };
 
 
+// Enumeration of the connection parameter sets
+typedef enum {
+	BLE_CONN_MODE_MONITOR = 0,	// Long intervals with latency (low duty cycle)
+	BLE_CONN_MODE_STREAM,		// Short intervals (high throughput)
+
+	BLE_CONN_MODE_MAX			// Upper boundary (none requested yet)
+} ble_conn_mode_t;
+
+
+// Structure describing the connection parameters in effect
+typedef struct {
+	uint16_t interval;			// Connection interval (in 1.25 ms units)
+	uint16_t latency;			// Events the device may skip
+	uint16_t timeout;			// Supervision timeout (in 10 ms units)
+	uint16_t tx_len;			// Link-layer payload sent per packet
+	uint16_t rx_len;			// Link-layer payload received per packet
+	uint8_t  mode;				// Set last requested (BLE_CONN_MODE_*)
+	uint32_t updates;			// Updates applied by the client
+	uint32_t rejected;			// Requests refused by the stack or client
+} ble_link_t;
+
+
+// Structure describing the counters of the notification sender
+typedef struct {
+	uint32_t sent;				// Notifications handed to the stack
+	uint32_t resent;			// Of those, copies sent again after a loss
+	uint32_t deferred;			// Sends put off (no credit, or congested)
+	uint32_t rejected;			// Sends refused by the stack (to be retried)
+	uint32_t failed;			// Notifications confirmed with an error
+	uint32_t congested;			// Times the stack reported congestion
+} ble_tx_stats_t;
+
+
 /*
  *******************************************************************************
  *                          External Global Variables                          *
@@ -105,17 +183,76 @@ esp_err_t ble_init (void);
 
 /* @brief Dispatches a message to the connected BLE device
  * @note Send this only after having called ble_init and knowing a device is 
- *       connected
+ *       connected. Each notification takes one of BLE_TX_CREDITS credits,
+ *       returned when the stack confirms it. Without a credit, or while the
+ *       stack reports congestion, nothing is sent. FLAG_BLE_SEND_MSG is set
+ *       once sending may resume. A copy of each notification is kept until
+ *       it is confirmed. When one is confirmed with an error, sending pauses
+ *       for BLE_TX_RETRY_MS (twice as long with each loss in a row) so the
+ *       stack may drain, and then it and every notification after it are
+ *       sent again, in order, before anything new (see ble_resend). The
+ *       client may get some twice, and drops those by sequence number
  * @param
  * - len: The length (size) of the uint8_t byte buffer to send
  * - buffer: The uint8_t buffer pointer
  * @return
  * - ESP_OK: The message was sent
  * - ESP_ERR_INVALID_ARG: The give buffer was null, among other reasons
- * - ESP_ERR_INVALID_SIZE The message given is too large to fit in an MTU
+ * - ESP_ERR_INVALID_SIZE The message exceeds the MTU (less the ATT header)
+ * - ESP_ERR_INVALID_STATE: No credit is left, the link is congested, or
+ *   notifications are left to send again
  * - Other errors resulting from esp_ble_gatts_send_indicate are possible
+ *   (the message wasn't sent, and may be retried after BLE_TX_RETRY_MS)
+*/
+esp_err_t ble_send (size_t len, const uint8_t *buffer);
+
+
+/* @brief Sends again, oldest first, the notifications a loss left to send
+ *        (the one confirmed with an error, and every one after it)
+ * @return
+ * - ESP_OK: None are left to send again
+ * - ESP_ERR_INVALID_STATE: Some are left (no credit, congested, or paused)
+ * - Other errors resulting from esp_ble_gatts_send_indicate are possible
+*/
+esp_err_t ble_resend (void);
+
+
+/* @brief Returns the notifications left to send again after a loss
+ * @return The number of notifications (at most BLE_TX_CREDITS)
+*/
+uint8_t ble_tx_pending (void);
+
+
+/* @brief Returns the MTU negotiated with the connected client
+ * @return The MTU (BLE_MTU_DEFAULT if none was negotiated)
+*/
+uint16_t ble_get_mtu (void);
+
+
+/* @brief Selects the connection parameters wanted from the client. The
+ *        request is made right away, or once an update in progress completes
+ *        (from the GAP handler). The client has the final say
+ * @param
+ * - mode: The parameter set (BLE_CONN_MODE_*)
+ * @return None
+*/
+void ble_set_conn_mode (ble_conn_mode_t mode);
+
+
+/* @brief Copies the connection parameters in effect
+ * @param
+ * - link: Receives the parameters
+ * @return None
+*/
+void ble_get_link (ble_link_t *link);
+
+
+/* @brief Copies the counters of the notification sender
+ * @param
+ * - stats: Receives the counters
+ * @return None
 */
-esp_err_t ble_send (size_t len, uint8_t *buffer);
+void ble_tx_stats (ble_tx_stats_t *stats);
 
 
 #endif
\ No newline at end of file
@@ -12,7 +12,8 @@
  * - Sonnya Dellarosa                                                          *
  *                                                                             *
  * Description:                                                                *
- *  KNN Classifier                                                             *
+ *  Pluggable beat classifier. Backends (KNN, decision tree, MLP) implement a  *
+ *  common interface, and one of them is selected as the active classifier     *
  *                                                                             *
  *******************************************************************************
 */
@@ -25,7 +26,6 @@
 #include <math.h>
 #include "esp_system.h"
 #include "esp_log.h"
-#include "ekg_task.h"
 
 
 /*
@@ -35,21 +35,44 @@
 */
 
 
-// Value for K of the KNN classifier
+// Value for K of the KNN classifier (votes are weighed in a byte: K <= 8)
+#if !defined(K_VALUE)
 #define 	K_VALUE                                    4
+#endif
 
+/* Number of normal, atrial and ventrical samples in the KNN training set. 
+ * Offsets are bytes, and the normal class is the largest. The host benchmark
+ * builds with other values, but the training data message holds these
+*/
+#if !defined(KNN_N_SAMPLES)
+#define     KNN_N_SAMPLES                              20
+#define     KNN_A_SAMPLES                              10
+#define     KNN_V_SAMPLES                              10
+#endif
+
+// Total number of samples in the KNN training set
+#define     KNN_SAMPLES     (KNN_N_SAMPLES + KNN_A_SAMPLES + KNN_V_SAMPLES)
+
+// Size of a KNN model blob (same layout as the training data message body)
+#define     KNN_BLOB_SIZE                   (2 * 2 * KNN_SAMPLES)
+
+// Maximum number of beats a backend processes in one batch pass
+#define     CLASSIFIER_BATCH_MAX                       64
+
+// Confidence value describing complete certainty in a label
+#define     CLASSIFIER_CONFIDENCE_MAX                  255
 
-// Global variables holding the normal wave training data set
-extern uint16_t g_n_periods[20];
-extern uint16_t g_n_amplitudes[20];
+// Maximum number of nodes in a decision tree model
+#define     TREE_NODE_MAX                              32
 
-// Global variables holding the atrial wave training data set
-extern uint16_t g_a_periods[10];
-extern uint16_t g_a_amplitudes[10];
+// Maximum number of hidden units in an MLP model
+#define     MLP_HIDDEN_MAX                             16
 
-// Global variables holding the ventrical wave training data set
-extern uint16_t g_v_periods[10];
-extern uint16_t g_v_amplitudes[10];
+// Maximum number of prototypes kept per class by the nearest-centroid model
+#define     NCM_PROTOTYPES_MAX                         8
+
+// Number of recent samples that dominate a class mean and prototype reservoir
+#define     NCM_WINDOW                                 64
 
 
 /*
@@ -68,13 +91,78 @@ typedef enum {
 } sample_label_t;
 
 
-// Structure describing a neighbor
+// Enumeration of the available classifier backends (treated as 8-bits)
+typedef enum {
+	CLASSIFIER_KNN = 0,         // K-Nearest-Neighbors over the training set
+	CLASSIFIER_TREE,            // Fixed-point decision tree
+	CLASSIFIER_MLP,             // Quantized (int8) multi-layer perceptron
+	CLASSIFIER_NCM,             // Nearest centroid/prototype (online learning)
+
+	CLASSIFIER_TYPE_MAX         // Upper boundary value for the backend type
+} classifier_type_t;
+
+
+// Structure describing the features of a single beat
+typedef struct {
+	uint16_t amplitude;         // Amplitude of the R peak
+	uint16_t rr_period;         // RR period (ms)
+} beat_features_t;
+
+
+// Structure describing the memory footprint of a backend (in bytes)
 typedef struct {
+	size_t ram;                 // Mutable model state
+	size_t flash;               // Constant (built-in) model data
+} classifier_footprint_t;
+
+
+// Structure describing a neighbor (distance is squared Euclidean)
+typedef struct {
+    uint32_t distance;
     sample_label_t label;
-    float distance;
 } neighbor_t;
 
 
+/* Interface implemented by every classifier backend
+ *
+ * - name:           Printable name of the backend
+ * - init:           Resets the backend and installs its built-in model
+ * - load:           Installs a model from a serialized blob (backend format)
+ * - classify:       Labels a single beat. Its confidence (0 -
+ *                   CLASSIFIER_CONFIDENCE_MAX) is written if non-null
+ * - classify_batch: Labels n beats. Labels must hold n entries. Confidences
+ *                   (0 - CLASSIFIER_CONFIDENCE_MAX) are written if non-null
+ * - update:         Learns from a single labeled beat in O(1) or O(model size).
+ *                   NULL if the backend does not support online learning
+ * - footprint:      Reports the RAM and flash used by the model
+*/
+typedef struct {
+	const char *name;
+	esp_err_t (*init)(void);
+	esp_err_t (*load)(const uint8_t *blob, size_t len);
+	sample_label_t (*classify)(const beat_features_t *features, 
+		uint8_t *confidence);
+	void (*classify_batch)(const beat_features_t *features, size_t n,
+		sample_label_t *labels, uint8_t *confidences);
+	esp_err_t (*update)(const beat_features_t *features, sample_label_t label);
+	void (*footprint)(classifier_footprint_t *footprint);
+} classifier_t;
+
+
+/*
+ *******************************************************************************
+ *                          External Global Variables                          *
+ *******************************************************************************
+*/
+
+
+// Backend implementations (see classifier_<name>.c)
+extern const classifier_t g_classifier_knn;
+extern const classifier_t g_classifier_tree;
+extern const classifier_t g_classifier_mlp;
+extern const classifier_t g_classifier_ncm;
+
+
 /*
  *******************************************************************************
  *                            Function Declarations                            *
@@ -82,17 +170,108 @@ typedef struct {
 */
 
 
-/* @brief Classifies a sample using the KNN method.
+/* @brief Initializes all backends and selects the KNN backend
  *
- * @note Sets of samples cannot be empty.
+ * @return
+ * - ESP_OK: All backends were initialized
+ * - Other errors resulting from a backend init function
+*/
+esp_err_t classifier_init (void);
+
+
+/* @brief Selects the backend used by classify and classify_batch
+ *
+ * @param
+ * - type: The backend to select
+ *
+ * @return
+ * - ESP_OK: The backend is now active
+ * - ESP_ERR_INVALID_ARG: Unknown backend type
+*/
+esp_err_t classifier_select (classifier_type_t type);
+
+
+/* @brief Installs a model blob into the given backend. The active backend is
+ *        not changed
+ *
+ * @param
+ * - type: The backend the model is intended for
+ * - blob: The serialized model (format is specific to the backend)
+ * - len:  Size of the blob (in bytes)
+ *
+ * @return
+ * - ESP_OK: The model was installed
+ * - ESP_ERR_INVALID_ARG: Unknown backend type or null blob
+ * - ESP_ERR_INVALID_SIZE: The blob size is wrong for the backend
+ * - ESP_ERR_INVALID_STATE: The blob describes a malformed model
+*/
+esp_err_t classifier_load (classifier_type_t type, const uint8_t *blob,
+	size_t len);
+
+
+/* @brief Returns the backend implementation for the given type
+ *
+ * @param
+ * - type: The backend type
+ *
+ * @return Pointer to the backend, or NULL if the type is unknown
+*/
+const classifier_t *classifier_get (classifier_type_t type);
+
+
+/* @brief Returns the type of the active backend */
+classifier_type_t classifier_active (void);
+
+
+/* @brief Updates the active backend with a labeled beat (online learning)
+ *
+ * @param
+ * - features: Features of the beat
+ * - label:    Correct label of the beat
+ *
+ * @return
+ * - ESP_OK: The model was updated
+ * - ESP_ERR_INVALID_ARG: The label is not a known class
+ * - ESP_ERR_NOT_SUPPORTED: The active backend cannot learn online
+*/
+esp_err_t classifier_update (const beat_features_t *features, 
+	sample_label_t label);
+
+
+/* @brief Returns a pseudo-random number (used by backends for reservoir
+ *        replacement)
+*/
+uint32_t classifier_random (void);
+
+
+/* @brief Classifies a sample using the active backend.
+ *
+ * @note A low confidence means the label is a close call (for example a tie
+ *       between classes), and should be checked by heavier analysis
  *
  * @param
  * - amplitude : Amplitude of the new sample to be classified.
  * - rr_period : RR period of the new sample to be classified.
+ * - confidence: Receives the confidence in the label (may be NULL)
  *
  * @return Label of the new sample
 */
-sample_label_t classify (uint16_t amplitude, uint16_t rr_period);
+sample_label_t classify (uint16_t amplitude, uint16_t rr_period, 
+	uint8_t *confidence);
+
+
+/* @brief Classifies a batch of samples using the active backend. Beats from
+ *        the same block should be classified together, since backends share
+ *        model-side work across the batch
+ *
+ * @param
+ * - features:    Array of n beat features
+ * - n:           Number of beats
+ * - labels:      Output array receiving n labels
+ * - confidences: Output array receiving n confidences (may be NULL)
+*/
+void classify_batch (const beat_features_t *features, size_t n,
+	sample_label_t *labels, uint8_t *confidences);
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,122 @@
+#if !defined(CLASSIFIER_BENCH_H)
+#define CLASSIFIER_BENCH_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 15/11/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Classifier benchmark. Measures the cycles taken per classification and the *
+ *  confusion matrix over a labeled feature set, and reports them as a single  *
+ *  machine-readable line. Runs on the device, and on the host (test/)         *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include "classifier.h"
+
+
+/*
+ *******************************************************************************
+ *                         External Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Number of histogram bins (bin i holds times in [2^i, 2^(i+1)) cycles)
+#define     CLASSIFIER_BENCH_BINS                     20
+
+
+// Prefix of report lines (so they can be picked out of the console log)
+#define     CLASSIFIER_BENCH_TAG                      "BENCH"
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing the results of a benchmark
+typedef struct {
+	uint32_t n;                                 // Samples classified
+	uint32_t cycles_min;                        // Fastest classification
+	uint32_t cycles_max;                        // Slowest classification
+	uint64_t cycles_total;                      // Sum over all samples
+	uint32_t histogram[CLASSIFIER_BENCH_BINS];  // Log2 cycle distribution
+	uint16_t confusion[4][4];                   // [true label][given label]
+} classifier_bench_t;
+
+
+/*
+ *******************************************************************************
+ *                            Function Declarations                            *
+ *******************************************************************************
+*/
+
+
+/* @brief Clears a benchmark result.
+ *
+ * @param
+ * - bench: The result to clear
+ *
+ * @return None
+*/
+void classifier_bench_reset (classifier_bench_t *bench);
+
+
+/* @brief Records a classification in the confusion matrix of a result.
+ *
+ * @param
+ * - bench:  The result to update
+ * - truth:  The true label
+ * - given:  The label given by the classifier
+ *
+ * @return None
+*/
+void classifier_bench_record (classifier_bench_t *bench, sample_label_t truth,
+	sample_label_t given);
+
+
+/* @brief Times a backend classifying each sample of a labeled feature set.
+ *
+ * @note Samples are classified one at a time. The backend is not selected
+ *
+ * @param
+ * - type:     The backend to measure
+ * - features: The feature set
+ * - labels:   The true label of each sample
+ * - n:        Number of samples
+ * - bench:    Receives the result (it is reset first)
+ *
+ * @return
+ * - ESP_OK: Success
+ * - ESP_ERR_INVALID_ARG: Unknown backend
+*/
+esp_err_t classifier_bench_run (classifier_type_t type, 
+	const beat_features_t *features, const sample_label_t *labels, size_t n,
+	classifier_bench_t *bench);
+
+
+/* @brief Prints a result as a single line of the form
+ *        BENCH {"name":..,"n":..,"ns_mean":..,"cycles":{..},"hist":[..],
+ *        "confusion":[[..],..]}
+ *
+ * @param
+ * - name:  Name reported with the result
+ * - bench: The result to print
+ *
+ * @return None
+*/
+void classifier_bench_print (const char *name, const classifier_bench_t *bench);
+
+
+#endif
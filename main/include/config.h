@@ -67,6 +67,13 @@
 #define DEVICE_SENSOR_PUSH_BUF_SIZE     256
 
 
+/* The number of sample blocks shared by the acquire and process stages. One
+ * is being filled, one is being processed and the rest are queued between
+ * them. Blocks are handed over by index, so they are never copied
+ */
+#define DEVICE_SAMPLE_BLOCKS            3
+
+
 // The threshold, at or over which, readings are considered to be R peaks
 #define DEVICE_R_PEAK_THRESHOLD         2450
 
@@ -94,4 +101,38 @@
 #define STACK_SIZE_SAMPLE_MANAGER       1024
 
 
+/*
+ *******************************************************************************
+ *                               Task Placement                                *
+ *******************************************************************************
+*/
+
+
+/* Samples flow through three stages connected by bounded queues:
+ *
+ * [ acquire (sample task) ] -> blocks -> [ process (EKG task) ] -> messages
+ * -> [ transmit (BLE task) ]
+ *
+ * The process stage detects, classifies and packs. It shares the
+ * APP CPU (1) with acquisition so the PROTOCOL CPU (0) is left to the radio
+ * stack and the transmit stage. Acquisition has the highest priority since
+ * it must keep the sampling period
+*/
+
+
+// Core and priority for the BLE task (transmit stage)
+#define CORE_BLE_MANAGER                0
+#define PRIORITY_BLE_MANAGER            2
+
+
+// Core and priority for the EKG task (process stage)
+#define CORE_EKG_MANAGER                1
+#define PRIORITY_EKG_MANAGER            3
+
+
+// Core and priority for the sample task (acquire stage)
+#define CORE_SAMPLE_MANAGER             1
+#define PRIORITY_SAMPLE_MANAGER         5
+
+
 #endif
\ No newline at end of file
@@ -25,6 +25,8 @@
 #include "freertos/event_groups.h"
 #include "freertos/queue.h"
 #include "esp_system.h"
+#include "msg.h"
+#include "ring.h"
 
 
 /*
@@ -38,12 +40,36 @@
 #define TASK_QUEUE_DATA_MAX         256
 
 
-// Maximum number of queue elements a queue can hold
-#define TASK_QUEUE_CAPACITY			16
+// Capacity (in bytes) of the receive queue
+#define TASK_QUEUE_RX_SIZE          1024
 
 
-// Maximum number of ticks a task should wait before abandoning queue operation
-#define TASK_QUEUE_MAX_TICKS		16
+// Size (in bytes) and number of small transmit buffers (single frames)
+#define TASK_POOL_SMALL_SIZE        64
+#define TASK_POOL_SMALL_COUNT       16
+
+
+// Size (in bytes) and number of large transmit buffers (batches, waveforms).
+// Any frame fits one (ipc.c checks the largest of each type). Every channel
+// but control (small replies only) can be full of large frames at once, so
+// a full pool never overrides the policy of a channel (ipc_init checks this)
+#define TASK_POOL_LARGE_SIZE        MSG_BUFFER_MAX
+#define TASK_POOL_LARGE_COUNT       34
+
+
+// Handle that refers to no transmit buffer
+#define IPC_BUFFER_NONE             0xFF
+
+
+// Nonzero to track the high-water mark, throughput and latency histogram of
+// each queue (counters of dropped messages are always kept)
+#if !defined(TASK_QUEUE_STATS)
+#define TASK_QUEUE_STATS            1
+#endif
+
+
+// Maximum number of labeled beats awaiting online learning
+#define TASK_FEEDBACK_CAPACITY      8
 
 
 /*
@@ -53,14 +79,82 @@
 */
 
 
-// Describes a variable-size queue element for IPC messages
+// Describes a variable-size queue element for IPC messages (only the first
+// size bytes of the data are copied through a queue)
 typedef struct {
-	uint8_t id;                            // Identifier (for selecting socket)
+	uint8_t id;                            // Logical channel (MSG_CHANNEL_*)
 	size_t size;                           // Size of the message (in bytes)
 	uint8_t data[TASK_QUEUE_DATA_MAX];     // Message buffer
 } task_queue_msg_t;
 
 
+// Policies applied when a frame is handed to a full channel
+typedef enum {
+	IPC_POLICY_DROP_OLDEST,                // Evict the oldest queued frame
+	IPC_POLICY_DROP_NEWEST,                // Refuse the new frame
+	IPC_POLICY_COALESCE,                   // Refuse it, the producer folds it
+	                                       // into a summary sent later
+	IPC_POLICY_DEADLINE                    // Evict the oldest frame if past its
+	                                       // deadline, else refuse the new one
+} ipc_policy_t;
+
+
+/* Describes a logical channel multiplexed over the BLE link. Channels of
+ * equal priority form a lane. Lanes are served strictly by ascending priority
+ * value, so a frame waits for at most the frame in flight from a less urgent
+ * lane. Within a lane, channels take turns sending up to their window of
+ * frames (weighted round robin)
+*/
+typedef struct {
+	const char *name;                      // Name (for logging)
+	uint8_t depth;                         // Capacity (in frames) of the queue
+	uint8_t priority;                      // Lane (zero is most urgent)
+	uint8_t window;                        // Frames sent per turn in the lane
+	uint8_t policy;                        // Policy when full (ipc_policy_t)
+	uint16_t deadline;                     // Frame lifetime (ms), if deadline
+} ipc_channel_t;
+
+
+/* Describes what happened to the messages handed to a queue since boot.
+ * Latency is measured from enqueue to dequeue, in buckets doubling from 1 ms
+ * (transmit queues only)
+*/
+typedef struct {
+	uint32_t queued;                       // Messages queued
+	uint32_t evicted;                      // Queued messages evicted
+	uint32_t refused;                      // Messages refused
+	uint32_t coalesced;                    // Messages refused to be coalesced
+	uint32_t expired;                      // Messages dropped past deadline
+	uint32_t bytes;                        // Bytes dequeued
+	uint16_t high_water;                   // Most messages queued at once
+	uint32_t latency[MSG_LATENCY_BUCKETS]; // Messages by time spent queued
+} ipc_queue_stats_t;
+
+
+/* Handle of a transmit buffer. A frame is packed once into a buffer taken
+ * from the pool, and only its handle travels through the transmit queues
+*/
+typedef uint8_t ipc_buffer_t;
+
+
+// Describes the use of the transmit buffer pool since boot
+typedef struct {
+	uint32_t allocs;                       // Buffers handed out
+	uint32_t exhausted;                    // Requests no buffer was free for
+	uint8_t  in_use;                       // Buffers held right now
+	uint8_t  peak;                         // Most buffers held at once
+} ipc_pool_stats_t;
+
+
+// Describes a queue of variable-size messages that tasks may share
+typedef struct {
+	ring_t ring;                           // Messages (length-prefixed)
+	ipc_queue_stats_t stats;               // Counters
+	msg_stream_t stream;                   // Stamps the frames of a channel
+	portMUX_TYPE lock;                     // Guards the ring, counters, stream
+} ipc_queue_t;
+
+
 /*
  *******************************************************************************
  *                          External Global Variables                          *
@@ -68,7 +162,7 @@ typedef struct {
 */
 
 
-/* FreeRTOS Bluetooth IPC Message Receive Queue
+/* Bluetooth IPC Message Receive Queue
  * This queue holds raw message data captured by the BLE driver wrapper. It is
  * thread safe
  *
@@ -77,19 +171,64 @@ typedef struct {
  * Written-By:
  * - sys_ble_wrapper: When any message is received
 */
-QueueHandle_t g_ble_rx_queue;
+ipc_queue_t g_ble_rx_queue;
+
 
+/* Logical Channel Table
+ * This table holds the queue depth, priority, window and backpressure policy
+ * of each channel, indexed by channel (MSG_CHANNEL_*). It is read-only
+*/
+extern const ipc_channel_t g_ipc_channels[MSG_CHANNEL_MAX];
 
-/* FreeRTOS Bluetooth IPC Message Transmit Queue
- * This queue holds raw message data to be transmitted to a (possibly)
- * connected device. It is thread safe
+
+/* Bluetooth IPC Message Transmit Queues
+ * These queues hold the buffers (ipc_buffer_t) of frames to be transmitted to
+ * a (possibly) connected device, one queue per channel (MSG_CHANNEL_*). They
+ * are thread safe
  *
  * Read-By:
  * - task_ble_manager: When any response is to be sent to a device
  * Written-By:
- * - task_wifi_manager: When disconnect occurred
+ * - task_ble_manager: When a hello is answered (control), when telemetry is
+ *   requested (telemetry) and while the beat log is synchronized (backlog)
+ * - task_ekg_manager: When beats are classified (beats, alerts, waveform)
+ * - dispatch_status_message: When the status changes (control)
+*/
+ipc_queue_t g_tx_queues[MSG_CHANNEL_MAX];
+
+
+/* Channel Service Order
+ * This array holds the channels (MSG_CHANNEL_*) by ascending priority value.
+ * It is filled by ipc_init
+ *
+ * Read-By:
+ * - ipc_next: When frames are sent
 */
-QueueHandle_t g_ble_tx_queue;
+uint8_t g_tx_order[MSG_CHANNEL_MAX];
+
+
+/* FreeRTOS Classifier Feedback Queue
+ * This queue holds labeled beats (msg_feedback_data_t) for online learning.
+ * Neither side blocks on it, so learning never delays the beat path
+ *
+ * Read-By:
+ * - task_ekg_manager: Between sample blocks
+ * Written-By:
+ * - task_ble_manager: When a feedback message is received
+*/
+QueueHandle_t g_feedback_queue;
+
+
+/* FreeRTOS Sample Block Queue
+ * This queue holds the indices of filled sample blocks (uint8_t) in the order
+ * they were acquired. Its capacity leaves one block for each side to work on
+ *
+ * Read-By:
+ * - task_ekg_manager: On each tick
+ * Written-By:
+ * - task_sample_manager: When a block is filled
+*/
+QueueHandle_t g_block_queue;
 
 
 /*
@@ -104,27 +243,202 @@ QueueHandle_t g_ble_tx_queue;
  * @return
  * - ESP_OK: Success
  * - ESP_ERR_NO_MEM: Insufficient memory
+ * - ESP_ERR_INVALID_SIZE: The channels hold more frames than the pool
 */
 esp_err_t ipc_init (void);
 
 
 /* @brief Loads the given data buffer into the supplied IPC queue
- *        This function blocks, but will return if the queue cannot
+ *        This function doesn't block, and returns if the queue cannot
  *        take anymore data. Data is sliced into message-sized chunks
- * @note  This should be thread-safe because queues are thread-safe
+ * @note  This is thread-safe, but not callable from an interrupt
  *
  * @param
- * - queue:  The QueueHandle_t queue handle
+ * - queue:  The queue
  * - id:     An identifier (optional) for data association
  * - size:   The size (in bytes) of the data to be enqueued
  * - buffer: The buffer from which the data will be read
  *
  * @return
  * - ESP_OK: Success
- * - ESP_ERR_TIMEOUT: The data could not be enqueued before timeout
+ * - ESP_ERR_NO_MEM: The queue is full
+*/
+esp_err_t ipc_enqueue (ipc_queue_t *queue, uint8_t id, size_t size, 
+    const void *buffer);
+
+
+/* @brief Takes the oldest message from the supplied IPC queue without
+ *        blocking
+ *
+ * @param
+ * - queue:  The queue
+ * - msg:    Receives the message (may be NULL to discard it)
+ *
+ * @return Size (in bytes) of the message, or zero if the queue is empty
+*/
+size_t ipc_dequeue (ipc_queue_t *queue, task_queue_msg_t *msg);
+
+
+/* @brief Takes a transmit buffer from the pool with a single reference
+ * @note  This is thread-safe, but not callable from an interrupt
+ *
+ * @param
+ * - size:   The size (in bytes) of the frame to be packed into it
+ *
+ * @return The buffer, or IPC_BUFFER_NONE if none is free or large enough
+*/
+ipc_buffer_t ipc_buffer_alloc (size_t size);
+
+
+/* @brief Returns the bytes of a transmit buffer
+ *
+ * @param
+ * - buffer: The buffer
+ *
+ * @return Pointer to the bytes of the buffer
+*/
+uint8_t *ipc_buffer_data (ipc_buffer_t buffer);
+
+
+/* @brief Returns the size of the frame held by a transmit buffer
+ *
+ * @param
+ * - buffer: The buffer
+ *
+ * @return Size (in bytes) given when the buffer was taken
+*/
+size_t ipc_buffer_size (ipc_buffer_t buffer);
+
+
+/* @brief Adds a reference to a transmit buffer (for a second holder)
+ *
+ * @param
+ * - buffer: The buffer
+ *
+ * @return None
+*/
+void ipc_buffer_retain (ipc_buffer_t buffer);
+
+
+/* @brief Drops a reference to a transmit buffer. The buffer returns to the
+ *        pool once the last reference is dropped
+ *
+ * @param
+ * - buffer: The buffer (IPC_BUFFER_NONE is ignored)
+ *
+ * @return None
+*/
+void ipc_buffer_release (ipc_buffer_t buffer);
+
+
+/* @brief Copies the counters of the transmit buffer pool
+ *
+ * @param
+ * - stats:  Receives the counters
+ *
+ * @return None
+*/
+void ipc_pool_stats (ipc_pool_stats_t *stats);
+
+
+/* @brief Hands a transmit buffer to a channel without blocking. If the
+ *        channel is full, its policy either evicts a queued frame or refuses
+ *        this one. The queue takes over the reference of the caller, even if
+ *        the buffer is refused (in which case it is released)
+ *
+ * @param
+ * - channel: The channel (MSG_CHANNEL_*)
+ * - buffer:  The buffer
+ *
+ * @return
+ * - ESP_OK: Success (possibly evicting another frame)
+ * - ESP_ERR_NO_MEM: The frame was refused
+*/
+esp_err_t ipc_send (uint8_t channel, ipc_buffer_t buffer);
+
+
+/* @brief Packs a message straight into a transmit buffer and hands it to a
+ *        channel without blocking. The frame takes the next sequence number
+ *        of the channel as it is queued (under the lock of the queue), so
+ *        the frames of every writer of a channel are numbered in the order
+ *        they are sent. Frames the channel refuses still take one
+ *
+ * @param
+ * - channel: The channel (MSG_CHANNEL_*)
+ * - msg:     The message
+ *
+ * @return
+ * - ESP_OK: Success
+ * - ESP_ERR_INVALID_ARG: The message type is unknown
+ * - ESP_ERR_NO_MEM: No transmit buffer was free, or the queue is full
+*/
+esp_err_t ipc_send_msg (uint8_t channel, const msg_t *msg);
+
+
+/* @brief Returns the sequence number the next frame sent on a channel with
+ *        ipc_send_msg takes (numbering starts over with ipc_init)
+ *
+ * @param
+ * - channel: The channel (MSG_CHANNEL_*)
+ *
+ * @return The sequence number
+*/
+uint16_t ipc_sequence (uint8_t channel);
+
+
+/* @brief Takes the next transmit buffer to be sent over the link without
+ *        blocking. The most urgent lane with frames queued is served, and
+ *        its channels take turns by their windows
+ *
+ * @param
+ * - channel: Set to the channel of the buffer
+ *
+ * @return The buffer, or IPC_BUFFER_NONE if all queues are empty
+*/
+ipc_buffer_t ipc_next (uint8_t *channel);
+
+
+/* @brief Takes the oldest transmit buffer from a channel without blocking.
+ *        Frames past the deadline of the channel are dropped. The caller 
+ *        releases the buffer when done
+ *
+ * @param
+ * - channel: The channel (MSG_CHANNEL_*)
+ *
+ * @return The buffer, or IPC_BUFFER_NONE if the queue is empty
+*/
+ipc_buffer_t ipc_receive (uint8_t channel);
+
+
+/* @brief Returns the number of frames queued on a channel
+ *
+ * @param
+ * - channel: The channel (MSG_CHANNEL_*)
+ *
+ * @return Number of frames queued (including any past their deadline)
+*/
+size_t ipc_pending (uint8_t channel);
+
+
+/* @brief Returns whether the queue of a channel is full
+ *
+ * @param
+ * - channel: The channel (MSG_CHANNEL_*)
+ *
+ * @return Nonzero if no more buffers fit
+*/
+int ipc_full (uint8_t channel);
+
+
+/* @brief Copies the counters of a queue
+ *
+ * @param
+ * - queue:  The queue (the receive queue, or that of a channel)
+ * - stats:  Receives the counters
+ *
+ * @return Number of messages queued right now
 */
-esp_err_t ipc_enqueue (QueueHandle_t queue, uint8_t id, size_t size, 
-    void *buffer);
+size_t ipc_queue_stats (ipc_queue_t *queue, ipc_queue_stats_t *stats);
 
 
 #endif
@@ -25,17 +25,34 @@
 #include <stdio.h>
 #include "esp_system.h"
 #include "esp_log.h"
+#include "msg_gen.h"
 
-/* A message has the following structure
+/* Message types and their layouts are defined in tools/msg_schema.json, from
+ * which tools/msggen.py generates msg_gen.h and msg_gen.c. 
  * 
- * [ HEAD HEAD | TYPE | -> ]
- *
- * I don't include my own CRC check because BLE has it already (if you enabled)
- * The type of the message denotes the length.
+ * A message is sent as a frame with the following structure
+ * 
+ * [ HEAD HEAD | TYPE | CHAN | SEQ SEQ | TIME TIME TIME TIME | LEN LEN | -> |
+ *   CRC CRC ]
  *
  * The header is composed of two 8-bit markers. 
  * The type is a single byte with 8 status bits
+ * The channel is the logical channel (MSG_CHANNEL_*) the frame belongs to
+ * The sequence number counts the frames of the channel (16-bit)
+ * The time is the device clock (ms since boot) when the frame was packed
+ * The length is the 16-bit size of the body that follows
+ * Multi-byte fields are little-endian
  * The rest of the payload is contingent on the type
+ * The CRC (CRC-16/CCITT) covers everything after the markers
+ *
+ * Markers can appear inside a body, so they only mark where a frame may
+ * start. A receiver accepts a frame once its length and CRC check out, and
+ * otherwise resumes the search one byte on (see msg_parser_feed)
+ *
+ * Protocol version 1 framed messages as [ HEAD HEAD | TYPE | -> ], one per
+ * write or notification. Hellos are exchanged in that framing, which never
+ * changes, and clients that haven't said hello are only sent (and may still
+ * write) frames of version 1 (see msg_to_v1 and msg_parser_feed_write)
 */
 
 
@@ -46,8 +63,31 @@
 */
 
 
-// Maximal buffer size for storing packed messages (marker + message size)
-#define     MSG_BUFFER_MAX                  (2 + sizeof(msg_t))
+// Maximal buffer size for storing packed messages (header + body + trailer)
+#define     MSG_BUFFER_MAX                  (MSG_HEADER_SIZE + \
+                                             sizeof(msg_body_t) + \
+                                             MSG_TRAILER_SIZE)
+
+// Size of the message header (markers, type, channel, sequence, time, length)
+#define     MSG_HEADER_SIZE                     12
+
+// Size of the message trailer (the CRC)
+#define     MSG_TRAILER_SIZE                    2
+
+// Size of the header of a version 1 frame (markers and type)
+#define     MSG_V1_HEADER_SIZE                  3
+
+// Message types of version 1 frames (those of protocol version 1, and hellos)
+#define     MSG_V1_TYPES    ((1 << MSG_TYPE_STATUS) |                \
+                             (1 << MSG_TYPE_TRAIN_DATA) |            \
+                             (1 << MSG_TYPE_SAMPLE_DATA) |           \
+                             (1 << MSG_TYPE_INSTRUCTION) |           \
+                             (1 << MSG_TYPE_CONFIGURATION) |         \
+                             (1 << MSG_TYPE_HELLO))
+
+// Frames per channel a parser remembers, to drop those seen before (more than
+// the notifications a device sends again after a loss may hold)
+#define     MSG_PARSER_WINDOW                   256
 
 // Byte value used for marking message headers
 #define 	MSG_BYTE_HEAD                       0xFF 
@@ -73,81 +113,69 @@
 */
 
 
-// Enumeration describing the type of the message received (treated as 8-bits)
-typedef enum {
-	MSG_TYPE_STATUS = 0,        // Message contains status bit-field only
-    MSG_TYPE_TRAIN_DATA,        // Message containing all training data
-    MSG_TYPE_SAMPLE_DATA,       // Message containing a data sample
-    MSG_TYPE_INSTRUCTION,       // Message contains a device instruction
-    MSG_TYPE_CONFIGURATION,     // Message contains configuration data
-
-    MSG_TYPE_MAX                // Upper boundary value for the message type 
-} msg_type_t;
-
-
 // Enumeration describing the type of instructions available (8-bit value)
 typedef enum {
     INST_EKG_STOP = 0,          // Instruct device to sample EKG data
     INST_EKG_START,             // Instruct device to monitor user
     INST_EKG_CONFIGURE,         // Instruct device to update configuration
+    INST_EKG_BENCHMARK,         // Instruct device to benchmark classifiers
+    INST_EKG_WAVE_START,        // Instruct device to stream raw samples
+    INST_EKG_WAVE_STOP,         // Instruct device to stop streaming samples
+    INST_EKG_TELEMETRY,         // Instruct device to report queue telemetry
 
     INST_TYPE_MAX               // Upper boundary value for instruction type
 } msg_instruction_type_t;
 
 
-// Structure describing a status message (contains single 8-bit status)
-typedef struct {
-	uint8_t status;             // Status bit-field
-} msg_status_t;
-
-
-// Structure describing a message containing training data (12-bit normalized)
-typedef struct {
-    uint16_t n_periods[20];     // Periods of normal waveforms
-    uint16_t n_amplitudes[20];  // Amplitudes of normal waveforms
-    uint16_t a_periods[10];     // Periods of atrial premature beat
-    uint16_t a_amplitudes[10];  // Amplitudes of atrial premature beat
-    uint16_t v_periods[10];     // Periods of premature ventricular contractions
-    uint16_t v_amplitudes[10];  // Amplitudes of premature ventricular contractions
-} msg_train_data_t;
-
+// Enumeration describing how relayed beats are encoded (8-bit value)
+typedef enum {
+    MSG_ENCODING_PLAIN = 0,     // Beats are sent as samples or sample batches
+    MSG_ENCODING_DELTA,         // Beats are sent as a coded beat stream
 
-// Structure describing a message containing a data sample
-typedef struct {
-    uint8_t  label;             // Sample label (0x0 = N, 0x1 = A, 0x2 = V)
-    uint16_t amplitude;         // Contains the amplitude of the sample
-    uint16_t period;            // Contains the period since the last sample
-} msg_sample_data_t;
+    MSG_ENCODING_MAX            // Upper boundary value for encoding type
+} msg_encoding_type_t;
 
 
-// Structure describing a message containing an instruction
+// Structure describing a validated message inside a receive buffer. The view
+// borrows the buffer, so it is only valid while the buffer is
 typedef struct {
-    uint8_t  inst;              // Holds value of msg_instruction_type_t
-} msg_instruction_data_t;
+    msg_type_t     type;        // Type of the message
+    const uint8_t *body;        // Body of the message (read-only)
+    size_t         size;        // Size of the body
+    uint8_t        channel;     // Logical channel of the frame
+    uint16_t       seq;         // Sequence number of the frame
+    uint32_t       time;        // Device time (ms since boot) of the frame
+} msg_view_t;
 
 
-// Structure describing a configuration message
+// Structure describing the sending side of a logical channel
 typedef struct {
-    uint8_t  cfg_comp;           // Comparator flag (0x0 = GTE, 0x1 = LTE)
-    uint16_t cfg_val;            // Comparator value 
-} msg_configuration_data_t;
+    uint8_t  channel;           // The channel (MSG_CHANNEL_*)
+    uint16_t seq;               // Sequence number of the next frame
+} msg_stream_t;
 
 
-// Union describing a message body in general (used for buffer sizing)
-typedef union {
-	msg_status_t             msg_status;
-    msg_train_data_t         msg_train;
-    msg_sample_data_t        msg_sample;
-    msg_configuration_data_t msg_configuration;
-    msg_instruction_data_t   msg_instruction;
-} msg_body_t;
+// Callback invoked for each frame accepted by a parser. The view is only
+// valid for the duration of the call
+typedef void (*msg_frame_handler_t)(const msg_view_t *view, void *ctx);
 
 
-// Structure describing the general message
+// Structure describing an incremental frame parser. Received bytes are
+// buffered until they form a complete frame or are found not to start one
 typedef struct {
-    msg_type_t type;
-    msg_body_t body;
-} msg_t;
+    uint8_t  buffer[MSG_BUFFER_MAX];    // Bytes of a (possibly) partial frame
+    size_t   len;                       // Bytes held in the buffer
+    uint32_t frames;                    // Frames accepted
+    uint32_t skipped;                   // Bytes discarded while resyncing
+    uint32_t crc_errors;                // Frames rejected by the CRC
+    uint16_t seq[MSG_CHANNEL_MAX];      // Sequence number expected next
+    uint8_t  seen[MSG_CHANNEL_MAX][MSG_PARSER_WINDOW / 8]; // Bit s % window
+                                        // set if frame s was seen
+    uint8_t  synced;                    // Bit c set once channel c was seen
+    uint32_t lost;                      // Frames skipped (incl. late ones)
+    uint32_t reordered;                 // Frames arriving behind the sequence
+    uint32_t duplicates;                // Frames seen before (dropped)
+} msg_parser_t;
 
 
 /*
@@ -157,7 +185,35 @@ typedef struct {
 */
 
 
-/* @brief Packs given message into supplied data buffer.
+/* @brief Returns the packed size of a message.
+ *
+ * @param
+ * - msg: Pointer to message structure
+ *
+ * @return Size (in bytes) of the packed message, or zero if the type is unknown
+*/
+size_t msg_size (const msg_t *msg);
+
+
+/* @brief Packs given message directly into a caller-supplied slot (such as
+ *        the data of a transmit queue element). The frame takes the next 
+ *        sequence number of the stream, and is stamped with the device time
+ *
+ * @param
+ * - msg:    Pointer to message structure
+ * - stream: The sending channel (or NULL for control, sequence number zero)
+ * - buffer: Slot in which the message will be stored
+ * - cap:    Capacity (in bytes) of the slot
+ *
+ * @return Size (in bytes) of the message, or zero if it doesn't fit. The
+ *         stream only advances if the message was packed
+*/
+size_t msg_pack_into (const msg_t *msg, msg_stream_t *stream, uint8_t *buffer,
+    size_t cap);
+
+
+/* @brief Packs given message into supplied data buffer (outside of any
+ *        stream).
  *
  * @note Buffer must be at least MSG_BUFFER_MAX in size to guarantee a fit
  *
@@ -170,8 +226,90 @@ typedef struct {
 size_t msg_pack (msg_t *msg, uint8_t *buffer);
 
 
+/* @brief Moves a packed frame onto another stream in place. The frame takes
+ *        the channel and next sequence number of the stream, but keeps its 
+ *        type, body and device time
+ *
+ * @param
+ * - buffer: The frame (as returned by msg_pack_into)
+ * - len:    Size (in bytes) of the frame
+ * - stream: The stream the frame now belongs to
+ *
+ * @return None
+*/
+void msg_restamp (uint8_t *buffer, size_t len, msg_stream_t *stream);
+
+
+/* @brief Converts a packed frame to the framing of protocol version 1 (the
+ *        markers, the type and the body)
+ *
+ * @param
+ * - frame:  The frame (as returned by msg_pack_into)
+ * - len:    Size (in bytes) of the frame
+ * - buffer: Receives the version 1 frame, MSG_HEADER_SIZE + MSG_TRAILER_SIZE
+ *           - MSG_V1_HEADER_SIZE bytes shorter than the frame (may be the 
+ *           frame itself)
+ *
+ * @return Size (in bytes) of the version 1 frame
+*/
+size_t msg_to_v1 (const uint8_t *frame, size_t len, uint8_t *buffer);
+
+
+/* @brief Validates the frame at the start of a buffer in place, and returns
+ *        a read-only view of its body. Nothing is copied. This function is
+ *        reentrant
+ *
+ * @param
+ * - view: The view to be filled
+ * - buffer: The buffer containing the serialized message
+ * - len: The length of the buffer containing the serialized message
+ *
+ * @return
+ * - ESP_OK: The frame is valid
+ * - ESP_ERR_INVALID_SIZE: Buffer too small to hold the detected frame, or 
+ *                         body too small for its type
+ * - ESP_ERR_INVALID_CRC: The frame is corrupt
+ * - ESP_ERR_INVALID_STATE: Frame intact but message type or channel unknown
+ * - ESP_FAIL: The message markers were not detected
+*/
+esp_err_t msg_parse (msg_view_t *view, const uint8_t *buffer, size_t len);
+
+
+/* @brief Validates a buffer holding exactly one version 1 frame of a fixed
+ *        size type, and returns a read-only view of its body. The view is
+ *        on the control channel, with sequence number and time zero
+ *
+ * @param
+ * - view:   The view to be filled
+ * - buffer: The buffer containing the frame
+ * - len:    The length of the buffer
+ * - types:  Bit i set if msg_type_t i is accepted (within MSG_V1_TYPES)
+ *
+ * @return
+ * - ESP_OK: The buffer holds such a frame
+ * - ESP_FAIL: It doesn't
+*/
+esp_err_t msg_parse_v1 (msg_view_t *view, const uint8_t *buffer, size_t len,
+    uint32_t types);
+
+
+/* @brief Decodes the body of a message view. Only the body of the viewed
+ *        type is written
+ *
+ * @param
+ * - msg: The pointer to the message type to be filled
+ * - view: A view returned by msg_parse
+ *
+ * @return
+ * - ESP_OK: The message was successfully decoded
+ * - ESP_ERR_INVALID_SIZE: A variable-size body exceeds the buffer
+*/
+esp_err_t msg_decode (msg_t *msg, const msg_view_t *view);
+
+
 /* @brief Unpacks a buffer containing a serialized message to 
- *        the instance given at the message-type pointer.
+ *        the instance given at the message-type pointer (msg_parse 
+ *        followed by msg_decode). This function is reentrant
  * @param
  * - msg: The pointer to the message type to be filled
  * - buffer: The buffer containing the serialized message
@@ -180,12 +318,91 @@ size_t msg_pack (msg_t *msg, uint8_t *buffer);
  * @return
  * - ESP_OK: The message was successfully decoded
  * - ESP_ERR_INVALID_SIZE: Buffer too small to decode detected message
+ * - ESP_ERR_INVALID_CRC: The frame is corrupt
  * - ESP_ERR_INVALID_STATE: Headers detected but message type unknown
  * - ESP_FAIL: The message markers were not detected
 */
 esp_err_t msg_unpack (msg_t *msg, uint8_t *buffer, size_t len);
 
 
+/* @brief Resets a frame parser for a new stream, discarding any partial 
+ *        frame and the expected sequence number. Counters are kept
+ *
+ * @param
+ * - parser: The parser
+ *
+ * @return None
+*/
+void msg_parser_reset (msg_parser_t *parser);
+
+
+/* @brief Feeds received bytes to a frame parser. The bytes may hold any
+ *        number of frames or fragments of them, and may start or end part
+ *        way through a frame. Each complete and intact frame is handed to
+ *        the handler in order. Corrupt data is skipped a byte at a time
+ *        until a valid frame starts. Sequence numbers are tracked per
+ *        channel. Those that jump ahead are counted as lost frames, and
+ *        those that fall behind as reordered. A frame seen before (one of
+ *        the last MSG_PARSER_WINDOW of its channel) is a duplicate, and is
+ *        dropped
+ *
+ * @param
+ * - parser:  The parser
+ * - buffer:  The received bytes
+ * - len:     Number of received bytes
+ * - handler: Invoked with each accepted frame
+ * - ctx:     Passed to the handler
+ *
+ * @return Number of frames accepted
+*/
+size_t msg_parser_feed (msg_parser_t *parser, const uint8_t *buffer, 
+    size_t len, msg_frame_handler_t handler, void *ctx);
+
+
+/* @brief Feeds a write received from a client to a frame parser. A write 
+ *        holding exactly one version 1 frame of the given types is handed
+ *        to the handler as is, unless the parser holds part of a frame (its
+ *        sequence number isn't tracked). Any other write is fed to the
+ *        parser (see msg_parser_feed)
+ *
+ * @param
+ * - parser:  The parser
+ * - buffer:  The bytes of the write
+ * - len:     Number of bytes written
+ * - types:   Types of version 1 frames accepted (see msg_parse_v1)
+ * - handler: Invoked with each accepted frame
+ * - ctx:     Passed to the handler
+ *
+ * @return Number of frames accepted
+*/
+size_t msg_parser_feed_write (msg_parser_t *parser, const uint8_t *buffer,
+    size_t len, uint32_t types, msg_frame_handler_t handler, void *ctx);
+
+
+/* @brief Reads a little-endian 16-bit value from a message body
+ *
+ * @param
+ * - b: Pointer to the value
+ *
+ * @return The value
+*/
+static inline uint16_t msg_read_u16 (const uint8_t *b) {
+    return b[0] | (b[1] << 8);
+}
+
+
+/* @brief Reads a little-endian 32-bit value from a message body
+ *
+ * @param
+ * - b: Pointer to the value
+ *
+ * @return The value
+*/
+static inline uint32_t msg_read_u32 (const uint8_t *b) {
+    return msg_read_u16(b) | ((uint32_t)msg_read_u16(b + 2) << 16);
+}
+
+
 /* @brief Returns a string describing the instruction type
  * 
  * @param
@@ -0,0 +1,136 @@
+#if !defined(RING_H)
+#define RING_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 21/11/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Ring of variable-length records in a contiguous byte buffer. Only the     *
+ *  size of each record is copied in and out                                  *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include <inttypes.h>
+#include <stddef.h>
+
+
+/* Each record is a three byte header followed by its payload
+ *
+ * [ LEN LEN | ID | -> ]
+ *
+ * Records wrap around the end of the buffer byte by byte, so no space is lost
+ * to padding. The ring isn't thread safe; callers guard it. This module has
+ * no dependencies on the device, so it may be built on a host
+*/
+
+
+/*
+ *******************************************************************************
+ *                         External Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Size of the header of a record (length and identifier)
+#define     RING_HEADER_SIZE                    3
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a ring of records
+typedef struct {
+	uint8_t *buffer;                        // Buffer holding the records
+	size_t   cap;                           // Capacity (in bytes) of the buffer
+	size_t   head;                          // Offset of the oldest record
+	size_t   used;                          // Bytes used (headers included)
+	size_t   count;                         // Number of records
+} ring_t;
+
+
+/*
+ *******************************************************************************
+ *                            Function Declarations                            *
+ *******************************************************************************
+*/
+
+
+/* @brief Initializes an empty ring over a buffer
+ *
+ * @param
+ * - ring:   The ring
+ * - buffer: Buffer to hold the records
+ * - cap:    Capacity (in bytes) of the buffer
+ *
+ * @return None
+*/
+void ring_init (ring_t *ring, uint8_t *buffer, size_t cap);
+
+
+/* @brief Appends a record
+ *
+ * @param
+ * - ring:   The ring
+ * - id:     Identifier of the record
+ * - data:   The payload
+ * - size:   Size (in bytes) of the payload (at most UINT16_MAX)
+ *
+ * @return Zero if the record was appended, else nonzero if it doesn't fit
+*/
+int ring_put (ring_t *ring, uint8_t id, const void *data, size_t size);
+
+
+/* @brief Returns the size of the oldest record without removing it. Payloads
+ *        larger than the buffer given are truncated
+ *
+ * @param
+ * - ring:   The ring
+ * - id:     Set to the identifier of the record (may be NULL)
+ * - data:   Buffer to which the payload is copied (may be NULL)
+ * - cap:    Capacity (in bytes) of the buffer
+ *
+ * @return Size (in bytes) of the payload, or zero if the ring is empty
+*/
+size_t ring_peek (const ring_t *ring, uint8_t *id, void *data, size_t cap);
+
+
+/* @brief Removes the oldest record. Payloads larger than the buffer given
+ *        are truncated
+ *
+ * @param
+ * - ring:   The ring
+ * - id:     Set to the identifier of the record (may be NULL)
+ * - data:   Buffer to which the payload is copied (may be NULL to discard)
+ * - cap:    Capacity (in bytes) of the buffer
+ *
+ * @return Size (in bytes) of the payload copied (or discarded), or zero if the
+ *         ring is empty
+*/
+size_t ring_get (ring_t *ring, uint8_t *id, void *data, size_t cap);
+
+
+/* @brief Returns whether a record of the given size fits the ring
+ *
+ * @param
+ * - ring:   The ring
+ * - size:   Size (in bytes) of the payload
+ *
+ * @return Nonzero if the record fits
+*/
+int ring_fits (const ring_t *ring, size_t size);
+
+
+#endif
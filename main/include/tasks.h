@@ -45,10 +45,13 @@
 #define FLAG_EKG_STOP               0x0020    // EKG will do nothing
 #define FLAG_EKG_CONFIGURE          0x0040    // EKG will update configuration
 #define FLAG_EKG_TICK               0x0080    // EKG will process sample buffer
+#define FLAG_EKG_BENCHMARK          0x0100    // EKG will benchmark classifiers
+#define FLAG_EKG_WAVE_START         0x0200    // EKG will stream raw samples
+#define FLAG_EKG_WAVE_STOP          0x0400    // EKG will stop streaming samples
 
 
 // EKG Flag-Group Mask
-#define MASK_EKG_FLAGS              0x00F0    // Masks all EKG event bits
+#define MASK_EKG_FLAGS              0x07F0    // Masks all EKG event bits
 
 
 /*
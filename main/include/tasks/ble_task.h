@@ -23,11 +23,13 @@
 
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "err.h"
 #include "msg.h"
 #include "tasks.h"
 #include "ipc.h"
 #include "ble.h"
+#include "beat_log.h"
 
 
 /*
@@ -53,6 +55,17 @@ extern uint16_t g_a_amplitudes[10];
 extern uint16_t g_v_periods[10];
 extern uint16_t g_v_amplitudes[10];
 
+// Global variables holding the requested classifier and its model blob
+extern uint8_t g_model_type;
+extern uint8_t g_model_size;
+extern uint8_t g_model_data[MSG_MODEL_DATA_MAX];
+
+// Global variable holding the escalation policy
+extern msg_policy_data_t g_policy;
+
+// Global variable holding the sample batching configuration
+extern msg_batching_data_t g_batching;
+
 
 /*
  *******************************************************************************
@@ -24,12 +24,16 @@
 #include "driver/adc.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "err.h"
 #include "msg.h"
 #include "tasks.h"
 #include "ipc.h"
 #include "config.h"
 #include "classifier.h"
+#include "classifier_bench.h"
+#include "beat_codec.h"
+#include "wave_codec.h"
 
 
 /*
@@ -39,12 +43,11 @@
 */
 
 
-// Buffer to hold samples. Periodically updated
-extern uint16_t g_sample_buffer[DEVICE_SENSOR_PUSH_BUF_SIZE];
+// Sample blocks. A block is owned by whichever stage last took its index
+extern uint16_t g_sample_blocks[DEVICE_SAMPLE_BLOCKS][DEVICE_SENSOR_PUSH_BUF_SIZE];
 
-
-// Global mutex for controlled access to the sensor buffer
-extern portMUX_TYPE g_sample_buffer_mutex;
+// Time (ms since boot) of the first sample of each block
+extern uint32_t g_sample_block_time[DEVICE_SAMPLE_BLOCKS];
 
 
 // Global variables (comparator type, comparator value)
@@ -63,6 +66,17 @@ extern uint16_t g_a_amplitudes[10];
 extern uint16_t g_v_periods[10];
 extern uint16_t g_v_amplitudes[10];
 
+// Global variables holding the requested classifier and its model blob
+extern uint8_t g_model_type;
+extern uint8_t g_model_size;
+extern uint8_t g_model_data[MSG_MODEL_DATA_MAX];
+
+// Global variable holding the escalation policy
+extern msg_policy_data_t g_policy;
+
+// Global variable holding the sample batching configuration
+extern msg_batching_data_t g_batching;
+
 
 /*
  *******************************************************************************
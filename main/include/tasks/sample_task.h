@@ -25,6 +25,7 @@
 #include "driver/adc.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "err.h"
 #include "msg.h"
 #include "tasks.h"
@@ -39,12 +40,11 @@
 */
 
 
-// Buffer to hold samples. Periodically updated
-extern uint16_t g_sample_buffer[DEVICE_SENSOR_PUSH_BUF_SIZE];
+// Sample blocks. A block is owned by whichever stage last took its index
+extern uint16_t g_sample_blocks[DEVICE_SAMPLE_BLOCKS][DEVICE_SENSOR_PUSH_BUF_SIZE];
 
-
-// Global mutex for controlled access to the sensor buffer
-extern portMUX_TYPE g_sample_buffer_mutex;
+// Time (ms since boot) of the first sample of each block
+extern uint32_t g_sample_block_time[DEVICE_SAMPLE_BLOCKS];
 
 
 /*
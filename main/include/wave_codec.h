@@ -0,0 +1,101 @@
+#if !defined(WAVE_CODEC_H)
+#define WAVE_CODEC_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 19/11/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Lossless waveform encoding. Samples are predicted from the two before the *
+ *  m, and the residuals are Rice coded                                       *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include <inttypes.h>
+#include <stddef.h>
+
+
+/* A frame codes a run of samples x[0..n-1]. The first sample is carried
+ * separately, and every other sample is coded as its residual to a prediction
+ *
+ * p[1] = x[0],  p[i] = 2 * x[i-1] - x[i-2]  (i > 1)
+ *
+ * Residuals are taken modulo 2^16, so they fit 16 bits whatever the samples.
+ * A residual is zigzag mapped to u and Rice coded with parameter k: u >> k in
+ * unary (that many 1 bits and a 0 bit) followed by the low k bits of u. If
+ * u >> k reaches WAVE_CODEC_ESCAPE, the escape (that many 1 bits) is followed
+ * by u in WAVE_CODEC_RAW_BITS bits instead. Bits are written most significant
+ * first, and the last byte is padded with 0 bits.
+ *
+ * Frames don't depend on each other. This module has no dependencies on the
+ * device, so gateways may build it
+*/
+
+
+/*
+ *******************************************************************************
+ *                         External Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Largest Rice parameter
+#define     WAVE_CODEC_K_MAX                    15
+
+// Unary length marking an escaped residual
+#define     WAVE_CODEC_ESCAPE                   24
+
+// Size (in bits) of an escaped residual
+#define     WAVE_CODEC_RAW_BITS                 16
+
+
+/*
+ *******************************************************************************
+ *                            Function Declarations                            *
+ *******************************************************************************
+*/
+
+
+/* @brief Codes as many samples as fit a buffer into a frame. The Rice
+ *        parameter is chosen from the mean residual of the samples given
+ *
+ * @param
+ * - samples: The samples to code (the first is not written to the buffer)
+ * - n:       Number of samples
+ * - k:       Set to the Rice parameter of the frame
+ * - buffer:  Buffer to which the residuals are written
+ * - cap:     Capacity (in bytes) of the buffer
+ * - size:    Set to the size (in bytes) of the residuals written
+ *
+ * @return Number of samples in the frame (including the first)
+*/
+size_t wave_encode (const uint16_t *samples, size_t n, uint8_t *k,
+	uint8_t *buffer, size_t cap, size_t *size);
+
+
+/* @brief Decodes a frame
+ *
+ * @param
+ * - first:   The first sample of the frame
+ * - k:       The Rice parameter of the frame
+ * - buffer:  Buffer holding the residuals
+ * - size:    Size (in bytes) of the residuals
+ * - samples: Set to the samples of the frame
+ * - n:       Number of samples in the frame
+ *
+ * @return Zero if the frame was decoded, else nonzero if it is truncated or
+ *         malformed
+*/
+int wave_decode (uint16_t first, uint8_t k, const uint8_t *buffer,
+	size_t size, uint16_t *samples, size_t n);
+
+
+#endif
@@ -0,0 +1,126 @@
+#include "beat_codec.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Maximum size (in bytes) of a variable-length integer holding 18 bits
+#define BEAT_CODEC_VARINT_MAX       3
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Maps a signed delta to an unsigned value (0, -1, 1, -2, ... -> 0, 1, 2, 3)
+static uint32_t zigzag (int16_t delta) {
+	return ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 15);
+}
+
+
+// Inverts zigzag
+static uint16_t unzigzag (uint32_t value) {
+	return (uint16_t)((value >> 1) ^ -(value & 0x1));
+}
+
+
+// Returns the size (in bytes) of a variable-length integer
+static size_t varint_size (uint32_t value) {
+	size_t n = 1;
+
+	while ((value >>= 7) != 0) {
+		n++;
+	}
+
+	return n;
+}
+
+
+// Writes a variable-length integer. Returns the size written
+static size_t varint_write (uint32_t value, uint8_t *buffer) {
+	size_t n = 0;
+
+	while (value >= 0x80) {
+		buffer[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	buffer[n++] = value;
+
+	return n;
+}
+
+
+// Reads a variable-length integer. Returns the size read, or zero if invalid
+static size_t varint_read (const uint8_t *buffer, size_t len, uint32_t *value) {
+	uint32_t v = 0;
+
+	for (size_t n = 0; n < len && n < BEAT_CODEC_VARINT_MAX; ++n) {
+		v |= (uint32_t)(buffer[n] & 0x7F) << (7 * n);
+		if ((buffer[n] & 0x80) == 0) {
+			*value = v;
+			return n + 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ *******************************************************************************
+ *                        External Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+void beat_codec_reset (beat_codec_t *codec) {
+	codec->amplitude = 0;
+	codec->period    = 0;
+}
+
+
+size_t beat_encode (beat_codec_t *codec, uint8_t label, uint16_t amplitude,
+	uint16_t period, uint8_t *buffer, size_t cap) {
+	uint32_t a = (zigzag((int16_t)(amplitude - codec->amplitude)) << 2) |
+		(label & 0x3);
+	uint32_t p = zigzag((int16_t)(period - codec->period));
+	size_t n;
+
+	// Check the beat fits before writing any of it
+	if (varint_size(a) + varint_size(p) > cap) {
+		return 0;
+	}
+
+	n = varint_write(a, buffer);
+	n += varint_write(p, buffer + n);
+
+	codec->amplitude = amplitude;
+	codec->period    = period;
+
+	return n;
+}
+
+
+size_t beat_decode (beat_codec_t *codec, const uint8_t *buffer, size_t len,
+	uint8_t *label, uint16_t *amplitude, uint16_t *period) {
+	uint32_t a, p;
+	size_t n, m;
+
+	if ((n = varint_read(buffer, len, &a)) == 0 ||
+		(m = varint_read(buffer + n, len - n, &p)) == 0) {
+		return 0;
+	}
+
+	*label     = a & 0x3;
+	*amplitude = codec->amplitude = codec->amplitude + unzigzag(a >> 2);
+	*period    = codec->period    = codec->period    + unzigzag(p);
+
+	return n + m;
+}
@@ -0,0 +1,387 @@
+#include <string.h>
+#include "beat_log.h"
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns the offset (in the partition) of a segment
+static inline size_t beat_log_base (uint32_t segment) {
+	return (size_t)segment * BEAT_LOG_SEGMENT_SIZE;
+}
+
+
+// Returns the segment following the given one
+static inline uint32_t beat_log_after (const beat_log_t *log,
+	uint32_t segment) {
+	return (segment + 1 == log->segments) ? 0 : segment + 1;
+}
+
+
+// Reads the first record of a segment, or fails if the segment isn't in use
+static esp_err_t beat_log_header (const beat_log_t *log, uint32_t segment,
+	uint32_t *seq) {
+	uint8_t header[BEAT_LOG_HEADER_SIZE];
+	esp_err_t err;
+
+	if ((err = esp_partition_read(log->partition, beat_log_base(segment),
+		header, sizeof(header))) != ESP_OK) {
+		return err;
+	}
+	if (msg_read_u32(header) != BEAT_LOG_MAGIC) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	*seq = msg_read_u32(header + 4);
+
+	return ESP_OK;
+}
+
+
+/* Returns the size of the valid frame at an offset, zero if the segment ends
+ * there, or -1 if the frame was cut short (by a reset while programming)
+*/
+static int beat_log_scan (const beat_log_t *log, size_t offset, size_t end) {
+	uint8_t frame[MSG_BUFFER_MAX];
+	msg_view_t view;
+	size_t z;
+
+	if (offset + MSG_HEADER_SIZE > end ||
+		esp_partition_read(log->partition, offset, frame, MSG_HEADER_SIZE)
+		!= ESP_OK || frame[2] == 0xFF) {
+		return 0;
+	}
+	z = MSG_HEADER_SIZE + msg_read_u16(frame + 10) + MSG_TRAILER_SIZE;
+	if (z > sizeof(frame) || offset + z > end ||
+		esp_partition_read(log->partition, offset, frame, z) != ESP_OK ||
+		msg_parse(&view, frame, z) != ESP_OK) {
+		return -1;
+	}
+
+	return z;
+}
+
+
+// Programs the buffered bytes
+static esp_err_t beat_log_program (beat_log_t *log) {
+	esp_err_t err;
+
+	if (log->fill == 0) {
+		return ESP_OK;
+	}
+	if ((err = esp_partition_write(log->partition, log->write, log->page,
+		log->fill)) != ESP_OK) {
+		return err;
+	}
+	log->write += log->fill;
+	log->fill = 0;
+
+	return ESP_OK;
+}
+
+
+// Buffers bytes, programming them whenever a flash page is complete
+static esp_err_t beat_log_buffer (beat_log_t *log, const uint8_t *data,
+	size_t len) {
+	esp_err_t err;
+	size_t z;
+
+	while (len > 0) {
+		z = BEAT_LOG_PAGE_SIZE - (log->write + log->fill) % BEAT_LOG_PAGE_SIZE;
+		z = (z < len) ? z : len;
+		memcpy(log->page + log->fill, data, z);
+		log->fill += z;
+		data += z;
+		len -= z;
+
+		if ((log->write + log->fill) % BEAT_LOG_PAGE_SIZE == 0 &&
+			(err = beat_log_program(log)) != ESP_OK) {
+			return err;
+		}
+	}
+
+	return ESP_OK;
+}
+
+
+// Drops the oldest segment if it is the given one, counting what the client
+// never received
+static esp_err_t beat_log_drop (beat_log_t *log, uint32_t segment) {
+	uint32_t seq;
+	esp_err_t err;
+
+	if (segment != log->head) {
+		return ESP_OK;
+	}
+	log->head = beat_log_after(log, log->head);
+	if ((err = beat_log_header(log, log->head, &seq)) != ESP_OK) {
+		return err;
+	}
+	if (seq > log->acked) {
+		log->overwritten += seq - log->acked;
+		log->acked = seq;
+	}
+	log->first = seq;
+
+	return ESP_OK;
+}
+
+
+// Starts appending to a segment (from the next record), erasing it unless it
+// was erased ahead
+static esp_err_t beat_log_start (beat_log_t *log, uint32_t segment) {
+	uint8_t header[BEAT_LOG_HEADER_SIZE];
+	esp_err_t err;
+
+	if (segment != log->spare && (err = esp_partition_erase_range(
+		log->partition, beat_log_base(segment), BEAT_LOG_SEGMENT_SIZE)) 
+		!= ESP_OK) {
+		return err;
+	}
+	for (int i = 0; i < 4; ++i) {
+		header[i] = (BEAT_LOG_MAGIC >> (8 * i)) & 0xFF;
+		header[4 + i] = (log->next >> (8 * i)) & 0xFF;
+	}
+	log->tail = segment;
+	log->spare = UINT32_MAX;
+	log->write = beat_log_base(segment);
+	log->fill = 0;
+
+	return beat_log_buffer(log, header, sizeof(header));
+}
+
+
+// Moves on to the next segment, overwriting the oldest one if the log is full
+static esp_err_t beat_log_advance (beat_log_t *log) {
+	uint32_t segment = beat_log_after(log, log->tail);
+	esp_err_t err;
+
+	if ((err = beat_log_program(log)) != ESP_OK ||
+		(err = beat_log_drop(log, segment)) != ESP_OK) {
+		return err;
+	}
+
+	return beat_log_start(log, segment);
+}
+
+
+// Finds the segments in use, and where appending resumes
+static esp_err_t beat_log_mount (beat_log_t *log) {
+	uint32_t seq, first = UINT32_MAX, last = 0;
+	size_t offset, end;
+	esp_err_t err;
+	int z;
+
+	// The segments in use run from the oldest to the newest
+	for (uint32_t s = 0; s < log->segments; ++s) {
+		if ((err = beat_log_header(log, s, &seq)) == ESP_ERR_NOT_FOUND) {
+			continue;
+		}
+		if (err != ESP_OK) {
+			return err;
+		}
+		if (seq < first) {
+			first = seq;
+			log->head = s;
+		}
+		if (seq >= last) {
+			last = seq;
+			log->tail = s;
+		}
+	}
+
+	// Start afresh if no segment is in use
+	if (first == UINT32_MAX) {
+		return beat_log_start(log, 0);
+	}
+
+	// Count the records of the newest segment up to the first erased byte
+	log->first = log->acked = first;
+	log->next = last;
+	offset = beat_log_base(log->tail) + BEAT_LOG_HEADER_SIZE;
+	end = beat_log_base(log->tail) + BEAT_LOG_SEGMENT_SIZE;
+	while ((z = beat_log_scan(log, offset, end)) > 0) {
+		offset += z;
+		log->next++;
+	}
+	log->write = offset;
+
+	// A frame cut short leaves bytes that can't be programmed again, so its
+	// record is skipped and appending resumes in the next segment
+	if (z < 0) {
+		log->next++;
+	}
+	log->stream.seq = log->next;
+
+	return (z < 0) ? beat_log_advance(log) : ESP_OK;
+}
+
+
+/*
+ *******************************************************************************
+ *                        External Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+esp_err_t beat_log_init (beat_log_t *log) {
+	esp_err_t err;
+
+	memset(log, 0, sizeof(*log));
+	log->stream.channel = MSG_CHANNEL_BACKLOG;
+	log->spare = UINT32_MAX;
+
+	if ((log->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+		BEAT_LOG_SUBTYPE, BEAT_LOG_PARTITION)) == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	if ((log->segments = log->partition->size / BEAT_LOG_SEGMENT_SIZE) < 2) {
+		err = ESP_ERR_INVALID_SIZE;
+	} else {
+		err = beat_log_mount(log);
+	}
+
+	// The log stays closed if it can't be used
+	if (err != ESP_OK) {
+		log->partition = NULL;
+		return err;
+	}
+	beat_log_rewind(log);
+
+	return ESP_OK;
+}
+
+
+esp_err_t beat_log_append (beat_log_t *log, uint8_t *frame, size_t len) {
+	esp_err_t err;
+
+	if (log->partition == NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (len > MSG_BUFFER_MAX) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	// Records don't straddle segments
+	if (log->write + log->fill + len > beat_log_base(log->tail) +
+		BEAT_LOG_SEGMENT_SIZE && (err = beat_log_advance(log)) != ESP_OK) {
+		return err;
+	}
+
+	msg_restamp(frame, len, &log->stream);
+	log->next++;
+
+	return beat_log_buffer(log, frame, len);
+}
+
+
+esp_err_t beat_log_prepare (beat_log_t *log) {
+	uint32_t segment;
+	esp_err_t err;
+
+	if (log->partition == NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	if ((segment = beat_log_after(log, log->tail)) == log->spare) {
+		return ESP_OK;
+	}
+
+	if ((err = beat_log_drop(log, segment)) != ESP_OK ||
+		(err = esp_partition_erase_range(log->partition, 
+		beat_log_base(segment), BEAT_LOG_SEGMENT_SIZE)) != ESP_OK) {
+		return err;
+	}
+	log->spare = segment;
+
+	return ESP_OK;
+}
+
+
+esp_err_t beat_log_flush (beat_log_t *log) {
+	if (log->partition == NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	return beat_log_program(log);
+}
+
+
+void beat_log_rewind (beat_log_t *log) {
+	uint32_t target = log->acked, seq;
+	size_t z;
+
+	log->read_segment = log->head;
+	log->read_offset = beat_log_base(log->head) + BEAT_LOG_HEADER_SIZE;
+	log->read_seq = log->first;
+
+	// Skip whole segments, then the records before the target
+	while (log->read_segment != log->tail &&
+		beat_log_header(log, beat_log_after(log, log->read_segment), &seq)
+		== ESP_OK && seq <= target) {
+		log->read_segment = beat_log_after(log, log->read_segment);
+		log->read_offset = beat_log_base(log->read_segment) +
+			BEAT_LOG_HEADER_SIZE;
+		log->read_seq = seq;
+	}
+	while (log->read_seq < target && (z = beat_log_peek(log)) > 0) {
+		log->read_offset += z;
+		log->read_seq++;
+	}
+}
+
+
+size_t beat_log_peek (beat_log_t *log) {
+	size_t end;
+	int z;
+
+	if (log->partition == NULL) {
+		return 0;
+	}
+
+	while (1) {
+
+		// Only programmed bytes are read, and only up to a frame cut short
+		end = (log->read_segment == log->tail) ? log->write :
+			beat_log_base(log->read_segment) + BEAT_LOG_SEGMENT_SIZE;
+		if ((z = beat_log_scan(log, log->read_offset, end)) > 0) {
+			return z;
+		}
+
+		// Continue in the next segment, unless this one is being appended to
+		// (its first record follows any skipped after a frame cut short)
+		if (log->read_segment == log->tail) {
+			return 0;
+		}
+		log->read_segment = beat_log_after(log, log->read_segment);
+		log->read_offset = beat_log_base(log->read_segment) +
+			BEAT_LOG_HEADER_SIZE;
+		if (beat_log_header(log, log->read_segment, &log->read_seq) 
+			!= ESP_OK) {
+			return 0;
+		}
+	}
+}
+
+
+esp_err_t beat_log_read (beat_log_t *log, uint8_t *buffer, size_t len) {
+	esp_err_t err;
+
+	if ((err = esp_partition_read(log->partition, log->read_offset, buffer,
+		len)) != ESP_OK) {
+		return err;
+	}
+	log->read_offset += len;
+	log->read_seq++;
+
+	return ESP_OK;
+}
+
+
+void beat_log_ack (beat_log_t *log, uint32_t next) {
+	if (next > log->acked && next <= log->next) {
+		log->acked = next;
+	}
+}
@@ -44,6 +44,24 @@ static void gatts_profile_event_handler (esp_gatts_cb_event_t,
 /*****************************************************************************/
 
 
+// Requests the wanted connection parameters unless an update is in progress
+static void request_conn_params (void);
+
+
+/*****************************************************************************/
+
+
+// Takes a credit for a notification (with the sender lock held)
+static bool take_credit (void);
+
+
+// Hands a copy of the window to the stack
+static esp_err_t send_copy (uint8_t i, bool fresh);
+
+
+/*****************************************************************************/
+
+
 /*
  *******************************************************************************
  *                          Internal Global Variables                          *
@@ -85,6 +103,66 @@ static const char *g_gatts_event_str[] = {
 static uint8_t g_adv_config_status = 0x0;
 
 
+// The MTU negotiated with the connected client
+static uint16_t g_ble_mtu = BLE_MTU_DEFAULT;
+
+
+// Notifications in flight, whether the link is congested, the time (us) until
+// which sending pauses after a loss and the pause (ms) after the next, and
+// the counters of the sender (shared with the stack callbacks, so guarded by
+// the lock)
+static uint8_t g_ble_in_flight;
+static bool g_ble_congested;
+static int64_t g_ble_tx_resume;
+static uint16_t g_ble_tx_pause = BLE_TX_RETRY_MS;
+static ble_tx_stats_t g_ble_tx_stats;
+static portMUX_TYPE g_ble_tx_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+/* Copies of the notifications not yet confirmed, oldest first (at the head),
+ * kept so they may be sent again after a loss. Of the copies held, the first
+ * are in flight and the rest wait to be sent again. Copies sent before a loss
+ * that are still in flight are stale: they hold a credit, but their
+ * confirmations no longer free a copy (guarded by the lock)
+*/
+static struct {
+	uint16_t len;
+	uint8_t value[BLE_MTU_SIZE - BLE_ATT_HEADER_SIZE];
+} g_ble_tx_window[BLE_TX_CREDITS];
+static uint8_t g_ble_tx_head, g_ble_tx_held, g_ble_tx_sent, g_ble_tx_stale;
+
+
+// Connection parameter sets requested of the client (by BLE_CONN_MODE_*)
+static const esp_ble_conn_update_params_t g_conn_params[BLE_CONN_MODE_MAX] = {
+	[BLE_CONN_MODE_MONITOR] = {
+		.min_int = BLE_CONN_MONITOR_MIN_INT,
+		.max_int = BLE_CONN_MONITOR_MAX_INT,
+		.latency = BLE_CONN_MONITOR_LATENCY,
+		.timeout = BLE_CONN_TIMEOUT
+	},
+	[BLE_CONN_MODE_STREAM] = {
+		.min_int = BLE_CONN_STREAM_MIN_INT,
+		.max_int = BLE_CONN_STREAM_MAX_INT,
+		.latency = BLE_CONN_STREAM_LATENCY,
+		.timeout = BLE_CONN_TIMEOUT
+	}
+};
+
+
+// Address of the connected client, the parameter set wanted, whether an 
+// update is in progress, and the parameters in effect (guarded by the lock)
+static esp_bd_addr_t g_conn_bda;
+static bool g_conn_open;
+static ble_conn_mode_t g_conn_wanted = BLE_CONN_MODE_MAX;
+static bool g_conn_updating;
+static ble_link_t g_ble_link = {
+	.tx_len = BLE_DATA_LEN_DEFAULT,
+	.rx_len = BLE_DATA_LEN_DEFAULT,
+	.mode   = BLE_CONN_MODE_MAX
+};
+static portMUX_TYPE g_ble_conn_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
 // The service UUID that is used the GAP advertising data and scan response
 static uint8_t g_service_uuid[32] = {
     /* LSB <------------------------------------------------------------> MSB */
@@ -273,9 +351,37 @@ end:
 }
 
 
-esp_err_t ble_send (size_t len, uint8_t *buffer) {
+uint16_t ble_get_mtu (void) {
+	return g_ble_mtu;
+}
+
+
+void ble_set_conn_mode (ble_conn_mode_t mode) {
+	portENTER_CRITICAL(&g_ble_conn_lock);
+	g_conn_wanted = mode;
+	portEXIT_CRITICAL(&g_ble_conn_lock);
+
+	request_conn_params();
+}
+
+
+void ble_get_link (ble_link_t *link) {
+	portENTER_CRITICAL(&g_ble_conn_lock);
+	*link = g_ble_link;
+	portEXIT_CRITICAL(&g_ble_conn_lock);
+}
+
+
+void ble_tx_stats (ble_tx_stats_t *stats) {
+	portENTER_CRITICAL(&g_ble_tx_lock);
+	*stats = g_ble_tx_stats;
+	portEXIT_CRITICAL(&g_ble_tx_lock);
+}
+
+
+esp_err_t ble_send (size_t len, const uint8_t *buffer) {
 	esp_err_t err = ESP_OK;
-	struct gatts_profile_t *p = g_profile_table + APP_PROFILE_MAIN;
+	uint8_t i;
 
 	// Check for null buffer pointer
 	if (buffer == NULL) {
@@ -283,31 +389,75 @@ esp_err_t ble_send (size_t len, uint8_t *buffer) {
 	}
 
 	// Check for messages with a length exceeding the MTU
-	if (len > BLE_RSP_MSG_MAX_SIZE) {
+	if (len > g_ble_mtu - BLE_ATT_HEADER_SIZE) {
 		return ESP_ERR_INVALID_SIZE;
 	}
 
-	// Prepare output buffer
-	static uint8_t buffer_out[BLE_RSP_MSG_MAX_SIZE] = {0};
-	memcpy(buffer_out, buffer, len);
-
+	// Copies left to send again after a loss go out first
+	if ((err = ble_resend()) != ESP_OK) {
+		return err;
+	}
 
-	// Attempt to send as notification (because we set no confirm)
-	if ((err = esp_ble_gatts_send_indicate(
-		p->gatts_if,
-		p->conn_id,
-		p->char_handle,
-		BLE_RSP_MSG_MAX_SIZE * sizeof(uint8_t),
-		buffer_out,
-		false)) != ESP_OK) {
-		ESP_LOGE("BLE-Driver", "Couldn't send GATTS notification: %s", 
-			E2S(err));
+	// Take a credit and a place in the window, unless a loss (confirmed just
+	// now) left copies to send again
+	portENTER_CRITICAL(&g_ble_tx_lock);
+	if (g_ble_tx_sent < g_ble_tx_held) {
+		g_ble_tx_stats.deferred++;
+		portEXIT_CRITICAL(&g_ble_tx_lock);
+		return ESP_ERR_INVALID_STATE;
 	}
+	if (!take_credit()) {
+		portEXIT_CRITICAL(&g_ble_tx_lock);
+		return ESP_ERR_INVALID_STATE;
+	}
+	i = (g_ble_tx_head + g_ble_tx_held++) % BLE_TX_CREDITS;
+	g_ble_tx_sent++;
+	portEXIT_CRITICAL(&g_ble_tx_lock);
+
+	// Keep a copy until the stack confirms it
+	g_ble_tx_window[i].len = len;
+	memcpy(g_ble_tx_window[i].value, buffer, len);
+
+	return send_copy(i, true);
+}
+
+
+esp_err_t ble_resend (void) {
+	esp_err_t err;
+	uint8_t i;
+
+	do {
+
+		// Take a credit for the oldest copy waiting, if any
+		portENTER_CRITICAL(&g_ble_tx_lock);
+		if (g_ble_tx_sent == g_ble_tx_held) {
+			portEXIT_CRITICAL(&g_ble_tx_lock);
+			return ESP_OK;
+		}
+		if (!take_credit()) {
+			portEXIT_CRITICAL(&g_ble_tx_lock);
+			return ESP_ERR_INVALID_STATE;
+		}
+		i = (g_ble_tx_head + g_ble_tx_sent++) % BLE_TX_CREDITS;
+		portEXIT_CRITICAL(&g_ble_tx_lock);
+
+	} while ((err = send_copy(i, false)) == ESP_OK);
 
 	return err;
 }
 
 
+uint8_t ble_tx_pending (void) {
+	uint8_t n;
+
+	portENTER_CRITICAL(&g_ble_tx_lock);
+	n = g_ble_tx_held - g_ble_tx_sent;
+	portEXIT_CRITICAL(&g_ble_tx_lock);
+
+	return n;
+}
+
+
 /*
  *******************************************************************************
  *                         FreeRTOS Task Hook Function                         *
@@ -318,17 +468,16 @@ esp_err_t ble_send (size_t len, uint8_t *buffer) {
 // Enqueues message and notifies FreeRTOS event group of recevied BLE message
 void notify_event_group (size_t size, void *buffer) {
 	esp_err_t err;
-	const size_t msg_lower_byte_limit = 3;
 
-	// Ignore data under three-bytes
-	if (size < msg_lower_byte_limit) {
-		ESP_LOGW("BLE-Driver", "Ignoring undersized message (<%d bytes)", 
-			msg_lower_byte_limit);
+	// Ignore empty writes (any other write may be part of a frame)
+	if (size == 0) {
+		ESP_LOGW("BLE-Driver", "Ignoring empty write");
 		return;
 	}
 
 	// Otherwise put the data on the BLE_RX_QUEUE
-	if ((err = ipc_enqueue(g_ble_rx_queue, 0x0, size, buffer)) != ESP_OK) {
+	if ((err = ipc_enqueue(&g_ble_rx_queue, MSG_CHANNEL_CONTROL, size, 
+		buffer)) != ESP_OK) {
 		ESP_LOGE("BLE-Driver", "Unable to enqueue received message: %s", 
 			E2S(err));
 	}
@@ -345,6 +494,94 @@ void notify_event_group (size_t size, void *buffer) {
 */
 
 
+// Takes a credit for a notification, unless all are in flight, the link is
+// congested, or a notification was lost just now (with the sender lock held)
+static bool take_credit (void) {
+	if (g_ble_congested || g_ble_in_flight >= BLE_TX_CREDITS ||
+		esp_timer_get_time() < g_ble_tx_resume) {
+		g_ble_tx_stats.deferred++;
+		return false;
+	}
+	g_ble_in_flight++;
+	return true;
+}
+
+
+/* Hands a copy of the window to the stack, once it took a credit (and was
+ * counted in flight). The stack copies the value before returning. A copy
+ * the stack refuses returns its credit, and goes out of flight: a fresh one
+ * leaves the window (the caller retries it), one sent again waits again
+*/
+static esp_err_t send_copy (uint8_t i, bool fresh) {
+	struct gatts_profile_t *p = g_profile_table + APP_PROFILE_MAIN;
+	esp_err_t err;
+
+	// Attempt to send as notification (because we set no confirm)
+	err = esp_ble_gatts_send_indicate(
+		p->gatts_if,
+		p->conn_id,
+		p->char_handle,
+		g_ble_tx_window[i].len * sizeof(uint8_t),
+		g_ble_tx_window[i].value,
+		false);
+
+	// The copy was the last in flight (unless a loss made it stale since, or
+	// the link went away)
+	portENTER_CRITICAL(&g_ble_tx_lock);
+	if (err != ESP_OK) {
+		if (g_ble_tx_sent > 0) {
+			g_ble_tx_sent--;
+		} else if (g_ble_tx_stale > 0) {
+			g_ble_tx_stale--;
+		}
+		if (fresh && g_ble_tx_held > 0) {
+			g_ble_tx_held--;
+		}
+		if (g_ble_in_flight > 0) {
+			g_ble_in_flight--;
+		}
+		g_ble_tx_stats.rejected++;
+	} else {
+		g_ble_tx_stats.sent++;
+		g_ble_tx_stats.resent += !fresh;
+	}
+	portEXIT_CRITICAL(&g_ble_tx_lock);
+
+	return err;
+}
+
+
+// Requests the wanted connection parameters unless an update is in progress
+// (the GAP handler calls again once it completes)
+static void request_conn_params (void) {
+	esp_ble_conn_update_params_t params;
+	esp_err_t err;
+
+	// Claim the update, so only one is in progress
+	portENTER_CRITICAL(&g_ble_conn_lock);
+	if (!g_conn_open || g_conn_updating || g_conn_wanted >= BLE_CONN_MODE_MAX
+		|| g_conn_wanted == g_ble_link.mode) {
+		portEXIT_CRITICAL(&g_ble_conn_lock);
+		return;
+	}
+	g_conn_updating = true;
+	g_ble_link.mode = g_conn_wanted;
+	params = g_conn_params[g_conn_wanted];
+	memcpy(params.bda, g_conn_bda, sizeof(esp_bd_addr_t));
+	portEXIT_CRITICAL(&g_ble_conn_lock);
+
+	// A set the stack refuses isn't requested again until another is wanted
+	if ((err = esp_ble_gap_update_conn_params(&params)) != ESP_OK) {
+		ESP_LOGE("BLE-Driver", "Couldn't request connection parameters: %s",
+			E2S(err));
+		portENTER_CRITICAL(&g_ble_conn_lock);
+		g_conn_updating = false;
+		g_ble_link.rejected++;
+		portEXIT_CRITICAL(&g_ble_conn_lock);
+	}
+}
+
+
 // Handles writes to the characteristic descriptor
 static void gatts_char_descr_write_handler (esp_gatt_if_t gatts_if,
 	esp_ble_gatts_cb_param_t *param, esp_gatt_char_prop_t char_property,
@@ -605,9 +842,46 @@ static void gap_event_handler (esp_gap_ble_cb_event_t event,
         break;
 
 
-        // Event triggered if the connection parameters were updated 
+        // Event triggered if the connection parameters were updated (on 
+        // request, or by the client on its own)
         case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT: {
-            ESP_LOGI("BLE-Driver", "Connection parameters updated");
+            portENTER_CRITICAL(&g_ble_conn_lock);
+            g_conn_updating = false;
+            if (param->update_conn_params.status == ESP_BT_STATUS_SUCCESS) {
+                g_ble_link.interval = param->update_conn_params.conn_int;
+                g_ble_link.latency = param->update_conn_params.latency;
+                g_ble_link.timeout = param->update_conn_params.timeout;
+                g_ble_link.updates++;
+            } else {
+                g_ble_link.rejected++;
+            }
+            portEXIT_CRITICAL(&g_ble_conn_lock);
+
+            ESP_LOGI("BLE-Driver", "Connection parameters updated (status %d):"
+                " interval %u, latency %u, timeout %u", 
+                param->update_conn_params.status, 
+                param->update_conn_params.conn_int, 
+                param->update_conn_params.latency,
+                param->update_conn_params.timeout);
+
+            // Request the set wanted since the update began
+            request_conn_params();
+        }
+        break;
+
+
+        // Event triggered once the data length is negotiated with the client
+        case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT: {
+            if (param->pkt_data_lenth_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+                portENTER_CRITICAL(&g_ble_conn_lock);
+                g_ble_link.tx_len = param->pkt_data_lenth_cmpl.params.tx_len;
+                g_ble_link.rx_len = param->pkt_data_lenth_cmpl.params.rx_len;
+                portEXIT_CRITICAL(&g_ble_conn_lock);
+            }
+            ESP_LOGI("BLE-Driver", "Data length set (status %d): tx %u, rx %u",
+                param->pkt_data_lenth_cmpl.status, 
+                param->pkt_data_lenth_cmpl.params.tx_len,
+                param->pkt_data_lenth_cmpl.params.rx_len);
         }
         break;
 
@@ -874,6 +1148,32 @@ static void gatts_profile_event_handler (esp_gatts_cb_event_t event,
         	// Update connection ID 
 			g_profile_table[APP_PROFILE_MAIN].conn_id = param->connect.conn_id;
 
+			// The client picked the initial parameters (in effect until the
+			// first update)
+			portENTER_CRITICAL(&g_ble_conn_lock);
+			memcpy(g_conn_bda, param->connect.remote_bda, 
+				sizeof(esp_bd_addr_t));
+			g_conn_open = true;
+			g_conn_updating = false;
+			g_ble_link = (ble_link_t) {
+				.interval = param->connect.conn_params.interval,
+				.latency  = param->connect.conn_params.latency,
+				.timeout  = param->connect.conn_params.timeout,
+				.tx_len   = BLE_DATA_LEN_DEFAULT,
+				.rx_len   = BLE_DATA_LEN_DEFAULT,
+				.mode     = BLE_CONN_MODE_MAX
+			};
+			portEXIT_CRITICAL(&g_ble_conn_lock);
+
+			// Ask for the longest link-layer packets, so a notification takes
+			// one packet instead of one per 27 bytes (the GAP handler records
+			// what the client agrees to)
+			if ((err = esp_ble_gap_set_pkt_data_len(param->connect.remote_bda,
+				BLE_DATA_LEN_MAX)) != ESP_OK) {
+				ESP_LOGE("BLE-Driver", "Couldn't request data length: %s",
+					E2S(err));
+			}
+
         	// Note: Only needs to be done ONCE for ALL PROFILES
         	ESP_LOGI("BLE-Driver", "GATTS Profile: Connect event");
 
@@ -883,6 +1183,14 @@ static void gatts_profile_event_handler (esp_gatts_cb_event_t event,
         break;
 
 
+        // Event triggered when the client negotiates the MTU
+        case ESP_GATTS_MTU_EVT: {
+        	g_ble_mtu = param->mtu.mtu;
+        	ESP_LOGI("BLE-Driver", "GATTS Profile: MTU set to %u", g_ble_mtu);
+        }
+        break;
+
+
         // Event tripped by READ operation: Implemented if auto-resp is NULL
         case ESP_GATTS_READ_EVT: {
         	esp_gatt_rsp_t response_data;
@@ -967,11 +1275,51 @@ static void gatts_profile_event_handler (esp_gatts_cb_event_t event,
 
         // Event tripped by a notify/indicate action
         case ESP_GATTS_CONF_EVT: {
+        	bool failed;
+
+        	// Return the credit of the notification (the stack has it queued,
+        	// or reports it couldn't be). Confirmations come in the order the
+        	// notifications were sent: those of stale copies come first, then
+        	// that of the oldest copy, which leaves the window once queued. If
+        	// it couldn't be, it and every copy after it are sent again, in 
+        	// order (those in flight become stale), after a pause so the stack
+        	// may drain (twice as long with each loss in a row)
+        	portENTER_CRITICAL(&g_ble_tx_lock);
+        	if (g_ble_in_flight > 0) {
+        		g_ble_in_flight--;
+        	}
+        	failed = (param->conf.status != ESP_GATT_OK && 
+        		param->conf.status != ESP_GATT_CONGESTED);
+        	if (g_ble_tx_stale > 0) {
+        		g_ble_tx_stale--;
+        	} else if (g_ble_tx_sent > 0 && !failed) {
+        		g_ble_tx_head = (g_ble_tx_head + 1) % BLE_TX_CREDITS;
+        		g_ble_tx_held--;
+        		g_ble_tx_sent--;
+        	} else if (g_ble_tx_sent > 0) {
+        		g_ble_tx_stale = g_ble_tx_sent - 1;
+        		g_ble_tx_sent = 0;
+        	}
+        	if (failed) {
+        		g_ble_tx_stats.failed++;
+        		g_ble_tx_resume = esp_timer_get_time() + 
+        			g_ble_tx_pause * 1000;
+        		g_ble_tx_pause = (g_ble_tx_pause < BLE_TX_PAUSE_MAX_MS) ? 
+        			g_ble_tx_pause * 2 : BLE_TX_PAUSE_MAX_MS;
+        	} else {
+        		g_ble_tx_pause = BLE_TX_RETRY_MS;
+        	}
+        	portEXIT_CRITICAL(&g_ble_tx_lock);
 
+        	// Notify: Resume sending with the returned credit
+        	xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
 
         	if (param->conf.status == ESP_GATT_OK) {
-        		ESP_LOGI("BLE-Driver", 
+        		ESP_LOGD("BLE-Driver", 
         			"GATTS Profile: ESP_GATTS_CONF_EVT okay!");
+        	} else if (param->conf.status == ESP_GATT_CONGESTED) {
+        		ESP_LOGD("BLE-Driver", 
+        			"GATTS Profile: ESP_GATTS_CONF_EVT queued (congested)");
         	} else {
         		ESP_LOGE("BLE-Driver", "GATTS Profile: ESP_GATTS_CONF_EVT (conn_id = %X, handle = %X)", param->conf.conn_id, param->conf.handle);
         		ESP_LOGE("BLE-Driver", 
@@ -982,6 +1330,22 @@ static void gatts_profile_event_handler (esp_gatts_cb_event_t event,
         }
         break;
 
+        // Event tripped when the link congests or clears up
+        case ESP_GATTS_CONGEST_EVT: {
+        	portENTER_CRITICAL(&g_ble_tx_lock);
+        	g_ble_congested = param->congest.congested;
+        	if (g_ble_congested) {
+        		g_ble_tx_stats.congested++;
+        	}
+        	portEXIT_CRITICAL(&g_ble_tx_lock);
+
+        	// Notify: Resume sending once the link clears up
+        	if (!param->congest.congested) {
+        		xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+        	}
+        }
+        break;
+
         // Event tripped when a GATT response completes
         case ESP_GATTS_RESPONSE_EVT: {
         	if (param->rsp.status == ESP_GATT_OK) {
@@ -1005,6 +1369,24 @@ static void gatts_profile_event_handler (esp_gatts_cb_event_t event,
         case ESP_GATTS_DISCONNECT_EVT: {
         	ESP_LOGW("BLE-Driver", "GATTS Profile: A disconnect occurred");
 
+        	// The next client starts from the default MTU
+        	g_ble_mtu = BLE_MTU_DEFAULT;
+
+        	// Notifications in flight, and their copies, are gone with the link
+        	portENTER_CRITICAL(&g_ble_tx_lock);
+        	g_ble_in_flight = 0;
+        	g_ble_tx_head = g_ble_tx_held = g_ble_tx_sent = g_ble_tx_stale = 0;
+        	g_ble_congested = false;
+        	g_ble_tx_resume = 0;
+        	g_ble_tx_pause = BLE_TX_RETRY_MS;
+        	portEXIT_CRITICAL(&g_ble_tx_lock);
+
+        	// No more parameters are requested until the next client
+        	portENTER_CRITICAL(&g_ble_conn_lock);
+        	g_conn_open = false;
+        	g_conn_wanted = BLE_CONN_MODE_MAX;
+        	portEXIT_CRITICAL(&g_ble_conn_lock);
+
         	// Begin advertising again
         	if ((err = esp_ble_gap_start_advertising(&g_adv_parameters)) 
         		!= ESP_OK) {
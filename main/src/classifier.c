@@ -3,126 +3,126 @@
 
 /*
  *******************************************************************************
- *                        External Function Definitions                        *
+ *                              Global Variables                               *
  *******************************************************************************
 */
 
 
-// Calculate the distance between two points
-double calculate_distance (uint16_t amplitude_1, uint16_t rr_period_1,
-							uint16_t amplitude_2, uint16_t rr_period_2) {
-    double distance = 0;
-    
-    // Calculate Euclidean distance
-    distance = sqrt((amplitude_1 - amplitude_2) * (amplitude_1 - amplitude_2) + 
-        (rr_period_1 - rr_period_2) * (rr_period_1 - rr_period_2));
+// Update this table as backends are introduced or removed
+static const classifier_t *g_classifier_tab[CLASSIFIER_TYPE_MAX] = {
+	[CLASSIFIER_KNN]  = &g_classifier_knn,
+	[CLASSIFIER_TREE] = &g_classifier_tree,
+	[CLASSIFIER_MLP]  = &g_classifier_mlp,
+	[CLASSIFIER_NCM]  = &g_classifier_ncm,
+};
 
-    // Return the distance
-    return distance;
-}
 
+// The type of the active backend
+static classifier_type_t g_classifier_active = CLASSIFIER_KNN;
 
-// Comparator function to sort by increasing order of distance 
-int compare (const void * s1, const void * s2) {
 
-	neighbor_t *n1 = (neighbor_t *) s1;
-	neighbor_t *n2 = (neighbor_t *) s2;
+// State of the pseudo-random number generator (xorshift32, never zero)
+static uint32_t g_classifier_random_state = 0x2545F491;
 
-    return (n1->distance - n2->distance); 
-}
 
+/*
+ *******************************************************************************
+ *                        External Function Definitions                        *
+ *******************************************************************************
+*/
 
-// Function to generate an array of neighbors
-void get_neighbors (uint16_t amplitude, uint16_t rr_period, neighbor_t* neighbors) {
-	uint16_t n_amplitude;
-	uint16_t n_rr_period;
-	sample_label_t n_label;
-	double distance;
-	int i;
 
-    // Calculate distance with each neighbor
-    for (i = 0; i < 40; i++) {
+esp_err_t classifier_init (void) {
+	esp_err_t err;
+	classifier_footprint_t footprint;
 
-		// Get a neighbor's amplitude, period, and label
-		if (i >= 0 && i < 20) {
-			n_amplitude = g_n_amplitudes[i];
-			n_rr_period = g_n_periods[i];
-			n_label = SAMPLE_LABEL_NORMAL;
-		}
-		else if (i >= 20 && i < 30) {
-			n_amplitude = g_a_amplitudes[i-20];
-			n_rr_period = g_a_periods[i-20];
-			n_label = SAMPLE_LABEL_ATRIAL;
-		}
-		else if (i >= 30 && i < 40) {
-			n_amplitude = g_v_amplitudes[i-30];
-			n_rr_period = g_v_periods[i-30];
-			n_label = SAMPLE_LABEL_VENTRICAL;
+	for (size_t i = 0; i < CLASSIFIER_TYPE_MAX; ++i) {
+		const classifier_t *c = g_classifier_tab[i];
+
+		if ((err = c->init()) != ESP_OK) {
+			ESP_LOGE("Classifier", "Couldn't initialize %s: %s", c->name,
+				esp_err_to_name(err));
+			return err;
 		}
 
-		// Calculate distance between sample and current neighbor
-		distance = calculate_distance(amplitude, rr_period, 
-			n_amplitude, n_rr_period);
+		c->footprint(&footprint);
+		ESP_LOGI("Classifier", "%s: %u B RAM, %u B flash", c->name,
+			footprint.ram, footprint.flash);
+	}
+
+	g_classifier_active = CLASSIFIER_KNN;
+
+	return ESP_OK;
+}
+
+
+esp_err_t classifier_select (classifier_type_t type) {
+	if (type >= CLASSIFIER_TYPE_MAX) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	g_classifier_active = type;
+	return ESP_OK;
+}
+
 
-		// Add calculated distance to array
-		neighbors[i] = (neighbor_t) {
-			.distance = distance,
-			.label = n_label
-		};
+esp_err_t classifier_load (classifier_type_t type, const uint8_t *blob,
+	size_t len) {
+	if (type >= CLASSIFIER_TYPE_MAX || blob == NULL) {
+		return ESP_ERR_INVALID_ARG;
 	}
+	return g_classifier_tab[type]->load(blob, len);
 }
 
 
-// Function to count a label in neighbor array
-void count_labels (neighbor_t* neighbors, uint8_t* N, uint8_t* A, uint8_t* V) {
-    int i;
-
-    // Start counters at zero
-    *N = 0;
-    *A = 0;
-    *V = 0;
-
-    // Find the most frequent label in the K closest samples
-    // use squared values of the order to avoid ties
-	for (i = K_VALUE; i > 0 ; i--) {
-		if ((neighbors[i]).label == SAMPLE_LABEL_NORMAL) {
-            *N += i*i;
-        } else if ((neighbors[i]).label == SAMPLE_LABEL_ATRIAL) {
-            *A += i*i;
-        } else if ((neighbors[i]).label == SAMPLE_LABEL_VENTRICAL) {
-            *V += i*i;
-        }
+const classifier_t *classifier_get (classifier_type_t type) {
+	if (type >= CLASSIFIER_TYPE_MAX) {
+		return NULL;
 	}
+	return g_classifier_tab[type];
 }
-  
 
-// Classifies a sample
-sample_label_t classify (uint16_t amplitude, uint16_t rr_period) {
-	sample_label_t label = SAMPLE_LABEL_UNKNOWN;
 
-    // Dynamically allocate neighbor array
-    neighbor_t neighbors[40];
+classifier_type_t classifier_active (void) {
+	return g_classifier_active;
+}
 
-    // Variables to store the count of each label
-    uint8_t N, A, V;
-	
-    // Get an array of neighbors
-    get_neighbors(amplitude, rr_period, neighbors);
 
-	// Sort distance array by the smallest distance
-	qsort(neighbors, 40, sizeof(neighbor_t), compare);
+esp_err_t classifier_update (const beat_features_t *features, 
+	sample_label_t label) {
+	const classifier_t *c = g_classifier_tab[g_classifier_active];
 
-	// Count each label
-    count_labels(neighbors, &N, &A, &V);
+	if (label < SAMPLE_LABEL_NORMAL || label > SAMPLE_LABEL_VENTRICAL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (c->update == NULL) {
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+	return c->update(features, label);
+}
+
+
+uint32_t classifier_random (void) {
+	uint32_t x = g_classifier_random_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return (g_classifier_random_state = x);
+}
+
+
+sample_label_t classify (uint16_t amplitude, uint16_t rr_period, 
+	uint8_t *confidence) {
+	beat_features_t features = (beat_features_t) {
+		.amplitude = amplitude,
+		.rr_period = rr_period
+	};
+	return g_classifier_tab[g_classifier_active]->classify(&features, 
+		confidence);
+}
 
-    // Find the most frequent
-    if (N > A && N > V) {
-        label = SAMPLE_LABEL_NORMAL;
-    } else if (A > N && A > V) {
-        label = SAMPLE_LABEL_ATRIAL;
-    } else if (V > N && V > A) {
-        label = SAMPLE_LABEL_VENTRICAL;
-    }
 
-	return label;
+void classify_batch (const beat_features_t *features, size_t n,
+	sample_label_t *labels, uint8_t *confidences) {
+	g_classifier_tab[g_classifier_active]->classify_batch(features, n, labels,
+		confidences);
 }
@@ -0,0 +1,105 @@
+#include "classifier_bench.h"
+#include "sdkconfig.h"
+#include "xtensa/hal.h"
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns the histogram bin of a duration in cycles
+static uint8_t bench_bin (uint32_t cycles) {
+	uint8_t bin = 0;
+
+	while ((cycles >>= 1) != 0 && bin < CLASSIFIER_BENCH_BINS - 1) {
+		bin++;
+	}
+
+	return bin;
+}
+
+
+/*
+ *******************************************************************************
+ *                        External Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+void classifier_bench_reset (classifier_bench_t *bench) {
+	memset(bench, 0, sizeof(classifier_bench_t));
+	bench->cycles_min = UINT32_MAX;
+}
+
+
+void classifier_bench_record (classifier_bench_t *bench, sample_label_t truth,
+	sample_label_t given) {
+	if (truth <= SAMPLE_LABEL_VENTRICAL && given <= SAMPLE_LABEL_VENTRICAL &&
+		bench->confusion[truth][given] < UINT16_MAX) {
+		bench->confusion[truth][given]++;
+	}
+}
+
+
+esp_err_t classifier_bench_run (classifier_type_t type, 
+	const beat_features_t *features, const sample_label_t *labels, size_t n,
+	classifier_bench_t *bench) {
+	const classifier_t *c = classifier_get(type);
+
+	if (c == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	classifier_bench_reset(bench);
+
+	for (size_t i = 0; i < n; ++i) {
+		uint32_t start, cycles;
+		sample_label_t label;
+
+		// Time a single classification (the counter wraps harmlessly)
+		start  = xthal_get_ccount();
+		label  = c->classify(features + i, NULL);
+		cycles = xthal_get_ccount() - start;
+
+		// Update the timing statistics
+		bench->n++;
+		bench->cycles_total += cycles;
+		if (cycles < bench->cycles_min) {
+			bench->cycles_min = cycles;
+		}
+		if (cycles > bench->cycles_max) {
+			bench->cycles_max = cycles;
+		}
+		bench->histogram[bench_bin(cycles)]++;
+
+		classifier_bench_record(bench, labels[i], label);
+	}
+
+	return ESP_OK;
+}
+
+
+void classifier_bench_print (const char *name, const classifier_bench_t *bench) {
+	uint32_t mean = (bench->n == 0) ? 0 : bench->cycles_total / bench->n;
+
+	printf(CLASSIFIER_BENCH_TAG " {\"name\":\"%s\",\"n\":%u,\"mhz\":%u,"
+		"\"ns_mean\":%u,\"cycles\":{\"min\":%u,\"mean\":%u,\"max\":%u},"
+		"\"hist\":[", name, bench->n, CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+		(mean * 1000) / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+		(bench->n == 0) ? 0 : bench->cycles_min, mean, bench->cycles_max);
+
+	for (uint8_t i = 0; i < CLASSIFIER_BENCH_BINS; ++i) {
+		printf("%s%u", (i == 0) ? "" : ",", bench->histogram[i]);
+	}
+
+	printf("],\"confusion\":[");
+	for (uint8_t t = 0; t < 4; ++t) {
+		printf("%s[%u,%u,%u,%u]", (t == 0) ? "" : ",", bench->confusion[t][0],
+			bench->confusion[t][1], bench->confusion[t][2], 
+			bench->confusion[t][3]);
+	}
+	printf("]}\n");
+}
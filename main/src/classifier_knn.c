@@ -0,0 +1,273 @@
+#include "classifier.h"
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a labeled training sample
+typedef struct {
+	uint16_t amplitude;
+	uint16_t rr_period;
+	sample_label_t label;
+} knn_sample_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// The installed training set
+static knn_sample_t g_knn_samples[KNN_SAMPLES];
+
+
+// Offset and size of each class segment in the training set (by label)
+static const uint8_t g_knn_class_offset[4] = {
+	[SAMPLE_LABEL_NORMAL]    = 0,
+	[SAMPLE_LABEL_ATRIAL]    = KNN_N_SAMPLES,
+	[SAMPLE_LABEL_VENTRICAL] = KNN_N_SAMPLES + KNN_A_SAMPLES
+};
+static const uint8_t g_knn_class_size[4] = {
+	[SAMPLE_LABEL_NORMAL]    = KNN_N_SAMPLES,
+	[SAMPLE_LABEL_ATRIAL]    = KNN_A_SAMPLES,
+	[SAMPLE_LABEL_VENTRICAL] = KNN_V_SAMPLES
+};
+
+
+// Number of samples offered to each class segment (capped at NCM_WINDOW)
+static uint16_t g_knn_seen[4];
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+/* Finds the K_VALUE + 1 nearest training samples of a beat, in order of
+ * increasing distance. The list stays in registers while the training set
+ * streams past, which measured about twice as fast on the host as scanning
+ * each sample against every beat of a batch
+*/
+static void get_neighbors (const beat_features_t *features, 
+	neighbor_t *neighbors) {
+
+	// Start with an empty neighbor list
+	for (size_t k = 0; k <= K_VALUE; ++k) {
+		neighbors[k] = (neighbor_t) {
+			.distance = UINT32_MAX,
+			.label    = SAMPLE_LABEL_UNKNOWN
+		};
+	}
+
+	for (size_t s = 0; s < KNN_SAMPLES; ++s) {
+		const knn_sample_t *t = g_knn_samples + s;
+		int32_t da = (int32_t)features->amplitude - t->amplitude;
+		int32_t dp = (int32_t)features->rr_period - t->rr_period;
+		// Squares are taken in 64 bits, since they overflow an int32_t
+		uint32_t da2 = (uint32_t)((int64_t)da * da);
+		uint32_t dp2 = (uint32_t)((int64_t)dp * dp);
+		uint32_t distance = da2 + dp2;
+		size_t k = K_VALUE;
+
+		// Saturate on overflow (only reachable with extreme features)
+		if (distance < da2) {
+			distance = UINT32_MAX;
+		}
+
+		// Skip samples further than the current K_VALUE + 1 nearest
+		if (distance >= neighbors[K_VALUE].distance) {
+			continue;
+		}
+
+		// Insert in order of increasing distance
+		while (k > 0 && neighbors[k - 1].distance > distance) {
+			neighbors[k] = neighbors[k - 1];
+			--k;
+		}
+		neighbors[k] = (neighbor_t) {
+			.distance = distance,
+			.label    = t->label
+		};
+	}
+}
+
+
+/* Votes on a label from a sorted neighbor list (optionally its confidence).
+ * Ties go to the tied label of the nearest voting neighbor, and the
+ * confidence is the margin of the winner over the runner-up (zero on a tie)
+*/
+static sample_label_t vote (const neighbor_t *neighbors, uint8_t *confidence) {
+	uint8_t w[4] = {0};   // Weight per sample_label_t
+	uint8_t total = 0, best = 0, second = 0;
+	sample_label_t label = SAMPLE_LABEL_UNKNOWN;
+	int i;
+
+    // Find the most frequent label in the K closest samples
+    // use squared values of the order to avoid ties
+	for (i = K_VALUE; i > 0 ; i--) {
+		w[neighbors[i].label] += i*i;
+		total += i*i;
+	}
+
+	// Find the winning and runner-up weights
+	for (i = SAMPLE_LABEL_NORMAL; i <= SAMPLE_LABEL_VENTRICAL; ++i) {
+		if (w[i] > best) {
+			second = best;
+			best   = w[i];
+		} else if (w[i] > second) {
+			second = w[i];
+		}
+	}
+
+	// Pick the label of the nearest voting neighbor holding the best weight
+	for (i = 1; i <= K_VALUE; ++i) {
+		if (neighbors[i].label != SAMPLE_LABEL_UNKNOWN && 
+			w[neighbors[i].label] == best) {
+			label = neighbors[i].label;
+			break;
+		}
+	}
+
+    if (confidence != NULL) {
+    	*confidence = (label == SAMPLE_LABEL_UNKNOWN) ? 0 :
+    		((best - second) * CLASSIFIER_CONFIDENCE_MAX) / total;
+    }
+
+	return label;
+}
+
+
+// Unpacks n little-endian 16-bit values from a blob
+static void unpack_u16 (const uint8_t *blob, uint16_t *values, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		values[i] = blob[2 * i] | (blob[2 * i + 1] << 8);
+	}
+}
+
+
+/*
+ *******************************************************************************
+ *                          Backend Interface Functions                        *
+ *******************************************************************************
+*/
+
+
+// Clears the training set
+static esp_err_t knn_init (void) {
+	memset(g_knn_samples, 0, sizeof(g_knn_samples));
+	memcpy(g_knn_seen, g_knn_class_size, sizeof(g_knn_class_size));
+	return ESP_OK;
+}
+
+
+// Installs a training set laid out as the training data message body
+static esp_err_t knn_load (const uint8_t *blob, size_t len) {
+	uint16_t periods[KNN_N_SAMPLES], amplitudes[KNN_N_SAMPLES];
+	const size_t counts[3] = {KNN_N_SAMPLES, KNN_A_SAMPLES, KNN_V_SAMPLES};
+	const sample_label_t labels[3] = {
+		SAMPLE_LABEL_NORMAL, SAMPLE_LABEL_ATRIAL, SAMPLE_LABEL_VENTRICAL
+	};
+	size_t i = 0;
+
+	if (len != KNN_BLOB_SIZE) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	// Each class is stored as periods[count] followed by amplitudes[count]
+	for (size_t c = 0; c < 3; ++c) {
+		unpack_u16(blob, periods, counts[c]);
+		blob += 2 * counts[c];
+		unpack_u16(blob, amplitudes, counts[c]);
+		blob += 2 * counts[c];
+
+		for (size_t j = 0; j < counts[c]; ++j, ++i) {
+			g_knn_samples[i] = (knn_sample_t) {
+				.amplitude = amplitudes[j],
+				.rr_period = periods[j],
+				.label     = labels[c]
+			};
+		}
+		g_knn_seen[labels[c]] = counts[c];
+	}
+
+	return ESP_OK;
+}
+
+
+// Classifies a batch of samples
+static void knn_classify_batch (const beat_features_t *features, size_t n,
+	sample_label_t *labels, uint8_t *confidences) {
+	neighbor_t neighbors[K_VALUE + 1];
+
+	for (size_t i = 0; i < n; ++i) {
+		get_neighbors(features + i, neighbors);
+		labels[i] = vote(neighbors, 
+			(confidences == NULL) ? NULL : confidences + i);
+	}
+}
+
+
+// Classifies a sample
+static sample_label_t knn_classify (const beat_features_t *features,
+	uint8_t *confidence) {
+	sample_label_t label;
+	knn_classify_batch(features, 1, &label, confidence);
+	return label;
+}
+
+
+/* Learns a labeled sample by reservoir replacement within its class segment.
+ * The seen count is capped so recent samples keep a fixed replacement chance
+*/
+static esp_err_t knn_update (const beat_features_t *features, 
+	sample_label_t label) {
+	uint32_t j;
+
+	if (g_knn_seen[label] < NCM_WINDOW) {
+		g_knn_seen[label]++;
+	}
+
+	// Replace a random member with probability size / seen
+	if ((j = classifier_random() % g_knn_seen[label]) < g_knn_class_size[label]) {
+		g_knn_samples[g_knn_class_offset[label] + j] = (knn_sample_t) {
+			.amplitude = features->amplitude,
+			.rr_period = features->rr_period,
+			.label     = label
+		};
+	}
+
+	return ESP_OK;
+}
+
+
+// Reports the model footprint
+static void knn_footprint (classifier_footprint_t *footprint) {
+	footprint->ram   = sizeof(g_knn_samples) + sizeof(g_knn_seen);
+	footprint->flash = sizeof(g_knn_class_offset) + sizeof(g_knn_class_size);
+}
+
+
+/*
+ *******************************************************************************
+ *                              Backend Instance                               *
+ *******************************************************************************
+*/
+
+
+const classifier_t g_classifier_knn = {
+	.name           = "KNN",
+	.init           = knn_init,
+	.load           = knn_load,
+	.classify       = knn_classify,
+	.classify_batch = knn_classify_batch,
+	.update         = knn_update,
+	.footprint      = knn_footprint
+};
@@ -0,0 +1,248 @@
+#include "classifier.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Number of input features (amplitude, RR period)
+#define MLP_INPUTS                  2
+
+// Number of output classes (normal, atrial, ventrical)
+#define MLP_OUTPUTS                 3
+
+// Size of the blob header: [hidden, in_shift[0], in_shift[1], hidden_shift]
+#define MLP_HEADER_SIZE             4
+
+// Size of a blob for a model with h hidden units
+#define MLP_BLOB_SIZE(h)            (MLP_HEADER_SIZE + \
+                                     (h) * MLP_INPUTS + 2 * (h) + \
+                                     MLP_OUTPUTS * (h) + 2 * MLP_OUTPUTS)
+
+
+/* An MLP blob has the following structure (16-bit values are little-endian)
+ *
+ * [ HEADER | W1 (int8)[H][2] | B1 (int16)[H] | W2 (int8)[3][H] | B2 (int16)[3] ]
+ *
+ * Inputs are quantized to int8 as (feature >> in_shift) - 128. Hidden units
+ * are computed in int32, shifted right by hidden_shift and clamped to [0,127]
+ * (ReLU). The label is the index of the largest output, and the confidence
+ * is the margin to the runner-up relative to their combined magnitude.
+*/
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a quantized two-layer perceptron
+typedef struct {
+	uint8_t hidden;                                // Number of hidden units
+	uint8_t in_shift[MLP_INPUTS];                  // Input quantization shifts
+	uint8_t hidden_shift;                          // Hidden requantization
+	int8_t  w1[MLP_HIDDEN_MAX][MLP_INPUTS];        // Input -> hidden weights
+	int16_t b1[MLP_HIDDEN_MAX];                    // Hidden biases
+	int8_t  w2[MLP_OUTPUTS][MLP_HIDDEN_MAX];       // Hidden -> output weights
+	int16_t b2[MLP_OUTPUTS];                       // Output biases
+} mlp_model_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+/* Built-in model. Units detect a regular rhythm, a premature beat of low
+ * amplitude, and a premature beat of high amplitude respectively
+*/
+static const mlp_model_t g_mlp_default = {
+	.hidden       = 3,
+	.in_shift     = {4, 4},
+	.hidden_shift = 0,
+	.w1           = {{0, 1}, {-1, -2}, {1, -2}},
+	.b1           = {91, -147, -217},
+	.w2           = {{2, 0, 0}, {0, 1, 0}, {0, 0, 1}},
+	.b2           = {1, 0, 0}
+};
+
+
+// The installed model
+static mlp_model_t g_mlp_model;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Quantizes a feature to int8
+static int8_t quantize (uint16_t value, uint8_t shift) {
+	uint16_t q = value >> shift;
+	return (int8_t)((q > 255 ? 255 : q) - 128);
+}
+
+
+// Reads a little-endian 16-bit signed value
+static int16_t read_i16 (const uint8_t *b) {
+	return (int16_t)(b[0] | (b[1] << 8));
+}
+
+
+/*
+ *******************************************************************************
+ *                          Backend Interface Functions                        *
+ *******************************************************************************
+*/
+
+
+// Installs the built-in model
+static esp_err_t mlp_init (void) {
+	g_mlp_model = g_mlp_default;
+	return ESP_OK;
+}
+
+
+// Installs a serialized model
+static esp_err_t mlp_load (const uint8_t *blob, size_t len) {
+	mlp_model_t m = {0};
+	size_t z = MLP_HEADER_SIZE;
+
+	if (len < MLP_HEADER_SIZE) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	// Check the hidden layer size against the blob size
+	m.hidden = blob[0];
+	if (m.hidden == 0 || m.hidden > MLP_HIDDEN_MAX ||
+		len != MLP_BLOB_SIZE(m.hidden)) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	// Shifts beyond the feature width would zero the inputs
+	m.in_shift[0]  = blob[1];
+	m.in_shift[1]  = blob[2];
+	m.hidden_shift = blob[3];
+	if (m.in_shift[0] > 15 || m.in_shift[1] > 15 || m.hidden_shift > 31) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	for (uint8_t j = 0; j < m.hidden; ++j) {
+		for (uint8_t i = 0; i < MLP_INPUTS; ++i) {
+			m.w1[j][i] = (int8_t)blob[z++];
+		}
+	}
+	for (uint8_t j = 0; j < m.hidden; ++j, z += 2) {
+		m.b1[j] = read_i16(blob + z);
+	}
+	for (uint8_t k = 0; k < MLP_OUTPUTS; ++k) {
+		for (uint8_t j = 0; j < m.hidden; ++j) {
+			m.w2[k][j] = (int8_t)blob[z++];
+		}
+	}
+	for (uint8_t k = 0; k < MLP_OUTPUTS; ++k, z += 2) {
+		m.b2[k] = read_i16(blob + z);
+	}
+
+	g_mlp_model = m;
+
+	return ESP_OK;
+}
+
+
+// Classifies a sample with a forward pass (optionally its confidence)
+static sample_label_t mlp_forward (const beat_features_t *features, 
+	uint8_t *confidence) {
+	const mlp_model_t *m = &g_mlp_model;
+	int8_t x[MLP_INPUTS], h[MLP_HIDDEN_MAX];
+	int32_t best = INT32_MIN, second = INT32_MIN;
+	sample_label_t label = SAMPLE_LABEL_UNKNOWN;
+
+	// Quantize inputs
+	x[0] = quantize(features->amplitude, m->in_shift[0]);
+	x[1] = quantize(features->rr_period, m->in_shift[1]);
+
+	// Hidden layer (ReLU, requantized to int8)
+	for (uint8_t j = 0; j < m->hidden; ++j) {
+		int32_t acc = m->b1[j] + m->w1[j][0] * x[0] + m->w1[j][1] * x[1];
+		acc >>= m->hidden_shift;
+		h[j] = (acc < 0) ? 0 : ((acc > 127) ? 127 : acc);
+	}
+
+	// Output layer (arg-max, tracking the runner-up)
+	for (uint8_t k = 0; k < MLP_OUTPUTS; ++k) {
+		int32_t acc = m->b2[k];
+		for (uint8_t j = 0; j < m->hidden; ++j) {
+			acc += m->w2[k][j] * h[j];
+		}
+		if (acc > best) {
+			second = best;
+			best   = acc;
+			label  = SAMPLE_LABEL_NORMAL + k;
+		} else if (acc > second) {
+			second = acc;
+		}
+	}
+
+	// Margin relative to the magnitude of the top two outputs
+	if (confidence != NULL) {
+		int32_t scale = abs(best) + abs(second);
+		int32_t c = (scale == 0) ? 0 :
+			((best - second) * CLASSIFIER_CONFIDENCE_MAX) / scale;
+		*confidence = (c > CLASSIFIER_CONFIDENCE_MAX) ? 
+			CLASSIFIER_CONFIDENCE_MAX : c;
+	}
+
+	return label;
+}
+
+
+// Classifies a sample
+static sample_label_t mlp_classify (const beat_features_t *features,
+	uint8_t *confidence) {
+	return mlp_forward(features, confidence);
+}
+
+
+// Classifies a batch of samples
+static void mlp_classify_batch (const beat_features_t *features, size_t n,
+	sample_label_t *labels, uint8_t *confidences) {
+	for (size_t i = 0; i < n; ++i) {
+		labels[i] = mlp_forward(features + i, 
+			(confidences == NULL) ? NULL : confidences + i);
+	}
+}
+
+
+// Reports the model footprint
+static void mlp_footprint (classifier_footprint_t *footprint) {
+	footprint->ram   = sizeof(g_mlp_model);
+	footprint->flash = sizeof(g_mlp_default);
+}
+
+
+/*
+ *******************************************************************************
+ *                              Backend Instance                               *
+ *******************************************************************************
+*/
+
+
+const classifier_t g_classifier_mlp = {
+	.name           = "MLP",
+	.init           = mlp_init,
+	.load           = mlp_load,
+	.classify       = mlp_classify,
+	.classify_batch = mlp_classify_batch,
+	.update         = NULL,
+	.footprint      = mlp_footprint
+};
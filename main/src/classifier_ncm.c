@@ -0,0 +1,248 @@
+#include "classifier.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Number of classes (normal, atrial, ventrical)
+#define NCM_CLASSES                 3
+
+// Fractional bits of the fixed-point class means
+#define NCM_MEAN_FRAC_BITS          4
+
+
+/* The nearest-centroid model keeps, per class, a running mean of the samples
+ * it has learned and a bounded reservoir of prototypes. A sample is labeled by
+ * the class owning the nearest centroid or prototype.
+ *
+ * Both the mean and the reservoir count saturate at NCM_WINDOW samples, so the
+ * model behaves like an exponential moving average and keeps tracking drift.
+*/
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing the learned state of a class
+typedef struct {
+	int32_t         mean_amplitude;                  // Running mean (Q4)
+	int32_t         mean_rr_period;                  // Running mean (Q4)
+	uint16_t        count;                           // Samples in the mean
+	uint16_t        seen;                            // Samples offered
+	uint8_t         n_prototypes;                    // Prototypes held
+	beat_features_t prototypes[NCM_PROTOTYPES_MAX];  // Prototype reservoir
+} ncm_class_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// The learned classes (indexed by label - SAMPLE_LABEL_NORMAL)
+static ncm_class_t g_ncm_classes[NCM_CLASSES];
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Squared distance between a sample and a point (fixed-point if frac_bits)
+static uint32_t distance (const beat_features_t *f, int32_t amplitude,
+	int32_t rr_period, uint8_t frac_bits) {
+	int32_t da = (((int32_t)f->amplitude << frac_bits) - amplitude) >> frac_bits;
+	int32_t dp = (((int32_t)f->rr_period << frac_bits) - rr_period) >> frac_bits;
+	// Squares are taken in 64 bits, since they overflow an int32_t
+	uint32_t da2 = (uint32_t)((int64_t)da * da);
+	uint32_t dp2 = (uint32_t)((int64_t)dp * dp);
+	uint32_t d = da2 + dp2;
+	return (d < da2) ? UINT32_MAX : d;
+}
+
+
+// Distance from a sample to the nearest centroid or prototype of a class
+static uint32_t class_distance (const ncm_class_t *c,
+	const beat_features_t *f) {
+	uint32_t best = distance(f, c->mean_amplitude, c->mean_rr_period,
+		NCM_MEAN_FRAC_BITS);
+
+	for (uint8_t i = 0; i < c->n_prototypes; ++i) {
+		uint32_t d = distance(f, c->prototypes[i].amplitude,
+			c->prototypes[i].rr_period, 0);
+		if (d < best) {
+			best = d;
+		}
+	}
+
+	return best;
+}
+
+
+// Classifies a sample (optionally its confidence)
+static sample_label_t ncm_nearest (const beat_features_t *features,
+	uint8_t *confidence) {
+	uint32_t best = UINT32_MAX, second = UINT32_MAX;
+	sample_label_t label = SAMPLE_LABEL_UNKNOWN;
+
+	for (uint8_t k = 0; k < NCM_CLASSES; ++k) {
+		uint32_t d;
+
+		// Classes without samples cannot be chosen
+		if (g_ncm_classes[k].count == 0) {
+			continue;
+		}
+
+		d = class_distance(g_ncm_classes + k, features);
+		if (d < best) {
+			second = best;
+			best   = d;
+			label  = SAMPLE_LABEL_NORMAL + k;
+		} else if (d < second) {
+			second = d;
+		}
+	}
+
+	// Confidence grows as the runner-up class becomes relatively further away
+	if (confidence != NULL) {
+		if (label == SAMPLE_LABEL_UNKNOWN) {
+			*confidence = 0;
+		} else if (second == UINT32_MAX) {
+			*confidence = CLASSIFIER_CONFIDENCE_MAX;
+		} else {
+			uint64_t span = (uint64_t)second + best;
+			*confidence = (span == 0) ? 0 :
+				((uint64_t)(second - best) * CLASSIFIER_CONFIDENCE_MAX) / span;
+		}
+	}
+
+	return label;
+}
+
+
+/*
+ *******************************************************************************
+ *                          Backend Interface Functions                        *
+ *******************************************************************************
+*/
+
+
+// Forgets all learned samples
+static esp_err_t ncm_init (void) {
+	memset(g_ncm_classes, 0, sizeof(g_ncm_classes));
+	return ESP_OK;
+}
+
+
+// Learns a labeled sample in O(NCM_PROTOTYPES_MAX)
+static esp_err_t ncm_update (const beat_features_t *features,
+	sample_label_t label) {
+	ncm_class_t *c = g_ncm_classes + (label - SAMPLE_LABEL_NORMAL);
+	int32_t a = (int32_t)features->amplitude << NCM_MEAN_FRAC_BITS;
+	int32_t p = (int32_t)features->rr_period << NCM_MEAN_FRAC_BITS;
+	uint32_t j;
+
+	// Update the running mean
+	if (c->count < NCM_WINDOW) {
+		c->count++;
+	}
+	c->mean_amplitude += (a - c->mean_amplitude) / c->count;
+	c->mean_rr_period += (p - c->mean_rr_period) / c->count;
+
+	// Update the prototype reservoir
+	if (c->seen < NCM_WINDOW) {
+		c->seen++;
+	}
+	if (c->n_prototypes < NCM_PROTOTYPES_MAX) {
+		c->prototypes[c->n_prototypes++] = *features;
+	} else if ((j = classifier_random() % c->seen) < NCM_PROTOTYPES_MAX) {
+		c->prototypes[j] = *features;
+	}
+
+	return ESP_OK;
+}
+
+
+// Seeds the model from a training set blob (same layout as KNN)
+static esp_err_t ncm_load (const uint8_t *blob, size_t len) {
+	const size_t counts[NCM_CLASSES] = {
+		KNN_N_SAMPLES, KNN_A_SAMPLES, KNN_V_SAMPLES
+	};
+
+	if (len != KNN_BLOB_SIZE) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	ncm_init();
+
+	// Each class is stored as periods[count] followed by amplitudes[count]
+	for (size_t k = 0; k < NCM_CLASSES; ++k) {
+		const uint8_t *periods = blob, *amplitudes = blob + 2 * counts[k];
+
+		for (size_t i = 0; i < counts[k]; ++i) {
+			beat_features_t f = (beat_features_t) {
+				.amplitude = amplitudes[2 * i] | (amplitudes[2 * i + 1] << 8),
+				.rr_period = periods[2 * i] | (periods[2 * i + 1] << 8)
+			};
+			ncm_update(&f, SAMPLE_LABEL_NORMAL + k);
+		}
+
+		blob += 4 * counts[k];
+	}
+
+	return ESP_OK;
+}
+
+
+// Classifies a sample
+static sample_label_t ncm_classify (const beat_features_t *features,
+	uint8_t *confidence) {
+	return ncm_nearest(features, confidence);
+}
+
+
+// Classifies a batch of samples
+static void ncm_classify_batch (const beat_features_t *features, size_t n,
+	sample_label_t *labels, uint8_t *confidences) {
+	for (size_t i = 0; i < n; ++i) {
+		labels[i] = ncm_nearest(features + i,
+			(confidences == NULL) ? NULL : confidences + i);
+	}
+}
+
+
+// Reports the model footprint
+static void ncm_footprint (classifier_footprint_t *footprint) {
+	footprint->ram   = sizeof(g_ncm_classes);
+	footprint->flash = 0;
+}
+
+
+/*
+ *******************************************************************************
+ *                              Backend Instance                               *
+ *******************************************************************************
+*/
+
+
+const classifier_t g_classifier_ncm = {
+	.name           = "NCM",
+	.init           = ncm_init,
+	.load           = ncm_load,
+	.classify       = ncm_classify,
+	.classify_batch = ncm_classify_batch,
+	.update         = ncm_update,
+	.footprint      = ncm_footprint
+};
@@ -0,0 +1,199 @@
+#include "classifier.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Feature index value marking a leaf node
+#define TREE_LEAF                   0xFF
+
+// Feature indices that a node may test
+#define TREE_FEATURE_AMPLITUDE      0x0
+#define TREE_FEATURE_RR_PERIOD      0x1
+
+// Size of a serialized node: [feature, label, threshold (LE16), left, right]
+#define TREE_NODE_SIZE              6
+
+
+/* A tree blob has the following structure
+ *
+ * [ COUNT | NODE_0 | NODE_1 | ... | NODE_(COUNT-1) ]
+ *
+ * Node 0 is the root. Inner nodes branch left when the tested feature is below
+ * the threshold, and right otherwise. Children must have a larger index than
+ * their parent, so every walk terminates within COUNT steps. Leaves carry
+ * their confidence (0-255) in the threshold field.
+*/
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a node of the decision tree
+typedef struct {
+	uint8_t  feature;           // Feature index, or TREE_LEAF
+	uint8_t  label;             // Label of a leaf (sample_label_t)
+	uint16_t threshold;         // Branch left if feature < threshold (or
+	                            // confidence of a leaf)
+	uint8_t  left;              // Index of the left child
+	uint8_t  right;             // Index of the right child
+} tree_node_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Built-in tree: premature beats split into atrial/ventrical by amplitude
+static const tree_node_t g_tree_default[] = {
+	{ TREE_FEATURE_RR_PERIOD, 0, 600,  1, 2 },
+	{ TREE_FEATURE_AMPLITUDE, 0, 2600, 3, 4 },
+	{ TREE_LEAF, SAMPLE_LABEL_NORMAL,    200, 0, 0 },
+	{ TREE_LEAF, SAMPLE_LABEL_ATRIAL,    160, 0, 0 },
+	{ TREE_LEAF, SAMPLE_LABEL_VENTRICAL, 160, 0, 0 },
+};
+
+
+// The installed tree
+static tree_node_t g_tree_nodes[TREE_NODE_MAX];
+
+
+// Number of nodes in the installed tree
+static uint8_t g_tree_node_count;
+
+
+/*
+ *******************************************************************************
+ *                          Backend Interface Functions                        *
+ *******************************************************************************
+*/
+
+
+// Installs the built-in tree
+static esp_err_t tree_init (void) {
+	g_tree_node_count = sizeof(g_tree_default) / sizeof(tree_node_t);
+	memcpy(g_tree_nodes, g_tree_default, sizeof(g_tree_default));
+	return ESP_OK;
+}
+
+
+// Installs a serialized tree after validating it
+static esp_err_t tree_load (const uint8_t *blob, size_t len) {
+	tree_node_t nodes[TREE_NODE_MAX];
+	uint8_t count;
+
+	if (len < 1) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	// Check the node count against the blob size
+	count = blob[0];
+	if (count == 0 || count > TREE_NODE_MAX ||
+		len != 1 + (size_t)count * TREE_NODE_SIZE) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	// Decode and validate each node
+	for (uint8_t i = 0; i < count; ++i) {
+		const uint8_t *b = blob + 1 + i * TREE_NODE_SIZE;
+		tree_node_t *n = nodes + i;
+
+		*n = (tree_node_t) {
+			.feature   = b[0],
+			.label     = b[1],
+			.threshold = b[2] | (b[3] << 8),
+			.left      = b[4],
+			.right     = b[5]
+		};
+
+		if (n->feature == TREE_LEAF) {
+			if (n->label > SAMPLE_LABEL_VENTRICAL ||
+				n->threshold > CLASSIFIER_CONFIDENCE_MAX) {
+				return ESP_ERR_INVALID_STATE;
+			}
+			continue;
+		}
+
+		if (n->feature > TREE_FEATURE_RR_PERIOD ||
+			n->left <= i || n->left >= count ||
+			n->right <= i || n->right >= count) {
+			return ESP_ERR_INVALID_STATE;
+		}
+	}
+
+	memcpy(g_tree_nodes, nodes, count * sizeof(tree_node_t));
+	g_tree_node_count = count;
+
+	return ESP_OK;
+}
+
+
+// Walks the tree to the leaf for a sample
+static const tree_node_t *tree_walk (const beat_features_t *features) {
+	const tree_node_t *n = g_tree_nodes;
+
+	while (n->feature != TREE_LEAF) {
+		uint16_t value = (n->feature == TREE_FEATURE_AMPLITUDE) ?
+			features->amplitude : features->rr_period;
+		n = g_tree_nodes + ((value < n->threshold) ? n->left : n->right);
+	}
+
+	return n;
+}
+
+
+// Classifies a sample
+static sample_label_t tree_classify (const beat_features_t *features,
+	uint8_t *confidence) {
+	const tree_node_t *leaf = tree_walk(features);
+	if (confidence != NULL) {
+		*confidence = leaf->threshold;
+	}
+	return leaf->label;
+}
+
+
+// Classifies a batch of samples
+static void tree_classify_batch (const beat_features_t *features, size_t n,
+	sample_label_t *labels, uint8_t *confidences) {
+	for (size_t i = 0; i < n; ++i) {
+		labels[i] = tree_classify(features + i, 
+			(confidences == NULL) ? NULL : confidences + i);
+	}
+}
+
+
+// Reports the model footprint
+static void tree_footprint (classifier_footprint_t *footprint) {
+	footprint->ram   = sizeof(g_tree_nodes) + sizeof(g_tree_node_count);
+	footprint->flash = sizeof(g_tree_default);
+}
+
+
+/*
+ *******************************************************************************
+ *                              Backend Instance                               *
+ *******************************************************************************
+*/
+
+
+const classifier_t g_classifier_tree = {
+	.name           = "Tree",
+	.init           = tree_init,
+	.load           = tree_load,
+	.classify       = tree_classify,
+	.classify_batch = tree_classify_batch,
+	.update         = NULL,
+	.footprint      = tree_footprint
+};
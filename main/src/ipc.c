@@ -1,6 +1,245 @@
 #include "ipc.h"
+#include "msg.h"
+#include "config.h"
+#include "esp_timer.h"
 
 
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Nonzero if a frame with a body of the given size fits a large buffer
+#define IPC_FITS(body)  (MSG_HEADER_SIZE + (body) + MSG_TRAILER_SIZE <= \
+                         TASK_POOL_LARGE_SIZE)
+
+
+// The largest frame of each type fits a large buffer (one that didn't could
+// never be sent)
+_Static_assert(IPC_FITS(MSG_STATUS_BODY_MAX),
+	"status frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_TRAIN_DATA_BODY_MAX),
+	"train data frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_SAMPLE_DATA_BODY_MAX),
+	"sample data frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_INSTRUCTION_BODY_MAX),
+	"instruction frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_CONFIGURATION_BODY_MAX),
+	"configuration frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_MODEL_DATA_BODY_MAX),
+	"model data frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_FEEDBACK_BODY_MAX),
+	"feedback frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_ESCALATION_BODY_MAX),
+	"escalation frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_SUMMARY_BODY_MAX),
+	"summary frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_POLICY_BODY_MAX),
+	"policy frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_SAMPLE_BATCH_BODY_MAX),
+	"sample batch frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_BATCHING_BODY_MAX),
+	"batching frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_BEAT_STREAM_BODY_MAX),
+	"beat stream frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_WAVEFORM_BODY_MAX),
+	"waveform frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_HELLO_BODY_MAX),
+	"hello frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_TELEMETRY_BODY_MAX),
+	"telemetry frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_LOG_STATUS_BODY_MAX),
+	"log status frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_LOG_ACK_BODY_MAX),
+	"log ack frame exceeds TASK_POOL_LARGE_SIZE");
+_Static_assert(IPC_FITS(MSG_LINK_STATUS_BODY_MAX),
+	"link status frame exceeds TASK_POOL_LARGE_SIZE");
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+/* Logical channels (control and alerts are small, so they are served first).
+ * Control replies go stale, the newest alerts and telemetry matter most, beats
+ * that don't fit are summarized, and waveform runs are kept contiguous. The
+ * backlog is topped up from the beat log, and gets what live data leaves
+*/
+const ipc_channel_t g_ipc_channels[MSG_CHANNEL_MAX] = {
+	[MSG_CHANNEL_CONTROL]   = {"control",   4,  0, 4, IPC_POLICY_DEADLINE, 2000},
+	[MSG_CHANNEL_ALERTS]    = {"alerts",    4,  1, 4, IPC_POLICY_DROP_OLDEST, 0},
+	[MSG_CHANNEL_BEATS]     = {"beats",     12, 2, 4, IPC_POLICY_COALESCE, 0},
+	[MSG_CHANNEL_TELEMETRY] = {"telemetry", 8,  2, 1, IPC_POLICY_DROP_OLDEST, 0},
+	[MSG_CHANNEL_WAVEFORM]  = {"waveform",  6,  2, 2, IPC_POLICY_DROP_NEWEST, 0},
+	[MSG_CHANNEL_BACKLOG]   = {"backlog",   4,  3, 1, IPC_POLICY_DROP_NEWEST, 0}
+};
+
+
+/* Position (in g_tx_order) of the channel taking its turn in each lane, and
+ * its frames left. A lane is indexed by the position of its first channel, so
+ * it resumes its turns where it left off after a more urgent lane was served
+*/
+static uint8_t g_tx_cursor[MSG_CHANNEL_MAX];
+static uint8_t g_tx_credit[MSG_CHANNEL_MAX];
+
+
+// Transmit buffers (small ones are handles 0 to TASK_POOL_SMALL_COUNT - 1)
+static uint8_t g_pool_small[TASK_POOL_SMALL_COUNT][TASK_POOL_SMALL_SIZE];
+static uint8_t g_pool_large[TASK_POOL_LARGE_COUNT][TASK_POOL_LARGE_SIZE];
+
+// References, frame size and time queued (microseconds) of each buffer
+static uint8_t  g_pool_refs[TASK_POOL_SMALL_COUNT + TASK_POOL_LARGE_COUNT];
+static uint16_t g_pool_sizes[TASK_POOL_SMALL_COUNT + TASK_POOL_LARGE_COUNT];
+static uint32_t g_pool_times[TASK_POOL_SMALL_COUNT + TASK_POOL_LARGE_COUNT];
+
+// Free transmit buffers of each size (stacks)
+static ipc_buffer_t g_pool_free_small[TASK_POOL_SMALL_COUNT];
+static ipc_buffer_t g_pool_free_large[TASK_POOL_LARGE_COUNT];
+static uint8_t g_pool_n_small, g_pool_n_large;
+
+// Pool counters, and the lock guarding the pool
+static ipc_pool_stats_t g_pool_stats;
+static portMUX_TYPE g_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Allocates the buffer of a queue holding the given number of bytes
+static esp_err_t ipc_queue_create (ipc_queue_t *queue, size_t size) {
+	uint8_t *buffer;
+
+	if ((buffer = malloc(size)) == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+	ring_init(&queue->ring, buffer, size);
+	queue->lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+
+	return ESP_OK;
+}
+
+
+// Returns the time (in microseconds, wrapping) used to stamp queued buffers
+static inline uint32_t ipc_now (void) {
+	return (uint32_t)esp_timer_get_time();
+}
+
+
+// Returns nonzero if a queued buffer has outlived the deadline of its channel
+static int ipc_expired (uint8_t channel, ipc_buffer_t buffer, uint32_t now) {
+	return g_ipc_channels[channel].policy == IPC_POLICY_DEADLINE &&
+		now - g_pool_times[buffer] >= 
+		1000 * (uint32_t)g_ipc_channels[channel].deadline;
+}
+
+
+// Raises the high-water mark of a queue after a put (lock held)
+static inline void ipc_track (ipc_queue_t *queue) {
+#if TASK_QUEUE_STATS
+	if (queue->ring.count > queue->stats.high_water) {
+		queue->stats.high_water = queue->ring.count;
+	}
+#endif
+}
+
+
+// Counts a message taken from a queue after the given wait (lock held)
+static inline void ipc_account (ipc_queue_t *queue, size_t size, 
+	uint32_t wait) {
+#if TASK_QUEUE_STATS
+	uint8_t bucket = 0;
+
+	// Bucket zero is below 1 ms, each next one spans twice as long
+	for (wait /= 1000; wait > 0 && bucket < MSG_LATENCY_BUCKETS - 1; 
+		wait >>= 1) {
+		bucket++;
+	}
+	queue->stats.bytes += size;
+	queue->stats.latency[bucket]++;
+#endif
+}
+
+
+/* Queues a transmit buffer on a channel, making room by its policy. A frame
+ * to be stamped takes the next sequence number of the channel first, under
+ * the lock, so frames are numbered in the order they are queued
+*/
+static esp_err_t ipc_put (uint8_t channel, ipc_buffer_t buffer, 
+	bool stamp) {
+	ipc_queue_t *queue = g_tx_queues + channel;
+	ipc_queue_stats_t *stats = &queue->stats;
+	ipc_buffer_t evicted = IPC_BUFFER_NONE;
+	uint32_t now = ipc_now();
+	int res;
+
+	g_pool_times[buffer] = now;
+
+	portENTER_CRITICAL(&queue->lock);
+
+	if (stamp) {
+		msg_restamp(ipc_buffer_data(buffer), ipc_buffer_size(buffer), 
+			&queue->stream);
+	}
+
+	// Make room according to the policy of the channel
+	if (!ring_fits(&queue->ring, sizeof(buffer))) {
+		switch (g_ipc_channels[channel].policy) {
+
+			case IPC_POLICY_DROP_OLDEST: {
+				ring_get(&queue->ring, NULL, &evicted, sizeof(evicted));
+				stats->evicted++;
+			}
+			break;
+
+			case IPC_POLICY_DEADLINE: {
+				ring_peek(&queue->ring, NULL, &evicted, sizeof(evicted));
+				if (ipc_expired(channel, evicted, now)) {
+					ring_get(&queue->ring, NULL, NULL, 0);
+					stats->expired++;
+				} else {
+					evicted = IPC_BUFFER_NONE;
+				}
+			}
+			break;
+
+			default:
+			break;
+		}
+	}
+
+	if ((res = ring_put(&queue->ring, channel, &buffer, sizeof(buffer))) 
+		== 0) {
+		stats->queued++;
+		ipc_track(queue);
+	} else if (g_ipc_channels[channel].policy == IPC_POLICY_COALESCE) {
+		stats->coalesced++;
+	} else {
+		stats->refused++;
+	}
+
+	portEXIT_CRITICAL(&queue->lock);
+
+	// Buffers are released outside of the queue lock
+	ipc_buffer_release(evicted);
+
+	// The queue holds the reference from now on, unless it was refused
+	if (res != 0) {
+		ipc_buffer_release(buffer);
+		return ESP_ERR_NO_MEM;
+	}
+
+	return ESP_OK;
+}
+
 
 /*
  *******************************************************************************
@@ -10,39 +249,82 @@
 
 
 esp_err_t ipc_init (void) {
+	size_t depth = 0;
 
-	g_ble_rx_queue = xQueueCreate(TASK_QUEUE_CAPACITY, 
-		sizeof(task_queue_msg_t));
-	g_ble_tx_queue = xQueueCreate(TASK_QUEUE_CAPACITY,
-		sizeof(task_queue_msg_t));
+	g_feedback_queue = xQueueCreate(TASK_FEEDBACK_CAPACITY,
+		sizeof(msg_feedback_data_t));
+	g_block_queue = xQueueCreate(DEVICE_SAMPLE_BLOCKS - 2, sizeof(uint8_t));
 
-	if (NULL == g_ble_tx_queue || NULL == g_ble_rx_queue) {
+	if (NULL == g_feedback_queue || NULL == g_block_queue ||
+		ipc_queue_create(&g_ble_rx_queue, TASK_QUEUE_RX_SIZE) != ESP_OK) {
 		return ESP_ERR_NO_MEM;
 	}
+
+	// Fill the transmit buffer pool
+	for (g_pool_n_small = 0; g_pool_n_small < TASK_POOL_SMALL_COUNT; 
+		++g_pool_n_small) {
+		g_pool_free_small[g_pool_n_small] = g_pool_n_small;
+	}
+	for (g_pool_n_large = 0; g_pool_n_large < TASK_POOL_LARGE_COUNT; 
+		++g_pool_n_large) {
+		g_pool_free_large[g_pool_n_large] = TASK_POOL_SMALL_COUNT + 
+			g_pool_n_large;
+	}
+
+	// Create a transmit queue per channel, and sort channels by priority
+	for (uint8_t c = 0; c < MSG_CHANNEL_MAX; ++c) {
+		uint8_t i = c;
+
+		if (c != MSG_CHANNEL_CONTROL) {
+			depth += g_ipc_channels[c].depth;
+		}
+
+		if (ipc_queue_create(g_tx_queues + c, g_ipc_channels[c].depth * 
+			(RING_HEADER_SIZE + sizeof(ipc_buffer_t))) != ESP_OK) {
+			return ESP_ERR_NO_MEM;
+		}
+		g_tx_queues[c].stream = (msg_stream_t) {.channel = c};
+		while (i > 0 && g_ipc_channels[g_tx_order[i - 1]].priority > 
+			g_ipc_channels[c].priority) {
+			g_tx_order[i] = g_tx_order[i - 1];
+			i--;
+		}
+		g_tx_order[i] = c;
+	}
+	memset(g_tx_cursor, 0, sizeof(g_tx_cursor));
+	memset(g_tx_credit, 0, sizeof(g_tx_credit));
+
+	// A channel must never find the pool empty (or its policy is moot)
+	if (depth > TASK_POOL_LARGE_COUNT || 
+		g_ipc_channels[MSG_CHANNEL_CONTROL].depth > TASK_POOL_SMALL_COUNT) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
 	return ESP_OK;
 }
 
 
-esp_err_t ipc_enqueue (QueueHandle_t queue, uint8_t id, size_t size, 
-    void *buffer) {
+esp_err_t ipc_enqueue (ipc_queue_t *queue, uint8_t id, size_t size, 
+    const void *buffer) {
 	size_t rem = size; off_t offset = 0;
-	BaseType_t res = pdPASS;
+	int res = 0;
 
 	// While data remains to be sent and space remains in the queue
-	while (rem > 0 && (res == pdPASS)) {
+	while (rem > 0 && res == 0) {
 
 		// Compute message chunk size
 		size_t z = (rem > TASK_QUEUE_DATA_MAX ? TASK_QUEUE_DATA_MAX : rem);
 
-		// Build message
-		task_queue_msg_t msg = (task_queue_msg_t) {
-			.id = id,
-			.size = z,
-		};
-		memcpy(msg.data, buffer + offset, z * sizeof(uint8_t));
-
-		// Enqueue next message chunk
-		res = xQueueSendToBack(queue, (void *)&msg, TASK_QUEUE_MAX_TICKS);
+		// Enqueue next message chunk (copying only its bytes)
+		portENTER_CRITICAL(&queue->lock);
+		if ((res = ring_put(&queue->ring, id, (const uint8_t *)buffer + offset,
+			z)) == 0) {
+			queue->stats.queued++;
+			ipc_track(queue);
+		} else {
+			queue->stats.refused++;
+		}
+		portEXIT_CRITICAL(&queue->lock);
 
 		// Update remaining size
 		rem -= z;
@@ -51,5 +333,250 @@ esp_err_t ipc_enqueue (QueueHandle_t queue, uint8_t id, size_t size,
 		offset += z;
 	}
 
-	return (res == pdPASS) ? ESP_OK : ESP_ERR_TIMEOUT;
+	return (res == 0) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+
+size_t ipc_dequeue (ipc_queue_t *queue, task_queue_msg_t *msg) {
+	size_t z;
+
+	portENTER_CRITICAL(&queue->lock);
+	if (msg == NULL) {
+		z = ring_get(&queue->ring, NULL, NULL, 0);
+	} else {
+		z = msg->size = ring_get(&queue->ring, &msg->id, msg->data, 
+			TASK_QUEUE_DATA_MAX);
+	}
+#if TASK_QUEUE_STATS
+	queue->stats.bytes += z;
+#endif
+	portEXIT_CRITICAL(&queue->lock);
+
+	return z;
+}
+
+
+ipc_buffer_t ipc_buffer_alloc (size_t size) {
+	ipc_buffer_t buffer = IPC_BUFFER_NONE;
+
+	portENTER_CRITICAL(&g_pool_lock);
+
+	// Take the smallest free buffer that is large enough
+	if (size <= TASK_POOL_SMALL_SIZE && g_pool_n_small > 0) {
+		buffer = g_pool_free_small[--g_pool_n_small];
+	} else if (size <= TASK_POOL_LARGE_SIZE && g_pool_n_large > 0) {
+		buffer = g_pool_free_large[--g_pool_n_large];
+	}
+
+	if (buffer == IPC_BUFFER_NONE) {
+		g_pool_stats.exhausted++;
+	} else {
+		g_pool_refs[buffer] = 1;
+		g_pool_sizes[buffer] = size;
+		g_pool_stats.allocs++;
+		if (++g_pool_stats.in_use > g_pool_stats.peak) {
+			g_pool_stats.peak = g_pool_stats.in_use;
+		}
+	}
+
+	portEXIT_CRITICAL(&g_pool_lock);
+
+	return buffer;
+}
+
+
+uint8_t *ipc_buffer_data (ipc_buffer_t buffer) {
+	if (buffer < TASK_POOL_SMALL_COUNT) {
+		return g_pool_small[buffer];
+	}
+	return g_pool_large[buffer - TASK_POOL_SMALL_COUNT];
+}
+
+
+size_t ipc_buffer_size (ipc_buffer_t buffer) {
+	return g_pool_sizes[buffer];
+}
+
+
+void ipc_buffer_retain (ipc_buffer_t buffer) {
+	portENTER_CRITICAL(&g_pool_lock);
+	g_pool_refs[buffer]++;
+	portEXIT_CRITICAL(&g_pool_lock);
+}
+
+
+void ipc_buffer_release (ipc_buffer_t buffer) {
+	if (buffer == IPC_BUFFER_NONE) {
+		return;
+	}
+
+	portENTER_CRITICAL(&g_pool_lock);
+
+	// Return the buffer to its free stack with the last reference
+	if (--g_pool_refs[buffer] == 0) {
+		if (buffer < TASK_POOL_SMALL_COUNT) {
+			g_pool_free_small[g_pool_n_small++] = buffer;
+		} else {
+			g_pool_free_large[g_pool_n_large++] = buffer;
+		}
+		g_pool_stats.in_use--;
+	}
+
+	portEXIT_CRITICAL(&g_pool_lock);
+}
+
+
+void ipc_pool_stats (ipc_pool_stats_t *stats) {
+	portENTER_CRITICAL(&g_pool_lock);
+	*stats = g_pool_stats;
+	portEXIT_CRITICAL(&g_pool_lock);
+}
+
+
+esp_err_t ipc_send (uint8_t channel, ipc_buffer_t buffer) {
+	return ipc_put(channel, buffer, false);
+}
+
+
+esp_err_t ipc_send_msg (uint8_t channel, const msg_t *msg) {
+	msg_stream_t stream = {.channel = channel};
+	size_t z = msg_size(msg);
+	ipc_buffer_t buffer;
+
+	if (z == 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if ((buffer = ipc_buffer_alloc(z)) == IPC_BUFFER_NONE) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	// The sequence number is stamped once the frame is in line
+	msg_pack_into(msg, &stream, ipc_buffer_data(buffer), z);
+
+	return ipc_put(channel, buffer, true);
+}
+
+
+uint16_t ipc_sequence (uint8_t channel) {
+	ipc_queue_t *queue = g_tx_queues + channel;
+	uint16_t seq;
+
+	portENTER_CRITICAL(&queue->lock);
+	seq = queue->stream.seq;
+	portEXIT_CRITICAL(&queue->lock);
+
+	return seq;
+}
+
+
+
+ipc_buffer_t ipc_next (uint8_t *channel) {
+	ipc_buffer_t buffer = IPC_BUFFER_NONE;
+	uint8_t lo, hi, priority, *cursor, *credit;
+
+	while (buffer == IPC_BUFFER_NONE) {
+
+		// Find the most urgent lane with frames queued
+		for (lo = 0; lo < MSG_CHANNEL_MAX && ipc_pending(g_tx_order[lo]) == 0;
+			++lo);
+		if (lo == MSG_CHANNEL_MAX) {
+			return IPC_BUFFER_NONE;
+		}
+
+		// Find the channels of the lane (adjacent in the service order)
+		priority = g_ipc_channels[g_tx_order[lo]].priority;
+		while (lo > 0 && g_ipc_channels[g_tx_order[lo - 1]].priority == 
+			priority) {
+			lo--;
+		}
+		for (hi = lo + 1; hi < MSG_CHANNEL_MAX && 
+			g_ipc_channels[g_tx_order[hi]].priority == priority; ++hi);
+
+		// Pass the turn on if the channel used its window or has nothing left
+		cursor = g_tx_cursor + lo;
+		credit = g_tx_credit + lo;
+		if (*cursor < lo || *cursor >= hi || *credit == 0 ||
+			ipc_pending(g_tx_order[*cursor]) == 0) {
+			if (*cursor < lo || *cursor >= hi) {
+				*cursor = hi - 1;
+			}
+			do {
+				*cursor = (*cursor + 1 >= hi) ? lo : *cursor + 1;
+			} while (ipc_pending(g_tx_order[*cursor]) == 0);
+			*credit = g_ipc_channels[g_tx_order[*cursor]].window;
+		}
+
+		// Take a frame (none if all those queued were past their deadline)
+		*channel = g_tx_order[*cursor];
+		(*credit)--;
+		buffer = ipc_receive(*channel);
+	}
+
+	return buffer;
+}
+
+
+ipc_buffer_t ipc_receive (uint8_t channel) {
+	ipc_queue_t *queue = g_tx_queues + channel;
+	ipc_buffer_t buffer;
+	uint32_t now = ipc_now();
+	int expired;
+
+	// Skip over the frames past their deadline
+	do {
+		buffer = IPC_BUFFER_NONE;
+
+		portENTER_CRITICAL(&queue->lock);
+		ring_get(&queue->ring, NULL, &buffer, sizeof(buffer));
+		if ((expired = (buffer != IPC_BUFFER_NONE && 
+			ipc_expired(channel, buffer, now)))) {
+			queue->stats.expired++;
+		} else if (buffer != IPC_BUFFER_NONE) {
+			ipc_account(queue, g_pool_sizes[buffer], 
+				now - g_pool_times[buffer]);
+		}
+		portEXIT_CRITICAL(&queue->lock);
+
+		if (expired) {
+			ipc_buffer_release(buffer);
+		}
+	} while (expired);
+
+	return buffer;
+}
+
+
+size_t ipc_queue_stats (ipc_queue_t *queue, ipc_queue_stats_t *stats) {
+	size_t count;
+
+	portENTER_CRITICAL(&queue->lock);
+	*stats = queue->stats;
+	count = queue->ring.count;
+	portEXIT_CRITICAL(&queue->lock);
+
+	return count;
+}
+
+
+size_t ipc_pending (uint8_t channel) {
+	ipc_queue_t *queue = g_tx_queues + channel;
+	size_t count;
+
+	portENTER_CRITICAL(&queue->lock);
+	count = queue->ring.count;
+	portEXIT_CRITICAL(&queue->lock);
+
+	return count;
+}
+
+
+int ipc_full (uint8_t channel) {
+	ipc_queue_t *queue = g_tx_queues + channel;
+	int full;
+
+	portENTER_CRITICAL(&queue->lock);
+	full = !ring_fits(&queue->ring, sizeof(ipc_buffer_t));
+	portEXIT_CRITICAL(&queue->lock);
+
+	return full;
 }
@@ -1,4 +1,6 @@
 #include "msg.h"
+#include "err.h"
+#include "esp_timer.h"
 
 
 /*
@@ -8,355 +10,434 @@
 */
 
 
-// Update this table with new message sizes as necessary
-size_t g_msg_size_tab[MSG_TYPE_MAX] = {
-    [MSG_TYPE_STATUS]          = 1,           // 1B status
-    [MSG_TYPE_TRAIN_DATA]      = 160,         // 2 * (40 + 20 + 20)
-    [MSG_TYPE_SAMPLE_DATA]     = 1 + 2 + 2,   // 1B label + 2B (amp/period)
-    [MSG_TYPE_INSTRUCTION]     = 1,           // 1B inst
-    [MSG_TYPE_CONFIGURATION]   = 1 + 2,       // 1B comp, 2B value
+// Update this table as new messages are introduced or removed
+const char *g_inst_str_tab[INST_TYPE_MAX] = {
+	[INST_EKG_STOP]       = "INST_EKG_STOP",
+	[INST_EKG_START]      = "INST_EKG_START",
+	[INST_EKG_CONFIGURE]  = "INST_EKG_CONFIGURE",
+	[INST_EKG_BENCHMARK]  = "INST_EKG_BENCHMARK",
+	[INST_EKG_WAVE_START] = "INST_EKG_WAVE_START",
+	[INST_EKG_WAVE_STOP]  = "INST_EKG_WAVE_STOP",
+	[INST_EKG_TELEMETRY]  = "INST_EKG_TELEMETRY"
 };
 
 
-// Update this table as new messages are introduced or removed
-const char *g_inst_str_tab[INST_TYPE_MAX] = {
-	[INST_EKG_STOP]      = "INST_EKG_STOP",
-	[INST_EKG_START]     = "INST_EKG_START",
-	[INST_EKG_CONFIGURE] = "INST_EKG_CONFIGURE"
+// CRC-16/CCITT lookup table (polynomial 0x1021)
+static const uint16_t g_crc_tab[256] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+	0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+	0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+	0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+	0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+	0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+	0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+	0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+	0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+	0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+	0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+	0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+	0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+	0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+	0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+	0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+	0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+	0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+	0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+	0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+	0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+	0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+	0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+	0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+	0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+	0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+	0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+	0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+	0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+	0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+	0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
 };
 
 
 /*
  *******************************************************************************
- *                          Message Packing Functions                          *
+ *                        Internal Function Definitions                        *
  *******************************************************************************
 */
 
 
-// Packs the status message
-size_t pack_msg_status (msg_t *msg, uint8_t *buffer) {
-	size_t z = 0;
+// Computes the CRC-16/CCITT (initial value 0xFFFF) of a buffer
+static uint16_t crc16 (const uint8_t *buffer, size_t len) {
+	uint16_t crc = 0xFFFF;
 
-	// Pack status
-	buffer[z++] = msg->body.msg_status.status;
+	while (len-- > 0) {
+		crc = (crc << 8) ^ g_crc_tab[(crc >> 8) ^ *buffer++];
+	}
 
-	return z;
+	return crc;
 }
 
 
-// Packs the Training data
-size_t pack_msg_train_data (msg_t *msg, uint8_t *buffer) {
-	size_t z = 0;
-
-	// Pack n_periods[20]
-	memcpy(buffer + z, msg->body.msg_train.n_periods, 20 * sizeof(uint16_t));
-	z += (2 * 20);
-
-	// Pack n_amplitudes[20]
-	memcpy(buffer + z, msg->body.msg_train.n_amplitudes, 20 * sizeof(uint16_t));
-	z += (2 * 20);
-
-
-	// Pack a_periods[10]
-	memcpy(buffer + z, msg->body.msg_train.a_periods, 10 * sizeof(uint16_t));
-	z += (2 * 10);
-
-	// Pack a_amplitudes[10]
-	memcpy(buffer + z, msg->body.msg_train.a_amplitudes, 10 * sizeof(uint16_t));
-	z += (2 * 10);
-
+/* Checks for a frame at the start of a buffer. Returns the size of the frame,
+ * zero if the buffer holds only part of it, -1 if no frame starts here, or -2
+ * if the frame is corrupt
+*/
+static int frame_size (const uint8_t *buffer, size_t len) {
+	size_t z;
 
-	// Pack v_periods[10]
-	memcpy(buffer + z, msg->body.msg_train.v_periods, 10 * sizeof(uint16_t));
-	z += (2 * 10);
+	// Check the markers as far as they were received
+	if ((len > 0 && buffer[0] != MSG_BYTE_HEAD) || 
+		(len > 1 && buffer[1] != MSG_BYTE_HEAD)) {
+		return -1;
+	}
+	if (len < MSG_HEADER_SIZE) {
+		return 0;
+	}
 
-	// Pack v_amplitudes[10]
-	memcpy(buffer + z, msg->body.msg_train.v_amplitudes, 10 * sizeof(uint16_t));
-	z += (2 * 10);
+	// Lengths over the largest frame can't be valid
+	z = MSG_HEADER_SIZE + msg_read_u16(buffer + 10) + MSG_TRAILER_SIZE;
+	if (z > MSG_BUFFER_MAX) {
+		return -1;
+	}
+	if (len < z) {
+		return 0;
+	}
 
+	// The CRC covers everything after the markers
+	if (crc16(buffer + 2, z - 4) != msg_read_u16(buffer + z - 2)) {
+		return -2;
+	}
 
 	return z;
 }
 
 
-// Packs the Sample data
-size_t pack_msg_sample_data (msg_t *msg, uint8_t *buffer) {
-	size_t z = 0;
-
-	// Pack the label
-	buffer[z++] = (msg->body.msg_sample.label);
+/* Counts frames lost or reordered, given the channel and sequence number of a
+ * new frame. Returns false for a frame seen before (a duplicate, when the
+ * device sent notifications again after a loss), which is dropped
+*/
+static bool parser_track (msg_parser_t *parser, uint8_t channel, 
+	uint16_t seq) {
+	uint16_t ahead = seq - parser->seq[channel];
+	uint8_t synced = parser->synced & (1 << channel);
+	uint8_t *seen = parser->seen[channel];
+	uint8_t bit = 1 << (seq % 8);
+	uint8_t *byte = seen + (seq % MSG_PARSER_WINDOW) / 8;
+
+	// A frame more than half the sequence space ahead is behind instead
+	if (synced && ahead >= 0x8000) {
+		if ((uint16_t)-ahead <= MSG_PARSER_WINDOW && (*byte & bit)) {
+			parser->duplicates++;
+			return false;
+		}
+		if ((uint16_t)-ahead <= MSG_PARSER_WINDOW) {
+			*byte |= bit;
+		}
+		parser->reordered++;
+		return true;
+	}
+	if (synced) {
+		parser->lost += ahead;
+	}
 
-	// Pack the amplitude
-	buffer[z++] = (msg->body.msg_sample.amplitude >> 0) & 0xFF;
-	buffer[z++] = (msg->body.msg_sample.amplitude >> 8) & 0xFF;
+	// Forget the frames the window moves past
+	if (!synced || ahead >= MSG_PARSER_WINDOW) {
+		memset(seen, 0, MSG_PARSER_WINDOW / 8);
+	} else {
+		for (uint16_t s = parser->seq[channel]; s != seq; ++s) {
+			seen[(s % MSG_PARSER_WINDOW) / 8] &= ~(1 << (s % 8));
+		}
+	}
+	*byte |= bit;
 
-	// Pack the period
-	buffer[z++] = (msg->body.msg_sample.period >> 0) & 0xFF;
-	buffer[z++] = (msg->body.msg_sample.period >> 8) & 0xFF;
+	parser->synced |= (1 << channel);
+	parser->seq[channel] = seq + 1;
 
-	return z;
+	return true;
 }
 
 
-// Packs an Instruction data message
-size_t pack_msg_instruction (msg_t *msg, uint8_t *buffer) {
-	size_t z = 0;
+// Accepts the complete frames buffered by a parser and drops invalid data
+static size_t parser_scan (msg_parser_t *parser, msg_frame_handler_t handler,
+	void *ctx) {
+	size_t offset = 0, frames = 0;
+	const uint8_t *head;
+	msg_view_t view;
+	esp_err_t err;
+	int z;
 
-	// Pack the instruction
-	buffer[z++] = msg->body.msg_instruction.inst;
+	while (offset < parser->len) {
 
-	return z;
-}
+		// Skip straight to the next marker
+		if ((head = memchr(parser->buffer + offset, MSG_BYTE_HEAD, 
+			parser->len - offset)) == NULL) {
+			parser->skipped += parser->len - offset;
+			offset = parser->len;
+			break;
+		}
+		parser->skipped += (head - parser->buffer) - offset;
+		offset = head - parser->buffer;
 
+		// Wait for the rest of a partial frame
+		if ((z = frame_size(head, parser->len - offset)) == 0) {
+			break;
+		}
 
-// Packs a Configuration data message
-size_t pack_msg_configuration (msg_t *msg, uint8_t *buffer) {
-	size_t z = 0;
+		// Resume the search one byte on if no intact frame starts here
+		if (z < 0) {
+			parser->crc_errors += (z == -2);
+			parser->skipped++;
+			offset++;
+			continue;
+		}
 
-	// Pack the comparator
-	buffer[z++] = msg->body.msg_configuration.cfg_comp;
+		// Intact frames of unknown type (or too small for it) are dropped
+		if ((err = msg_parse(&view, head, z)) == ESP_OK) {
+			if (parser_track(parser, view.channel, view.seq)) {
+				parser->frames++;
+				frames++;
+				handler(&view, ctx);
+			}
+		} else {
+			ESP_LOGW("MSG", "Dropping frame: %s", E2S(err));
+		}
+		offset += z;
+	}
 
-	// Pack the threshold
-	buffer[z++] = (msg->body.msg_configuration.cfg_val >> 0) & 0xFF;
-	buffer[z++] = (msg->body.msg_configuration.cfg_val >> 8) & 0xFF;
+	// Keep the unprocessed bytes
+	memmove(parser->buffer, parser->buffer + offset, parser->len - offset);
+	parser->len -= offset;
 
-	return z;
+	return frames;
 }
 
 
 /*
  *******************************************************************************
- *                         Message Unpacking Functions                         *
+ *                        External Function Definitions                        *
  *******************************************************************************
 */
 
 
-// Unpacks the status message
-void unpack_msg_status (msg_t *msg, uint8_t *buffer) {
-	size_t offset = 0;
-
-	// Unpack the status
-	msg->body.msg_status.status = buffer[offset++];
-}
+size_t msg_size (const msg_t *msg) {
+	const msg_codec_t *codec;
 
+	if (msg->type >= MSG_TYPE_MAX) {
+		return 0;
+	}
+	codec = g_msg_codec_tab + msg->type;
 
-// Unpacks the training data
-void unpack_msg_train_data (msg_t *msg, uint8_t *buffer) {
-	size_t offset = 0;
-
-	// Unpack n_periods[20]
-	memcpy(msg->body.msg_train.n_periods, buffer + offset, 
-		20 * sizeof(uint16_t));
-	offset += (2 * 20);
+	return MSG_HEADER_SIZE + codec->size + 
+		((codec->extra == NULL) ? 0 : codec->extra(msg)) + MSG_TRAILER_SIZE;
+}
 
-	// Unpack n_amplitudes[20]
-	memcpy(msg->body.msg_train.n_amplitudes, buffer + offset, 
-		20 * sizeof(uint16_t));
-	offset += (2 * 20);
 
-	// Unpack a_periods[10]
-	memcpy(msg->body.msg_train.a_periods, buffer + offset,
-		10 * sizeof(uint16_t));
-	offset += (2 * 10);
+size_t msg_pack_into (const msg_t *msg, msg_stream_t *stream, uint8_t *buffer,
+	size_t cap) {
+	size_t z = msg_size(msg);
+	uint16_t crc, seq = (stream == NULL) ? 0 : stream->seq;
+	uint8_t channel = (stream == NULL) ? MSG_CHANNEL_CONTROL : stream->channel;
+	uint32_t time = esp_timer_get_time() / 1000;
 
-	// Unpack a_amplitudes[10]
-	memcpy(msg->body.msg_train.a_amplitudes, buffer + offset,
-		10 * sizeof(uint16_t));
-	offset += (2 * 10);
+	// Unknown types and messages larger than the slot are not packed
+	if (z == 0 || z > cap) {
+		ESP_LOGE("MSG", "Can't pack message type %d (%u bytes) into %u bytes",
+			msg->type, z, cap);
+		return 0;
+	}
 
-	// Unpack v_periods[10]
-	memcpy(msg->body.msg_train.v_periods, buffer + offset,
-		10 * sizeof(uint16_t));
-	offset += (2 * 10);
+	// Insert leading byte markers
+	buffer[0] = buffer[1] = MSG_BYTE_HEAD;
 
-	// Unpack v_amplitudes[10]
-	memcpy(msg->body.msg_train.v_amplitudes, buffer + offset,
-		10 * sizeof(uint16_t));
-	offset += (2 * 10);
-}
+	// Insert the message type
+	buffer[2] = msg->type;
 
+	// Insert the channel, sequence number and time
+	buffer[3] = channel;
+	buffer[4] = seq & 0xFF;
+	buffer[5] = (seq >> 8) & 0xFF;
+	for (int i = 0; i < 4; ++i) {
+		buffer[6 + i] = (time >> (8 * i)) & 0xFF;
+	}
 
-// Unpacks the sample data
-void unpack_msg_sample_data (msg_t *msg, uint8_t *buffer) {
-	size_t offset = 0;
-	uint8_t label;
-	uint16_t amplitude, period;
+	// Invoke the packing procedure of the type, then insert its length
+	z = g_msg_codec_tab[msg->type].pack(msg, buffer + MSG_HEADER_SIZE);
+	buffer[10] = z & 0xFF;
+	buffer[11] = (z >> 8) & 0xFF;
+	z += MSG_HEADER_SIZE;
 
-	// Unpack the label
-	label = buffer[offset++];
-	msg->body.msg_sample.label = label;
+	// Append the CRC
+	crc = crc16(buffer + 2, z - 2);
+	buffer[z++] = crc & 0xFF;
+	buffer[z++] = (crc >> 8) & 0xFF;
 
-	// Unpack the amplitude
-	amplitude = buffer[offset++]; amplitude <<= 8;
-	amplitude |= buffer[offset++]; amplitude <<= 8;
-	msg->body.msg_sample.amplitude = amplitude;
+	// Advance the stream
+	if (stream != NULL) {
+		stream->seq++;
+	}
 
-	// Unpack the period
-	period = buffer[offset++]; period <<= 8;
-	period |= buffer[offset++]; period <<= 8;
-	msg->body.msg_sample.period = period;
+	return z;
 }
 
 
-// Unpacks an Instruction data message
-void unpack_msg_instruction (msg_t *msg, uint8_t *buffer) {
-	size_t offset = 0;
-	uint8_t inst = 0;
-
-	// Unpack the instruction
-	inst = buffer[offset++];
-	msg->body.msg_instruction.inst = inst;
+size_t msg_pack (msg_t *msg, uint8_t *buffer) {
+	return msg_pack_into(msg, NULL, buffer, MSG_BUFFER_MAX);
 }
 
 
-// Unpacks a Configuration data message
-void unpack_msg_configuration (msg_t *msg, uint8_t *buffer) {
-	size_t offset = 0;
-	uint8_t cfg_comp = 0;
-	uint16_t cfg_val = 0;
+void msg_restamp (uint8_t *buffer, size_t len, msg_stream_t *stream) {
+	uint16_t crc;
 
-	// Unpack the comparator
-	cfg_comp = buffer[offset++];
-	msg->body.msg_configuration.cfg_comp = cfg_comp;
+	// Rewrite the channel and sequence number, then the CRC covering them
+	buffer[3] = stream->channel;
+	buffer[4] = stream->seq & 0xFF;
+	buffer[5] = (stream->seq >> 8) & 0xFF;
+	crc = crc16(buffer + 2, len - 4);
+	buffer[len - 2] = crc & 0xFF;
+	buffer[len - 1] = (crc >> 8) & 0xFF;
 
-	// Unpack the threshold
-	cfg_val = buffer[offset++]; cfg_val <<= 8;
-	cfg_val |= buffer[offset++];
-	msg->body.msg_configuration.cfg_val = cfg_val;
+	stream->seq++;
 }
 
 
-/*
- *******************************************************************************
- *                        External Function Definitions                        *
- *******************************************************************************
-*/
-
+size_t msg_to_v1 (const uint8_t *frame, size_t len, uint8_t *buffer) {
+	size_t z = len - MSG_HEADER_SIZE - MSG_TRAILER_SIZE;
 
-size_t msg_pack (msg_t *msg, uint8_t *buffer) {
+	// Keep the markers and type, and the body right after them (the frame
+	// may be converted in place)
+	memmove(buffer, frame, MSG_V1_HEADER_SIZE);
+	memmove(buffer + MSG_V1_HEADER_SIZE, frame + MSG_HEADER_SIZE, z);
 
-	// Size is set to offset 2 for marker bytes + type
-	size_t z = 3;
+	return MSG_V1_HEADER_SIZE + z;
+}
 
-	// Insert leading byte markers (offset += 2)
-	buffer[0] = buffer[1] = MSG_BYTE_HEAD;
 
-	// Insert the message type (offset += 1)
-	buffer[2] = msg->type;
+esp_err_t msg_parse (msg_view_t *view, const uint8_t *buffer, size_t len) {
+	uint8_t type;
+	int z;
 
+	// Check the frame
+	if ((z = frame_size(buffer, len)) == 0) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	if (z == -1) {
+		return ESP_FAIL;
+	}
+	if (z == -2) {
+		return ESP_ERR_INVALID_CRC;
+	}
 
-	// Invoke switched packing procedure
-	switch (msg->type) {
+	// Check type and channel
+	if ((type = buffer[2]) >= MSG_TYPE_MAX || buffer[3] >= MSG_CHANNEL_MAX) {
+		return ESP_ERR_INVALID_STATE;
+	}
 
-		case MSG_TYPE_STATUS: {
-			z += pack_msg_status(msg, buffer + z);
-		}
-		break;
+	// Check if the body is large enough to parse the type
+	if (g_msg_codec_tab[type].size > (size_t)z - MSG_HEADER_SIZE - 
+		MSG_TRAILER_SIZE) {
+		return ESP_ERR_INVALID_SIZE;
+	}
 
-		case MSG_TYPE_TRAIN_DATA: {
-			z += pack_msg_train_data(msg, buffer + z);
-		}
-		break;
+	*view = (msg_view_t) {
+		.type = type,
+		.body = buffer + MSG_HEADER_SIZE,
+		.size = z - MSG_HEADER_SIZE - MSG_TRAILER_SIZE,
+		.channel = buffer[3],
+		.seq     = msg_read_u16(buffer + 4),
+		.time    = msg_read_u32(buffer + 6)
+	};
 
-		case MSG_TYPE_SAMPLE_DATA: {
-			z += pack_msg_sample_data(msg, buffer + z);
-		}
-		break;
+	return ESP_OK;
+}
 
-		case MSG_TYPE_INSTRUCTION: {
-			z += pack_msg_instruction(msg, buffer + z);
-		}
-		break;
 
-		case MSG_TYPE_CONFIGURATION: {
-			z += pack_msg_configuration(msg, buffer + z);
-		}
-		break;
+esp_err_t msg_parse_v1 (msg_view_t *view, const uint8_t *buffer, size_t len,
+	uint32_t types) {
+	uint8_t type;
 
-		default:
-		ESP_LOGE("MSG", "Unrecognized message type (%d)", msg->type);
-		break;
+	// Without a length, only the body size of the type tells a frame apart
+	if (len < MSG_V1_HEADER_SIZE || buffer[0] != MSG_BYTE_HEAD || 
+		buffer[1] != MSG_BYTE_HEAD || (type = buffer[2]) >= MSG_TYPE_MAX ||
+		((types & MSG_V1_TYPES) & (1 << type)) == 0 ||
+		g_msg_codec_tab[type].extra != NULL ||
+		len != MSG_V1_HEADER_SIZE + g_msg_codec_tab[type].size) {
+		return ESP_FAIL;
 	}
 
-	return z;
-}
+	*view = (msg_view_t) {
+		.type    = type,
+		.body    = buffer + MSG_V1_HEADER_SIZE,
+		.size    = len - MSG_V1_HEADER_SIZE,
+		.channel = MSG_CHANNEL_CONTROL
+	};
 
+	return ESP_OK;
+}
 
-esp_err_t msg_unpack (msg_t *msg, uint8_t *buffer, size_t len) {
-	static msg_t msg_cpy;
-	esp_err_t err = ESP_OK;
 
-	// Clear out the persistent (static) msg_cpy buffer
-	memset(&msg_cpy, 0, sizeof(msg_cpy));
+esp_err_t msg_decode (msg_t *msg, const msg_view_t *view) {
+	msg->type = view->type;
+	return g_msg_codec_tab[view->type].unpack(msg, view->body, view->size);
+}
 
-	// Set initial known offset (two header bytes + type)
-	size_t offset = 3;
 
-	// Length must be at least 3 bytes: [Head,Head,Type]
-	if (len < 3) {
-		printf("size check 1: %u < 3\n", len);
-		return ESP_ERR_INVALID_SIZE;
-	}
+esp_err_t msg_unpack (msg_t *msg, uint8_t *buffer, size_t len) {
+	msg_view_t view;
+	esp_err_t err;
 
-	// Check header
-	if (buffer[0] != MSG_BYTE_HEAD || buffer[1] != MSG_BYTE_HEAD) {
-		return ESP_FAIL;
+	if ((err = msg_parse(&view, buffer, len)) != ESP_OK) {
+		return err;
 	}
 
-	// Check type
-	if ((msg_cpy.type = buffer[2]) > MSG_TYPE_MAX) {
-		return ESP_ERR_INVALID_STATE;
-	}
+	return msg_decode(msg, &view);
+}
 
-	// Check if enough data remains to parse the type
-	if (g_msg_size_tab[msg_cpy.type] > (len - offset)) {
-		printf("size check 2: %u > %u\n", g_msg_size_tab[msg_cpy.type], (len - offset));
-		return ESP_ERR_INVALID_SIZE;
-	}
 
-	// Parse on type (TODO: Use a function table instead)
-	switch (msg_cpy.type) {
-		case MSG_TYPE_STATUS: {
-			unpack_msg_status(&msg_cpy, buffer + offset);
-		}
-		break;
+void msg_parser_reset (msg_parser_t *parser) {
+	parser->len = 0;
+	parser->synced = 0;
+}
 
-		case MSG_TYPE_TRAIN_DATA: {
-			unpack_msg_train_data(&msg_cpy, buffer + offset);
-		}
-		break;
 
-		case MSG_TYPE_SAMPLE_DATA: {
-			unpack_msg_sample_data(&msg_cpy, buffer + offset);
-		}
-		break;
+size_t msg_parser_feed (msg_parser_t *parser, const uint8_t *buffer, 
+	size_t len, msg_frame_handler_t handler, void *ctx) {
+	size_t frames = 0, z;
 
-		case MSG_TYPE_INSTRUCTION: {
-			unpack_msg_instruction(&msg_cpy, buffer + offset);
-		}
-		break;
+	while (len > 0) {
 
-		case MSG_TYPE_CONFIGURATION: {
-			unpack_msg_configuration(&msg_cpy, buffer + offset);
-		}
-		break;
+		// Buffer as much as fits (a full buffer always holds a frame or junk)
+		z = sizeof(parser->buffer) - parser->len;
+		z = (len > z) ? z : len;
+		memcpy(parser->buffer + parser->len, buffer, z);
+		parser->len += z;
+		buffer += z;
+		len -= z;
 
-		default:
-			err = ESP_FAIL;
-		break;
+		frames += parser_scan(parser, handler, ctx);
 	}
 
+	return frames;
+}
+
 
-	// Finally update the supplied message pointer
-	memcpy(msg, &msg_cpy, sizeof(msg_t));
+size_t msg_parser_feed_write (msg_parser_t *parser, const uint8_t *buffer,
+	size_t len, uint32_t types, msg_frame_handler_t handler, void *ctx) {
+	msg_view_t view;
 
+	// Version 1 frames come one per write, never behind part of a frame
+	if (parser->len == 0 && msg_parse_v1(&view, buffer, len, types) == 
+		ESP_OK) {
+		parser->frames++;
+		handler(&view, ctx);
+		return 1;
+	}
 
-	return err;
+	return msg_parser_feed(parser, buffer, len, handler, ctx);
 }
 
 
 const char *inst_to_str (msg_instruction_type_t type) {
-	if (type < 0 || type > INST_TYPE_MAX) {
+	if (type < 0 || type >= INST_TYPE_MAX) {
 		return "<Invalid>";
 	}
 	return g_inst_str_tab[type];
@@ -0,0 +1,1017 @@
+#include "msg.h"
+
+
+/*
+ *******************************************************************************
+ *           Generated by tools/msggen.py from tools/msg_schema.json           *
+ *                            Do not edit this file                            *
+ *******************************************************************************
+*/
+
+
+/*
+ *******************************************************************************
+ *                          Message Packing Functions                          *
+ *******************************************************************************
+*/
+
+
+// Packs a status message
+size_t pack_msg_status (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = msg->body.msg_status.status;
+
+	return z;
+}
+
+
+// Packs a train data message
+size_t pack_msg_train_data (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	for (size_t i = 0; i < 20; ++i) {
+		buffer[z++] = (msg->body.msg_train.n_periods[i] >> 0) & 0xFF;
+		buffer[z++] = (msg->body.msg_train.n_periods[i] >> 8) & 0xFF;
+	}
+	for (size_t i = 0; i < 20; ++i) {
+		buffer[z++] = (msg->body.msg_train.n_amplitudes[i] >> 0) & 0xFF;
+		buffer[z++] = (msg->body.msg_train.n_amplitudes[i] >> 8) & 0xFF;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		buffer[z++] = (msg->body.msg_train.a_periods[i] >> 0) & 0xFF;
+		buffer[z++] = (msg->body.msg_train.a_periods[i] >> 8) & 0xFF;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		buffer[z++] = (msg->body.msg_train.a_amplitudes[i] >> 0) & 0xFF;
+		buffer[z++] = (msg->body.msg_train.a_amplitudes[i] >> 8) & 0xFF;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		buffer[z++] = (msg->body.msg_train.v_periods[i] >> 0) & 0xFF;
+		buffer[z++] = (msg->body.msg_train.v_periods[i] >> 8) & 0xFF;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		buffer[z++] = (msg->body.msg_train.v_amplitudes[i] >> 0) & 0xFF;
+		buffer[z++] = (msg->body.msg_train.v_amplitudes[i] >> 8) & 0xFF;
+	}
+
+	return z;
+}
+
+
+// Packs a sample data message
+size_t pack_msg_sample_data (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = msg->body.msg_sample.label;
+	buffer[z++] = (msg->body.msg_sample.amplitude >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_sample.amplitude >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_sample.period >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_sample.period >> 8) & 0xFF;
+
+	return z;
+}
+
+
+// Packs a instruction message
+size_t pack_msg_instruction (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = msg->body.msg_instruction.inst;
+
+	return z;
+}
+
+
+// Packs a configuration message
+size_t pack_msg_configuration (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = msg->body.msg_configuration.cfg_comp;
+	buffer[z++] = (msg->body.msg_configuration.cfg_val >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_configuration.cfg_val >> 8) & 0xFF;
+
+	return z;
+}
+
+
+// Packs a model data message
+size_t pack_msg_model_data (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = msg->body.msg_model.model;
+	buffer[z++] = msg->body.msg_model.size;
+	for (size_t i = 0; i < msg->body.msg_model.size; ++i) {
+		buffer[z++] = msg->body.msg_model.data[i];
+	}
+
+	return z;
+}
+
+
+// Packs a feedback message
+size_t pack_msg_feedback (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = msg->body.msg_feedback.label;
+	buffer[z++] = (msg->body.msg_feedback.amplitude >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_feedback.amplitude >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_feedback.period >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_feedback.period >> 8) & 0xFF;
+
+	return z;
+}
+
+
+// Packs a escalation message
+size_t pack_msg_escalation (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = msg->body.msg_escalation.label;
+	buffer[z++] = msg->body.msg_escalation.confidence;
+	buffer[z++] = (msg->body.msg_escalation.amplitude >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_escalation.amplitude >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_escalation.period >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_escalation.period >> 8) & 0xFF;
+	buffer[z++] = msg->body.msg_escalation.n_samples;
+	for (size_t i = 0; i < msg->body.msg_escalation.n_samples; ++i) {
+		buffer[z++] = (msg->body.msg_escalation.samples[i] >> 0) & 0xFF;
+		buffer[z++] = (msg->body.msg_escalation.samples[i] >> 8) & 0xFF;
+	}
+
+	return z;
+}
+
+
+// Packs a summary message
+size_t pack_msg_summary (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = (msg->body.msg_summary.count >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_summary.count >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_summary.amplitude >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_summary.amplitude >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_summary.period >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_summary.period >> 8) & 0xFF;
+
+	return z;
+}
+
+
+// Packs a policy message
+size_t pack_msg_policy (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = msg->body.msg_policy.enabled;
+	buffer[z++] = msg->body.msg_policy.min_confidence;
+	buffer[z++] = msg->body.msg_policy.snippet_len;
+	buffer[z++] = msg->body.msg_policy.summary_blocks;
+
+	return z;
+}
+
+
+// Packs a sample batch message
+size_t pack_msg_sample_batch (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = (msg->body.msg_sample_batch.timestamp >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_sample_batch.timestamp >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_sample_batch.timestamp >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_sample_batch.timestamp >> 24) & 0xFF;
+	buffer[z++] = msg->body.msg_sample_batch.n_beats;
+	for (size_t i = 0; i < msg->body.msg_sample_batch.n_beats; ++i) {
+		buffer[z++] = msg->body.msg_sample_batch.labels[i];
+	}
+	for (size_t i = 0; i < msg->body.msg_sample_batch.n_beats; ++i) {
+		buffer[z++] = (msg->body.msg_sample_batch.amplitudes[i] >> 0) & 0xFF;
+		buffer[z++] = (msg->body.msg_sample_batch.amplitudes[i] >> 8) & 0xFF;
+	}
+	for (size_t i = 0; i < msg->body.msg_sample_batch.n_beats; ++i) {
+		buffer[z++] = (msg->body.msg_sample_batch.periods[i] >> 0) & 0xFF;
+		buffer[z++] = (msg->body.msg_sample_batch.periods[i] >> 8) & 0xFF;
+	}
+
+	return z;
+}
+
+
+// Packs a batching message
+size_t pack_msg_batching (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = msg->body.msg_batching.count;
+	buffer[z++] = (msg->body.msg_batching.age >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_batching.age >> 8) & 0xFF;
+	buffer[z++] = msg->body.msg_batching.encoding;
+	buffer[z++] = msg->body.msg_batching.keyframe;
+
+	return z;
+}
+
+
+// Packs a beat stream message
+size_t pack_msg_beat_stream (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = (msg->body.msg_beat_stream.timestamp >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_beat_stream.timestamp >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_beat_stream.timestamp >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_beat_stream.timestamp >> 24) & 0xFF;
+	buffer[z++] = msg->body.msg_beat_stream.keyframe;
+	buffer[z++] = msg->body.msg_beat_stream.n_beats;
+	buffer[z++] = msg->body.msg_beat_stream.size;
+	for (size_t i = 0; i < msg->body.msg_beat_stream.size; ++i) {
+		buffer[z++] = msg->body.msg_beat_stream.data[i];
+	}
+
+	return z;
+}
+
+
+// Packs a waveform message
+size_t pack_msg_waveform (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = (msg->body.msg_waveform.timestamp >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_waveform.timestamp >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_waveform.timestamp >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_waveform.timestamp >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_waveform.first >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_waveform.first >> 8) & 0xFF;
+	buffer[z++] = msg->body.msg_waveform.k;
+	buffer[z++] = msg->body.msg_waveform.n_samples;
+	buffer[z++] = msg->body.msg_waveform.size;
+	for (size_t i = 0; i < msg->body.msg_waveform.size; ++i) {
+		buffer[z++] = msg->body.msg_waveform.data[i];
+	}
+
+	return z;
+}
+
+
+// Packs a hello message
+size_t pack_msg_hello (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = msg->body.msg_hello.version;
+	buffer[z++] = (msg->body.msg_hello.types >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_hello.types >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_hello.types >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_hello.types >> 24) & 0xFF;
+	buffer[z++] = msg->body.msg_hello.encodings;
+	buffer[z++] = msg->body.msg_hello.batch_max;
+	buffer[z++] = (msg->body.msg_hello.mtu >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_hello.mtu >> 8) & 0xFF;
+
+	return z;
+}
+
+
+// Packs a telemetry message
+size_t pack_msg_telemetry (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = msg->body.msg_telemetry.queue;
+	buffer[z++] = (msg->body.msg_telemetry.depth >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.depth >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.high_water >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.high_water >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.queued >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.queued >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.queued >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.queued >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.evicted >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.evicted >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.evicted >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.evicted >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.refused >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.refused >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.refused >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.refused >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.coalesced >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.coalesced >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.coalesced >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.coalesced >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.expired >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.expired >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.expired >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.expired >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.bytes >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.bytes >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.bytes >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_telemetry.bytes >> 24) & 0xFF;
+	for (size_t i = 0; i < MSG_LATENCY_BUCKETS; ++i) {
+		buffer[z++] = (msg->body.msg_telemetry.latency[i] >> 0) & 0xFF;
+		buffer[z++] = (msg->body.msg_telemetry.latency[i] >> 8) & 0xFF;
+		buffer[z++] = (msg->body.msg_telemetry.latency[i] >> 16) & 0xFF;
+		buffer[z++] = (msg->body.msg_telemetry.latency[i] >> 24) & 0xFF;
+	}
+
+	return z;
+}
+
+
+// Packs a log status message
+size_t pack_msg_log_status (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = (msg->body.msg_log_status.first >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_status.first >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_status.first >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_status.first >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_status.next >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_status.next >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_status.next >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_status.next >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_status.overwritten >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_status.overwritten >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_status.overwritten >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_status.overwritten >> 24) & 0xFF;
+
+	return z;
+}
+
+
+// Packs a log ack message
+size_t pack_msg_log_ack (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = (msg->body.msg_log_ack.next >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_ack.next >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_ack.next >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_log_ack.next >> 24) & 0xFF;
+
+	return z;
+}
+
+
+// Packs a link status message
+size_t pack_msg_link_status (const msg_t *msg, uint8_t *buffer) {
+	size_t z = 0;
+
+	buffer[z++] = (msg->body.msg_link_status.mtu >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.mtu >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.tx_len >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.tx_len >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.rx_len >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.rx_len >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.interval >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.interval >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.latency >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.latency >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.timeout >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.timeout >> 8) & 0xFF;
+	buffer[z++] = msg->body.msg_link_status.mode;
+	buffer[z++] = (msg->body.msg_link_status.sent >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.sent >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.sent >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.sent >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.deferred >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.deferred >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.deferred >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.deferred >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.rejected >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.rejected >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.rejected >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.rejected >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.failed >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.failed >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.failed >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.failed >> 24) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.congested >> 0) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.congested >> 8) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.congested >> 16) & 0xFF;
+	buffer[z++] = (msg->body.msg_link_status.congested >> 24) & 0xFF;
+
+	return z;
+}
+
+
+/*
+ *******************************************************************************
+ *                         Message Unpacking Functions                         *
+ *******************************************************************************
+*/
+
+
+// Unpacks a status message
+esp_err_t unpack_msg_status (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_status.status = buffer[offset++];
+
+	return ESP_OK;
+}
+
+
+// Unpacks a train data message
+esp_err_t unpack_msg_train_data (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	for (size_t i = 0; i < 20; ++i) {
+		msg->body.msg_train.n_periods[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+	for (size_t i = 0; i < 20; ++i) {
+		msg->body.msg_train.n_amplitudes[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		msg->body.msg_train.a_periods[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		msg->body.msg_train.a_amplitudes[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		msg->body.msg_train.v_periods[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		msg->body.msg_train.v_amplitudes[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+
+	return ESP_OK;
+}
+
+
+// Unpacks a sample data message
+esp_err_t unpack_msg_sample_data (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_sample.label = buffer[offset++];
+	msg->body.msg_sample.amplitude = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_sample.period = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+
+	return ESP_OK;
+}
+
+
+// Unpacks a instruction message
+esp_err_t unpack_msg_instruction (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_instruction.inst = buffer[offset++];
+
+	return ESP_OK;
+}
+
+
+// Unpacks a configuration message
+esp_err_t unpack_msg_configuration (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_configuration.cfg_comp = buffer[offset++];
+	msg->body.msg_configuration.cfg_val = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+
+	return ESP_OK;
+}
+
+
+// Unpacks a model data message
+esp_err_t unpack_msg_model_data (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+
+	msg->body.msg_model.model = buffer[offset++];
+	msg->body.msg_model.size = buffer[offset++];
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_model.size > MSG_MODEL_DATA_MAX ||
+		1 * (size_t)msg->body.msg_model.size > (len - offset)) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	for (size_t i = 0; i < msg->body.msg_model.size; ++i) {
+		msg->body.msg_model.data[i] = buffer[offset++];
+	}
+
+	return ESP_OK;
+}
+
+
+// Unpacks a feedback message
+esp_err_t unpack_msg_feedback (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_feedback.label = buffer[offset++];
+	msg->body.msg_feedback.amplitude = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_feedback.period = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+
+	return ESP_OK;
+}
+
+
+// Unpacks a escalation message
+esp_err_t unpack_msg_escalation (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+
+	msg->body.msg_escalation.label = buffer[offset++];
+	msg->body.msg_escalation.confidence = buffer[offset++];
+	msg->body.msg_escalation.amplitude = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_escalation.period = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_escalation.n_samples = buffer[offset++];
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_escalation.n_samples > MSG_SNIPPET_MAX ||
+		2 * (size_t)msg->body.msg_escalation.n_samples > (len - offset)) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	for (size_t i = 0; i < msg->body.msg_escalation.n_samples; ++i) {
+		msg->body.msg_escalation.samples[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+
+	return ESP_OK;
+}
+
+
+// Unpacks a summary message
+esp_err_t unpack_msg_summary (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_summary.count = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_summary.amplitude = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_summary.period = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+
+	return ESP_OK;
+}
+
+
+// Unpacks a policy message
+esp_err_t unpack_msg_policy (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_policy.enabled = buffer[offset++];
+	msg->body.msg_policy.min_confidence = buffer[offset++];
+	msg->body.msg_policy.snippet_len = buffer[offset++];
+	msg->body.msg_policy.summary_blocks = buffer[offset++];
+
+	return ESP_OK;
+}
+
+
+// Unpacks a sample batch message
+esp_err_t unpack_msg_sample_batch (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+
+	msg->body.msg_sample_batch.timestamp = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_sample_batch.n_beats = buffer[offset++];
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_sample_batch.n_beats > MSG_BATCH_MAX ||
+		1 * (size_t)msg->body.msg_sample_batch.n_beats > (len - offset)) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	for (size_t i = 0; i < msg->body.msg_sample_batch.n_beats; ++i) {
+		msg->body.msg_sample_batch.labels[i] = buffer[offset++];
+	}
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_sample_batch.n_beats > MSG_BATCH_MAX ||
+		2 * (size_t)msg->body.msg_sample_batch.n_beats > (len - offset)) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	for (size_t i = 0; i < msg->body.msg_sample_batch.n_beats; ++i) {
+		msg->body.msg_sample_batch.amplitudes[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_sample_batch.n_beats > MSG_BATCH_MAX ||
+		2 * (size_t)msg->body.msg_sample_batch.n_beats > (len - offset)) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	for (size_t i = 0; i < msg->body.msg_sample_batch.n_beats; ++i) {
+		msg->body.msg_sample_batch.periods[i] = buffer[offset] |
+			((uint16_t)buffer[offset + 1] << 8);
+		offset += 2;
+	}
+
+	return ESP_OK;
+}
+
+
+// Unpacks a batching message
+esp_err_t unpack_msg_batching (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_batching.count = buffer[offset++];
+	msg->body.msg_batching.age = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_batching.encoding = buffer[offset++];
+	msg->body.msg_batching.keyframe = buffer[offset++];
+
+	return ESP_OK;
+}
+
+
+// Unpacks a beat stream message
+esp_err_t unpack_msg_beat_stream (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+
+	msg->body.msg_beat_stream.timestamp = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_beat_stream.keyframe = buffer[offset++];
+	msg->body.msg_beat_stream.n_beats = buffer[offset++];
+	msg->body.msg_beat_stream.size = buffer[offset++];
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_beat_stream.size > MSG_STREAM_MAX ||
+		1 * (size_t)msg->body.msg_beat_stream.size > (len - offset)) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	for (size_t i = 0; i < msg->body.msg_beat_stream.size; ++i) {
+		msg->body.msg_beat_stream.data[i] = buffer[offset++];
+	}
+
+	return ESP_OK;
+}
+
+
+// Unpacks a waveform message
+esp_err_t unpack_msg_waveform (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+
+	msg->body.msg_waveform.timestamp = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_waveform.first = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_waveform.k = buffer[offset++];
+	msg->body.msg_waveform.n_samples = buffer[offset++];
+	msg->body.msg_waveform.size = buffer[offset++];
+
+	// Check the array fits both the message and the remaining data
+	if (msg->body.msg_waveform.size > MSG_WAVE_MAX ||
+		1 * (size_t)msg->body.msg_waveform.size > (len - offset)) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	for (size_t i = 0; i < msg->body.msg_waveform.size; ++i) {
+		msg->body.msg_waveform.data[i] = buffer[offset++];
+	}
+
+	return ESP_OK;
+}
+
+
+// Unpacks a hello message
+esp_err_t unpack_msg_hello (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_hello.version = buffer[offset++];
+	msg->body.msg_hello.types = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_hello.encodings = buffer[offset++];
+	msg->body.msg_hello.batch_max = buffer[offset++];
+	msg->body.msg_hello.mtu = buffer[offset] | ((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+
+	return ESP_OK;
+}
+
+
+// Unpacks a telemetry message
+esp_err_t unpack_msg_telemetry (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_telemetry.queue = buffer[offset++];
+	msg->body.msg_telemetry.depth = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_telemetry.high_water = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_telemetry.queued = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_telemetry.evicted = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_telemetry.refused = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_telemetry.coalesced = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_telemetry.expired = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_telemetry.bytes = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	for (size_t i = 0; i < MSG_LATENCY_BUCKETS; ++i) {
+		msg->body.msg_telemetry.latency[i] = buffer[offset] |
+			((uint32_t)buffer[offset + 1] << 8) |
+			((uint32_t)buffer[offset + 2] << 16) |
+			((uint32_t)buffer[offset + 3] << 24);
+		offset += 4;
+	}
+
+	return ESP_OK;
+}
+
+
+// Unpacks a log status message
+esp_err_t unpack_msg_log_status (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_log_status.first = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_log_status.next = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_log_status.overwritten = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+
+	return ESP_OK;
+}
+
+
+// Unpacks a log ack message
+esp_err_t unpack_msg_log_ack (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_log_ack.next = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+
+	return ESP_OK;
+}
+
+
+// Unpacks a link status message
+esp_err_t unpack_msg_link_status (msg_t *msg, const uint8_t *buffer, 
+	size_t len) {
+	size_t offset = 0;
+	(void)len;
+
+	msg->body.msg_link_status.mtu = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.tx_len = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.rx_len = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.interval = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.latency = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.timeout = buffer[offset] |
+		((uint16_t)buffer[offset + 1] << 8);
+	offset += 2;
+	msg->body.msg_link_status.mode = buffer[offset++];
+	msg->body.msg_link_status.sent = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_link_status.deferred = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_link_status.rejected = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_link_status.failed = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+	msg->body.msg_link_status.congested = buffer[offset] |
+		((uint32_t)buffer[offset + 1] << 8) |
+		((uint32_t)buffer[offset + 2] << 16) |
+		((uint32_t)buffer[offset + 3] << 24);
+	offset += 4;
+
+	return ESP_OK;
+}
+
+
+/*
+ *******************************************************************************
+ *                           Variable Size Functions                           *
+ *******************************************************************************
+*/
+
+
+// Size of the variable part of a model data message
+size_t extra_msg_model_data (const msg_t *msg) {
+	return 1 * (size_t)msg->body.msg_model.size;
+}
+
+
+// Size of the variable part of a escalation message
+size_t extra_msg_escalation (const msg_t *msg) {
+	return 2 * (size_t)msg->body.msg_escalation.n_samples;
+}
+
+
+// Size of the variable part of a sample batch message
+size_t extra_msg_sample_batch (const msg_t *msg) {
+	return 1 * (size_t)msg->body.msg_sample_batch.n_beats +
+		2 * (size_t)msg->body.msg_sample_batch.n_beats +
+		2 * (size_t)msg->body.msg_sample_batch.n_beats;
+}
+
+
+// Size of the variable part of a beat stream message
+size_t extra_msg_beat_stream (const msg_t *msg) {
+	return 1 * (size_t)msg->body.msg_beat_stream.size;
+}
+
+
+// Size of the variable part of a waveform message
+size_t extra_msg_waveform (const msg_t *msg) {
+	return 1 * (size_t)msg->body.msg_waveform.size;
+}
+
+
+/*
+ *******************************************************************************
+ *                             Message Codec Table                             *
+ *******************************************************************************
+*/
+
+
+const msg_codec_t g_msg_codec_tab[MSG_TYPE_MAX] = {
+    [MSG_TYPE_STATUS] = {
+        1, pack_msg_status, unpack_msg_status,
+        NULL
+    },
+    [MSG_TYPE_TRAIN_DATA] = {
+        160, pack_msg_train_data, unpack_msg_train_data,
+        NULL
+    },
+    [MSG_TYPE_SAMPLE_DATA] = {
+        5, pack_msg_sample_data, unpack_msg_sample_data,
+        NULL
+    },
+    [MSG_TYPE_INSTRUCTION] = {
+        1, pack_msg_instruction, unpack_msg_instruction,
+        NULL
+    },
+    [MSG_TYPE_CONFIGURATION] = {
+        3, pack_msg_configuration, unpack_msg_configuration,
+        NULL
+    },
+    [MSG_TYPE_MODEL_DATA] = {
+        2, pack_msg_model_data, unpack_msg_model_data,
+        extra_msg_model_data
+    },
+    [MSG_TYPE_FEEDBACK] = {
+        5, pack_msg_feedback, unpack_msg_feedback,
+        NULL
+    },
+    [MSG_TYPE_ESCALATION] = {
+        7, pack_msg_escalation, unpack_msg_escalation,
+        extra_msg_escalation
+    },
+    [MSG_TYPE_SUMMARY] = {
+        6, pack_msg_summary, unpack_msg_summary,
+        NULL
+    },
+    [MSG_TYPE_POLICY] = {
+        4, pack_msg_policy, unpack_msg_policy,
+        NULL
+    },
+    [MSG_TYPE_SAMPLE_BATCH] = {
+        5, pack_msg_sample_batch, unpack_msg_sample_batch,
+        extra_msg_sample_batch
+    },
+    [MSG_TYPE_BATCHING] = {
+        5, pack_msg_batching, unpack_msg_batching,
+        NULL
+    },
+    [MSG_TYPE_BEAT_STREAM] = {
+        7, pack_msg_beat_stream, unpack_msg_beat_stream,
+        extra_msg_beat_stream
+    },
+    [MSG_TYPE_WAVEFORM] = {
+        9, pack_msg_waveform, unpack_msg_waveform,
+        extra_msg_waveform
+    },
+    [MSG_TYPE_HELLO] = {
+        9, pack_msg_hello, unpack_msg_hello,
+        NULL
+    },
+    [MSG_TYPE_TELEMETRY] = {
+        77, pack_msg_telemetry, unpack_msg_telemetry,
+        NULL
+    },
+    [MSG_TYPE_LOG_STATUS] = {
+        12, pack_msg_log_status, unpack_msg_log_status,
+        NULL
+    },
+    [MSG_TYPE_LOG_ACK] = {
+        4, pack_msg_log_ack, unpack_msg_log_ack,
+        NULL
+    },
+    [MSG_TYPE_LINK_STATUS] = {
+        33, pack_msg_link_status, unpack_msg_link_status,
+        NULL
+    },
+};
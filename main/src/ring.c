@@ -0,0 +1,120 @@
+#include <string.h>
+#include "ring.h"
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Wraps an offset (less than twice the capacity) into the buffer
+static inline size_t ring_wrap (const ring_t *ring, size_t offset) {
+	return (offset >= ring->cap) ? offset - ring->cap : offset;
+}
+
+
+// Copies bytes into the ring at an offset, wrapping at the end of the buffer
+static void ring_write (ring_t *ring, size_t offset, const uint8_t *data, 
+	size_t size) {
+	size_t first = ring->cap - offset;
+
+	if (size <= first) {
+		memcpy(ring->buffer + offset, data, size);
+	} else {
+		memcpy(ring->buffer + offset, data, first);
+		memcpy(ring->buffer, data + first, size - first);
+	}
+}
+
+
+// Copies bytes out of the ring from an offset, wrapping at the end of the buffer
+static void ring_read (const ring_t *ring, size_t offset, uint8_t *data, 
+	size_t size) {
+	size_t first = ring->cap - offset;
+
+	if (size <= first) {
+		memcpy(data, ring->buffer + offset, size);
+	} else {
+		memcpy(data, ring->buffer + offset, first);
+		memcpy(data + first, ring->buffer, size - first);
+	}
+}
+
+
+/*
+ *******************************************************************************
+ *                        External Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+void ring_init (ring_t *ring, uint8_t *buffer, size_t cap) {
+	ring->buffer = buffer;
+	ring->cap    = cap;
+	ring->head   = 0;
+	ring->used   = 0;
+	ring->count  = 0;
+}
+
+
+int ring_fits (const ring_t *ring, size_t size) {
+	return size <= UINT16_MAX && 
+		RING_HEADER_SIZE + size <= ring->cap - ring->used;
+}
+
+
+int ring_put (ring_t *ring, uint8_t id, const void *data, size_t size) {
+	uint8_t header[RING_HEADER_SIZE] = {size & 0xFF, (size >> 8) & 0xFF, id};
+	size_t tail = ring_wrap(ring, ring->head + ring->used);
+
+	if (!ring_fits(ring, size)) {
+		return -1;
+	}
+
+	ring_write(ring, tail, header, RING_HEADER_SIZE);
+	ring_write(ring, ring_wrap(ring, tail + RING_HEADER_SIZE), data, size);
+	ring->used += RING_HEADER_SIZE + size;
+	ring->count++;
+
+	return 0;
+}
+
+
+size_t ring_peek (const ring_t *ring, uint8_t *id, void *data, size_t cap) {
+	uint8_t header[RING_HEADER_SIZE];
+	size_t size;
+
+	if (ring->count == 0) {
+		return 0;
+	}
+
+	ring_read(ring, ring->head, header, RING_HEADER_SIZE);
+	if (id != NULL) {
+		*id = header[2];
+	}
+	size = header[0] | (header[1] << 8);
+
+	if (data != NULL) {
+		ring_read(ring, ring_wrap(ring, ring->head + RING_HEADER_SIZE), data, 
+			(size > cap) ? cap : size);
+	}
+
+	return size;
+}
+
+
+size_t ring_get (ring_t *ring, uint8_t *id, void *data, size_t cap) {
+	size_t size = ring_peek(ring, id, data, cap);
+
+	if (ring->count == 0) {
+		return 0;
+	}
+
+	ring->head = ring_wrap(ring, ring->head + RING_HEADER_SIZE + size);
+	ring->used -= RING_HEADER_SIZE + size;
+	ring->count--;
+
+	return (data == NULL || size <= cap) ? size : cap;
+}
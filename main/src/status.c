@@ -9,18 +9,13 @@
 
 
 void dispatch_status_message (const char *task_tag) {
-        static uint8_t msg_buffer[MSG_BUFFER_MAX];
         esp_err_t err;
         
         // Prepare message
         msg_t msg = MSG_STATUS(g_state_flag);
 
-        // Pack message
-        size_t z = msg_pack(&msg, msg_buffer);
-
-        // Place message on outgoing queue
-        if ((err = ipc_enqueue(g_ble_tx_queue, 0x0, z, msg_buffer)) 
-            != ESP_OK) {
+        // Pack message onto the outgoing queue
+        if ((err = ipc_send_msg(MSG_CHANNEL_CONTROL, &msg)) != ESP_OK) {
             ESP_LOGE(task_tag, "Couldn't enqueue message for BLE: %s", 
                 E2S(err));
         }
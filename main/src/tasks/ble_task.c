@@ -1,6 +1,58 @@
 #include "ble_task.h"
 
 
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Reassembles frames from the chunks received over BLE
+static msg_parser_t g_rx_parser;
+
+
+/* Capabilities assumed until a client says hello: those of protocol version
+ * 1. The original message types, plain and unbatched, and framed as version 1
+ * did (one frame per notification, without channel, sequence, time or CRC)
+*/
+static const msg_hello_data_t g_default_peer = {
+    .version   = 0,
+    .types     = (1 << MSG_TYPE_STATUS) | (1 << MSG_TYPE_TRAIN_DATA) |
+                 (1 << MSG_TYPE_SAMPLE_DATA) | (1 << MSG_TYPE_INSTRUCTION) |
+                 (1 << MSG_TYPE_CONFIGURATION),
+    .encodings = (1 << MSG_ENCODING_PLAIN),
+    .batch_max = 1,
+    .mtu       = BLE_MTU_DEFAULT
+};
+
+
+// Capabilities of the connected client
+static msg_hello_data_t g_peer;
+
+// Frames withheld because the client doesn't understand their type
+static uint32_t g_withheld;
+
+// Nonzero while frames are sent in the framing of version 1 (until the reply
+// to the first hello of the client went out)
+static uint8_t g_v1_framing = 1;
+
+// Frames gathered for the next notification (up to the MTU less the header)
+static uint8_t g_notify[BLE_MTU_SIZE - BLE_ATT_HEADER_SIZE];
+static size_t g_notify_len;
+
+// Frame being gathered, and the bytes of it gathered so far
+static ipc_buffer_t g_tx_frame = IPC_BUFFER_NONE;
+static size_t g_tx_offset;
+
+// Beats relayed while disconnected, and whether they are being synchronized
+static beat_log_t g_beat_log;
+static uint8_t g_syncing;
+
+// Time (ms since boot) until which the stream connection parameters are kept
+static uint32_t g_stream_until;
+
+
 /*
  *******************************************************************************
  *                        Internal Function Definitions                        *
@@ -8,6 +60,66 @@
 */
 
 
+/* Reports the counters of every transmit queue, then of the receive queue
+ * (one telemetry message each), and then the link in effect. The channel 
+ * holds a full report
+*/
+static void send_telemetry (void) {
+    msg_t msg = (msg_t) { .type = MSG_TYPE_TELEMETRY };
+    msg_telemetry_data_t *t = &msg.body.msg_telemetry;
+    ipc_queue_stats_t stats;
+    ble_tx_stats_t tx;
+    ble_link_t link;
+    esp_err_t err;
+
+    for (uint8_t q = 0; q <= MSG_CHANNEL_MAX; ++q) {
+        t->queue = q;
+        t->depth = ipc_queue_stats((q < MSG_CHANNEL_MAX) ? g_tx_queues + q :
+            &g_ble_rx_queue, &stats);
+        t->high_water = stats.high_water;
+        t->queued     = stats.queued;
+        t->evicted    = stats.evicted;
+        t->refused    = stats.refused;
+        t->coalesced  = stats.coalesced;
+        t->expired    = stats.expired;
+        t->bytes      = stats.bytes;
+        memcpy(t->latency, stats.latency, sizeof(t->latency));
+
+        if ((err = ipc_send_msg(MSG_CHANNEL_TELEMETRY, &msg)) != ESP_OK) {
+            ESP_LOGE("BLE", "Couldn't enqueue telemetry: %s", E2S(err));
+            break;
+        }
+    }
+
+    // Report the link (negotiated lengths, parameters and sender counters)
+    ble_get_link(&link);
+    ble_tx_stats(&tx);
+    msg = (msg_t) {
+        .type = MSG_TYPE_LINK_STATUS,
+        .body = (msg_body_t) {
+            .msg_link_status = (msg_link_status_data_t) {
+                .mtu       = ble_get_mtu(),
+                .tx_len    = link.tx_len,
+                .rx_len    = link.rx_len,
+                .interval  = link.interval,
+                .latency   = link.latency,
+                .timeout   = link.timeout,
+                .mode      = link.mode,
+                .sent      = tx.sent,
+                .deferred  = tx.deferred,
+                .rejected  = tx.rejected,
+                .failed    = tx.failed,
+                .congested = tx.congested
+            }
+        }
+    };
+    if ((err = ipc_send_msg(MSG_CHANNEL_TELEMETRY, &msg)) != ESP_OK) {
+        ESP_LOGE("BLE", "Couldn't enqueue link status: %s", E2S(err));
+    }
+    xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+}
+
+
 // Processes instructions received in a message
 void instruction_handler (uint8_t instruction) {
     switch (instruction) {
@@ -27,25 +139,341 @@ void instruction_handler (uint8_t instruction) {
         }
         break;
 
+        case INST_EKG_BENCHMARK: {
+            xEventGroupSetBits(g_event_group, FLAG_EKG_BENCHMARK);
+        }
+        break;
+
+        case INST_EKG_WAVE_START: {
+            xEventGroupSetBits(g_event_group, FLAG_EKG_WAVE_START);
+        }
+        break;
+
+        case INST_EKG_WAVE_STOP: {
+            xEventGroupSetBits(g_event_group, FLAG_EKG_WAVE_STOP);
+        }
+        break;
+
+        case INST_EKG_TELEMETRY: {
+            send_telemetry();
+        }
+        break;
+
         default:
             ESP_LOGE("BLE", "Unhandled instruction (%X)", instruction);
     }
 }
 
 
-// Processes messages received over BLE
-void msg_handler (uint8_t *buffer, size_t size) {
+/* Moves the beats queued while disconnected into the beat log, so the beat
+ * channel never fills (without a log they stay queued instead). The segment
+ * the log continues in is erased afterwards, once no beat is held
+*/
+static void log_beats (void) {
+    ipc_buffer_t buffer;
+    esp_err_t err;
+
+    if (g_beat_log.partition == NULL) {
+        return;
+    }
+
+    while ((buffer = ipc_receive(MSG_CHANNEL_BEATS)) != IPC_BUFFER_NONE) {
+        if ((err = beat_log_append(&g_beat_log, ipc_buffer_data(buffer),
+            ipc_buffer_size(buffer))) != ESP_OK) {
+            ESP_LOGE("BLE", "Couldn't log beats: %s", E2S(err));
+        }
+        ipc_buffer_release(buffer);
+    }
+
+    if ((err = beat_log_prepare(&g_beat_log)) != ESP_OK) {
+        ESP_LOGE("BLE", "Couldn't erase beat log ahead: %s", E2S(err));
+    }
+}
+
+
+/* Announces the records of the beat log the client hasn't acknowledged, and
+ * starts sending them on the backlog channel
+*/
+static void start_sync (void) {
+    msg_t msg = (msg_t) {
+        .type = MSG_TYPE_LOG_STATUS
+    };
+
+    // Only clients that acknowledge records are sent the log
+    if (g_beat_log.partition == NULL ||
+        (g_peer.types & (1 << MSG_TYPE_LOG_STATUS)) == 0) {
+        return;
+    }
+
+    beat_log_rewind(&g_beat_log);
+    msg.body.msg_log_status = (msg_log_status_data_t) {
+        .first       = g_beat_log.read_seq,
+        .next        = g_beat_log.next,
+        .overwritten = g_beat_log.overwritten
+    };
+
+    // The announcement is sent on the control channel, ahead of the records
+    if (ipc_send_msg(MSG_CHANNEL_CONTROL, &msg) != ESP_OK) {
+        ESP_LOGE("BLE", "Couldn't enqueue beat log status");
+        return;
+    }
+    ESP_LOGI("BLE", "Synchronizing beat log (records %u to %u)",
+        g_beat_log.read_seq, g_beat_log.next);
+
+    g_syncing = 1;
+    xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+}
+
+
+// Tops up the backlog channel with records read from the beat log
+static void fill_backlog (void) {
+    ipc_buffer_t buffer;
+    esp_err_t err;
+    size_t z;
+
+    while (g_syncing && !ipc_full(MSG_CHANNEL_BACKLOG)) {
+
+        // Stop once all records were read
+        if ((z = beat_log_peek(&g_beat_log)) == 0) {
+            ESP_LOGI("BLE", "Beat log sent up to record %u", g_beat_log.next);
+            g_syncing = 0;
+            break;
+        }
+
+        // Resume once a transmit buffer is returned
+        if ((buffer = ipc_buffer_alloc(z)) == IPC_BUFFER_NONE) {
+            break;
+        }
+
+        // Records are sent straight from flash
+        if ((err = beat_log_read(&g_beat_log, ipc_buffer_data(buffer), z)) 
+            != ESP_OK) {
+            ESP_LOGE("BLE", "Couldn't read beat log: %s", E2S(err));
+            ipc_buffer_release(buffer);
+            g_syncing = 0;
+            break;
+        }
+        ipc_send(MSG_CHANNEL_BACKLOG, buffer);
+    }
+}
+
+
+// Replies to a client hello with the capabilities of this device
+static void send_hello (void) {
+    msg_t msg = (msg_t) {
+        .type = MSG_TYPE_HELLO,
+        .body = (msg_body_t) {
+            .msg_hello = (msg_hello_data_t) {
+                .version   = MSG_PROTOCOL_VERSION,
+                .types     = (1 << MSG_TYPE_MAX) - 1,
+                .encodings = (1 << MSG_ENCODING_MAX) - 1,
+                .batch_max = MSG_BATCH_MAX,
+                .mtu       = ble_get_mtu()
+            }
+        }
+    };
+
+    // Control replies are sent ahead of the data channels
+    if (ipc_send_msg(MSG_CHANNEL_CONTROL, &msg) != ESP_OK) {
+        ESP_LOGE("BLE", "Couldn't enqueue hello");
+        return;
+    }
+    xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+}
+
+
+/* Sends the frames gathered for a notification. If it can't be sent yet, it
+ * is kept (and nothing more is gathered behind a full one), so frames go out 
+ * in order once sending resumes
+*/
+static esp_err_t send_notification (void) {
+    esp_err_t err;
+
+    if (g_notify_len == 0) {
+        return ESP_OK;
+    }
+
+    // Without a credit or while congested, the stack signals when to resume
+    if ((err = ble_send(g_notify_len, g_notify)) != ESP_OK) {
+        if (err != ESP_ERR_INVALID_STATE) {
+            ESP_LOGE("BLE", "Couldn't send notification: %s", E2S(err));
+        }
+        return err;
+    }
+
+    // The reply to the hello is the last notification framed as version 1
+    if (g_v1_framing && g_notify[2] == MSG_TYPE_HELLO) {
+        g_v1_framing = 0;
+    }
+    g_notify_len = 0;
+
+    return ESP_OK;
+}
+
+
+/* Sends queued frames by lane until all channels are empty (and the beat log
+ * was sent), until a received message is waiting (sending then resumes after
+ * handling it), or until a notification can't be sent. Frames are packed back
+ * to back, and split where a notification fills up (clients reassemble the 
+ * byte stream). A frame is only released once gathered whole. Clients yet to
+ * say hello get a version 1 frame per notification instead
+*/
+static void send_frames (void) {
+    size_t max = ble_get_mtu() - BLE_ATT_HEADER_SIZE, z;
+    uint8_t channel;
+    uint8_t *data;
+
+    // Notifications a loss left to send again go out before anything new
+    if (ble_resend() != ESP_OK) {
+        return;
+    }
+
+    while (1) {
+
+        // A full notification (or any, in version 1 framing) goes out before
+        // gathering any more
+        if ((g_notify_len >= max || (g_v1_framing && g_notify_len > 0)) && 
+            send_notification() != ESP_OK) {
+            return;
+        }
+
+        // Take the next frame once the last was gathered
+        if (g_tx_frame == IPC_BUFFER_NONE) {
+            fill_backlog();
+            if ((g_tx_frame = ipc_next(&channel)) == IPC_BUFFER_NONE) {
+                break;
+            }
+            g_tx_offset = 0;
+
+            // Withhold frames the client wouldn't understand
+            data = ipc_buffer_data(g_tx_frame);
+            if ((g_peer.types & (1 << data[2])) == 0) {
+                g_withheld++;
+                ipc_buffer_release(g_tx_frame);
+                g_tx_frame = IPC_BUFFER_NONE;
+                continue;
+            }
+            ESP_LOGD("BLE", "Sending a message of %d bytes (%s)!", 
+                ipc_buffer_size(g_tx_frame), g_ipc_channels[channel].name);
+
+            // Version 1 frames go whole (the device sends none too long)
+            if (g_v1_framing) {
+                z = ipc_buffer_size(g_tx_frame);
+                if (z - MSG_HEADER_SIZE - MSG_TRAILER_SIZE + 
+                    MSG_V1_HEADER_SIZE <= max) {
+                    g_notify_len = msg_to_v1(data, z, g_notify);
+                } else {
+                    g_withheld++;
+                }
+                ipc_buffer_release(g_tx_frame);
+                g_tx_frame = IPC_BUFFER_NONE;
+                continue;
+            }
+        }
+
+        // Gather as much of the frame as fits
+        data = ipc_buffer_data(g_tx_frame);
+        z = ipc_buffer_size(g_tx_frame) - g_tx_offset;
+        z = (max - g_notify_len < z) ? max - g_notify_len : z;
+        memcpy(g_notify + g_notify_len, data + g_tx_offset, z);
+        g_notify_len += z;
+        g_tx_offset += z;
+        if (g_tx_offset < ipc_buffer_size(g_tx_frame)) {
+            continue;
+        }
+        ipc_buffer_release(g_tx_frame);
+        g_tx_frame = IPC_BUFFER_NONE;
+
+        // Let instructions overtake a backlog of data
+        if (xEventGroupGetBits(g_event_group) & FLAG_BLE_RECV_MSG) {
+            xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+            break;
+        }
+    }
+
+    // Don't hold back a partly filled notification
+    send_notification();
+}
+
+
+/* Drops the notification being gathered, and the frame being split across
+ * notifications (both are gone with the link)
+*/
+static void drop_notification (void) {
+    g_notify_len = 0;
+    if (g_tx_frame != IPC_BUFFER_NONE) {
+        ipc_buffer_release(g_tx_frame);
+        g_tx_frame = IPC_BUFFER_NONE;
+    }
+}
+
+
+/* Selects the connection parameters from the frames waiting. Stream ones 
+ * are wanted while samples are streamed, the beat log is synchronized or the
+ * channels hold BLE_CONN_STREAM_DEPTH frames, and monitoring ones once none 
+ * of these held for BLE_CONN_IDLE_MS
+*/
+static void select_conn_mode (void) {
+    uint32_t now = esp_timer_get_time() / 1000;
+    size_t depth = 0;
+
+    for (uint8_t c = 0; c < MSG_CHANNEL_MAX; ++c) {
+        depth += ipc_pending(c);
+    }
+    if (g_syncing || ipc_pending(MSG_CHANNEL_WAVEFORM) > 0 || 
+        depth >= BLE_CONN_STREAM_DEPTH) {
+        g_stream_until = now + BLE_CONN_IDLE_MS;
+    }
+    ble_set_conn_mode(((int32_t)(g_stream_until - now) > 0) ? 
+        BLE_CONN_MODE_STREAM : BLE_CONN_MODE_MONITOR);
+}
+
+
+/* Returns how long to wait for events: until a notification refused by the
+ * stack (or left to send again after a loss) is retried, or until the stream
+ * parameters may be given up
+*/
+static TickType_t wait_ticks (void) {
+    int32_t left = g_stream_until - (uint32_t)(esp_timer_get_time() / 1000);
+
+    if (g_notify_len > 0 || ble_tx_pending() > 0) {
+        return pdMS_TO_TICKS(BLE_TX_RETRY_MS);
+    }
+    if (left > 0) {
+        return pdMS_TO_TICKS(left) + 1;
+    }
+    return portMAX_DELAY;
+}
+
+
+/* Restricts a batching configuration to what the client supports. Unknown
+ * encodings fall back to plain samples, and batches to the client limit
+*/
+static void restrict_batching (msg_batching_data_t *batching) {
+    if (batching->encoding >= MSG_ENCODING_MAX || 
+        (g_peer.encodings & (1 << batching->encoding)) == 0) {
+        batching->encoding = MSG_ENCODING_PLAIN;
+    }
+    if (batching->count > g_peer.batch_max) {
+        batching->count = g_peer.batch_max;
+    }
+}
+
+
+// Processes messages received over BLE (frames validated by the parser)
+void msg_handler (const msg_view_t *view, void *ctx) {
     esp_err_t err;
     msg_t msg;
 
-    // Unpack the message
-    if ((err = msg_unpack(&msg, buffer, size)) != ESP_OK) {
+    // Training data is read in place, all other messages are decoded
+    if (view->type != MSG_TYPE_TRAIN_DATA && 
+        (err = msg_decode(&msg, view)) != ESP_OK) {
         ESP_LOGE("BLE", "Couldn't unpack message: %s", E2S(err));
         return;
     }
 
     // Take action based on message type
-    switch (msg.type) {
+    switch (view->type) {
 
         // Message with Instruction
         case MSG_TYPE_INSTRUCTION: {
@@ -83,23 +511,92 @@ void msg_handler (uint8_t *buffer, size_t size) {
         case MSG_TYPE_TRAIN_DATA: {
             ESP_LOGI("BLE", "Training Data Received!");
             
+            const uint8_t *body = view->body;
+
             // Install normal training data
-            memcpy(g_n_periods, msg.body.msg_train.n_periods, 
-                20 * sizeof(uint16_t));
-            memcpy(g_n_amplitudes, msg.body.msg_train.n_amplitudes, 
-                20 * sizeof(uint16_t));
+            memcpy(g_n_periods, body, 20 * sizeof(uint16_t));
+            body += 20 * sizeof(uint16_t);
+            memcpy(g_n_amplitudes, body, 20 * sizeof(uint16_t));
+            body += 20 * sizeof(uint16_t);
 
             // Install atrial training data
-            memcpy(g_a_periods, msg.body.msg_train.a_periods, 
-                10 * sizeof(uint16_t));
-            memcpy(g_a_amplitudes, msg.body.msg_train.a_amplitudes, 
-                10 * sizeof(uint16_t));
+            memcpy(g_a_periods, body, 10 * sizeof(uint16_t));
+            body += 10 * sizeof(uint16_t);
+            memcpy(g_a_amplitudes, body, 10 * sizeof(uint16_t));
+            body += 10 * sizeof(uint16_t);
 
             // Install ventricular training data
-            memcpy(g_v_periods, msg.body.msg_train.v_periods, 
-                10 * sizeof(uint16_t));
-            memcpy(g_v_amplitudes, msg.body.msg_train.v_amplitudes, 
-                10 * sizeof(uint16_t));
+            memcpy(g_v_periods, body, 10 * sizeof(uint16_t));
+            body += 10 * sizeof(uint16_t);
+            memcpy(g_v_amplitudes, body, 10 * sizeof(uint16_t));
+        }
+        break;
+
+        // Message with a classifier selection (and optional model blob)
+        case MSG_TYPE_MODEL_DATA: {
+            ESP_LOGI("BLE", "Model Data Received! (model = %u, size = %u)",
+                msg.body.msg_model.model, msg.body.msg_model.size);
+
+            // Buffer the model until the next configure instruction
+            g_model_type = msg.body.msg_model.model;
+            g_model_size = msg.body.msg_model.size;
+            memcpy(g_model_data, msg.body.msg_model.data, g_model_size);
+        }
+        break;
+
+        // Message with a labeled beat for online learning
+        case MSG_TYPE_FEEDBACK: {
+
+            // Hand over without blocking; the EKG task applies it
+            if (xQueueSendToBack(g_feedback_queue, &msg.body.msg_feedback, 0)
+                != pdPASS) {
+                ESP_LOGW("BLE", "Feedback queue full, dropping labeled beat");
+            }
+        }
+        break;
+
+        // Message with an escalation policy
+        case MSG_TYPE_POLICY: {
+
+            // Buffer the policy until the next configure instruction
+            g_policy = msg.body.msg_policy;
+
+            ESP_LOGI("BLE", "Buffered Policy: (enabled = %u, confidence = %u,"
+                " snippet = %u, summary = %u)", g_policy.enabled,
+                g_policy.min_confidence, g_policy.snippet_len, 
+                g_policy.summary_blocks);
+        }
+        break;
+
+        // Message with a sample batching configuration
+        case MSG_TYPE_BATCHING: {
+
+            // Buffer the configuration until the next configure instruction
+            g_batching = msg.body.msg_batching;
+            restrict_batching(&g_batching);
+
+            ESP_LOGI("BLE", "Buffered Batching: (count = %u, age = %u ms,"
+                " encoding = %u, keyframe = %u)", g_batching.count, 
+                g_batching.age, g_batching.encoding, g_batching.keyframe);
+        }
+        break;
+
+        // Message with the capabilities of the client
+        case MSG_TYPE_HELLO: {
+            g_peer = msg.body.msg_hello;
+
+            ESP_LOGI("BLE", "Hello: (version = %u, types = %X, encodings = %X,"
+                " batch = %u, mtu = %u)", g_peer.version, g_peer.types,
+                g_peer.encodings, g_peer.batch_max, g_peer.mtu);
+
+            send_hello();
+            start_sync();
+        }
+        break;
+
+        // Message with the beat log records received by the client
+        case MSG_TYPE_LOG_ACK: {
+            beat_log_ack(&g_beat_log, msg.body.msg_log_ack.next);
         }
         break;
 
@@ -110,7 +607,7 @@ void msg_handler (uint8_t *buffer, size_t size) {
         break;
 
         default: {
-            ESP_LOGW("BLE", "Received unknown message type (%d)",msg.type);
+            ESP_LOGW("BLE", "Received unknown message type (%d)",view->type);
         }
     }
 }
@@ -125,29 +622,103 @@ void msg_handler (uint8_t *buffer, size_t size) {
 
 void task_ble_manager (void *args) {
     uint32_t flags;
-    esp_err_t err;
+    ipc_pool_stats_t pool;
+    ipc_queue_stats_t queue;
+    ble_tx_stats_t tx;
     task_queue_msg_t queue_msg;   // Holds messages taken from queues
+    ipc_buffer_t buffer;
+    esp_err_t err;
 
     /* State Bit Flags 
      * 0x1: Bluetooth Low Energy is connected if set
     */
     uint8_t state = 0x0;
 
+    // Assume the original message types until a client says hello
+    g_peer = g_default_peer;
+
+    // Open the beat log (without it, beats stay queued while disconnected)
+    if ((err = beat_log_init(&g_beat_log)) != ESP_OK) {
+        ESP_LOGE("BLE", "Couldn't open beat log: %s", E2S(err));
+    } else {
+        ESP_LOGI("BLE", "Beat log holds records %u to %u", g_beat_log.first,
+            g_beat_log.next);
+    }
+
     do {
 
-        // Wait indefinitely until any bit in the group is set
+        // Wait until any bit in the group is set, until a notification
+        // refused by the stack is due to be retried, or until the connection
+        // parameters may change
         flags = xEventGroupWaitBits(g_event_group, MASK_BLE_FLAGS, pdTRUE, 
-            pdFALSE, portMAX_DELAY);
+            pdFALSE, wait_ticks());
+
+        // On a timeout (or with a notification pending) make a send pass
+        if ((state & 0x1) && (g_notify_len > 0 || ble_tx_pending() > 0 ||
+            (flags & MASK_BLE_FLAGS) == 0)) {
+            flags |= FLAG_BLE_SEND_MSG;
+        }
 
         // If the connected flag is set, then save state (bit auto-cleared)
         if (flags & FLAG_BLE_CONNECTED) {
         	state |= 0x1;
+
+            // Program the beats logged last, so they may be read
+            if (g_beat_log.partition != NULL && 
+                (err = beat_log_flush(&g_beat_log)) != ESP_OK) {
+                ESP_LOGE("BLE", "Couldn't flush beat log: %s", E2S(err));
+            }
+
+            // Send the frames held while disconnected
+            flags |= FLAG_BLE_SEND_MSG;
         }
 
         // If the disconnected flag is set, then save state (bit auto-cleared)
         if (flags & FLAG_BLE_DISCONNECTED) {
         	state &= ~0x1;
 
+            // Report on the frames received so far
+            ESP_LOGI("BLE", "Received %u frames (%u lost, %u reordered, "
+                "%u corrupt, %u bytes skipped), withheld %u", 
+                g_rx_parser.frames, g_rx_parser.lost, g_rx_parser.reordered, 
+                g_rx_parser.crc_errors, g_rx_parser.skipped, g_withheld);
+
+            // Report on the transmit buffers
+            ipc_pool_stats(&pool);
+            ESP_LOGI("BLE", "Transmit buffers: %u taken, %u refused, %u held "
+                "(peak %u)", pool.allocs, pool.exhausted, pool.in_use, 
+                pool.peak);
+            ble_tx_stats(&tx);
+            ESP_LOGI("BLE", "Notifications: %u sent (%u again), %u deferred, "
+                "%u rejected, %u failed, congested %u times", tx.sent, 
+                tx.resent, tx.deferred, tx.rejected, tx.failed, tx.congested);
+            for (uint8_t c = 0; c < MSG_CHANNEL_MAX; ++c) {
+                ipc_queue_stats(g_tx_queues + c, &queue);
+                ESP_LOGI("BLE", "Channel %s: %u queued, %u evicted, %u refused,"
+                    " %u coalesced, %u expired (peak %u)", 
+                    g_ipc_channels[c].name, queue.queued, queue.evicted, 
+                    queue.refused, queue.coalesced, queue.expired, 
+                    queue.high_water);
+            }
+
+            // Drop any partial frame left by the last connection
+            msg_parser_reset(&g_rx_parser);
+            drop_notification();
+
+            // The next client starts out with the parameters it picks
+            g_stream_until = esp_timer_get_time() / 1000;
+
+            // Until the next client says hello, assume protocol version 1
+            g_peer = g_default_peer;
+            g_v1_framing = 1;
+
+            // The next client resumes after the records it acknowledges
+            g_syncing = 0;
+            while ((buffer = ipc_receive(MSG_CHANNEL_BACKLOG)) != 
+                IPC_BUFFER_NONE) {
+                ipc_buffer_release(buffer);
+            }
+
             // Clear the transmit queue (?)
         }
 
@@ -155,17 +726,14 @@ void task_ble_manager (void *args) {
         if (flags & FLAG_BLE_RECV_MSG) {
 
             // While there are messages to process
-            while (uxQueueMessagesWaiting(g_ble_rx_queue) > 0) {
-
-                // Dequeue the next message in BLE_RX_QUEUE
-                if (xQueueReceive(g_ble_rx_queue, (void *)&queue_msg, 
-                    TASK_QUEUE_MAX_TICKS) != pdPASS) {
-                    ESP_LOGE("BLE", "Problem receiving data from BLE driver");
-                    continue;
-                }
-
-                // Process the message
-                msg_handler(queue_msg.data, queue_msg.size);
+            while (ipc_dequeue(&g_ble_rx_queue, &queue_msg) > 0) {
+
+                // Process the messages completed by the chunk. Clients yet
+                // to say hello may write version 1 frames, and hellos are
+                // always framed so
+                msg_parser_feed_write(&g_rx_parser, queue_msg.data, 
+                    queue_msg.size, (g_peer.version < 2) ? MSG_V1_TYPES : 
+                    (1 << MSG_TYPE_HELLO), msg_handler, NULL);
             }
 
         }
@@ -174,36 +742,13 @@ void task_ble_manager (void *args) {
         if (flags & FLAG_BLE_SEND_MSG) {
 
 
-            // If connected, then dequeue and send ...
+            // If connected, then send by lane. Otherwise beats are logged,
+            // and other frames are held (full channels apply their policy)
             if (state & 0x1) {
-
-                // While there are messages to process
-                while (uxQueueMessagesWaiting(g_ble_tx_queue) > 0) {
-
-                    // Read next message in BLE_TX_QUEUE for dispatch
-                    if (xQueueReceive(g_ble_tx_queue, (void *)&queue_msg, 
-                        TASK_QUEUE_MAX_TICKS) != pdPASS) {
-                        ESP_LOGE("BLE", 
-                            "Send flag set but no message on queue!");
-                        continue;
-                    }
-
-                    ESP_LOGI("BLE", "Sending a message of %d bytes!", queue_msg.size);
-
-                    if ((err = ble_send(queue_msg.size, queue_msg.data)) 
-                        != ESP_OK) {
-                        ESP_LOGE("BLE", 
-                            "Couldn't send message: %s", E2S(err));
-                    }                   
-                }
+                select_conn_mode();
+                send_frames();
             } else {
-
-                // Discard message if capacity is reached
-                if (uxQueueMessagesWaiting(g_ble_tx_queue) >= TASK_QUEUE_CAPACITY) {
-
-                    // Don't really care about the return value
-                    xQueueReceive(g_ble_tx_queue, (void *)&queue_msg, TASK_QUEUE_MAX_TICKS);
-                }
+                log_beats();
             }
 
         }
@@ -1,5 +1,16 @@
 #include "ekg_task.h"
 
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Maximum number of beats in a block (a peak needs a non-peak sample before it)
+#define EKG_BLOCK_BEATS_MAX      (DEVICE_SENSOR_PUSH_BUF_SIZE / 2)
+
+
 /*
  *******************************************************************************
  *                              Global Variables                               *
@@ -7,20 +18,51 @@
 */
 
 
-// The local sample buffer
-static uint16_t g_local_sample_buffer[DEVICE_SENSOR_PUSH_BUF_SIZE];
+// The sample block being processed (owned until the next block is taken)
+static const uint16_t *g_block_samples;
+
+// Local copy of the training data set (the KNN model)
+static msg_train_data_t g_local_train;
+
+// Features, labels and confidences of the beats found in the current block
+static beat_features_t g_block_beats[EKG_BLOCK_BEATS_MAX];
+static sample_label_t  g_block_labels[EKG_BLOCK_BEATS_MAX];
+static uint8_t         g_block_confidences[EKG_BLOCK_BEATS_MAX];
+
+// Position of the peak of each beat in the current block
+static uint16_t        g_block_peaks[EKG_BLOCK_BEATS_MAX];
+
+// Local copy of the escalation policy
+static msg_policy_data_t g_local_policy;
 
-// Local variables holding the normal wave training data set
-static uint16_t g_local_n_periods[20];
-static uint16_t g_local_n_amplitudes[20];
+// Local copy of the batching configuration
+static msg_batching_data_t g_local_batching;
 
-// Local variables holding the atrial wave training data set
-static uint16_t g_local_a_periods[10];
-static uint16_t g_local_a_amplitudes[10];
+// Beats held for the next sample batch
+static msg_sample_batch_data_t g_batch;
 
-// Local variables holding the ventrical wave training data set
-static uint16_t g_local_v_periods[10];
-static uint16_t g_local_v_amplitudes[10];
+// State of the coded beat stream, and frames sent since its last keyframe
+static beat_codec_t g_stream_codec;
+static uint8_t      g_stream_frames;
+
+// Beats counted locally since the last summary (sums for the means)
+static uint16_t g_summary_count;
+static uint32_t g_summary_amplitude;
+static uint32_t g_summary_period;
+static uint8_t  g_summary_blocks;
+
+// Nonzero if the summary holds beats the beat channel refused
+static uint8_t  g_summary_coalesced;
+
+// Accuracy of each backend on the labeled beats received (held out, since
+// each beat is scored before it is learned)
+static classifier_bench_t g_feedback_bench[CLASSIFIER_TYPE_MAX];
+
+// Running totals: beats classified, beats escalated, frames and bytes queued
+static uint32_t g_stat_beats;
+static uint32_t g_stat_escalated;
+static uint32_t g_stat_frames;
+static uint32_t g_stat_bytes;
 
 
 /*
@@ -29,49 +71,385 @@ static uint16_t g_local_v_amplitudes[10];
  *******************************************************************************
 */
 
-// Classifies a sample
-static sample_label_t classify_knn (uint16_t amplitude, uint16_t rr_period) {
-	sample_label_t label = SAMPLE_LABEL_UNKNOWN;
+// Installs the training data and requested model into the classifier
+static void configure_classifier (void) {
+	esp_err_t err;
+
+	// The training data set is always installed as the KNN and NCM model
+	if ((err = classifier_load(CLASSIFIER_KNN, (const uint8_t *)&g_local_train,
+		sizeof(msg_train_data_t))) != ESP_OK) {
+		ESP_LOGE("EKG", "Couldn't load KNN model: %s", E2S(err));
+	}
+	if ((err = classifier_load(CLASSIFIER_NCM, (const uint8_t *)&g_local_train,
+		sizeof(msg_train_data_t))) != ESP_OK) {
+		ESP_LOGE("EKG", "Couldn't load NCM model: %s", E2S(err));
+	}
+
+	// A model blob (if any) is installed into the requested backend
+	if (g_model_size > 0 && (err = classifier_load(g_model_type, g_model_data,
+		g_model_size)) != ESP_OK) {
+		ESP_LOGE("EKG", "Couldn't load model for classifier %u: %s", 
+			g_model_type, E2S(err));
+		return;
+	}
 
-	// TODO: Implement Sonnya's KNN here
-	label = classify(amplitude, rr_period);
+	// Select the requested backend
+	if ((err = classifier_select(g_model_type)) != ESP_OK) {
+		ESP_LOGE("EKG", "Couldn't select classifier %u: %s", g_model_type,
+			E2S(err));
+		return;
+	}
 
-	return label;
+	ESP_LOGI("EKG", "Classifier: %s", classifier_get(g_model_type)->name);
 }
 
 
-// Dispatches a serialized message containing the amplitude and RR-peak period
-static void send_sample (uint16_t amplitude, uint16_t rr_period, uint8_t lab) {
-	uint8_t buffer[MSG_BUFFER_MAX] = {0};
+// Applies all pending labeled beats to the active classifier (non-blocking)
+static void apply_feedback (void) {
+	msg_feedback_data_t feedback;
+	esp_err_t err;
+
+	while (xQueueReceive(g_feedback_queue, &feedback, 0) == pdPASS) {
+		beat_features_t features = (beat_features_t) {
+			.amplitude = feedback.amplitude,
+			.rr_period = feedback.period
+		};
 
-	// Construct message body
-	msg_body_t body = (msg_body_t) {
-		.msg_sample = (msg_sample_data_t) {
-			.label     = lab,
-			.amplitude = amplitude,
-			.period    = rr_period
+		// Score every backend before the active one learns the beat
+		for (size_t t = 0; t < CLASSIFIER_TYPE_MAX; ++t) {
+			classifier_bench_record(g_feedback_bench + t, feedback.label,
+				classifier_get(t)->classify(&features, NULL));
 		}
+
+		if ((err = classifier_update(&features, feedback.label)) != ESP_OK) {
+			ESP_LOGW("EKG", "Couldn't learn labeled beat: %s", E2S(err));
+		}
+	}
+}
+
+
+/* Benchmarks every backend. Classifications are timed on the installed 
+ * training data set, but the confusion reported is over the labeled beats
+ * received so far: the training set would only measure resubstitution
+*/
+static void run_benchmark (void) {
+	const uint16_t *sets[3][2] = {
+		{g_local_train.n_amplitudes, g_local_train.n_periods},
+		{g_local_train.a_amplitudes, g_local_train.a_periods},
+		{g_local_train.v_amplitudes, g_local_train.v_periods}
 	};
+	const size_t counts[3] = {KNN_N_SAMPLES, KNN_A_SAMPLES, KNN_V_SAMPLES};
+	static beat_features_t features[KNN_SAMPLES];
+	static sample_label_t labels[KNN_SAMPLES];
+	classifier_bench_t bench;
+	size_t n = 0;
+
+	// Flatten the training data set into a labeled feature set
+	for (size_t c = 0; c < 3; ++c) {
+		for (size_t i = 0; i < counts[c]; ++i, ++n) {
+			features[n] = (beat_features_t) {
+				.amplitude = sets[c][0][i],
+				.rr_period = sets[c][1][i]
+			};
+			labels[n] = SAMPLE_LABEL_NORMAL + c;
+		}
+	}
+
+	for (size_t t = 0; t < CLASSIFIER_TYPE_MAX; ++t) {
+		if (classifier_bench_run(t, features, labels, n, &bench) == ESP_OK) {
+			memcpy(bench.confusion, g_feedback_bench[t].confusion, 
+				sizeof(bench.confusion));
+			classifier_bench_print(classifier_get(t)->name, &bench);
+		}
+	}
+}
+
+
+/* Serializes a message into a transmit buffer and hands it to the BLE 
+ * Manager. Never blocks: frames refused by a full channel are counted there
+*/
+static esp_err_t send_msg (uint8_t channel, const msg_t *message) {
+	esp_err_t err;
+
+	// Serialize the message straight into a transmit buffer
+	if ((err = ipc_send_msg(channel, message)) != ESP_OK) {
+		if (err != ESP_ERR_NO_MEM) {
+			ESP_LOGE("EKG", "Problem pushing message data (%s): %s", 
+				g_ipc_channels[channel].name, E2S(err));
+		}
+		return err;
+	}
+	g_stat_frames++;
+	g_stat_bytes += msg_size(message);
+
+	// Otherwise notify the BLE Manager to send it
+	xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+
+	return ESP_OK;
+}
+
+
+// Counts a beat toward the next summary
+static void summarize_beat (uint16_t amplitude, uint16_t rr_period) {
+	if (g_summary_count < UINT16_MAX) {
+		g_summary_count++;
+		g_summary_amplitude += amplitude;
+		g_summary_period    += rr_period;
+	}
+}
+
+
+/* Folds beats the beat channel refused into the next summary (if that is the
+ * policy of the channel), which is sent once the channel has room again
+*/
+static void coalesce_beats (const uint16_t *amplitudes, 
+	const uint16_t *rr_periods, uint8_t n) {
+	if (g_ipc_channels[MSG_CHANNEL_BEATS].policy != IPC_POLICY_COALESCE) {
+		return;
+	}
+
+	for (uint8_t i = 0; i < n; ++i) {
+		summarize_beat(amplitudes[i], rr_periods[i]);
+	}
+	g_summary_coalesced = 1;
+}
+
+
+// Dispatches a serialized message containing the amplitude and RR-peak period
+static void send_sample (uint16_t amplitude, uint16_t rr_period, uint8_t lab) {
 
 	// Construct the message
 	msg_t message = (msg_t){
 		.type = MSG_TYPE_SAMPLE_DATA,
-		.body = body
+		.body = (msg_body_t) {
+			.msg_sample = (msg_sample_data_t) {
+				.label     = lab,
+				.amplitude = amplitude,
+				.period    = rr_period
+			}
+		}
 	};
 
-	// Serialize the message
-	size_t z = msg_pack(&message, buffer);
+	if (send_msg(MSG_CHANNEL_BEATS, &message) == ESP_ERR_NO_MEM) {
+		coalesce_beats(&amplitude, &rr_period, 1);
+	}
+}
+
 
-	// Enqueue message for transmission
-	if (ipc_enqueue(g_ble_tx_queue, 0x0, z, buffer) != ESP_OK) {
-		ESP_LOGE("EKG", "Problem pushing message data!");
+/* Dispatches an escalated beat with a waveform snippet centered on its peak.
+ * Snippets are clipped to the block, and only fit a notification if short
+*/
+static void send_escalation (const beat_features_t *beat, uint8_t label, 
+	uint8_t confidence, uint16_t peak) {
+	msg_t message = (msg_t) {
+		.type = MSG_TYPE_ESCALATION,
+		.body = (msg_body_t) {
+			.msg_escalation = (msg_escalation_data_t) {
+				.label      = label,
+				.confidence = confidence,
+				.amplitude  = beat->amplitude,
+				.period     = beat->rr_period
+			}
+		}
+	};
+	msg_escalation_data_t *e = &message.body.msg_escalation;
+	int start;
+
+	// Copy the snippet
+	e->n_samples = (g_local_policy.snippet_len > MSG_SNIPPET_MAX) ? 
+		MSG_SNIPPET_MAX : g_local_policy.snippet_len;
+	start = (int)peak - e->n_samples / 2;
+	if (start > DEVICE_SENSOR_PUSH_BUF_SIZE - e->n_samples) {
+		start = DEVICE_SENSOR_PUSH_BUF_SIZE - e->n_samples;
+	}
+	if (start < 0) {
+		start = 0;
+	}
+	memcpy(e->samples, g_block_samples + start, 
+		e->n_samples * sizeof(uint16_t));
+
+	g_stat_escalated++;
+	send_msg(MSG_CHANNEL_ALERTS, &message);
+}
+
+
+// Dispatches (and resets) the summary of the locally counted beats
+static void send_summary (void) {
+	uint16_t n = g_summary_count;
+	msg_t message = (msg_t) {
+		.type = MSG_TYPE_SUMMARY,
+		.body = (msg_body_t) {
+			.msg_summary = (msg_summary_data_t) {
+				.count     = n,
+				.amplitude = (n == 0) ? 0 : g_summary_amplitude / n,
+				.period    = (n == 0) ? 0 : g_summary_period / n
+			}
+		}
+	};
+
+	// Keep counting if the beat channel is still full
+	if (send_msg(MSG_CHANNEL_BEATS, &message) != ESP_OK) {
 		return;
 	}
 
-	// Otherwise notify the BLE Manager to send it
-	xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+	ESP_LOGI("EKG", "Beats: %u total, %u escalated, %u frames (%u bytes) queued",
+		g_stat_beats, g_stat_escalated, g_stat_frames, g_stat_bytes);
 
-	return;
+	g_summary_count = 0;
+	g_summary_amplitude = g_summary_period = 0;
+	g_summary_blocks = 0;
+	g_summary_coalesced = 0;
+}
+
+
+/* Dispatches the pending sample batch as frames of the coded beat stream. 
+ * The stream state is reset with a keyframe every few frames, so the receiver
+ * can resume after a lost frame
+*/
+static void send_stream (void) {
+	msg_t message = (msg_t) {
+		.type = MSG_TYPE_BEAT_STREAM
+	};
+	msg_beat_stream_data_t *f = &message.body.msg_beat_stream;
+	uint32_t time = g_batch.timestamp;
+	uint8_t i = 0, first;
+	size_t z;
+
+	while ((first = i) < g_batch.n_beats) {
+
+		// Start with a keyframe if one is due
+		if ((f->keyframe = (g_stream_frames == 0))) {
+			beat_codec_reset(&g_stream_codec);
+		}
+		f->timestamp = time;
+		f->n_beats = f->size = 0;
+
+		// Code as many beats as fit the frame
+		while (i < g_batch.n_beats && (z = beat_encode(&g_stream_codec, 
+			g_batch.labels[i], g_batch.amplitudes[i], g_batch.periods[i],
+			f->data + f->size, MSG_STREAM_MAX - f->size)) > 0) {
+			f->size += z;
+			f->n_beats++;
+			if (++i < g_batch.n_beats) {
+				time += g_batch.periods[i];
+			}
+		}
+
+		// A refused frame is summarized, and the stream resumes from a keyframe
+		if (send_msg(MSG_CHANNEL_BEATS, &message) == ESP_ERR_NO_MEM) {
+			coalesce_beats(g_batch.amplitudes + first, g_batch.periods + first,
+				f->n_beats);
+			g_stream_frames = 0;
+		} else if (++g_stream_frames >= g_local_batching.keyframe) {
+			g_stream_frames = 0;
+		}
+	}
+}
+
+
+// Dispatches (and empties) the pending sample batch, if any
+static void flush_batch (void) {
+	msg_t message;
+
+	if (g_batch.n_beats == 0) {
+		return;
+	}
+
+	if (g_local_batching.encoding == MSG_ENCODING_DELTA) {
+		send_stream();
+	} else {
+		message.type = MSG_TYPE_SAMPLE_BATCH;
+		message.body.msg_sample_batch = g_batch;
+		if (send_msg(MSG_CHANNEL_BEATS, &message) == ESP_ERR_NO_MEM) {
+			coalesce_beats(g_batch.amplitudes, g_batch.periods, 
+				g_batch.n_beats);
+		}
+	}
+
+	g_batch.n_beats = 0;
+}
+
+
+// Adds a beat (peaking at the given time) to the pending sample batch
+static void batch_sample (uint16_t amplitude, uint16_t rr_period, 
+	uint8_t label, uint32_t time) {
+	uint8_t n = g_batch.n_beats;
+	uint8_t count = (g_local_batching.count > MSG_BATCH_MAX) ? 
+		MSG_BATCH_MAX : g_local_batching.count;
+
+	if (n == 0) {
+		g_batch.timestamp = time;
+	}
+	g_batch.labels[n]     = label;
+	g_batch.amplitudes[n] = amplitude;
+	g_batch.periods[n]    = rr_period;
+
+	// Flush on count
+	if ((g_batch.n_beats = n + 1) >= count) {
+		flush_batch();
+	}
+}
+
+
+/* Dispatches a sample block as waveform frames. Each frame holds as many
+ * samples as its coded residuals leave room for
+*/
+static void send_waveform (uint8_t block) {
+	const uint16_t *samples = g_sample_blocks[block];
+	msg_t message = (msg_t) {
+		.type = MSG_TYPE_WAVEFORM
+	};
+	msg_waveform_data_t *f = &message.body.msg_waveform;
+	size_t off = 0, n, z;
+
+	while (off < DEVICE_SENSOR_PUSH_BUF_SIZE) {
+		n = DEVICE_SENSOR_PUSH_BUF_SIZE - off;
+
+		// The sample count has to fit a byte
+		n = wave_encode(samples + off, (n > UINT8_MAX) ? UINT8_MAX : n, 
+			&f->k, f->data, MSG_WAVE_MAX, &z);
+
+		f->timestamp = g_sample_block_time[block] + 
+			off * DEVICE_SENSOR_POLL_PERIOD_MS;
+		f->first     = samples[off];
+		f->n_samples = n;
+		f->size      = z;
+		send_msg(MSG_CHANNEL_WAVEFORM, &message);
+
+		off += n;
+	}
+}
+
+
+/* Applies the escalation policy to a classified beat. Confident normal beats
+ * are only counted, while uncertain or abnormal beats are escalated. A normal
+ * beat is never escalated for lack of room in the count
+*/
+static void relay_beat (const beat_features_t *beat, uint8_t label, 
+	uint8_t confidence, uint16_t peak, uint32_t time) {
+
+	// Without a policy every beat is relayed (in batches if configured)
+	if (!g_local_policy.enabled) {
+		if (g_local_batching.count > 1 || 
+			g_local_batching.encoding == MSG_ENCODING_DELTA) {
+			batch_sample(beat->amplitude, beat->rr_period, label, time);
+		} else {
+			send_sample(beat->amplitude, beat->rr_period, label);
+		}
+		return;
+	}
+
+	if (label != SAMPLE_LABEL_NORMAL || 
+		confidence < g_local_policy.min_confidence) {
+		send_escalation(beat, label, confidence, peak);
+		return;
+	}
+
+	// A full count is summarized early (the beat is dropped if that fails)
+	if (g_summary_count == UINT16_MAX) {
+		send_summary();
+	}
+	summarize_beat(beat->amplitude, beat->rr_period);
 }
 
 
@@ -85,6 +463,85 @@ static int isPeak (uint16_t value, uint8_t comp, uint16_t threshold) {
 }
 
 
+/* Locates the peaks in a sample block and writes the features of every beat
+ * (pair of consecutive peaks) to the beats array, and the position of its
+ * peak to the peaks array. A peak is the first sample of a run of samples 
+ * passing the detector. Returns the number of beats
+*/
+static size_t detect_beats (const uint16_t *samples, uint8_t comp, 
+	uint16_t threshold, beat_features_t *beats, uint16_t *peaks) {
+	size_t n = 0;
+	int last = -1, in_peak = 0;
+
+	for (int p = 0; p < DEVICE_SENSOR_PUSH_BUF_SIZE; ++p) {
+		int peak = isPeak(samples[p], comp, threshold);
+
+		// Rising edge into a peak
+		if (peak && !in_peak) {
+			if (last >= 0) {
+				peaks[n] = p;
+				beats[n++] = (beat_features_t) {
+					.amplitude = samples[p],
+					.rr_period = DEVICE_SENSOR_POLL_PERIOD_MS * (p - last)
+				};
+			}
+			last = p;
+		}
+		in_peak = peak;
+	}
+
+	return n;
+}
+
+
+// Detects, classifies and relays the beats of a sample block
+static void process_block (uint8_t block, uint8_t relay, uint8_t comp, 
+	uint16_t threshold) {
+	const uint16_t *samples = g_sample_blocks[block];
+	uint32_t time = g_sample_block_time[block];
+	size_t n;
+
+	g_block_samples = samples;
+
+	// Locate all beats in the block
+	n = detect_beats(samples, comp, threshold, g_block_beats, g_block_peaks);
+
+	// Classify them together
+	classify_batch(g_block_beats, n, g_block_labels, g_block_confidences);
+
+	for (size_t i = 0; i < n; ++i) {
+		uint16_t rr_period = g_block_beats[i].rr_period;
+		uint16_t amplitude = g_block_beats[i].amplitude;
+		uint8_t  label     = g_block_labels[i];
+
+		ESP_LOGD("EKG", "%u %u %u (%u)", rr_period, amplitude, label,
+			g_block_confidences[i]);
+
+		// Relay the beat (but only if in relay mode)
+		if (relay) {
+			relay_beat(g_block_beats + i, label, g_block_confidences[i], 
+				g_block_peaks[i], 
+				time + g_block_peaks[i] * DEVICE_SENSOR_POLL_PERIOD_MS);
+		}
+	}
+	g_stat_beats += n;
+
+	// Flush on age (checked once per block)
+	if (g_batch.n_beats > 0 && (uint32_t)(esp_timer_get_time() / 1000) -
+		g_batch.timestamp >= g_local_batching.age) {
+		flush_batch();
+	}
+
+	// Summarize the counted beats every few blocks, and the coalesced beats
+	// as soon as the beat channel has room again
+	if (relay && ((g_local_policy.enabled && 
+		++g_summary_blocks >= g_local_policy.summary_blocks) ||
+		(g_summary_coalesced && !ipc_full(MSG_CHANNEL_BEATS)))) {
+		send_summary();
+	}
+}
+
+
 /*
  *******************************************************************************
  *                            Function Definitions                             *
@@ -98,21 +555,39 @@ static int isPeak (uint16_t value, uint8_t comp, uint16_t threshold) {
 void task_ekg_manager (void *args) {
 	uint32_t  flags    = 0x0;
 	uint8_t   relay    = 0x0;     // Initially not relaying
+	uint8_t   wave     = 0x0;     // Initially not streaming samples
 	uint8_t   cfg_comp = 0x0;
 	uint16_t  cfg_val  = 2450;    
-	int p1, p2;
+	uint8_t   block    = 0;
 
 	// Configure output pin for LED
 	gpio_pad_select_gpio(LED_PIN);
     gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
 
+	// Start with no feedback scored
+	for (size_t t = 0; t < CLASSIFIER_TYPE_MAX; ++t) {
+		classifier_bench_reset(g_feedback_bench + t);
+	}
+
+	// Start with the default escalation policy and batching
+	g_local_policy = g_policy;
+	g_local_batching = g_batching;
+
+	// Initialize the classifier backends
+	if (classifier_init() != ESP_OK) {
+		task_panic("Couldn't initialize the classifier", ESP_OK);
+	}
+
 	do {
 
 		// Unset LED
 		gpio_set_level(LED_PIN, 0);
 
-		// Wait indefinitely for a flag to be set (clear all automatically)
-		flags = xEventGroupWaitBits(g_event_group, MASK_EKG_FLAGS | FLAG_BLE_DISCONNECTED, pdFALSE,
+		/* Wait indefinitely for a flag to be set (clear all automatically).
+		 * Only EKG flags are waited on: the BLE flags stay set, and waiting
+		 * on one would spin this task and starve the idle task of its core
+		*/
+		flags = xEventGroupWaitBits(g_event_group, MASK_EKG_FLAGS, pdFALSE,
 			pdFALSE, portMAX_DELAY);
 
         // Clear the EKG flags
@@ -122,83 +597,79 @@ void task_ekg_manager (void *args) {
 		if (flags & FLAG_EKG_CONFIGURE) {
 			cfg_comp = g_cfg_comp;
 			cfg_val  = g_cfg_val;
-			memcpy(g_local_n_periods,    g_n_periods,    20 * sizeof(uint16_t));
-			memcpy(g_local_n_amplitudes, g_n_amplitudes, 20 * sizeof(uint16_t));
-			memcpy(g_local_a_periods,    g_a_periods,    10 * sizeof(uint16_t));
-			memcpy(g_local_a_amplitudes, g_a_amplitudes, 10 * sizeof(uint16_t));
-			memcpy(g_local_v_periods,    g_v_periods,    10 * sizeof(uint16_t));
-			memcpy(g_local_v_amplitudes, g_v_amplitudes, 10 * sizeof(uint16_t));
-
-			// DEBUG: Log the training data
-            for (int i = 0; i < 20; ++i) {
-                printf("Normal: period = %u amplitude = %u\n", g_local_n_periods[i], g_local_n_amplitudes[i]);
-            }
-            for (int i = 0; i < 10; ++i) {
-            	printf("Atrial: period = %u amplitude = %u\n", g_local_a_periods[i], g_local_a_amplitudes[i]);
-            }
-            for (int i = 0; i < 10; ++i) {
-            	printf("Ventrical: period = %u amplitude = %u\n", g_local_v_periods[i], g_local_v_amplitudes[i]);
-            }
-		}
-
-		// If the start flag is set: Enable relaying
+			g_local_policy = g_policy;
+			g_local_batching = g_batching;
+			g_stream_frames = 0;
+			memcpy(g_local_train.n_periods,    g_n_periods,    KNN_N_SAMPLES * sizeof(uint16_t));
+			memcpy(g_local_train.n_amplitudes, g_n_amplitudes, KNN_N_SAMPLES * sizeof(uint16_t));
+			memcpy(g_local_train.a_periods,    g_a_periods,    KNN_A_SAMPLES * sizeof(uint16_t));
+			memcpy(g_local_train.a_amplitudes, g_a_amplitudes, KNN_A_SAMPLES * sizeof(uint16_t));
+			memcpy(g_local_train.v_periods,    g_v_periods,    KNN_V_SAMPLES * sizeof(uint16_t));
+			memcpy(g_local_train.v_amplitudes, g_v_amplitudes, KNN_V_SAMPLES * sizeof(uint16_t));
+
+			// Log the training data (debug builds only)
+			for (int i = 0; i < KNN_N_SAMPLES; ++i) {
+				ESP_LOGD("EKG", "Normal: period = %u amplitude = %u", 
+					g_local_train.n_periods[i], g_local_train.n_amplitudes[i]);
+			}
+			for (int i = 0; i < KNN_A_SAMPLES; ++i) {
+				ESP_LOGD("EKG", "Atrial: period = %u amplitude = %u", 
+					g_local_train.a_periods[i], g_local_train.a_amplitudes[i]);
+			}
+			for (int i = 0; i < KNN_V_SAMPLES; ++i) {
+				ESP_LOGD("EKG", "Ventricular: period = %u amplitude = %u", 
+					g_local_train.v_periods[i], g_local_train.v_amplitudes[i]);
+			}
+
+			// Install the models
+			configure_classifier();
+		}
+
+		// Learn from any labeled beats received since the last wake-up
+		apply_feedback();
+
+		// If the benchmark flag is set: Measure the classifiers
+		if (flags & FLAG_EKG_BENCHMARK) {
+			run_benchmark();
+		}
+
+		// If the start flag is set: Enable relaying (from a keyframe)
 		if (flags & FLAG_EKG_START) {
+			g_stream_frames = 0;
 			relay = 1;
 		}
 
 		// If the stop flag is set: Disable relaying
 		if (flags & FLAG_EKG_STOP) {
+			flush_batch();
 			relay = 0;
 		}
 
-		// If a tick occurred: Copy and process the buffer
+		// If the waveform start flag is set: Enable sample streaming
+		if (flags & FLAG_EKG_WAVE_START) {
+			wave = 1;
+		}
+
+		// If the waveform stop flag is set: Disable sample streaming
+		if (flags & FLAG_EKG_WAVE_STOP) {
+			wave = 0;
+		}
+
+		// If a tick occurred: Process the queued blocks
 		if (flags & FLAG_EKG_TICK) {
 
 			// Flash LED to show pulse
  			gpio_set_level(LED_PIN, 1);
 
-			// Lock the mutex and copy over the data
-			portENTER_CRITICAL(&g_sample_buffer_mutex);
-			memcpy(g_local_sample_buffer, g_sample_buffer, 
-				DEVICE_SENSOR_PUSH_BUF_SIZE * sizeof(uint16_t));
-			portEXIT_CRITICAL(&g_sample_buffer_mutex);
-
-			// Just output the samples for now
-			// for (p1 = 0; p1 < DEVICE_SENSOR_PUSH_BUF_SIZE; ++p1) {
-			// 	printf("%u\n", g_local_sample_buffer[p1]);
-			// }
-
-			// Look for a first peak
-			for (p1 = 0; p1 < DEVICE_SENSOR_PUSH_BUF_SIZE; ++p1) {
-				if (isPeak(g_local_sample_buffer[p1], cfg_comp, cfg_val)) {
-					break;
-				}
-			}
-
-			// If no peak found, then just continue now
-			if (p1 >= DEVICE_SENSOR_PUSH_BUF_SIZE) continue;
+			// Process every block handed over since the last tick
+			while (xQueueReceive(g_block_queue, &block, 0) == pdPASS) {
+				process_block(block, relay, cfg_comp, cfg_val);
 
-			// Search for a second peak
-			for (p2 = p1 + 1; p2 < DEVICE_SENSOR_PUSH_BUF_SIZE; ++p2) {
-				if (isPeak(g_local_sample_buffer[p2], cfg_comp, cfg_val)) {
-					break;
+				// Stream the block itself (but only if in waveform mode)
+				if (wave) {
+					send_waveform(block);
 				}
 			}
-
-			// If no peak found, then also continue here
-			if (p2 >= DEVICE_SENSOR_PUSH_BUF_SIZE) continue;
-
-			// Otherwise compute the features
-			uint16_t rr_period    = 10 * (p2 - p1); // Period in ms
-			uint16_t amplitude    = g_local_sample_buffer[p2];
-			uint8_t  label        = classify_knn(amplitude, rr_period);
-
-			printf("%u %u %u\n", rr_period, amplitude, label);
-
-			// Send sample (but only if in relay mode)
-			if (relay) {
-				send_sample(amplitude, rr_period, label);
-			}
 		}
 
 	} while (1);
@@ -8,8 +8,8 @@
 */
 
 
-// The local sample buffer
-static uint16_t g_local_sample_buffer[DEVICE_SENSOR_PUSH_BUF_SIZE];
+// Number of blocks dropped because the process stage fell behind
+static uint32_t g_dropped_blocks;
 
 
 /*
@@ -21,35 +21,49 @@ static uint16_t g_local_sample_buffer[DEVICE_SENSOR_PUSH_BUF_SIZE];
 
 void task_sample_manager (void *args) {
 	int adc_val = 0;
+	uint8_t block = 0;     // Index of the block being filled
 
 	// The sampling period ~ (100Hz)
 	const TickType_t period = 10 / portTICK_PERIOD_MS;
 
+	// Tick of the last sample. Samples keep to the period even if the task
+	// was held (a flash erase holds it for up to 400 ms), so only those due
+	// meanwhile are late
+	TickType_t last = xTaskGetTickCount();
+
 	// Configure ADC (ADC2, pin 14)
 	adc2_config_channel_atten(DEVICE_EKG_PIN, ADC_ATTEN_11db);
 
 	// Task loop
 	do {
 
-		// Fill the buffer with samples
+		uint16_t *samples = g_sample_blocks[block];
+
+		// Note when the block starts (the first sample is one period later)
+		g_sample_block_time[block] = esp_timer_get_time() / 1000 + 
+			DEVICE_SENSOR_POLL_PERIOD_MS;
+
+		// Fill the block with samples
 		for (int i = 0; i < DEVICE_SENSOR_PUSH_BUF_SIZE; ++i) {
 
 			// Delay for fixed sample intervals
-			vTaskDelay(period);
+			vTaskDelayUntil(&last, period);
 
 			// Read ADC value (no error checking)
 			adc2_get_raw(DEVICE_EKG_PIN, ADC_WIDTH_12Bit, &adc_val);
 
 			// Push to buffer
-			g_local_sample_buffer[i] = (uint16_t)adc_val;
+			samples[i] = (uint16_t)adc_val;
 
 		}
 
-		// Lock the mutex and copy over the data
-		portENTER_CRITICAL(&g_sample_buffer_mutex);
-		memcpy(g_sample_buffer, g_local_sample_buffer, 
-			DEVICE_SENSOR_PUSH_BUF_SIZE * sizeof(uint16_t));
-		portEXIT_CRITICAL(&g_sample_buffer_mutex);
+		// Hand the block over, or refill it if the queue is full (dropped)
+		if (xQueueSendToBack(g_block_queue, &block, 0) != pdPASS) {
+			ESP_LOGW("Sample", "Process stage behind, dropped %u blocks", 
+				++g_dropped_blocks);
+			continue;
+		}
+		block = (block + 1) % DEVICE_SAMPLE_BLOCKS;
 
 		// Notify the EKG task that new data is available
 		xEventGroupSetBits(g_event_group, FLAG_EKG_TICK);
@@ -0,0 +1,165 @@
+#include "wave_codec.h"
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a position in a bit stream
+typedef struct {
+	uint8_t *buffer;                        // Buffer holding the stream
+	size_t   bits;                          // Bits written or read so far
+} bit_stream_t;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Maps a signed residual to an unsigned value (0, -1, 1, -2, ... -> 0, 1, 2, 3)
+static uint32_t zigzag (int16_t residual) {
+	return (((uint32_t)residual << 1) ^ (uint32_t)(residual >> 15)) & 0xFFFF;
+}
+
+
+// Inverts zigzag
+static uint16_t unzigzag (uint32_t value) {
+	return (uint16_t)((value >> 1) ^ -(value & 0x1));
+}
+
+
+// Returns the prediction of sample i (i > 0) from the samples before it
+static uint16_t predict (const uint16_t *samples, size_t i) {
+	return (i == 1) ? samples[0] : 2 * samples[i - 1] - samples[i - 2];
+}
+
+
+// Writes the low n bits of a value (most significant first)
+static void bits_put (bit_stream_t *s, uint32_t value, uint8_t n) {
+	while (n-- > 0) {
+		if ((s->bits & 0x7) == 0) {
+			s->buffer[s->bits >> 3] = 0;
+		}
+		if ((value >> n) & 0x1) {
+			s->buffer[s->bits >> 3] |= 0x80 >> (s->bits & 0x7);
+		}
+		s->bits++;
+	}
+}
+
+
+// Reads n bits (most significant first). The caller checks the bounds
+static uint32_t bits_get (bit_stream_t *s, uint8_t n) {
+	uint32_t value = 0;
+
+	while (n-- > 0) {
+		value = (value << 1) |
+			((s->buffer[s->bits >> 3] >> (7 - (s->bits & 0x7))) & 0x1);
+		s->bits++;
+	}
+
+	return value;
+}
+
+
+/*
+ *******************************************************************************
+ *                        External Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+size_t wave_encode (const uint16_t *samples, size_t n, uint8_t *k,
+	uint8_t *buffer, size_t cap, size_t *size) {
+	bit_stream_t s = {.buffer = buffer, .bits = 0};
+	uint32_t sum = 0;
+	size_t i;
+
+	*k = 0;
+	*size = 0;
+	if (n == 0) {
+		return 0;
+	}
+
+	// Pick the parameter nearest the mean residual (2^k <= mean)
+	for (i = 1; i < n; ++i) {
+		sum += zigzag((int16_t)(samples[i] - predict(samples, i)));
+	}
+	while (*k < WAVE_CODEC_K_MAX && ((uint32_t)(n - 1) << (*k + 1)) <= sum) {
+		(*k)++;
+	}
+
+	// Code residuals until the buffer is full
+	for (i = 1; i < n; ++i) {
+		uint32_t u = zigzag((int16_t)(samples[i] - predict(samples, i)));
+		uint32_t q = u >> *k;
+
+		if (q < WAVE_CODEC_ESCAPE) {
+			if (s.bits + q + 1 + *k > 8 * cap) {
+				break;
+			}
+			bits_put(&s, ((1 << q) - 1) << 1, q + 1);
+			bits_put(&s, u, *k);
+		} else {
+			if (s.bits + WAVE_CODEC_ESCAPE + WAVE_CODEC_RAW_BITS > 8 * cap) {
+				break;
+			}
+			bits_put(&s, (1 << WAVE_CODEC_ESCAPE) - 1, WAVE_CODEC_ESCAPE);
+			bits_put(&s, u, WAVE_CODEC_RAW_BITS);
+		}
+	}
+
+	*size = (s.bits + 7) >> 3;
+
+	return i;
+}
+
+
+int wave_decode (uint16_t first, uint8_t k, const uint8_t *buffer,
+	size_t size, uint16_t *samples, size_t n) {
+	bit_stream_t s = {.buffer = (uint8_t *)buffer, .bits = 0};
+	size_t limit = 8 * size;
+
+	if (n == 0 || k > WAVE_CODEC_K_MAX) {
+		return -1;
+	}
+	samples[0] = first;
+
+	for (size_t i = 1; i < n; ++i) {
+		uint32_t q = 0, u;
+
+		// Unary quotient (or escape)
+		while (q < WAVE_CODEC_ESCAPE) {
+			if (s.bits >= limit) {
+				return -1;
+			}
+			if (bits_get(&s, 1) == 0) {
+				break;
+			}
+			q++;
+		}
+
+		// Remainder (or the escaped residual)
+		if (q == WAVE_CODEC_ESCAPE) {
+			if (s.bits + WAVE_CODEC_RAW_BITS > limit) {
+				return -1;
+			}
+			u = bits_get(&s, WAVE_CODEC_RAW_BITS);
+		} else {
+			if (s.bits + k > limit) {
+				return -1;
+			}
+			u = (q << k) | bits_get(&s, k);
+		}
+
+		samples[i] = predict(samples, i) + unzigzag(u);
+	}
+
+	return 0;
+}
@@ -0,0 +1,228 @@
+#include <math.h>
+#include "beats.h"
+#include "config.h"
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing the distribution of a class
+typedef struct {
+	double amplitude, amplitude_sd;
+	double rr_period, rr_period_sd;
+} beats_class_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Distribution of each class (by label)
+static const beats_class_t g_beats_classes[4] = {
+	[SAMPLE_LABEL_NORMAL]    = {2000.0, 180.0, 800.0, 70.0},
+	[SAMPLE_LABEL_ATRIAL]    = {2250.0, 150.0, 470.0, 50.0},
+	[SAMPLE_LABEL_VENTRICAL] = {2950.0, 220.0, 500.0, 60.0}
+};
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns a uniform draw in (0, 1) (xorshift32)
+static double beats_uniform (uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return (x + 0.5) / 4294967296.0;
+}
+
+
+// Returns a standard normal draw (Box-Muller)
+static double beats_normal (uint32_t *state) {
+	double u = beats_uniform(state), v = beats_uniform(state);
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+
+// Clamps a feature to its 16-bit range
+static uint16_t beats_clamp (double value) {
+	return (value < 0.0) ? 0 : (value > UINT16_MAX) ? UINT16_MAX : 
+		(uint16_t)lround(value);
+}
+
+
+// Allocates a set of n beats
+static void beats_alloc (beats_t *set, size_t n) {
+	set->features = malloc(n * sizeof(beat_features_t));
+	set->labels   = malloc(n * sizeof(sample_label_t));
+	set->n        = n;
+}
+
+
+/*
+ *******************************************************************************
+ *                        External Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+void beats_generate (beats_t *set, size_t n, const beats_model_t *model) {
+	uint32_t state = (model->seed == 0) ? 1 : model->seed;
+
+	beats_alloc(set, n);
+
+	for (size_t i = 0; i < n; ++i) {
+		double r = 100.0 * beats_uniform(&state);
+		double f = (n > 1) ? (double)i / (n - 1) : 0.0;
+		sample_label_t label = (r >= model->abnormal) ? SAMPLE_LABEL_NORMAL :
+			(r < model->abnormal / 2.0) ? SAMPLE_LABEL_ATRIAL : 
+			SAMPLE_LABEL_VENTRICAL;
+		const beats_class_t *c = g_beats_classes + label;
+
+		set->labels[i] = label;
+		set->features[i] = (beat_features_t) {
+			.amplitude = beats_clamp(c->amplitude + f * model->drift_amplitude
+				+ c->amplitude_sd * beats_normal(&state)),
+			.rr_period = beats_clamp(c->rr_period + f * model->drift_period
+				+ c->rr_period_sd * beats_normal(&state))
+		};
+	}
+}
+
+
+esp_err_t beats_read (beats_t *set, const char *path) {
+	FILE *file;
+	char line[128], tag;
+	unsigned amplitude, rr_period;
+	size_t cap = 1024;
+
+	if ((file = fopen(path, "r")) == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	beats_alloc(set, cap);
+	set->n = 0;
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		sample_label_t label;
+
+		if (sscanf(line, "%u,%u,%c", &amplitude, &rr_period, &tag) != 3 ||
+			amplitude > UINT16_MAX || rr_period > UINT16_MAX) {
+			continue;
+		}
+		switch (tag) {
+			case 'N': case '1': label = SAMPLE_LABEL_NORMAL;    break;
+			case 'A': case '2': label = SAMPLE_LABEL_ATRIAL;    break;
+			case 'V': case '3': label = SAMPLE_LABEL_VENTRICAL; break;
+			default: continue;
+		}
+
+		// Grow the set as needed
+		if (set->n == cap) {
+			cap *= 2;
+			set->features = realloc(set->features, cap * 
+				sizeof(beat_features_t));
+			set->labels = realloc(set->labels, cap * sizeof(sample_label_t));
+		}
+		set->features[set->n] = (beat_features_t) {
+			.amplitude = amplitude,
+			.rr_period = rr_period
+		};
+		set->labels[set->n++] = label;
+	}
+	fclose(file);
+
+	return (set->n == 0) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+
+esp_err_t beats_blob (const beats_t *set, uint8_t *blob) {
+	const size_t counts[3] = {KNN_N_SAMPLES, KNN_A_SAMPLES, KNN_V_SAMPLES};
+
+	// Each class is stored as periods[count] followed by amplitudes[count]
+	for (size_t c = 0; c < 3; ++c) {
+		size_t taken = 0;
+
+		for (size_t i = 0; i < set->n && taken < counts[c]; ++i) {
+			const beat_features_t *f = set->features + i;
+			uint8_t *p = blob + 2 * taken, *a = blob + 2 * (counts[c] + taken);
+
+			if (set->labels[i] != SAMPLE_LABEL_NORMAL + c) {
+				continue;
+			}
+			p[0] = f->rr_period & 0xFF;
+			p[1] = f->rr_period >> 8;
+			a[0] = f->amplitude & 0xFF;
+			a[1] = f->amplitude >> 8;
+			taken++;
+		}
+		if (taken < counts[c]) {
+			return ESP_ERR_NOT_FOUND;
+		}
+		blob += 4 * counts[c];
+	}
+
+	return ESP_OK;
+}
+
+
+void beats_signal_init (beats_signal_t *signal, const beats_t *set, 
+	uint32_t seed) {
+	*signal = (beats_signal_t) {
+		.set   = set,
+		.state = (seed == 0) ? 1 : seed,
+		.last  = UINT32_MAX,
+		.wait  = set->features[0].rr_period / DEVICE_SENSOR_POLL_PERIOD_MS
+	};
+}
+
+
+void beats_signal_fill (beats_signal_t *signal, uint16_t *samples, size_t n) {
+	for (size_t i = 0; i < n; ++i, ++signal->t) {
+		const beat_features_t *f = signal->set->features + signal->next;
+		uint16_t peak = (f->amplitude > BEATS_SIGNAL_THRESHOLD) ? 
+			f->amplitude : BEATS_SIGNAL_THRESHOLD;
+		double level = BEATS_SIGNAL_BASELINE + 60.0 * sin(signal->t / 50.0) +
+			8.0 * beats_normal(&signal->state);
+
+		// The samples beside a peak rise a third of the way (under threshold)
+		if (signal->wait == 1 || (signal->last != UINT32_MAX &&
+			signal->t == signal->last + 1)) {
+			level += (peak - BEATS_SIGNAL_BASELINE) / 3;
+			if (level >= BEATS_SIGNAL_THRESHOLD) {
+				level = BEATS_SIGNAL_THRESHOLD - 1;
+			}
+		}
+		samples[i] = (signal->wait == 0) ? peak : beats_clamp(level);
+
+		// Move on to the next beat after a peak
+		if (signal->wait-- == 0) {
+			signal->last = signal->t;
+			signal->next = (signal->next + 1) % signal->set->n;
+			f = signal->set->features + signal->next;
+			signal->wait = f->rr_period / DEVICE_SENSOR_POLL_PERIOD_MS;
+			signal->wait = (signal->wait < 3) ? 3 : signal->wait;
+			signal->wait--;
+		}
+	}
+}
+
+
+void beats_free (beats_t *set) {
+	free(set->features);
+	free(set->labels);
+	*set = (beats_t) {0};
+}
@@ -0,0 +1,158 @@
+#if !defined(BEATS_H)
+#define BEATS_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 02/12/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Labeled beat sets for the host tests. Sets are read from CSV files, or     *
+ *  drawn from a seeded synthetic model of the three beat classes, and can be  *
+ *  rendered as a sensor signal                                                *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include "classifier.h"
+
+
+// Sensor level between beats, and the level peaks are detected at or over
+#define     BEATS_SIGNAL_BASELINE                   1000
+#define     BEATS_SIGNAL_THRESHOLD                  1500
+
+
+/* The synthetic model draws each class from a normal distribution per feature.
+ * Normal beats have a regular rhythm, atrial beats are premature with a low
+ * amplitude and ventrical beats are premature with a high amplitude, which is
+ * the split the built-in tree and MLP models are made for. The classes
+ * overlap, so no backend scores every beat. It stands in for recorded beats
+ * (such as annotated MIT-BIH records) when no CSV file is given
+ *
+ * CSV files hold one beat per line: amplitude,rr_period,label where the label
+ * is N, A or V (or 1, 2, 3). Other lines are skipped
+*/
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a labeled beat set
+typedef struct {
+	beat_features_t *features;
+	sample_label_t  *labels;
+	size_t           n;
+} beats_t;
+
+
+// Structure describing a sensor signal rendered from a beat set
+typedef struct {
+	const beats_t *set;         // The beats (rendered in order, then again)
+	size_t         next;        // Beat peaking next
+	uint32_t       wait;        // Samples until it peaks
+	uint32_t       state;       // State of the noise
+	uint32_t       t;           // Samples rendered
+	uint32_t       last;        // Sample of the last peak
+} beats_signal_t;
+
+
+// Structure describing how a synthetic set is drawn
+typedef struct {
+	uint32_t seed;              // Seed of the draw (same seed, same beats)
+	uint8_t  abnormal;          // Percentage of atrial plus ventrical beats
+	int16_t  drift_amplitude;   // Change of every class mean over the set
+	int16_t  drift_period;      // Change of every class mean over the set (ms)
+} beats_model_t;
+
+
+/*
+ *******************************************************************************
+ *                            Function Declarations                            *
+ *******************************************************************************
+*/
+
+
+/* @brief Draws a synthetic beat set. Means drift linearly over the set
+ *
+ * @param
+ * - set:   Receives the set (free with beats_free)
+ * - n:     Number of beats
+ * - model: How the beats are drawn
+ *
+ * @return None
+*/
+void beats_generate (beats_t *set, size_t n, const beats_model_t *model);
+
+
+/* @brief Reads a beat set from a CSV file
+ *
+ * @param
+ * - set:  Receives the set (free with beats_free)
+ * - path: Path of the file
+ *
+ * @return
+ * - ESP_OK: The set was read
+ * - ESP_ERR_NOT_FOUND: The file couldn't be opened
+ * - ESP_ERR_INVALID_SIZE: The file holds no beats
+*/
+esp_err_t beats_read (beats_t *set, const char *path);
+
+
+/* @brief Packs a training blob (the KNN layout) from the first beats of each
+ *        class in a set
+ *
+ * @param
+ * - set:  The set
+ * - blob: Receives KNN_BLOB_SIZE bytes
+ *
+ * @return
+ * - ESP_OK: The blob was packed
+ * - ESP_ERR_NOT_FOUND: The set lacks beats of some class
+*/
+esp_err_t beats_blob (const beats_t *set, uint8_t *blob);
+
+
+/* @brief Starts rendering a beat set as a sensor signal. The signal wanders
+ *        around BEATS_SIGNAL_BASELINE, and every beat is a QRS complex of
+ *        three samples whose middle one is the first over the threshold.
+ *        Periods are rounded to the sensor period, and amplitudes are raised
+ *        to the threshold
+ *
+ * @param
+ * - signal: The signal
+ * - set:    The beats (the first beat peaks after its own period)
+ * - seed:   Seed of the noise
+ *
+ * @return None
+*/
+void beats_signal_init (beats_signal_t *signal, const beats_t *set, 
+	uint32_t seed);
+
+
+/* @brief Renders the next samples of a signal
+ *
+ * @param
+ * - signal:  The signal
+ * - samples: Receives n samples
+ * - n:       Number of samples
+ *
+ * @return None
+*/
+void beats_signal_fill (beats_signal_t *signal, uint16_t *samples, size_t n);
+
+
+/* @brief Releases a beat set */
+void beats_free (beats_t *set);
+
+
+#endif
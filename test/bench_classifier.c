@@ -0,0 +1,94 @@
+#include "test.h"
+#include "beats.h"
+#include "classifier_bench.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Beats in the synthetic training set (the blob takes the first of each class)
+#define TRAIN_BEATS                 (8 * KNN_SAMPLES)
+
+// Beats in the synthetic held-out test set
+#define TEST_BEATS                  4000
+
+// Lowest accuracy (percent) of the KNN backend on the synthetic test set
+#define KNN_ACCURACY_MIN            85
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns the accuracy (percent) in the confusion matrix of a result
+static double accuracy (const classifier_bench_t *bench) {
+	uint32_t right = 0, total = 0;
+
+	for (int t = 0; t < 4; ++t) {
+		for (int g = 0; g < 4; ++g) {
+			total += bench->confusion[t][g];
+			right += (t == g) ? bench->confusion[t][g] : 0;
+		}
+	}
+	return (total == 0) ? 0.0 : (100.0 * right) / total;
+}
+
+
+/* Benchmarks every backend on a held-out test set, after training the KNN
+ * and NCM backends on a separate training set. Usage:
+ *
+ *   bench_classifier_<variant> [<train.csv> <test.csv>]
+ *
+ * CSV lines are "amplitude,rr_period,label" (label N, A, V or 1, 2, 3), as 
+ * derived from annotated ECG records. Without files, both sets are drawn from
+ * the synthetic model with different seeds. Each backend is reported as one
+ * BENCH line named <backend>/k<K>/n<training samples>
+*/
+int main (int argc, char *argv[]) {
+	const beats_model_t train_model = {.seed = 4, .abnormal = 30};
+	const beats_model_t test_model = {.seed = 17, .abnormal = 20};
+	uint8_t blob[KNN_BLOB_SIZE];
+	classifier_bench_t bench;
+	beats_t train, test;
+	char name[32];
+
+	if (argc == 3) {
+		CHECK(beats_read(&train, argv[1]) == ESP_OK);
+		CHECK(beats_read(&test, argv[2]) == ESP_OK);
+	} else {
+		beats_generate(&train, TRAIN_BEATS, &train_model);
+		beats_generate(&test, TEST_BEATS, &test_model);
+	}
+	if (g_test_failures > 0 || beats_blob(&train, blob) != ESP_OK) {
+		fprintf(stderr, "Training set needs %u/%u/%u beats of N/A/V\n",
+			KNN_N_SAMPLES, KNN_A_SAMPLES, KNN_V_SAMPLES);
+		return 1;
+	}
+
+	CHECK(classifier_init() == ESP_OK);
+	CHECK(classifier_load(CLASSIFIER_KNN, blob, KNN_BLOB_SIZE) == ESP_OK);
+	CHECK(classifier_load(CLASSIFIER_NCM, blob, KNN_BLOB_SIZE) == ESP_OK);
+
+	for (classifier_type_t t = 0; t < CLASSIFIER_TYPE_MAX; ++t) {
+		CHECK(classifier_bench_run(t, test.features, test.labels, test.n,
+			&bench) == ESP_OK);
+		snprintf(name, sizeof(name), "%s/k%u/n%u", classifier_get(t)->name,
+			K_VALUE, KNN_SAMPLES);
+		classifier_bench_print(name, &bench);
+
+		if (t == CLASSIFIER_KNN && argc != 3) {
+			CHECK(accuracy(&bench) >= KNN_ACCURACY_MIN);
+		}
+	}
+
+	beats_free(&train);
+	beats_free(&test);
+	return TEST_RESULT();
+}
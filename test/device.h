@@ -0,0 +1,52 @@
+#if !defined(DEVICE_H)
+#define DEVICE_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 02/12/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  The globals ekg_main.c owns on the device, for the tests that include the  *
+ *  tasks (replay.h and link.h). Include this once, in the test source         *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include "config.h"
+#include "msg.h"
+#include "classifier.h"
+#include "beats.h"
+
+
+/*
+ *******************************************************************************
+ *                       Globals Owned by ekg_main.c                           *
+ *******************************************************************************
+*/
+
+
+uint8_t g_cfg_comp = 0x0;
+uint16_t g_cfg_val = BEATS_SIGNAL_THRESHOLD;
+uint16_t g_sample_blocks[DEVICE_SAMPLE_BLOCKS][DEVICE_SENSOR_PUSH_BUF_SIZE];
+uint32_t g_sample_block_time[DEVICE_SAMPLE_BLOCKS];
+uint16_t g_n_periods[20];
+uint16_t g_n_amplitudes[20];
+uint16_t g_a_periods[10];
+uint16_t g_a_amplitudes[10];
+uint16_t g_v_periods[10];
+uint16_t g_v_amplitudes[10];
+uint8_t g_model_type = CLASSIFIER_KNN;
+uint8_t g_model_size = 0;
+uint8_t g_model_data[MSG_MODEL_DATA_MAX];
+msg_policy_data_t g_policy;
+msg_batching_data_t g_batching;
+
+
+#endif
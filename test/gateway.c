@@ -0,0 +1,50 @@
+#include <string.h>
+#include "gateway.h"
+#include "ekg_msg.h"
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Counts a decoded message
+static void count_msg (const msg_t *msg, const ekg_msg_frame_t *frame, 
+	void *ctx) {
+	(*(size_t *)ctx)++;
+}
+
+
+/*
+ *******************************************************************************
+ *                        External Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+int gateway_decode (const uint8_t *buffer, size_t len, uint8_t *type,
+	void *body, size_t cap) {
+	msg_t msg;
+	int z;
+
+	if (cap < sizeof(msg_body_t)) {
+		return -1;
+	}
+	memset(&msg, 0, sizeof(msg));
+	if ((z = ekg_msg_decode(buffer, len, &msg, NULL)) > 0) {
+		*type = msg.type;
+		memset(body, 0, cap);
+		memcpy(body, &msg.body, sizeof(msg_body_t));
+	}
+	return z;
+}
+
+
+size_t gateway_decode_stream (const uint8_t *buffer, size_t len) {
+	size_t n = 0;
+
+	ekg_msg_decode_stream(buffer, len, count_msg, &n);
+	return n;
+}
@@ -0,0 +1,59 @@
+#if !defined(GATEWAY_H)
+#define GATEWAY_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 02/12/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Runs the gateway decoder (gateway/ekg_msg.c) for the host tests. It is     *
+ *  built apart from the firmware, since both define msg_t                     *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/*
+ *******************************************************************************
+ *                            Function Declarations                            *
+ *******************************************************************************
+*/
+
+
+/* @brief Decodes the frame at the start of a buffer with the gateway decoder
+ *
+ * @param
+ * - buffer: The frame
+ * - len:    Length of the frame
+ * - type:   Receives the message type
+ * - body:   Receives the decoded body (zeroed first)
+ * - cap:    Capacity of the body (at least the gateway's sizeof(msg_body_t))
+ *
+ * @return Bytes consumed (> 0), 0 if incomplete, or -1 if not a valid frame
+*/
+int gateway_decode (const uint8_t *buffer, size_t len, uint8_t *type,
+	void *body, size_t cap);
+
+
+/* @brief Decodes a buffer of frames with the gateway stream decoder
+ *
+ * @param
+ * - buffer: The frames
+ * - len:    Length of the frames
+ *
+ * @return Number of messages decoded
+*/
+size_t gateway_decode_stream (const uint8_t *buffer, size_t len);
+
+
+#endif
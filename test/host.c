@@ -0,0 +1,478 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "host.h"
+#include "esp_timer.h"
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_gatts_api.h"
+#include "esp_gatt_common_api.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/adc.h"
+#include "xtensa/hal.h"
+#include "sdkconfig.h"
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a queue (copies of items in a ring)
+struct host_queue {
+	size_t   length;
+	size_t   item_size;
+	size_t   head;
+	size_t   count;
+	uint8_t  items[];
+};
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+int64_t g_host_time_us;
+EventBits_t g_host_event_bits;
+int (*g_host_wait_hook)(EventBits_t bits, TickType_t ticks);
+uint32_t g_host_wait_spins;
+int64_t g_host_wait_began;
+esp_err_t (*g_host_indicate_hook)(uint16_t len, uint8_t *value, 
+	bool need_confirm);
+esp_err_t (*g_host_conn_params_hook)(
+	const esp_ble_conn_update_params_t *params);
+esp_err_t (*g_host_data_len_hook)(uint16_t tx_len);
+int (*g_host_adc_hook)(void);
+host_flash_t g_host_flash = {.write_budget = -1};
+
+
+// The simulated beat log partition and its contents
+static esp_partition_t g_host_partition = {
+	.type    = ESP_PARTITION_TYPE_DATA,
+	.subtype = 0x40,
+	.label   = "beatlog"
+};
+static uint8_t *g_host_flash_data;
+
+
+// The only event group
+static int g_host_event_group;
+
+
+/*
+ *******************************************************************************
+ *                          Host Function Definitions                          *
+ *******************************************************************************
+*/
+
+
+void host_advance_us (uint64_t us) {
+	g_host_time_us += us;
+}
+
+
+uint64_t host_ns (void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+
+void host_flash_reset (size_t size) {
+	free(g_host_flash_data);
+	g_host_flash_data = NULL;
+	g_host_partition.size = size;
+	if (size > 0) {
+		g_host_flash_data = malloc(size);
+		memset(g_host_flash_data, 0xFF, size);
+	}
+	g_host_flash = (host_flash_t) {
+		.write_budget = -1
+	};
+}
+
+
+uint8_t *host_flash_data (void) {
+	return g_host_flash_data;
+}
+
+
+/*
+ *******************************************************************************
+ *                           ESP-IDF Stand-ins                                 *
+ *******************************************************************************
+*/
+
+
+const char *esp_err_to_name (esp_err_t code) {
+	switch (code) {
+		case ESP_OK:                   return "ESP_OK";
+		case ESP_FAIL:                 return "ESP_FAIL";
+		case ESP_ERR_NO_MEM:           return "ESP_ERR_NO_MEM";
+		case ESP_ERR_INVALID_ARG:      return "ESP_ERR_INVALID_ARG";
+		case ESP_ERR_INVALID_STATE:    return "ESP_ERR_INVALID_STATE";
+		case ESP_ERR_INVALID_SIZE:     return "ESP_ERR_INVALID_SIZE";
+		case ESP_ERR_NOT_FOUND:        return "ESP_ERR_NOT_FOUND";
+		case ESP_ERR_NOT_SUPPORTED:    return "ESP_ERR_NOT_SUPPORTED";
+		case ESP_ERR_TIMEOUT:          return "ESP_ERR_TIMEOUT";
+		case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+		case ESP_ERR_INVALID_CRC:      return "ESP_ERR_INVALID_CRC";
+		case ESP_ERR_INVALID_VERSION:  return "ESP_ERR_INVALID_VERSION";
+		default:                       return "UNKNOWN ERROR";
+	}
+}
+
+
+int64_t esp_timer_get_time (void) {
+	return g_host_time_us;
+}
+
+
+uint32_t xthal_get_ccount (void) {
+	return (uint32_t)((host_ns() * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ) / 1000);
+}
+
+
+// Flash stand-in ---------------------------------------------------------------
+
+
+const esp_partition_t *esp_partition_find_first (esp_partition_type_t type,
+	esp_partition_subtype_t subtype, const char *label) {
+	if (g_host_flash_data == NULL || type != g_host_partition.type ||
+		subtype != g_host_partition.subtype || (label != NULL && 
+		strcmp(label, g_host_partition.label) != 0)) {
+		return NULL;
+	}
+	return &g_host_partition;
+}
+
+
+esp_err_t esp_partition_read (const esp_partition_t *partition, 
+	size_t offset, void *buffer, size_t size) {
+	if (offset + size > partition->size) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	g_host_flash.reads++;
+	memcpy(buffer, g_host_flash_data + offset, size);
+	return ESP_OK;
+}
+
+
+// Programs bytes (bits can only be cleared). Once power is cut, writes tear
+esp_err_t esp_partition_write (const esp_partition_t *partition, 
+	size_t offset, const void *buffer, size_t size) {
+	const uint8_t *b = buffer;
+
+	if (offset + size > partition->size) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	if (g_host_flash.write_budget == 0) {
+		return ESP_FAIL;
+	}
+	if (g_host_flash.write_budget > 0 && --g_host_flash.write_budget == 0) {
+		size /= 2;
+	}
+	for (size_t i = 0; i < size; ++i) {
+		g_host_flash_data[offset + i] &= b[i];
+	}
+	g_host_flash.writes++;
+	g_host_flash.bytes_written += size;
+	return (g_host_flash.write_budget == 0) ? ESP_FAIL : ESP_OK;
+}
+
+
+esp_err_t esp_partition_erase_range (const esp_partition_t *partition,
+	size_t offset, size_t size) {
+	if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0 ||
+		offset + size > partition->size) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (g_host_flash.write_budget == 0) {
+		return ESP_FAIL;
+	}
+	memset(g_host_flash_data + offset, 0xFF, size);
+	g_host_flash.erases += size / SPI_FLASH_SEC_SIZE;
+	return ESP_OK;
+}
+
+
+// Peripheral stand-ins ---------------------------------------------------------
+
+
+void gpio_pad_select_gpio (uint8_t pin) {
+}
+
+
+esp_err_t gpio_set_direction (int pin, int mode) {
+	return ESP_OK;
+}
+
+
+esp_err_t gpio_set_level (int pin, uint32_t level) {
+	return ESP_OK;
+}
+
+
+esp_err_t adc2_config_channel_atten (adc2_channel_t channel, adc_atten_t atten) {
+	return ESP_OK;
+}
+
+
+esp_err_t adc2_get_raw (adc2_channel_t channel, adc_bits_width_t width,
+	int *raw) {
+	*raw = (g_host_adc_hook == NULL) ? 0 : g_host_adc_hook();
+	return ESP_OK;
+}
+
+
+/*
+ *******************************************************************************
+ *                           FreeRTOS Stand-ins                                *
+ *******************************************************************************
+*/
+
+
+BaseType_t xTaskCreatePinnedToCore (TaskFunction_t task, const char *name,
+	uint32_t stack_size, void *args, UBaseType_t priority, 
+	TaskHandle_t *handle, BaseType_t core) {
+	return pdPASS;
+}
+
+
+void vTaskDelete (TaskHandle_t task) {
+}
+
+
+void vTaskDelay (TickType_t ticks) {
+	host_advance_us((uint64_t)ticks * 1000 * portTICK_PERIOD_MS);
+}
+
+
+TickType_t xTaskGetTickCount (void) {
+	return (TickType_t)(g_host_time_us / (1000 * portTICK_PERIOD_MS));
+}
+
+
+QueueHandle_t xQueueCreate (UBaseType_t length, UBaseType_t item_size) {
+	QueueHandle_t queue = calloc(1, sizeof(struct host_queue) + 
+		length * item_size);
+
+	if (queue != NULL) {
+		queue->length = length;
+		queue->item_size = item_size;
+	}
+	return queue;
+}
+
+
+BaseType_t xQueueSendToBack (QueueHandle_t queue, const void *item, 
+	TickType_t ticks) {
+	if (queue->count == queue->length) {
+		return pdFAIL;
+	}
+	memcpy(queue->items + ((queue->head + queue->count) % queue->length) * 
+		queue->item_size, item, queue->item_size);
+	queue->count++;
+	return pdPASS;
+}
+
+
+BaseType_t xQueueReceive (QueueHandle_t queue, void *item, TickType_t ticks) {
+	if (queue->count == 0) {
+		return pdFAIL;
+	}
+	memcpy(item, queue->items + queue->head * queue->item_size, 
+		queue->item_size);
+	queue->head = (queue->head + 1) % queue->length;
+	queue->count--;
+	return pdPASS;
+}
+
+
+UBaseType_t uxQueueMessagesWaiting (QueueHandle_t queue) {
+	return queue->count;
+}
+
+
+EventGroupHandle_t xEventGroupCreate (void) {
+	return (EventGroupHandle_t)&g_host_event_group;
+}
+
+
+EventBits_t xEventGroupWaitBits (EventGroupHandle_t group, EventBits_t bits,
+	BaseType_t clear, BaseType_t all, TickType_t ticks) {
+	EventBits_t set;
+
+	g_host_wait_began = g_host_time_us;
+
+	/* Let the test run the world until the bits are set, or it gives up. A 
+	 * spinning task doesn't stop the other core either
+	*/
+	if (g_host_wait_hook != NULL) {
+		if (all ? (g_host_event_bits & bits) == bits : 
+			(g_host_event_bits & bits) != 0) {
+			if (++g_host_wait_spins % HOST_SPIN_YIELD == 0) {
+				g_host_wait_hook(bits, ticks);
+			}
+		}
+		while ((all ? (g_host_event_bits & bits) != bits : 
+			(g_host_event_bits & bits) == 0) && g_host_wait_hook(bits, ticks)) {
+		}
+	}
+
+	set = g_host_event_bits;
+	if (clear) {
+		g_host_event_bits &= ~bits;
+	}
+	return set;
+}
+
+
+EventBits_t xEventGroupSetBits (EventGroupHandle_t group, EventBits_t bits) {
+	return (g_host_event_bits |= bits);
+}
+
+
+EventBits_t xEventGroupClearBits (EventGroupHandle_t group, EventBits_t bits) {
+	EventBits_t set = g_host_event_bits;
+	g_host_event_bits &= ~bits;
+	return set;
+}
+
+
+EventBits_t xEventGroupGetBits (EventGroupHandle_t group) {
+	return g_host_event_bits;
+}
+
+
+/*
+ *******************************************************************************
+ *                           Bluetooth Stand-ins                               *
+ *******************************************************************************
+*/
+
+
+esp_err_t esp_bt_controller_mem_release (esp_bt_mode_t mode) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_bt_controller_init (esp_bt_controller_config_t *cfg) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_bt_controller_enable (esp_bt_mode_t mode) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_bluedroid_init (void) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_bluedroid_enable (void) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gatt_set_local_mtu (uint16_t mtu) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gap_register_callback (esp_gap_ble_cb_t callback) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gap_config_adv_data (esp_ble_adv_data_t *adv_data) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gap_start_advertising (esp_ble_adv_params_t *adv_params) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gap_set_device_name (const char *name) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gap_update_conn_params (esp_ble_conn_update_params_t *params) {
+	return (g_host_conn_params_hook == NULL) ? ESP_OK : 
+		g_host_conn_params_hook(params);
+}
+
+
+esp_err_t esp_ble_gap_set_pkt_data_len (esp_bd_addr_t remote_device,
+	uint16_t tx_data_length) {
+	return (g_host_data_len_hook == NULL) ? ESP_OK : 
+		g_host_data_len_hook(tx_data_length);
+}
+
+
+esp_err_t esp_ble_gatts_register_callback (esp_gatts_cb_t callback) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gatts_app_register (uint16_t app_id) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gatts_create_service (esp_gatt_if_t gatts_if, 
+	esp_gatt_srvc_id_t *service_id, uint16_t num_handle) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gatts_start_service (uint16_t service_handle) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gatts_add_char (uint16_t service_handle, 
+	esp_bt_uuid_t *char_uuid, esp_gatt_perm_t perm, 
+	esp_gatt_char_prop_t property, esp_attr_value_t *char_val, void *control) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gatts_add_char_descr (uint16_t service_handle,
+	esp_bt_uuid_t *descr_uuid, esp_gatt_perm_t perm, 
+	esp_attr_value_t *char_descr_val, void *control) {
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gatts_get_attr_value (uint16_t attr_handle, 
+	uint16_t *length, const uint8_t **value) {
+	*length = 0;
+	return ESP_OK;
+}
+
+
+esp_err_t esp_ble_gatts_send_indicate (esp_gatt_if_t gatts_if, 
+	uint16_t conn_id, uint16_t attr_handle, uint16_t value_len, 
+	uint8_t *value, bool need_confirm) {
+	return (g_host_indicate_hook == NULL) ? ESP_OK : 
+		g_host_indicate_hook(value_len, value, need_confirm);
+}
+
+
+esp_err_t esp_ble_gatts_send_response (esp_gatt_if_t gatts_if, 
+	uint16_t conn_id, uint32_t trans_id, esp_gatt_status_t status, 
+	esp_gatt_rsp_t *rsp) {
+	return ESP_OK;
+}
@@ -0,0 +1,138 @@
+#if !defined(HOST_H)
+#define HOST_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 02/12/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Host implementation of the ESP-IDF and FreeRTOS stand-ins in stubs/. Time  *
+ *  is simulated, flash is kept in RAM, and tests hook the radio and the event *
+ *  group to drive the firmware                                                *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_gap_ble_api.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+
+/*
+ *******************************************************************************
+ *                         External Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Spinning waits after which the wait hook is called anyway
+#define     HOST_SPIN_YIELD                         1000
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing the use of the simulated flash
+typedef struct {
+	uint32_t reads;             // Read calls
+	uint32_t writes;            // Write calls
+	uint32_t erases;            // Sectors erased
+	uint64_t bytes_written;     // Bytes programmed
+	int32_t  write_budget;      // Writes left before power is cut (-1: none)
+} host_flash_t;
+
+
+/*
+ *******************************************************************************
+ *                          External Global Variables                          *
+ *******************************************************************************
+*/
+
+
+// Simulated time (microseconds since boot) returned by esp_timer_get_time
+extern int64_t g_host_time_us;
+
+// Bits of the (single) event group
+extern EventBits_t g_host_event_bits;
+
+/* Called by xEventGroupWaitBits until it returns nonzero, or the wait times 
+ * out. Tests use it to run the rest of the system while a task waits. When
+ * NULL, waits return at once
+*/
+extern int (*g_host_wait_hook)(EventBits_t bits, TickType_t ticks);
+
+/* Waits that returned at once although a hook was set, that is, with a bit 
+ * already set. A task whose wait never blocks spins, and starves every task 
+ * below it on its core. The hook is still called every HOST_SPIN_YIELD spins
+*/
+extern uint32_t g_host_wait_spins;
+
+// Simulated time at which the last wait began (hooks time out against it)
+extern int64_t g_host_wait_began;
+
+// Radio hooks (NULL: the call succeeds and does nothing)
+extern esp_err_t (*g_host_indicate_hook)(uint16_t len, uint8_t *value, 
+	bool need_confirm);
+extern esp_err_t (*g_host_conn_params_hook)(
+	const esp_ble_conn_update_params_t *params);
+extern esp_err_t (*g_host_data_len_hook)(uint16_t tx_len);
+
+// Sensor hook (NULL: reads zero)
+extern int (*g_host_adc_hook)(void);
+
+// Use of the simulated flash
+extern host_flash_t g_host_flash;
+
+
+/*
+ *******************************************************************************
+ *                            Function Declarations                            *
+ *******************************************************************************
+*/
+
+
+/* @brief Advances the simulated time
+ *
+ * @param
+ * - us: Microseconds to advance by
+ *
+ * @return None
+*/
+void host_advance_us (uint64_t us);
+
+
+/* @brief Returns a monotonic host clock (nanoseconds), for timing host code */
+uint64_t host_ns (void);
+
+
+/* @brief Replaces the simulated flash with an erased partition. A size of zero
+ *        removes the partition
+ *
+ * @param
+ * - size: Size of the beat log partition (bytes, a multiple of the sector)
+ *
+ * @return None
+*/
+void host_flash_reset (size_t size);
+
+
+/* @brief Returns the contents of the simulated flash */
+uint8_t *host_flash_data (void);
+
+
+#endif
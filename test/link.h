@@ -0,0 +1,550 @@
+#if !defined(LINK_H)
+#define LINK_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 02/12/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Runs the BLE stage (ble.c and ble_task.c, included here) against a         *
+ *  simulated Bluetooth stack, radio link and client. Include this once, in    *
+ *  the test source                                                            *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include <ucontext.h>
+#include "ble.c"
+#include "ble_task.c"
+#include "device.h"
+#include "host.h"
+
+
+/* The BLE task runs on a stack of its own, and the test switches to it for a
+ * stretch of simulated time (link_run). While the task waits, the world moves
+ * on in steps of LINK_STEP_US: the test's step callback runs, the stack moves
+ * notifications on, and the radio delivers them once per connection event.
+ *
+ * The stack stand-in takes up to stack_queue notifications from
+ * esp_ble_gatts_send_indicate and refuses more. Each step it moves them into
+ * the L2CAP queue, confirming each (ESP_GATTS_CONF_EVT): ESP_GATT_OK, or
+ * ESP_GATT_CONGESTED once the L2CAP queue holds LINK_CONGEST_HIGH of them.
+ * When the L2CAP queue is full a notification is dropped and confirmed with
+ * ESP_GATT_NO_RESOURCES. Congestion (ESP_GATTS_CONGEST_EVT) clears once the
+ * queue is down to LINK_CONGEST_LOW.
+ *
+ * Each connection event carries up to `packets` link-layer packets. A
+ * notification adds ATT (3) and L2CAP (4) headers, and takes one packet per
+ * link-layer payload (27 bytes, or what data length extension agreed). Each
+ * packet costs LINK_PACKET_OVERHEAD bytes on air besides its payload. With
+ * slave latency the device skips events while it has nothing to send.
+ *
+ * The client grants parameter requests LINK_UPDATE_EVENTS events after they
+ * are made (at the shortest interval asked for), unless configured to refuse,
+ * and agrees to the data length it supports right away. It reads version 1
+ * frames (one per notification) until the hello of the device, and sends its
+ * hellos framed so
+*/
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Simulated time (us) per step of the world
+#define LINK_STEP_US                250
+
+// Size (in bytes) of the stack the BLE task runs on
+#define LINK_TASK_STACK             (256 * 1024)
+
+// Defaults of the configuration: notifications the stack queues, L2CAP
+// queue capacity, link-layer packets per event, interval (1.25 ms units)
+#define LINK_STACK_QUEUE            8
+#define LINK_L2CAP_QUEUE            12
+#define LINK_PACKETS                6
+#define LINK_INTERVAL               24
+
+// L2CAP queue depth at which the link congests, and clears up again
+#define LINK_CONGEST_HIGH           8
+#define LINK_CONGEST_LOW            3
+
+// Events until the client applies requested connection parameters
+#define LINK_UPDATE_EVENTS          6
+
+// Bytes a link-layer packet costs besides its payload (preamble, access
+// address, header and CRC)
+#define LINK_PACKET_OVERHEAD        10
+
+// Largest notification the stand-in holds (the value of an attribute)
+#define LINK_VALUE_MAX              512
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing the client and the stack (zero fields take defaults)
+typedef struct {
+	uint16_t mtu;               // MTU the client negotiates (0: keeps 23)
+	uint16_t ll_len;            // Longest link-layer payload (0: 27, no DLE)
+	uint16_t interval;          // Interval the client connects with
+	uint8_t  refuse_params;     // Nonzero if parameter requests are refused
+	uint8_t  stack_queue;       // Notifications the stack takes at once
+	uint8_t  l2cap_queue;       // Notifications waiting for the radio
+	uint8_t  packets;           // Link-layer packets per connection event
+} link_config_t;
+
+
+// Structure describing a notification held by the stack
+typedef struct {
+	uint16_t len;
+	uint8_t  value[LINK_VALUE_MAX];
+} link_note_t;
+
+
+// Structure describing the simulation (counters run from link_boot)
+typedef struct {
+	link_config_t config;
+
+	// The client: its parser, the frames it took, and the test's callbacks
+	msg_parser_t        parser;
+	uint8_t             v2;                     // Set once the device said hello
+	msg_stream_t        stream;                 // Control channel of the client
+	uint32_t            frames[MSG_TYPE_MAX];   // Frames taken per type
+	msg_frame_handler_t on_frame;               // Called with each frame
+	void               *ctx;                    // Passed to on_frame
+	void              (*on_notify)(const uint8_t *value, size_t len);
+	void              (*on_step)(void);         // Called every step
+
+	// The connection
+	uint8_t  connected;
+	uint16_t interval;          // Interval in effect (1.25 ms units)
+	uint16_t latency;           // Slave latency in effect
+	uint16_t ll_len;            // Link-layer payload in effect
+	int64_t  next_event;        // Time of the next connection event
+	uint16_t skipped;           // Events skipped in a row
+	esp_ble_conn_update_params_t request;       // Parameters requested
+	int64_t  request_at;        // When they are answered (0: none pending)
+	uint16_t data_len;          // Data length requested (0: none pending)
+
+	// The stack
+	link_note_t stack[LINK_STACK_QUEUE * 4];
+	size_t      stack_n;
+	link_note_t l2cap[LINK_L2CAP_QUEUE * 4];
+	size_t      l2cap_n;
+	size_t      packets_left;   // Packets the first L2CAP entry still needs
+	bool        congested;
+
+	// Counters
+	uint32_t notifications;     // Notifications taken by the stack
+	uint32_t refused;           // Notifications refused by the stack
+	uint32_t dropped;           // Notifications dropped by L2CAP
+	uint32_t delivered;         // Notifications delivered to the client
+	uint64_t bytes;             // Bytes of the notifications delivered
+	uint64_t packets;           // Link-layer packets sent
+	uint64_t radio_bytes;       // Bytes on air (headers included)
+	uint32_t events;            // Connection events
+	uint32_t attended;          // Connection events the device took part in
+
+	// The contexts of the test and the task
+	ucontext_t main;
+	ucontext_t task;
+	int64_t    until;
+} link_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+static link_t g_link;
+static uint8_t g_link_task_stack[LINK_TASK_STACK];
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Counts a frame taken by the client, and passes it on to the test
+static void link_frame (const msg_view_t *view, void *ctx) {
+	g_link.frames[view->type]++;
+	if (g_link.on_frame != NULL) {
+		g_link.on_frame(view, g_link.ctx);
+	}
+}
+
+
+/* Reads a notification: a version 1 frame until the hello of the device (the
+ * last such frame), frames of the protocol version after it
+*/
+static void link_read (const uint8_t *value, size_t len) {
+	msg_view_t view;
+
+	if (g_link.v2) {
+		msg_parser_feed(&g_link.parser, value, len, link_frame, NULL);
+	} else if (msg_parse_v1(&view, value, len, MSG_V1_TYPES) == ESP_OK) {
+		g_link.v2 = (view.type == MSG_TYPE_HELLO);
+		link_frame(&view, NULL);
+	}
+}
+
+
+// Confirms a notification to the device
+static void link_conf (esp_gatt_status_t status) {
+	esp_ble_gatts_cb_param_t p = {.conf = {.status = status}};
+	gatts_profile_event_handler(ESP_GATTS_CONF_EVT, 0, &p);
+}
+
+
+// Reports congestion to the device
+static void link_congest (bool congested) {
+	esp_ble_gatts_cb_param_t p = {.congest = {.congested = congested}};
+	g_link.congested = congested;
+	gatts_profile_event_handler(ESP_GATTS_CONGEST_EVT, 0, &p);
+}
+
+
+// Returns the link-layer packets a notification of a given length takes
+static size_t link_packets (size_t len) {
+	return (len + 3 + 4 + g_link.ll_len - 1) / g_link.ll_len;
+}
+
+
+// Takes a notification into the stack queue, unless it is full
+static esp_err_t link_indicate (uint16_t len, uint8_t *value,
+	bool need_confirm) {
+	link_note_t *note;
+
+	if (!g_link.connected || g_link.stack_n >= g_link.config.stack_queue) {
+		g_link.refused++;
+		return ESP_FAIL;
+	}
+	note = g_link.stack + g_link.stack_n++;
+	note->len = len;
+	memcpy(note->value, value, len);
+	g_link.notifications++;
+	return ESP_OK;
+}
+
+
+// Records a connection parameter request (answered a few events later)
+static esp_err_t link_conn_params (const esp_ble_conn_update_params_t *params) {
+	g_link.request = *params;
+	g_link.request_at = g_host_time_us +
+		LINK_UPDATE_EVENTS * g_link.interval * 1250;
+	return ESP_OK;
+}
+
+
+// Records a data length request (answered at the next step)
+static esp_err_t link_data_len (uint16_t tx_len) {
+	g_link.data_len = tx_len;
+	return ESP_OK;
+}
+
+
+// Moves the notifications taken by the stack to the L2CAP queue
+static void link_stack_step (void) {
+	for (size_t i = 0; i < g_link.stack_n; ++i) {
+		if (g_link.l2cap_n >= g_link.config.l2cap_queue) {
+			g_link.dropped++;
+			link_conf(ESP_GATT_NO_RESOURCES);
+			continue;
+		}
+		g_link.l2cap[g_link.l2cap_n++] = g_link.stack[i];
+		if (g_link.l2cap_n == 1) {
+			g_link.packets_left = link_packets(g_link.l2cap[0].len);
+		}
+		if (g_link.l2cap_n >= LINK_CONGEST_HIGH && !g_link.congested) {
+			link_congest(true);
+		}
+		link_conf(g_link.congested ? ESP_GATT_CONGESTED : ESP_GATT_OK);
+	}
+	g_link.stack_n = 0;
+}
+
+
+// Sends what the packets of a connection event carry to the client
+static void link_event (void) {
+	size_t budget = g_link.config.packets, z;
+	link_note_t *note;
+
+	g_link.events++;
+
+	// With nothing to send, the device may skip up to latency events
+	if (g_link.l2cap_n == 0 && g_link.skipped < g_link.latency) {
+		g_link.skipped++;
+		return;
+	}
+	g_link.skipped = 0;
+	g_link.attended++;
+
+	while (budget > 0 && g_link.l2cap_n > 0) {
+		note = g_link.l2cap;
+		z = (budget < g_link.packets_left) ? budget : g_link.packets_left;
+		budget -= z;
+		g_link.packets_left -= z;
+		if (g_link.packets_left > 0) {
+			break;
+		}
+
+		// The whole notification is on the client
+		z = link_packets(note->len);
+		g_link.delivered++;
+		g_link.bytes += note->len;
+		g_link.packets += z;
+		g_link.radio_bytes += note->len + 3 + 4 + z * LINK_PACKET_OVERHEAD;
+		if (g_link.on_notify != NULL) {
+			g_link.on_notify(note->value, note->len);
+		}
+		link_read(note->value, note->len);
+
+		memmove(g_link.l2cap, g_link.l2cap + 1,
+			--g_link.l2cap_n * sizeof(link_note_t));
+		if (g_link.l2cap_n > 0) {
+			g_link.packets_left = link_packets(g_link.l2cap[0].len);
+		}
+	}
+
+	if (g_link.congested && g_link.l2cap_n <= LINK_CONGEST_LOW) {
+		link_congest(false);
+	}
+}
+
+
+// Answers the requests of the device that are due
+static void link_answer (void) {
+	esp_ble_gap_cb_param_t p;
+
+	if (g_link.data_len > 0) {
+		memset(&p, 0, sizeof(p));
+		g_link.ll_len = (g_link.data_len < g_link.config.ll_len) ?
+			g_link.data_len : g_link.config.ll_len;
+		p.pkt_data_lenth_cmpl.params.tx_len = g_link.ll_len;
+		p.pkt_data_lenth_cmpl.params.rx_len = g_link.ll_len;
+		g_link.data_len = 0;
+		gap_event_handler(ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT, &p);
+	}
+
+	if (g_link.request_at > 0 && g_host_time_us >= g_link.request_at) {
+		memset(&p, 0, sizeof(p));
+		g_link.request_at = 0;
+		if (g_link.config.refuse_params) {
+			p.update_conn_params.status = ESP_BT_STATUS_FAIL;
+			p.update_conn_params.conn_int = g_link.interval;
+			p.update_conn_params.latency = g_link.latency;
+		} else {
+			g_link.interval = g_link.request.min_int;
+			g_link.latency = g_link.request.latency;
+			p.update_conn_params.conn_int = g_link.interval;
+			p.update_conn_params.latency = g_link.latency;
+			p.update_conn_params.timeout = g_link.request.timeout;
+		}
+		gap_event_handler(ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, &p);
+	}
+}
+
+
+// Moves the world on by a step
+static void link_step (void) {
+	host_advance_us(LINK_STEP_US);
+	if (g_link.on_step != NULL) {
+		g_link.on_step();
+	}
+	if (!g_link.connected) {
+		return;
+	}
+	link_answer();
+	link_stack_step();
+	while (g_host_time_us >= g_link.next_event) {
+		link_event();
+		g_link.next_event += g_link.interval * 1250;
+	}
+}
+
+
+/* Runs the world while the BLE task waits. Control returns to the test once
+ * the time given to link_run is up. Returns zero once the wait times out
+*/
+static int link_wait_hook (EventBits_t bits, TickType_t ticks) {
+	if (g_host_time_us >= g_link.until) {
+		swapcontext(&g_link.task, &g_link.main);
+	}
+	link_step();
+
+	return ticks == portMAX_DELAY ||
+		g_host_time_us - g_host_wait_began < (int64_t)ticks *
+		portTICK_PERIOD_MS * 1000;
+}
+
+
+// Entry point of the task context
+static void link_task (void) {
+	task_ble_manager(NULL);
+}
+
+
+/* Starts the device over (a boot): the channels are emptied, the BLE driver
+ * and task forget the last client, and the task runs to its first wait
+*/
+static void link_boot (const link_config_t *config) {
+	memset(&g_link, 0, sizeof(g_link));
+	g_link.config = *config;
+	g_link.config.ll_len = (config->ll_len == 0) ? BLE_DATA_LEN_DEFAULT :
+		config->ll_len;
+	g_link.config.interval = (config->interval == 0) ? LINK_INTERVAL :
+		config->interval;
+	g_link.config.stack_queue = (config->stack_queue == 0) ?
+		LINK_STACK_QUEUE : config->stack_queue;
+	g_link.config.l2cap_queue = (config->l2cap_queue == 0) ?
+		LINK_L2CAP_QUEUE : config->l2cap_queue;
+	g_link.config.packets = (config->packets == 0) ? LINK_PACKETS :
+		config->packets;
+	g_link.stream.channel = MSG_CHANNEL_CONTROL;
+
+	// The device
+	g_host_time_us = 0;
+	g_host_event_bits = 0;
+	ipc_init();
+	g_ble_mtu = BLE_MTU_DEFAULT;
+	g_ble_in_flight = 0;
+	g_ble_congested = false;
+	g_ble_tx_resume = 0;
+	g_ble_tx_pause = BLE_TX_RETRY_MS;
+	memset(&g_ble_tx_stats, 0, sizeof(g_ble_tx_stats));
+	g_ble_tx_head = g_ble_tx_held = g_ble_tx_sent = g_ble_tx_stale = 0;
+	g_conn_open = false;
+	g_conn_wanted = BLE_CONN_MODE_MAX;
+	g_conn_updating = false;
+	g_ble_link = (ble_link_t) {
+		.tx_len = BLE_DATA_LEN_DEFAULT,
+		.rx_len = BLE_DATA_LEN_DEFAULT,
+		.mode   = BLE_CONN_MODE_MAX
+	};
+	g_profile_table[APP_PROFILE_MAIN].char_handle = 1;
+	g_profile_table[APP_PROFILE_MAIN].descr_handle = 2;
+	memset(&g_rx_parser, 0, sizeof(g_rx_parser));
+	g_withheld = 0;
+	g_v1_framing = 1;
+	g_notify_len = 0;
+	g_tx_frame = IPC_BUFFER_NONE;
+	g_syncing = 0;
+	g_stream_until = 0;
+
+	// The radio
+	g_host_indicate_hook = link_indicate;
+	g_host_conn_params_hook = link_conn_params;
+	g_host_data_len_hook = link_data_len;
+	g_host_wait_hook = link_wait_hook;
+
+	getcontext(&g_link.task);
+	g_link.task.uc_stack.ss_sp = g_link_task_stack;
+	g_link.task.uc_stack.ss_size = sizeof(g_link_task_stack);
+	g_link.task.uc_link = &g_link.main;
+	makecontext(&g_link.task, link_task, 0);
+	g_link.until = g_host_time_us;
+	swapcontext(&g_link.main, &g_link.task);
+}
+
+
+// Runs the device for a stretch of simulated time (us)
+static void link_run (int64_t us) {
+	g_link.until = g_host_time_us + us;
+	swapcontext(&g_link.main, &g_link.task);
+}
+
+
+// Connects the client, which then negotiates the MTU (if configured to)
+static void link_connect (void) {
+	esp_ble_gatts_cb_param_t p = {0};
+
+	g_link.connected = 1;
+	g_link.interval = g_link.config.interval;
+	g_link.latency = 0;
+	g_link.ll_len = BLE_DATA_LEN_DEFAULT;
+	g_link.next_event = g_host_time_us + g_link.interval * 1250;
+	g_link.skipped = 0;
+	g_link.stream.seq = 0;
+	g_link.v2 = 0;
+	msg_parser_reset(&g_link.parser);
+
+	p.connect.conn_params.interval = g_link.interval;
+	p.connect.conn_params.timeout = BLE_CONN_TIMEOUT;
+	gatts_profile_event_handler(ESP_GATTS_CONNECT_EVT, 0, &p);
+
+	if (g_link.config.mtu > 0) {
+		memset(&p, 0, sizeof(p));
+		p.mtu.mtu = g_link.config.mtu;
+		gatts_profile_event_handler(ESP_GATTS_MTU_EVT, 0, &p);
+	}
+}
+
+
+// Disconnects the client. Whatever the stack held is lost
+static void link_disconnect (void) {
+	esp_ble_gatts_cb_param_t p = {0};
+
+	g_link.connected = 0;
+	g_link.stack_n = g_link.l2cap_n = 0;
+	g_link.congested = false;
+	g_link.request_at = 0;
+	g_link.data_len = 0;
+	gatts_profile_event_handler(ESP_GATTS_DISCONNECT_EVT, 0, &p);
+}
+
+
+// Writes bytes to the characteristic, in writes of up to the MTU less 3
+static void link_write (const uint8_t *bytes, size_t len) {
+	size_t max = ((g_link.config.mtu > 0) ? g_link.config.mtu :
+		BLE_MTU_DEFAULT) - BLE_ATT_HEADER_SIZE;
+	uint8_t value[LINK_VALUE_MAX];
+	esp_ble_gatts_cb_param_t p;
+
+	for (size_t off = 0, z; off < len; off += z) {
+		z = (len - off > max) ? max : len - off;
+		memcpy(value, bytes + off, z);
+		memset(&p, 0, sizeof(p));
+		p.write.need_rsp = true;
+		p.write.handle = g_profile_table[APP_PROFILE_MAIN].char_handle;
+		p.write.len = z;
+		p.write.value = value;
+		gatts_profile_event_handler(ESP_GATTS_WRITE_EVT, 0, &p);
+	}
+}
+
+
+// Sends a message from the client (on its control channel, hellos framed as
+// version 1)
+static void link_send (const msg_t *msg) {
+	uint8_t frame[MSG_BUFFER_MAX];
+	size_t z;
+
+	if (msg->type == MSG_TYPE_HELLO) {
+		z = msg_to_v1(frame, msg_pack((msg_t *)msg, frame), frame);
+	} else {
+		z = msg_pack_into(msg, &g_link.stream, frame, sizeof(frame));
+	}
+	link_write(frame, z);
+}
+
+
+#endif
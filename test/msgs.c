@@ -0,0 +1,43 @@
+#include "msgs.h"
+
+
+/*
+ *******************************************************************************
+ *                        External Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+void msgs_example (msg_t *msg, msg_type_t type, uint32_t seed) {
+	uint8_t *body = (uint8_t *)&msg->body;
+
+	// Draw every byte of the body (xorshift32)
+	msg->type = type;
+	for (size_t i = 0; i < sizeof(msg_body_t); ++i) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		body[i] = seed;
+	}
+
+	// Fill the variable arrays
+	switch (type) {
+		case MSG_TYPE_MODEL_DATA:
+			msg->body.msg_model.size = MSG_MODEL_DATA_MAX;
+			break;
+		case MSG_TYPE_ESCALATION:
+			msg->body.msg_escalation.n_samples = MSG_SNIPPET_MAX;
+			break;
+		case MSG_TYPE_SAMPLE_BATCH:
+			msg->body.msg_sample_batch.n_beats = MSG_BATCH_MAX;
+			break;
+		case MSG_TYPE_BEAT_STREAM:
+			msg->body.msg_beat_stream.size = MSG_STREAM_MAX;
+			break;
+		case MSG_TYPE_WAVEFORM:
+			msg->body.msg_waveform.size = MSG_WAVE_MAX;
+			break;
+		default:
+			break;
+	}
+}
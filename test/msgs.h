@@ -0,0 +1,46 @@
+#if !defined(MSGS_H)
+#define MSGS_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 02/12/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Example messages for the host tests. Every field is drawn from a seed,     *
+ *  and variable arrays are filled to their maximum, so each example packs to  *
+ *  the largest frame of its type                                              *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include "msg.h"
+
+
+/*
+ *******************************************************************************
+ *                            Function Declarations                            *
+ *******************************************************************************
+*/
+
+
+/* @brief Fills a message of a type with seeded content, and its variable
+ *        arrays (if any) to their maximum length
+ *
+ * @param
+ * - msg:  Receives the message
+ * - type: Type of the message
+ * - seed: Seed of the content (nonzero)
+ *
+ * @return None
+*/
+void msgs_example (msg_t *msg, msg_type_t type, uint32_t seed);
+
+
+#endif
@@ -0,0 +1,203 @@
+#if !defined(REPLAY_H)
+#define REPLAY_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 02/12/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Replays a beat set through the process stage (ekg_task.c, included here)   *
+ *  as sample blocks, and counts the frames it hands to each channel. Include  *
+ *  this once, in the test source                                              *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include <stdio.h>
+#include "beats.h"
+
+// The process stage prints every beat it classifies
+static int replay_printf (const char *format, ...) {
+	return 0;
+}
+#define printf replay_printf
+#include "ekg_task.c"
+#undef printf
+#include "device.h"
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing how a beat set is replayed
+typedef struct {
+	msg_policy_data_t   policy;     // Escalation policy
+	msg_batching_data_t batching;   // Sample batching
+	uint8_t             wave;       // Nonzero to stream the waveform too
+	uint32_t            blocks;     // Sample blocks replayed
+	uint16_t            mtu;        // ATT MTU (0: the default of 23)
+	uint16_t            ll_len;     // Link-layer payload (0: 27, no DLE)
+} replay_config_t;
+
+
+// Structure describing what the process stage queued during a replay
+typedef struct {
+	uint32_t beats;                         // Beats classified
+	uint32_t escalated;                     // Beats escalated
+	uint32_t frames[MSG_CHANNEL_MAX];       // Frames queued per channel
+	uint64_t bytes[MSG_CHANNEL_MAX];        // Bytes queued per channel
+	uint32_t wakeups;                       // Blocks after which frames waited
+	uint32_t notifications;                 // Notifications sent
+	uint64_t radio_bytes;                   // Bytes sent over the air
+	double   seconds;                       // Signal time replayed
+} replay_result_t;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+/* Installs the KNN model trained on a set, and resets the IPC channels and
+ * the process stage. Returns nonzero on success
+*/
+static int replay_setup (const beats_t *train) {
+	if (classifier_init() != ESP_OK || ipc_init() != ESP_OK ||
+		beats_blob(train, (uint8_t *)&g_local_train) != ESP_OK) {
+		return 0;
+	}
+	configure_classifier();
+
+	g_stat_beats = g_stat_escalated = g_stat_frames = g_stat_bytes = 0;
+	g_summary_count = g_summary_blocks = g_summary_coalesced = 0;
+	g_summary_amplitude = g_summary_period = 0;
+	g_batch.n_beats = 0;
+	g_stream_frames = 0;
+
+	return 1;
+}
+
+
+/* Counts the notifications and radio bytes taken by the frames of a wakeup.
+ * Frames are packed back to back into notifications of MTU - 3 bytes. Each
+ * notification gains ATT (3) and L2CAP (4) headers, and is split into link
+ * layer packets that each add 10 bytes (preamble, access address, header and
+ * CRC). Empty packets and acknowledgements are not counted
+*/
+static void replay_radio (const replay_config_t *config, 
+	replay_result_t *result, uint64_t bytes) {
+	const uint32_t payload = ((config->mtu == 0) ? 23 : config->mtu) - 3;
+	const uint32_t ll_len = (config->ll_len == 0) ? 27 : config->ll_len;
+
+	while (bytes > 0) {
+		uint32_t p = (bytes > payload) ? payload : bytes;
+		uint32_t pdu = p + 3 + 4;
+
+		result->notifications++;
+		result->radio_bytes += pdu + 10 * ((pdu + ll_len - 1) / ll_len);
+		bytes -= p;
+	}
+}
+
+
+// Returns the bytes queued on all channels so far
+static uint64_t replay_bytes (const replay_result_t *result) {
+	uint64_t bytes = 0;
+
+	for (int c = 0; c < MSG_CHANNEL_MAX; ++c) {
+		bytes += result->bytes[c];
+	}
+	return bytes;
+}
+
+
+// Takes every queued frame off the channels, counting them
+static int replay_drain (replay_result_t *result) {
+	ipc_buffer_t buffer;
+	uint8_t channel;
+	int n = 0;
+
+	while ((buffer = ipc_next(&channel)) != IPC_BUFFER_NONE) {
+		result->frames[channel]++;
+		result->bytes[channel] += ipc_buffer_size(buffer);
+		ipc_buffer_release(buffer);
+		n++;
+	}
+
+	return n;
+}
+
+
+// Renders the next sample block of a signal, and has the process stage take it
+static void replay_block (beats_signal_t *signal, uint8_t block) {
+	uint16_t *samples = g_sample_blocks[block];
+
+	// The block is processed once its last sample is in
+	g_sample_block_time[block] = g_host_time_us / 1000;
+	beats_signal_fill(signal, samples, DEVICE_SENSOR_PUSH_BUF_SIZE);
+	host_advance_us(1000 * DEVICE_SENSOR_POLL_PERIOD_MS * 
+		DEVICE_SENSOR_PUSH_BUF_SIZE);
+
+	process_block(block, 1, g_cfg_comp, g_cfg_val);
+}
+
+
+/* Replays a beat set through the process stage, one sample block at a time.
+ * The link keeps up: queued frames are taken off after every block
+*/
+static void replay_run (const replay_config_t *config, const beats_t *set,
+	replay_result_t *result) {
+	beats_signal_t signal;
+	uint64_t bytes;
+
+	*result = (replay_result_t) {0};
+	beats_signal_init(&signal, set, 7);
+	g_local_policy   = config->policy;
+	g_local_batching = config->batching;
+	g_stream_frames  = 0;
+	g_stat_beats = g_stat_escalated = 0;
+
+	for (uint32_t b = 0; b < config->blocks; ++b) {
+		uint8_t block = b % DEVICE_SAMPLE_BLOCKS;
+
+		bytes = replay_bytes(result);
+		replay_block(&signal, block);
+		if (config->wave) {
+			send_waveform(block);
+		}
+		if (replay_drain(result) > 0) {
+			result->wakeups++;
+			replay_radio(config, result, replay_bytes(result) - bytes);
+		}
+	}
+
+	// Whatever is still batched or counted goes out at the end
+	flush_batch();
+	if (g_summary_count > 0) {
+		send_summary();
+	}
+	bytes = replay_bytes(result);
+	replay_drain(result);
+	replay_radio(config, result, replay_bytes(result) - bytes);
+
+	result->beats     = g_stat_beats;
+	result->escalated = g_stat_escalated;
+	result->seconds   = config->blocks * DEVICE_SENSOR_PUSH_BUF_SIZE * 
+		DEVICE_SENSOR_POLL_PERIOD_MS / 1000.0;
+}
+
+
+#endif
@@ -0,0 +1,28 @@
+#if !defined(DRIVER_ADC_H)
+#define DRIVER_ADC_H
+
+// Host stand-in for the ESP-IDF ADC driver. Readings come from host_adc_read
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+
+typedef enum {
+	ADC2_CHANNEL_6 = 6
+} adc2_channel_t;
+
+typedef enum {
+	ADC_ATTEN_11db = 3
+} adc_atten_t;
+
+typedef enum {
+	ADC_WIDTH_12Bit = 3
+} adc_bits_width_t;
+
+
+esp_err_t adc2_config_channel_atten (adc2_channel_t channel, adc_atten_t atten);
+esp_err_t adc2_get_raw (adc2_channel_t channel, adc_bits_width_t width,
+	int *raw);
+
+
+#endif
@@ -0,0 +1,17 @@
+#if !defined(DRIVER_GPIO_H)
+#define DRIVER_GPIO_H
+
+// Host stand-in for the ESP-IDF GPIO driver (pins are ignored)
+
+#include "esp_err.h"
+
+
+#define GPIO_MODE_OUTPUT                2
+
+
+void gpio_pad_select_gpio (uint8_t pin);
+esp_err_t gpio_set_direction (int pin, int mode);
+esp_err_t gpio_set_level (int pin, uint32_t level);
+
+
+#endif
@@ -0,0 +1,28 @@
+#if !defined(ESP_BT_H)
+#define ESP_BT_H
+
+// Host stand-in for the ESP-IDF Bluetooth controller API
+
+#include "esp_err.h"
+
+
+typedef enum {
+	ESP_BT_MODE_IDLE       = 0x00,
+	ESP_BT_MODE_BLE        = 0x01,
+	ESP_BT_MODE_CLASSIC_BT = 0x02,
+	ESP_BT_MODE_BTDM       = 0x03
+} esp_bt_mode_t;
+
+typedef struct {
+	uint16_t controller_task_stack_size;
+} esp_bt_controller_config_t;
+
+#define BT_CONTROLLER_INIT_CONFIG_DEFAULT() {0}
+
+
+esp_err_t esp_bt_controller_mem_release (esp_bt_mode_t mode);
+esp_err_t esp_bt_controller_init (esp_bt_controller_config_t *cfg);
+esp_err_t esp_bt_controller_enable (esp_bt_mode_t mode);
+
+
+#endif
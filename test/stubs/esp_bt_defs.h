@@ -0,0 +1,37 @@
+#if !defined(ESP_BT_DEFS_H)
+#define ESP_BT_DEFS_H
+
+// Host stand-in for the Bluedroid definitions used by the firmware
+
+#include "esp_err.h"
+
+
+#define ESP_UUID_LEN_16                 2
+
+typedef uint8_t esp_bd_addr_t[6];
+
+typedef enum {
+	ESP_BT_STATUS_SUCCESS = 0,
+	ESP_BT_STATUS_FAIL
+} esp_bt_status_t;
+
+typedef enum {
+	BLE_ADDR_TYPE_PUBLIC = 0x00
+} esp_ble_addr_type_t;
+
+typedef struct {
+	uint16_t len;
+	union {
+		uint16_t uuid16;
+	} uuid;
+} esp_bt_uuid_t;
+
+// Connection parameters reported on connection (units of the LL)
+typedef struct {
+	uint16_t interval;
+	uint16_t latency;
+	uint16_t timeout;
+} esp_gatt_conn_params_t;
+
+
+#endif
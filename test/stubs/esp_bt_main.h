@@ -0,0 +1,13 @@
+#if !defined(ESP_BT_MAIN_H)
+#define ESP_BT_MAIN_H
+
+// Host stand-in for the Bluedroid host API
+
+#include "esp_err.h"
+
+
+esp_err_t esp_bluedroid_init (void);
+esp_err_t esp_bluedroid_enable (void);
+
+
+#endif
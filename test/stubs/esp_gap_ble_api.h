@@ -0,0 +1,101 @@
+#if !defined(ESP_GAP_BLE_API_H)
+#define ESP_GAP_BLE_API_H
+
+// Host stand-in for the Bluedroid GAP API (the parts the firmware uses)
+
+#include "esp_bt_defs.h"
+
+
+#define ESP_BLE_ADV_FLAG_GEN_DISC           (0x01 << 1)
+#define ESP_BLE_ADV_FLAG_BREDR_NOT_SPT      (0x01 << 2)
+#define ADV_CHNL_ALL                        0x07
+
+
+typedef enum {
+	ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT = 0,
+	ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT,
+	ESP_GAP_BLE_ADV_START_COMPLETE_EVT,
+	ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT,
+	ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT
+} esp_gap_ble_cb_event_t;
+
+typedef enum {
+	ADV_TYPE_IND = 0x00
+} esp_ble_adv_type_t;
+
+typedef enum {
+	ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY = 0x00
+} esp_ble_adv_filter_t;
+
+typedef struct {
+	bool     set_scan_rsp;
+	bool     include_name;
+	bool     include_txpower;
+	int      min_interval;
+	int      max_interval;
+	int      appearance;
+	uint16_t manufacturer_len;
+	uint8_t *p_manufacturer_data;
+	uint16_t service_data_len;
+	uint8_t *p_service_data;
+	uint16_t service_uuid_len;
+	uint8_t *p_service_uuid;
+	uint8_t  flag;
+} esp_ble_adv_data_t;
+
+typedef struct {
+	uint16_t             adv_int_min;
+	uint16_t             adv_int_max;
+	esp_ble_adv_type_t   adv_type;
+	esp_ble_addr_type_t  own_addr_type;
+	int                  channel_map;
+	esp_ble_adv_filter_t adv_filter_policy;
+} esp_ble_adv_params_t;
+
+typedef struct {
+	esp_bd_addr_t bda;
+	uint16_t      min_int;
+	uint16_t      max_int;
+	uint16_t      latency;
+	uint16_t      timeout;
+} esp_ble_conn_update_params_t;
+
+typedef struct {
+	uint16_t rx_len;
+	uint16_t tx_len;
+} esp_ble_pkt_data_length_params_t;
+
+typedef union {
+	struct {
+		esp_bt_status_t status;
+	} adv_start_cmpl;
+	struct {
+		esp_bt_status_t status;
+		esp_bd_addr_t   bda;
+		uint16_t        min_int;
+		uint16_t        max_int;
+		uint16_t        latency;
+		uint16_t        conn_int;
+		uint16_t        timeout;
+	} update_conn_params;
+	struct {
+		esp_bt_status_t                  status;
+		esp_ble_pkt_data_length_params_t params;
+		esp_bd_addr_t                    remote_addr;
+	} pkt_data_lenth_cmpl;
+} esp_ble_gap_cb_param_t;
+
+typedef void (*esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t event,
+	esp_ble_gap_cb_param_t *param);
+
+
+esp_err_t esp_ble_gap_register_callback (esp_gap_ble_cb_t callback);
+esp_err_t esp_ble_gap_config_adv_data (esp_ble_adv_data_t *adv_data);
+esp_err_t esp_ble_gap_start_advertising (esp_ble_adv_params_t *adv_params);
+esp_err_t esp_ble_gap_set_device_name (const char *name);
+esp_err_t esp_ble_gap_update_conn_params (esp_ble_conn_update_params_t *params);
+esp_err_t esp_ble_gap_set_pkt_data_len (esp_bd_addr_t remote_device,
+	uint16_t tx_data_length);
+
+
+#endif
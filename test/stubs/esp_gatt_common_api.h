@@ -0,0 +1,12 @@
+#if !defined(ESP_GATT_COMMON_API_H)
+#define ESP_GATT_COMMON_API_H
+
+// Host stand-in for the Bluedroid common GATT API
+
+#include "esp_err.h"
+
+
+esp_err_t esp_ble_gatt_set_local_mtu (uint16_t mtu);
+
+
+#endif
@@ -0,0 +1,189 @@
+#if !defined(ESP_GATTS_API_H)
+#define ESP_GATTS_API_H
+
+// Host stand-in for the Bluedroid GATT server API (the parts the firmware uses)
+
+#include "esp_bt_defs.h"
+
+
+#define ESP_GATT_IF_NONE                    0xFF
+#define ESP_GATT_CHAR_PROP_BIT_READ         (1 << 1)
+#define ESP_GATT_CHAR_PROP_BIT_WRITE        (1 << 3)
+#define ESP_GATT_CHAR_PROP_BIT_NOTIFY       (1 << 4)
+#define ESP_GATT_CHAR_PROP_BIT_INDICATE     (1 << 5)
+#define ESP_GATT_PERM_READ                  (1 << 0)
+#define ESP_GATT_PERM_WRITE                 (1 << 4)
+#define ESP_GATT_UUID_CHAR_CLIENT_CONFIG    0x2902
+#define ESP_GATT_AUTH_REQ_NONE              0
+#define ESP_GATT_MAX_ATTR_LEN               600
+
+
+typedef enum {
+	ESP_GATTS_REG_EVT = 0,
+	ESP_GATTS_READ_EVT,
+	ESP_GATTS_WRITE_EVT,
+	ESP_GATTS_EXEC_WRITE_EVT,
+	ESP_GATTS_MTU_EVT,
+	ESP_GATTS_CONF_EVT,
+	ESP_GATTS_UNREG_EVT,
+	ESP_GATTS_CREATE_EVT,
+	ESP_GATTS_ADD_INCL_SRVC_EVT,
+	ESP_GATTS_ADD_CHAR_EVT,
+	ESP_GATTS_ADD_CHAR_DESCR_EVT,
+	ESP_GATTS_DELETE_EVT,
+	ESP_GATTS_START_EVT,
+	ESP_GATTS_STOP_EVT,
+	ESP_GATTS_CONNECT_EVT,
+	ESP_GATTS_DISCONNECT_EVT,
+	ESP_GATTS_OPEN_EVT,
+	ESP_GATTS_CANCEL_OPEN_EVT,
+	ESP_GATTS_CLOSE_EVT,
+	ESP_GATTS_LISTEN_EVT,
+	ESP_GATTS_CONGEST_EVT,
+	ESP_GATTS_RESPONSE_EVT,
+	ESP_GATTS_CREAT_ATTR_TAB_EVT,
+	ESP_GATTS_SET_ATTR_VAL_EVT,
+	ESP_GATTS_SEND_SERVICE_CHANGE_EVT
+} esp_gatts_cb_event_t;
+
+typedef enum {
+	ESP_GATT_OK               = 0x00,
+	ESP_GATT_INVALID_OFFSET   = 0x07,
+	ESP_GATT_INVALID_ATTR_LEN = 0x0D,
+	ESP_GATT_NO_RESOURCES     = 0x80,
+	ESP_GATT_ERROR            = 0x85,
+	ESP_GATT_CONGESTED        = 0x8F
+} esp_gatt_status_t;
+
+typedef enum {
+	ESP_GATT_PREP_WRITE_CANCEL = 0x00,
+	ESP_GATT_PREP_WRITE_EXEC   = 0x01
+} esp_gatt_prep_write_type;
+
+typedef uint8_t  esp_gatt_if_t;
+typedef uint8_t  esp_gatt_char_prop_t;
+typedef uint16_t esp_gatt_perm_t;
+
+typedef struct {
+	struct {
+		uint8_t       inst_id;
+		esp_bt_uuid_t uuid;
+	} id;
+	bool is_primary;
+} esp_gatt_srvc_id_t;
+
+typedef struct {
+	uint16_t  attr_max_len;
+	uint16_t  attr_len;
+	uint8_t  *attr_value;
+} esp_attr_value_t;
+
+typedef union {
+	struct {
+		uint8_t  value[ESP_GATT_MAX_ATTR_LEN];
+		uint16_t handle;
+		uint16_t offset;
+		uint16_t len;
+		uint8_t  auth_req;
+	} attr_value;
+} esp_gatt_rsp_t;
+
+typedef union {
+	struct {
+		esp_gatt_status_t status;
+		uint16_t          app_id;
+	} reg;
+	struct {
+		uint16_t conn_id;
+		uint32_t trans_id;
+		uint16_t handle;
+	} read;
+	struct {
+		uint16_t  conn_id;
+		uint32_t  trans_id;
+		uint16_t  handle;
+		uint16_t  offset;
+		bool      need_rsp;
+		bool      is_prep;
+		uint16_t  len;
+		uint8_t  *value;
+	} write;
+	struct {
+		uint16_t conn_id;
+		uint32_t trans_id;
+		uint8_t  exec_write_flag;
+	} exec_write;
+	struct {
+		uint16_t conn_id;
+		uint16_t mtu;
+	} mtu;
+	struct {
+		esp_gatt_status_t  status;
+		uint16_t           conn_id;
+		uint16_t           handle;
+		uint16_t           len;
+		uint8_t           *value;
+	} conf;
+	struct {
+		esp_gatt_status_t status;
+		uint16_t          service_handle;
+	} create;
+	struct {
+		esp_gatt_status_t status;
+		uint16_t          service_handle;
+	} start;
+	struct {
+		esp_gatt_status_t status;
+		uint16_t          attr_handle;
+		uint16_t          service_handle;
+	} add_char;
+	struct {
+		esp_gatt_status_t status;
+		uint16_t          attr_handle;
+	} add_char_descr;
+	struct {
+		uint16_t               conn_id;
+		esp_bd_addr_t          remote_bda;
+		esp_gatt_conn_params_t conn_params;
+	} connect;
+	struct {
+		uint16_t      conn_id;
+		esp_bd_addr_t remote_bda;
+		int           reason;
+	} disconnect;
+	struct {
+		uint16_t conn_id;
+		bool     congested;
+	} congest;
+	struct {
+		esp_gatt_status_t status;
+		uint16_t          handle;
+	} rsp;
+} esp_ble_gatts_cb_param_t;
+
+typedef void (*esp_gatts_cb_t)(esp_gatts_cb_event_t event, 
+	esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
+
+
+esp_err_t esp_ble_gatts_register_callback (esp_gatts_cb_t callback);
+esp_err_t esp_ble_gatts_app_register (uint16_t app_id);
+esp_err_t esp_ble_gatts_create_service (esp_gatt_if_t gatts_if, 
+	esp_gatt_srvc_id_t *service_id, uint16_t num_handle);
+esp_err_t esp_ble_gatts_start_service (uint16_t service_handle);
+esp_err_t esp_ble_gatts_add_char (uint16_t service_handle, 
+	esp_bt_uuid_t *char_uuid, esp_gatt_perm_t perm, 
+	esp_gatt_char_prop_t property, esp_attr_value_t *char_val, void *control);
+esp_err_t esp_ble_gatts_add_char_descr (uint16_t service_handle,
+	esp_bt_uuid_t *descr_uuid, esp_gatt_perm_t perm, 
+	esp_attr_value_t *char_descr_val, void *control);
+esp_err_t esp_ble_gatts_get_attr_value (uint16_t attr_handle, 
+	uint16_t *length, const uint8_t **value);
+esp_err_t esp_ble_gatts_send_indicate (esp_gatt_if_t gatts_if, 
+	uint16_t conn_id, uint16_t attr_handle, uint16_t value_len, 
+	uint8_t *value, bool need_confirm);
+esp_err_t esp_ble_gatts_send_response (esp_gatt_if_t gatts_if, 
+	uint16_t conn_id, uint32_t trans_id, esp_gatt_status_t status, 
+	esp_gatt_rsp_t *rsp);
+
+
+#endif
@@ -0,0 +1,34 @@
+#if !defined(ESP_LOG_H)
+#define ESP_LOG_H
+
+/* Host stand-in for the ESP-IDF logging macros. Log lines are type checked
+ * but not printed, so test output only holds results
+*/
+
+#include "esp_err.h"
+
+
+typedef enum {
+	ESP_LOG_NONE,
+	ESP_LOG_ERROR,
+	ESP_LOG_WARN,
+	ESP_LOG_INFO,
+	ESP_LOG_DEBUG
+} esp_log_level_t;
+
+
+#define ESP_LOG_DISCARD(...)            do { if (0) printf(__VA_ARGS__); } while (0)
+
+#define ESP_LOGE(tag, ...)              ESP_LOG_DISCARD(__VA_ARGS__)
+#define ESP_LOGW(tag, ...)              ESP_LOG_DISCARD(__VA_ARGS__)
+#define ESP_LOGI(tag, ...)              ESP_LOG_DISCARD(__VA_ARGS__)
+#define ESP_LOGD(tag, ...)              ESP_LOG_DISCARD(__VA_ARGS__)
+
+#define ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, len, level) \
+	do { (void)(buffer); (void)(len); } while (0)
+
+#define esp_log_buffer_hex(tag, buffer, len) \
+	do { (void)(buffer); (void)(len); } while (0)
+
+
+#endif
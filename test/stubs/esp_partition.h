@@ -0,0 +1,40 @@
+#if !defined(ESP_PARTITION_H)
+#define ESP_PARTITION_H
+
+/* Host stand-in for the ESP-IDF partition API. Partitions live in RAM and
+ * behave like NOR flash: writes only clear bits and erases set whole sectors
+*/
+
+#include "esp_err.h"
+
+
+#define SPI_FLASH_SEC_SIZE              4096
+
+
+typedef enum {
+	ESP_PARTITION_TYPE_APP  = 0x00,
+	ESP_PARTITION_TYPE_DATA = 0x01
+} esp_partition_type_t;
+
+typedef int esp_partition_subtype_t;
+
+typedef struct {
+	esp_partition_type_t    type;
+	esp_partition_subtype_t subtype;
+	uint32_t                address;
+	uint32_t                size;
+	char                    label[17];
+} esp_partition_t;
+
+
+const esp_partition_t *esp_partition_find_first (esp_partition_type_t type,
+	esp_partition_subtype_t subtype, const char *label);
+esp_err_t esp_partition_read (const esp_partition_t *partition, 
+	size_t offset, void *buffer, size_t size);
+esp_err_t esp_partition_write (const esp_partition_t *partition, 
+	size_t offset, const void *buffer, size_t size);
+esp_err_t esp_partition_erase_range (const esp_partition_t *partition,
+	size_t offset, size_t size);
+
+
+#endif
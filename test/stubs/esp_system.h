@@ -0,0 +1,9 @@
+#if !defined(ESP_SYSTEM_H)
+#define ESP_SYSTEM_H
+
+// Host stand-in for the ESP-IDF system header
+
+#include "esp_err.h"
+
+
+#endif
@@ -0,0 +1,12 @@
+#if !defined(ESP_TIMER_H)
+#define ESP_TIMER_H
+
+// Host stand-in for the ESP-IDF timer. Time is simulated (see host.h)
+
+#include <stdint.h>
+
+
+int64_t esp_timer_get_time (void);
+
+
+#endif
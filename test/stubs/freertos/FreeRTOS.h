@@ -0,0 +1,39 @@
+#if !defined(FREERTOS_H)
+#define FREERTOS_H
+
+/* Host stand-in for FreeRTOS. Tests are single threaded, so critical sections
+ * do nothing and one tick is one millisecond of simulated time
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdPASS                          1
+#define pdFAIL                          0
+#define pdTRUE                          1
+#define pdFALSE                         0
+#define portMAX_DELAY                   0xFFFFFFFFu
+#define portTICK_PERIOD_MS              1
+#define pdMS_TO_TICKS(ms)               ((TickType_t)(ms))
+#define tskIDLE_PRIORITY                0
+#define configMAX_PRIORITIES            25
+
+
+typedef struct {
+	int owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    {0}
+
+#define portENTER_CRITICAL(mux)         ((void)(mux))
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux)     ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)      ((void)(mux))
+
+
+#endif
@@ -0,0 +1,23 @@
+#if !defined(FREERTOS_EVENT_GROUPS_H)
+#define FREERTOS_EVENT_GROUPS_H
+
+/* Host stand-in for FreeRTOS event groups. A wait returns at once with the
+ * bits set, unless a test installs g_host_wait_hook (see host.h)
+*/
+
+#include "FreeRTOS.h"
+
+
+typedef struct host_event_group *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+
+EventGroupHandle_t xEventGroupCreate (void);
+EventBits_t xEventGroupWaitBits (EventGroupHandle_t group, EventBits_t bits,
+	BaseType_t clear, BaseType_t all, TickType_t ticks);
+EventBits_t xEventGroupSetBits (EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits (EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits (EventGroupHandle_t group);
+
+
+#endif
@@ -0,0 +1,19 @@
+#if !defined(FREERTOS_QUEUE_H)
+#define FREERTOS_QUEUE_H
+
+// Host stand-in for FreeRTOS queues (copying FIFOs that never block)
+
+#include "FreeRTOS.h"
+
+
+typedef struct host_queue *QueueHandle_t;
+
+
+QueueHandle_t xQueueCreate (UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSendToBack (QueueHandle_t queue, const void *item, 
+	TickType_t ticks);
+BaseType_t xQueueReceive (QueueHandle_t queue, void *item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting (QueueHandle_t queue);
+
+
+#endif
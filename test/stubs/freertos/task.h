@@ -0,0 +1,21 @@
+#if !defined(FREERTOS_TASK_H)
+#define FREERTOS_TASK_H
+
+// Host stand-in for FreeRTOS tasks. Delays advance the simulated time
+
+#include "FreeRTOS.h"
+
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+
+BaseType_t xTaskCreatePinnedToCore (TaskFunction_t task, const char *name,
+	uint32_t stack_size, void *args, UBaseType_t priority, 
+	TaskHandle_t *handle, BaseType_t core);
+void vTaskDelete (TaskHandle_t task);
+void vTaskDelay (TickType_t ticks);
+TickType_t xTaskGetTickCount (void);
+
+
+#endif
@@ -0,0 +1,9 @@
+#if !defined(SDKCONFIG_H)
+#define SDKCONFIG_H
+
+// Host stand-in for the generated project configuration
+
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ   160
+
+
+#endif
@@ -0,0 +1,14 @@
+#if !defined(XTENSA_HAL_H)
+#define XTENSA_HAL_H
+
+/* Host stand-in for the Xtensa cycle counter. It counts host time in cycles
+ * of a CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ clock, so host figures are relative
+*/
+
+#include <stdint.h>
+
+
+uint32_t xthal_get_ccount (void);
+
+
+#endif
@@ -0,0 +1,59 @@
+#if !defined(TEST_H)
+#define TEST_H
+
+
+/*
+ *******************************************************************************
+ *                          (C) Copyright 2019 <None>                          *
+ * Created: 02/12/2019                                                         *
+ *                                                                             *
+ * Programmer(s):                                                              *
+ * - Charles Randolph                                                          *
+ * - Sonnya Dellarosa                                                          *
+ *                                                                             *
+ * Description:                                                                *
+ *  Checks shared by the host tests. A test is one executable: it prints its   *
+ *  measurements, and exits nonzero if any check failed                        *
+ *                                                                             *
+ *******************************************************************************
+*/
+
+
+#include <stdio.h>
+#include "host.h"
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Number of checks that failed
+static int g_test_failures;
+
+
+/*
+ *******************************************************************************
+ *                                   Macros                                    *
+ *******************************************************************************
+*/
+
+
+// Macro: Counts (and reports) a failed condition
+#define CHECK(cond) {                                                    \
+    if (!(cond)) {                                                       \
+        fprintf(stderr, "Check failed (%s:%d) | \"%s\" |\n",             \
+            __FILE__, __LINE__, #cond);                                  \
+        g_test_failures++;                                               \
+    }                                                                    \
+}
+
+
+// Macro: Returns the exit status of the test from main
+#define TEST_RESULT() ((g_test_failures == 0) ? 0 :                      \
+    (fprintf(stderr, "%d check(s) failed\n", g_test_failures), 1))
+
+
+#endif
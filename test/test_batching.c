@@ -0,0 +1,137 @@
+#include "test.h"
+#include "replay.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Sample blocks replayed per configuration (about 40 minutes of signal)
+#define REPLAY_BLOCKS               960
+
+// Age (ms) past which batches flush, long enough for a full batch of beats
+#define BATCH_AGE                   60000
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a named batching configuration
+typedef struct {
+	const char *name;
+	uint8_t     count;
+	uint8_t     encoding;
+} run_t;
+
+
+// Structure describing a link
+typedef struct {
+	const char *name;
+	uint16_t    mtu;
+	uint16_t    ll_len;
+} link_t;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns a count scaled to 1000 beats of the result
+static double per_1000 (double value, const replay_result_t *result) {
+	return (1000.0 * value) / result->beats;
+}
+
+
+int main (void) {
+	const run_t runs[] = {
+		{"Unbatched",  1,             MSG_ENCODING_PLAIN},
+		{"Batch 4",    4,             MSG_ENCODING_PLAIN},
+		{"Batch 16",   16,            MSG_ENCODING_PLAIN},
+		{"Batch 32",   32,            MSG_ENCODING_PLAIN},
+		{"Batch 48",   MSG_BATCH_MAX, MSG_ENCODING_PLAIN},
+		{"Delta 16",   16,            MSG_ENCODING_DELTA},
+		{"Delta 32",   32,            MSG_ENCODING_DELTA}
+	};
+	const link_t links[] = {
+		{"MTU 23",            23,  27},
+		{"MTU 247, DLE 251",  247, 251}
+	};
+	const size_t n_runs = sizeof(runs) / sizeof(runs[0]);
+	const beats_model_t train_model = {.seed = 4, .abnormal = 30};
+	const beats_model_t replay_model = {.seed = 11, .abnormal = 10};
+	replay_result_t results[2][sizeof(runs) / sizeof(runs[0])];
+	beats_t train, replay;
+
+	beats_generate(&train, 400, &train_model);
+	beats_generate(&replay, 2000, &replay_model);
+
+	for (size_t l = 0; l < 2; ++l) {
+		printf("%s: per 1000 beats\n%-12s %8s %8s %8s %9s %9s\n", 
+			links[l].name, "", "frames", "wakeups", "notif.", "bytes", 
+			"radio");
+		for (size_t r = 0; r < n_runs; ++r) {
+			const replay_config_t config = {
+				.batching = {
+					.count    = runs[r].count,
+					.age      = BATCH_AGE,
+					.encoding = runs[r].encoding,
+					.keyframe = 8
+				},
+				.blocks = REPLAY_BLOCKS,
+				.mtu    = links[l].mtu,
+				.ll_len = links[l].ll_len
+			};
+			replay_result_t *x = results[l] + r;
+
+			CHECK(replay_setup(&train));
+			replay_run(&config, &replay, x);
+			printf("%-12s %8.1f %8.1f %8.1f %9.0f %9.0f\n", runs[r].name,
+				per_1000(x->frames[MSG_CHANNEL_BEATS], x), 
+				per_1000(x->wakeups, x), per_1000(x->notifications, x),
+				per_1000(replay_bytes(x), x), per_1000(x->radio_bytes, x));
+			CHECK(x->beats > 1000);
+		}
+		printf("\n");
+	}
+
+	for (size_t l = 0; l < 2; ++l) {
+		const replay_result_t *x = results[l];
+
+		// Unbatched, every beat is a frame and wakes the BLE task
+		CHECK(x[0].frames[MSG_CHANNEL_BEATS] == x[0].beats);
+		CHECK(x[0].wakeups * 2 > x[0].beats / 4);
+
+		// Full batches: one frame (and wakeup) per count beats
+		for (size_t r = 1; r < 5; ++r) {
+			CHECK(x[r].beats == x[0].beats);
+			CHECK(x[r].frames[MSG_CHANNEL_BEATS] <= 
+				x[r].beats / runs[r].count + 1);
+			CHECK(x[r].wakeups <= x[r].frames[MSG_CHANNEL_BEATS]);
+			CHECK(x[r].radio_bytes < x[r - 1].radio_bytes);
+		}
+
+		// Coded streams send fewer bytes than plain batches of the count
+		CHECK(replay_bytes(x + 5) < replay_bytes(x + 2));
+		CHECK(replay_bytes(x + 6) < replay_bytes(x + 3));
+	}
+
+	// A larger MTU and DLE carry the same frames in fewer radio bytes
+	for (size_t r = 0; r < n_runs; ++r) {
+		CHECK(results[1][r].notifications <= results[0][r].notifications);
+		CHECK(results[1][r].radio_bytes < results[0][r].radio_bytes);
+	}
+
+	beats_free(&train);
+	beats_free(&replay);
+	return TEST_RESULT();
+}
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include "sdkconfig.h"
+#include "test.h"
+#include "beats.h"
+#include "beat_codec.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Beats per frame (a batch), and frames from one keyframe to the next
+#define STREAM_BATCH                32
+#define STREAM_KEYFRAME             8
+
+// Size (in bytes) of a beat in a plain batch (label, amplitude and period)
+#define PLAIN_BEAT_SIZE             5
+
+// Times each set is coded and decoded for the timings
+#define CODEC_ROUNDS                200
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Codes a set as a stream of frames. Returns the size of the stream
+static size_t encode_set (const beats_t *set, uint8_t *stream) {
+	beat_codec_t codec;
+	size_t z = 0;
+
+	for (size_t i = 0; i < set->n; ++i) {
+		if (i % (STREAM_BATCH * STREAM_KEYFRAME) == 0) {
+			beat_codec_reset(&codec);
+		}
+		z += beat_encode(&codec, set->labels[i], set->features[i].amplitude,
+			set->features[i].rr_period, stream + z, BEAT_CODEC_BEAT_MAX);
+	}
+	return z;
+}
+
+
+// Decodes a stream coded by encode_set. Returns the beats that match the set
+static size_t decode_set (const beats_t *set, const uint8_t *stream, 
+	size_t len) {
+	beat_codec_t codec;
+	size_t z = 0, n = 0, matched = 0;
+	uint16_t amplitude, period;
+	uint8_t label;
+
+	for (size_t i = 0; i < set->n; ++i, ++n) {
+		size_t step;
+
+		if (i % (STREAM_BATCH * STREAM_KEYFRAME) == 0) {
+			beat_codec_reset(&codec);
+		}
+		if ((step = beat_decode(&codec, stream + z, len - z, &label, 
+			&amplitude, &period)) == 0) {
+			break;
+		}
+		z += step;
+		matched += (label == set->labels[i] &&
+			amplitude == set->features[i].amplitude &&
+			period == set->features[i].rr_period);
+	}
+	return (z == len) ? matched : 0;
+}
+
+
+/* Codes a set, decodes it back, and reports the compression ratio against
+ * plain batches along with the cycles per beat of either direction
+*/
+static void run_set (const char *name, const beats_t *set, double ratio_min) {
+	uint8_t *stream = malloc(set->n * BEAT_CODEC_BEAT_MAX);
+	size_t len = encode_set(set, stream);
+	uint64_t start, encode_ns, decode_ns;
+	volatile size_t sink = 0;
+	double ratio = (double)(set->n * PLAIN_BEAT_SIZE) / len;
+
+	CHECK(decode_set(set, stream, len) == set->n);
+
+	start = host_ns();
+	for (int r = 0; r < CODEC_ROUNDS; ++r) {
+		sink += encode_set(set, stream);
+	}
+	encode_ns = host_ns() - start;
+
+	start = host_ns();
+	for (int r = 0; r < CODEC_ROUNDS; ++r) {
+		sink += decode_set(set, stream, len);
+	}
+	decode_ns = host_ns() - start;
+
+	printf("%-22s %6zu %8.2f %8.2f %9.1f %9.1f\n", name, set->n,
+		(double)len / set->n, ratio,
+		(double)encode_ns * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ /
+			(1000.0 * CODEC_ROUNDS * set->n),
+		(double)decode_ns * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ /
+			(1000.0 * CODEC_ROUNDS * set->n));
+	CHECK(ratio >= ratio_min);
+	free(stream);
+}
+
+
+/* Beats at the ends of the range take the most bytes, and still round trip.
+ * A beat cut short, or one that doesn't fit, leaves the state as it was
+*/
+static void test_extremes (void) {
+	const uint16_t values[] = {0, UINT16_MAX, 0, 1, UINT16_MAX - 1, 32768};
+	beat_codec_t encoder, decoder;
+	uint8_t buffer[BEAT_CODEC_BEAT_MAX];
+	uint16_t amplitude, period;
+	uint8_t label;
+	size_t z;
+
+	beat_codec_reset(&encoder);
+	beat_codec_reset(&decoder);
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+		uint16_t v = values[i], w = values[(i + 3) % 6];
+
+		z = beat_encode(&encoder, i & 3, v, w, buffer, sizeof(buffer));
+		CHECK(z > 0 && z <= BEAT_CODEC_BEAT_MAX);
+		CHECK(beat_decode(&decoder, buffer, z - 1, &label, &amplitude, 
+			&period) == 0);
+		CHECK(beat_decode(&decoder, buffer, z, &label, &amplitude, 
+			&period) == z);
+		CHECK(label == (i & 3) && amplitude == v && period == w);
+	}
+
+	z = beat_encode(&encoder, 0, 0, 0, buffer, 1);
+	CHECK(z == 0);
+	CHECK(encoder.amplitude == values[5] && encoder.period == values[2]);
+}
+
+
+int main (int argc, char **argv) {
+	const beats_model_t models[] = {
+		{.seed = 4,  .abnormal = 0},
+		{.seed = 17, .abnormal = 10},
+		{.seed = 23, .abnormal = 30, .drift_amplitude = 400, 
+			.drift_period = 200}
+	};
+	const char *names[] = {"Synthetic, normal", "Synthetic, 10% abn.",
+		"Synthetic, 30% drift"};
+	beats_t set;
+
+	test_extremes();
+
+	printf("%-22s %6s %8s %8s %9s %9s\n", "set", "beats", "B/beat", "ratio",
+		"enc. cyc", "dec. cyc");
+	// Synthetic beats are drawn independently, so deltas are wider than in
+	// recordings, where the rhythm changes slowly
+	for (size_t i = 0; i < sizeof(models) / sizeof(models[0]); ++i) {
+		beats_generate(&set, 5000, models + i);
+		run_set(names[i], &set, 1.25);
+		beats_free(&set);
+	}
+
+	// Recordings given on the command line (amplitude,rr_period,label)
+	for (int i = 1; i < argc; ++i) {
+		if (beats_read(&set, argv[i]) != ESP_OK) {
+			fprintf(stderr, "Can't read beats from %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+		run_set(argv[i], &set, 1.0);
+		beats_free(&set);
+	}
+	printf("(host timings, in cycles of a %u MHz clock; ratio against %d "
+		"bytes per plain beat)\n", CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, 
+		PLAIN_BEAT_SIZE);
+
+	return TEST_RESULT();
+}
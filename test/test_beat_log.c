@@ -0,0 +1,356 @@
+#include "test.h"
+#include "msgs.h"
+#include "link.h"
+#include "beat_log.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Segments of the small log used to wrap around, and of the beatlog
+// partition (partitions.csv)
+#define SMALL_SEGMENTS              8
+#define PARTITION_SEGMENTS          (0xB0000 / BEAT_LOG_SEGMENT_SIZE)
+
+// Size of a beat frame
+#define BEAT_FRAME_SIZE             (MSG_HEADER_SIZE + \
+	MSG_SAMPLE_DATA_BODY_MAX + MSG_TRAILER_SIZE)
+
+// Writes after which power is cut, from one up to this
+#define POWER_CUTS                  40
+
+// Frames appended before each power cut, and between flushes
+#define CUT_FRAMES                  600
+#define CUT_FLUSH_FRAMES            25
+
+// Frames appended to measure write amplification, and between flushes (a
+// client connecting)
+#define WEAR_FRAMES                 20000
+#define WEAR_FLUSH_FRAMES           500
+
+// Beats per hour (60 bpm), to put the erases in time
+#define BEATS_PER_HOUR              3600
+
+// Typical and longest time (ms) of a sector erase (SPI NOR flash data sheets)
+#define ERASE_TYP_MS                45
+#define ERASE_MAX_MS                400
+
+// Beats logged before the client connects, and the records it acknowledges
+#define SYNC_FRAMES                 1500
+#define SYNC_ACKED                  1000
+
+// Longest simulated time (us) a synchronization may take
+#define SYNC_TIMEOUT_US             (60 * 1000 * 1000)
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// The log, as the BLE task would hold it
+static beat_log_t g_log;
+
+// Beat channel of the process stage
+static msg_stream_t g_beat_stream = {.channel = MSG_CHANNEL_BEATS};
+
+// What the client took while synchronizing: the status, the backlog records
+// (and the first), and whether each was the one expected
+static msg_log_status_data_t g_status;
+static uint32_t g_records, g_first_record, g_wrong;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Appends the example beat of the next record
+static esp_err_t append (void) {
+	uint8_t frame[MSG_BUFFER_MAX];
+	size_t z;
+	msg_t msg;
+
+	msgs_example(&msg, MSG_TYPE_SAMPLE_DATA, g_log.next);
+	z = msg_pack_into(&msg, &g_beat_stream, frame, sizeof(frame));
+	return beat_log_append(&g_log, frame, z);
+}
+
+
+// Returns nonzero if a frame is the example beat of its record
+static int is_record (const msg_view_t *view, uint32_t record) {
+	msg_t msg, expect;
+
+	msgs_example(&expect, MSG_TYPE_SAMPLE_DATA, record);
+	return view->channel == MSG_CHANNEL_BACKLOG &&
+		view->seq == (record & 0xFFFF) && msg_decode(&msg, view) == ESP_OK &&
+		msg.type == expect.type &&
+		msg.body.msg_sample.label == expect.body.msg_sample.label &&
+		msg.body.msg_sample.amplitude == expect.body.msg_sample.amplitude &&
+		msg.body.msg_sample.period == expect.body.msg_sample.period;
+}
+
+
+/* Reads the records not yet acknowledged, checking each, and returns their
+ * number. Records ascend (numbers skipped after a frame cut short only)
+*/
+static uint32_t read_records (void) {
+	uint8_t frame[MSG_BUFFER_MAX];
+	uint32_t n = 0, last = 0;
+	msg_view_t view;
+	size_t z;
+
+	beat_log_rewind(&g_log);
+	while ((z = beat_log_peek(&g_log)) > 0) {
+		uint32_t record = g_log.read_seq;
+
+		CHECK(n == 0 || record > last);
+		CHECK(beat_log_read(&g_log, frame, z) == ESP_OK);
+		CHECK(msg_parse(&view, frame, z) == ESP_OK && is_record(&view, record));
+		last = record;
+		n++;
+	}
+	return n;
+}
+
+
+// Keeps the status and backlog records taken by the client
+static void on_frame (const msg_view_t *view, void *ctx) {
+	msg_t msg;
+
+	if (view->type == MSG_TYPE_LOG_STATUS && msg_decode(&msg, view) ==
+		ESP_OK) {
+		g_status = msg.body.msg_log_status;
+		g_first_record = g_status.first;
+	}
+	if (view->channel != MSG_CHANNEL_BACKLOG) {
+		return;
+	}
+	g_wrong += !is_record(view, g_first_record + g_records);
+	g_records++;
+}
+
+
+/* The log wraps around its segments. Appending never erases (the segment it
+ * continues in was erased ahead), the oldest records are dropped a segment
+ * at a time and counted if they weren't acknowledged, and the records held
+ * survive a reset
+*/
+static void test_wraparound (void) {
+	uint32_t erases, appends = 0, first, next, overwritten, held;
+
+	host_flash_reset(SMALL_SEGMENTS * BEAT_LOG_SEGMENT_SIZE);
+	CHECK(beat_log_init(&g_log) == ESP_OK);
+	CHECK(beat_log_prepare(&g_log) == ESP_OK);
+
+	// Three times around, as the BLE task logs a beat per wakeup
+	while (g_log.next < 3 * SMALL_SEGMENTS * BEAT_LOG_SEGMENT_SIZE /
+		BEAT_FRAME_SIZE) {
+		erases = g_host_flash.erases;
+		CHECK(append() == ESP_OK);
+		appends += (g_host_flash.erases != erases);
+		CHECK(beat_log_prepare(&g_log) == ESP_OK);
+	}
+	CHECK(appends == 0);
+	CHECK(beat_log_flush(&g_log) == ESP_OK);
+	CHECK(g_log.first > 0);
+	CHECK(g_log.overwritten == g_log.first);
+	held = read_records();
+	CHECK(held == g_log.next - g_log.first);
+	printf("Wraparound: %u records, %u held in %u segments (one erased "
+		"ahead), %u overwritten, %u erases\n", g_log.next, held,
+		SMALL_SEGMENTS, g_log.overwritten, g_host_flash.erases);
+
+	// Acknowledged records are dropped without counting
+	beat_log_ack(&g_log, g_log.next);
+	overwritten = g_log.overwritten;
+	for (uint32_t i = 0; i < held; ++i) {
+		CHECK(append() == ESP_OK);
+		CHECK(beat_log_prepare(&g_log) == ESP_OK);
+	}
+	CHECK(g_log.overwritten == overwritten);
+	CHECK(beat_log_flush(&g_log) == ESP_OK);
+	CHECK(read_records() == g_log.next - g_log.acked);
+
+	// After a reset every record held is sent again
+	first = g_log.first;
+	next = g_log.next;
+	CHECK(beat_log_init(&g_log) == ESP_OK);
+	CHECK(g_log.first == first && g_log.next == next);
+	CHECK(read_records() == next - first);
+}
+
+
+/* Power is cut at every write in turn. After the reset the log holds every
+ * record flushed before the cut (and maybe a few after it), each whole, and
+ * appending resumes after them
+*/
+static void test_power_cut (void) {
+	uint32_t durable, appended, held, worst = UINT32_MAX;
+
+	for (int cut = 1; cut <= POWER_CUTS; ++cut) {
+		host_flash_reset(SMALL_SEGMENTS * BEAT_LOG_SEGMENT_SIZE);
+		CHECK(beat_log_init(&g_log) == ESP_OK);
+		g_host_flash.write_budget = cut;
+
+		durable = appended = 0;
+		for (int i = 0; i < CUT_FRAMES && g_host_flash.write_budget != 0;
+			++i) {
+			if (append() != ESP_OK) {
+				break;
+			}
+			appended++;
+			beat_log_prepare(&g_log);
+			if (appended % CUT_FLUSH_FRAMES == 0 &&
+				beat_log_flush(&g_log) == ESP_OK) {
+				durable = appended;
+			}
+		}
+		CHECK(g_host_flash.write_budget == 0);
+
+		// The reset
+		g_host_flash.write_budget = -1;
+		CHECK(beat_log_init(&g_log) == ESP_OK);
+		held = read_records();
+		CHECK(held >= durable && held <= appended);
+		worst = (held - durable < worst) ? held - durable : worst;
+
+		// Appending resumes after the records held
+		for (int i = 0; i < CUT_FLUSH_FRAMES; ++i) {
+			CHECK(append() == ESP_OK);
+		}
+		CHECK(beat_log_flush(&g_log) == ESP_OK);
+		CHECK(read_records() == held + CUT_FLUSH_FRAMES);
+	}
+	printf("Power cut: at each of %u writes, every flushed record recovered\n",
+		POWER_CUTS);
+}
+
+
+/* Measures the bytes programmed and erased per byte of beat frames logged,
+ * and the erases (each stalling the sample task) per hour of disconnection
+*/
+static void test_amplification (void) {
+	uint64_t frames = 0;
+	double programmed, erased, per_hour;
+	uint32_t next;
+
+	host_flash_reset(PARTITION_SEGMENTS * BEAT_LOG_SEGMENT_SIZE);
+	CHECK(beat_log_init(&g_log) == ESP_OK);
+	g_host_flash = (host_flash_t) {.write_budget = -1};
+
+	for (int i = 0; i < WEAR_FRAMES; ++i) {
+		next = g_log.next;
+		CHECK(append() == ESP_OK);
+		CHECK(g_log.next == next + 1);
+		frames += BEAT_FRAME_SIZE;
+		CHECK(beat_log_prepare(&g_log) == ESP_OK);
+		if ((i + 1) % WEAR_FLUSH_FRAMES == 0) {
+			CHECK(beat_log_flush(&g_log) == ESP_OK);
+		}
+	}
+
+	programmed = (double)g_host_flash.bytes_written / frames;
+	erased = (double)g_host_flash.erases * BEAT_LOG_SEGMENT_SIZE / frames;
+	per_hour = (double)g_host_flash.erases * BEATS_PER_HOUR / WEAR_FRAMES;
+	printf("Amplification: %u beat frames (%llu bytes), %.3f bytes programmed "
+		"and %.3f erased per byte, %.3f writes per frame\n", WEAR_FRAMES,
+		(unsigned long long)frames, programmed, erased,
+		(double)g_host_flash.writes / WEAR_FRAMES);
+	printf("Erases: %.1f per hour at 60 bpm, holding the sample task %.2f s "
+		"(up to %.1f s) per hour, %d to %d sample periods each\n", per_hour,
+		per_hour * ERASE_TYP_MS / 1000, per_hour * ERASE_MAX_MS / 1000,
+		ERASE_TYP_MS / DEVICE_SENSOR_POLL_PERIOD_MS,
+		ERASE_MAX_MS / DEVICE_SENSOR_POLL_PERIOD_MS);
+
+	// Frames are programmed once (headers aside), and sectors hardly wasted
+	CHECK(programmed < 1.01);
+	CHECK(erased < 1.02);
+	CHECK(g_host_flash.writes * 10 < WEAR_FRAMES);
+}
+
+
+/* Beats logged while no client is connected are synchronized once one says
+ * hello, at what the link leaves. A client that acknowledged records gets
+ * the rest only after reconnecting
+*/
+static void test_sync (void) {
+	link_config_t config = {.mtu = 247, .ll_len = BLE_DATA_LEN_MAX};
+	msg_t hello = {
+		.type = MSG_TYPE_HELLO,
+		.body.msg_hello = {
+			.version   = MSG_PROTOCOL_VERSION,
+			.types     = (1 << MSG_TYPE_MAX) - 1,
+			.encodings = (1 << MSG_ENCODING_MAX) - 1,
+			.batch_max = MSG_BATCH_MAX,
+			.mtu       = 247
+		}
+	};
+	msg_t ack = {
+		.type = MSG_TYPE_LOG_ACK,
+		.body.msg_log_ack.next = SYNC_ACKED
+	};
+	msg_t msg;
+	int64_t start;
+	double seconds;
+
+	host_flash_reset(PARTITION_SEGMENTS * BEAT_LOG_SEGMENT_SIZE);
+	link_boot(&config);
+	g_link.on_frame = on_frame;
+
+	// Beats while disconnected
+	for (uint32_t r = 0; r < SYNC_FRAMES; ++r) {
+		msgs_example(&msg, MSG_TYPE_SAMPLE_DATA, r);
+		CHECK(ipc_send_msg(MSG_CHANNEL_BEATS, &msg) == ESP_OK);
+		xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+		link_run(LINK_STEP_US);
+	}
+	CHECK(ipc_pending(MSG_CHANNEL_BEATS) == 0);
+
+	// The client connects and says hello
+	g_records = g_wrong = 0;
+	link_connect();
+	start = g_host_time_us;
+	link_send(&hello);
+	while (g_records < SYNC_FRAMES && g_host_time_us - start <
+		SYNC_TIMEOUT_US) {
+		link_run(LINK_STEP_US);
+	}
+	seconds = (g_host_time_us - start) / 1e6;
+	CHECK(g_status.first == 0 && g_status.next == SYNC_FRAMES);
+	CHECK(g_records == SYNC_FRAMES && g_wrong == 0);
+	printf("Sync: %u records in %.2f s (%.0f records/s, %.1f kB/s)\n",
+		g_records, seconds, g_records / seconds, g_records *
+		BEAT_FRAME_SIZE / seconds / 1e3);
+
+	// The client acknowledges some, and reconnects
+	link_send(&ack);
+	link_run(LINK_STEP_US * 100);
+	link_disconnect();
+	link_run(LINK_STEP_US * 100);
+	g_records = g_wrong = 0;
+	link_connect();
+	link_send(&hello);
+	link_run(SYNC_TIMEOUT_US / 10);
+	CHECK(g_status.first == SYNC_ACKED && g_status.next == SYNC_FRAMES);
+	CHECK(g_records == SYNC_FRAMES - SYNC_ACKED && g_wrong == 0);
+	printf("Resume: %u records after acknowledging %u\n", g_records,
+		SYNC_ACKED);
+}
+
+
+int main (void) {
+	test_wraparound();
+	test_power_cut();
+	test_amplification();
+	test_sync();
+	return TEST_RESULT();
+}
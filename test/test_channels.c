@@ -0,0 +1,193 @@
+#include "test.h"
+#include "msgs.h"
+#include "link.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Control requests made per run, and the simulated time (us) between them
+#define REQUESTS                    50
+#define REQUEST_PERIOD_US           (200 * 1000)
+
+// Longest wait (us) for a reply before it counts as lost
+#define REPLY_TIMEOUT_US            (2000 * 1000)
+
+// Longest control reply latency (us) allowed while the waveform saturates the
+// link: the notifications already handed to the stack, at the stream
+// interval, and a few intervals besides
+#define REPLY_BOUND_US              (150 * 1000)
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing the control reply latencies of a run
+typedef struct {
+	uint32_t replies;           // Replies taken by the client
+	int64_t  max_us;            // Longest latency
+	int64_t  total_us;          // Sum of latencies
+	uint32_t waveform;          // Waveform frames taken by the client
+	double   kbps;              // Throughput of the waveform channel (kB/s)
+} run_result_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Whether the waveform channel is kept full
+static uint8_t g_saturate;
+
+// Bytes of waveform frames taken by the client
+static uint64_t g_wave_bytes;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Counts the waveform bytes taken by the client
+static void on_frame (const msg_view_t *view, void *ctx) {
+	if (view->channel == MSG_CHANNEL_WAVEFORM) {
+		g_wave_bytes += view->size + MSG_HEADER_SIZE + MSG_TRAILER_SIZE;
+	}
+}
+
+
+// Keeps the waveform channel full, as a stream faster than the link would
+static void on_step (void) {
+	msg_t msg;
+
+	if (!g_saturate) {
+		return;
+	}
+	do {
+		msgs_example(&msg, MSG_TYPE_WAVEFORM, 
+			ipc_sequence(MSG_CHANNEL_WAVEFORM));
+	} while (ipc_send_msg(MSG_CHANNEL_WAVEFORM, &msg) == ESP_OK);
+	xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+}
+
+
+/* Sends hello requests from the client, and measures how long the device
+ * takes to reply on its control channel
+*/
+static run_result_t run (uint8_t saturate) {
+	link_config_t config = {.mtu = 247, .ll_len = BLE_DATA_LEN_MAX};
+	msg_t hello = {
+		.type = MSG_TYPE_HELLO,
+		.body.msg_hello = {
+			.version   = MSG_PROTOCOL_VERSION,
+			.types     = (1 << MSG_TYPE_MAX) - 1,
+			.encodings = (1 << MSG_ENCODING_MAX) - 1,
+			.batch_max = MSG_BATCH_MAX,
+			.mtu       = 247
+		}
+	};
+	run_result_t result = {0};
+	int64_t start, latency, began;
+	uint32_t replies;
+
+	g_saturate = 0;
+	g_wave_bytes = 0;
+	link_boot(&config);
+	g_link.on_frame = on_frame;
+	g_link.on_step = on_step;
+	link_connect();
+
+	// The client says hello first, so the waveform isn't withheld from it.
+	// The stream then runs until the link has switched to its parameters
+	link_send(&hello);
+	link_run(REQUEST_PERIOD_US);
+	g_saturate = saturate;
+	link_run(REPLY_TIMEOUT_US);
+
+	began = g_host_time_us;
+	for (int i = 0; i < REQUESTS; ++i) {
+		replies = g_link.frames[MSG_TYPE_HELLO];
+		start = g_host_time_us;
+		link_send(&hello);
+		while (g_link.frames[MSG_TYPE_HELLO] == replies &&
+			g_host_time_us - start < REPLY_TIMEOUT_US) {
+			link_run(LINK_STEP_US);
+		}
+		if (g_link.frames[MSG_TYPE_HELLO] == replies) {
+			continue;
+		}
+		latency = g_host_time_us - start;
+		result.replies++;
+		result.total_us += latency;
+		result.max_us = (latency > result.max_us) ? latency : result.max_us;
+
+		// The next request comes at an arbitrary point of the interval
+		link_run(REQUEST_PERIOD_US - latency + (i * 7919) % 20000);
+	}
+
+	result.kbps = g_wave_bytes * 1e3 / (g_host_time_us - began);
+
+	// Drain the channel behind one last frame, which follows every refused one
+	if (saturate) {
+		g_saturate = 0;
+		link_run(REPLY_TIMEOUT_US);
+		msgs_example(&hello, MSG_TYPE_WAVEFORM, 
+			ipc_sequence(MSG_CHANNEL_WAVEFORM));
+		CHECK(ipc_send_msg(MSG_CHANNEL_WAVEFORM, &hello) == ESP_OK);
+		xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+		link_run(REPLY_TIMEOUT_US);
+	}
+	result.waveform = g_link.frames[MSG_TYPE_WAVEFORM];
+
+	printf("%-12s %7u %9.1f %9.1f %9u %9.1f %8u\n",
+		saturate ? "Saturated" : "Idle", result.replies,
+		result.total_us / 1e3 / (result.replies + !result.replies),
+		result.max_us / 1e3, result.waveform, result.kbps,
+		g_link.parser.lost);
+	return result;
+}
+
+
+/* Control replies keep a bounded latency while the waveform channel has more
+ * to send than the link carries. The only waveform frames missing are those
+ * the full channel refused (their sequence numbers were taken), and the
+ * client tells the channels apart
+*/
+static void test_saturated (void) {
+	run_result_t idle, busy;
+	ipc_queue_stats_t wave;
+
+	printf("%-12s %7s %9s %9s %9s %9s %8s\n", "waveform", "replies",
+		"mean(ms)", "max(ms)", "frames", "kB/s", "lost");
+	idle = run(0);
+	CHECK(idle.replies == REQUESTS);
+	CHECK(idle.waveform == 0);
+
+	busy = run(1);
+	ipc_queue_stats(g_tx_queues + MSG_CHANNEL_WAVEFORM, &wave);
+	CHECK(busy.replies == REQUESTS);
+	CHECK(busy.max_us < REPLY_BOUND_US);
+	CHECK(busy.waveform > 0);
+	CHECK(wave.refused > 0);
+	CHECK(g_link.parser.lost == wave.refused);
+	CHECK(g_link.parser.crc_errors == 0);
+}
+
+
+int main (void) {
+	test_saturated();
+	return TEST_RESULT();
+}
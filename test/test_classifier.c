@@ -0,0 +1,147 @@
+#include <inttypes.h>
+#include "test.h"
+#include "beats.h"
+#include "classifier.h"
+#include "classifier_bench.h"
+#include "sdkconfig.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Beats drawn for the training and the (held-out) test set
+#define TRAIN_BEATS                 400
+#define TEST_BEATS                  4000
+
+// Lowest accuracy (percent) accepted from any backend on the synthetic set
+#define ACCURACY_MIN                75
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns the share (percent) of the beats in a result given the right label
+static double accuracy (const classifier_bench_t *bench) {
+	uint32_t right = 0;
+
+	for (size_t t = SAMPLE_LABEL_NORMAL; t <= SAMPLE_LABEL_VENTRICAL; ++t) {
+		right += bench->confusion[t][t];
+	}
+	return (bench->n == 0) ? 0.0 : (100.0 * right) / bench->n;
+}
+
+
+// Packs a training blob holding the same beat for every sample of a class
+static void uniform_blob (uint8_t *blob, const beat_features_t class[3]) {
+	const size_t counts[3] = {KNN_N_SAMPLES, KNN_A_SAMPLES, KNN_V_SAMPLES};
+
+	for (size_t c = 0; c < 3; ++c) {
+		for (size_t i = 0; i < counts[c]; ++i) {
+			blob[2 * i]                     = class[c].rr_period & 0xFF;
+			blob[2 * i + 1]                 = class[c].rr_period >> 8;
+			blob[2 * (counts[c] + i)]     = class[c].amplitude & 0xFF;
+			blob[2 * (counts[c] + i) + 1] = class[c].amplitude >> 8;
+		}
+		blob += 4 * counts[c];
+	}
+}
+
+
+/* Reports the latency, footprint and accuracy of every backend on a held-out
+ * set. KNN and NCM are trained on a separate draw, the tree and MLP use their
+ * built-in models
+*/
+static void test_backends (void) {
+	const beats_model_t train_model = {.seed = 1, .abnormal = 30};
+	const beats_model_t test_model  = {.seed = 2, .abnormal = 20};
+	uint8_t blob[KNN_BLOB_SIZE];
+	beats_t train, test;
+
+	beats_generate(&train, TRAIN_BEATS, &train_model);
+	beats_generate(&test, TEST_BEATS, &test_model);
+
+	CHECK(classifier_init() == ESP_OK);
+	CHECK(beats_blob(&train, blob) == ESP_OK);
+	CHECK(classifier_load(CLASSIFIER_KNN, blob, sizeof(blob)) == ESP_OK);
+	CHECK(classifier_load(CLASSIFIER_NCM, blob, sizeof(blob)) == ESP_OK);
+
+	printf("%-6s %8s %8s %10s %10s %9s\n", "", "RAM (B)", "ROM (B)", 
+		"ns/beat", "cyc/beat", "accuracy");
+
+	for (size_t t = 0; t < CLASSIFIER_TYPE_MAX; ++t) {
+		const classifier_t *c = classifier_get(t);
+		classifier_footprint_t footprint;
+		classifier_bench_t bench;
+		uint32_t cycles;
+
+		c->footprint(&footprint);
+		CHECK(classifier_bench_run(t, test.features, test.labels, test.n, 
+			&bench) == ESP_OK);
+		CHECK(bench.n == test.n);
+		cycles = bench.cycles_total / bench.n;
+
+		printf("%-6s %8zu %8zu %10.1f %10" PRIu32 " %8.1f%%\n", c->name, 
+			footprint.ram, footprint.flash, 
+			(1000.0 * cycles) / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, cycles,
+			accuracy(&bench));
+		CHECK(accuracy(&bench) >= ACCURACY_MIN);
+	}
+	printf("(host timings, in cycles of a %u MHz clock)\n",
+		CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+
+	beats_free(&train);
+	beats_free(&test);
+}
+
+
+/* Classifies beats at the far ends of the feature range, where squared
+ * differences no longer fit an int32_t (run under -fsanitize=undefined too)
+*/
+static void test_distance_range (void) {
+	const beat_features_t class[3] = {
+		{.amplitude = 0,     .rr_period = 0},
+		{.amplitude = 60000, .rr_period = 0},
+		{.amplitude = 0,     .rr_period = 60000}
+	};
+	const beat_features_t far[3] = {
+		{.amplitude = 65535, .rr_period = 0},
+		{.amplitude = 0,     .rr_period = 65535},
+		{.amplitude = 65535, .rr_period = 65535}
+	};
+	const classifier_type_t types[2] = {CLASSIFIER_KNN, CLASSIFIER_NCM};
+	uint8_t blob[KNN_BLOB_SIZE];
+
+	uniform_blob(blob, class);
+
+	for (size_t t = 0; t < 2; ++t) {
+		const classifier_t *c = classifier_get(types[t]);
+		sample_label_t labels[3];
+		uint8_t confidences[3];
+
+		CHECK(c->init() == ESP_OK);
+		CHECK(c->load(blob, sizeof(blob)) == ESP_OK);
+		c->classify_batch(far, 3, labels, confidences);
+
+		CHECK(labels[0] == SAMPLE_LABEL_ATRIAL);
+		CHECK(labels[1] == SAMPLE_LABEL_VENTRICAL);
+
+		// Every class is out of range of the last beat, so it gets no label
+		CHECK(labels[2] == SAMPLE_LABEL_UNKNOWN);
+		CHECK(confidences[2] == 0);
+	}
+}
+
+
+int main (void) {
+	test_backends();
+	test_distance_range();
+	return TEST_RESULT();
+}
@@ -0,0 +1,103 @@
+#include "test.h"
+#include "beats.h"
+#include "classifier.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Beats classified per measurement (a multiple of every batch size)
+#define BEATS                       (CLASSIFIER_BATCH_MAX * 256)
+
+// Measurements taken per batch size (the fastest is kept)
+#define ROUNDS                      5
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Labels and confidences given one beat at a time, and in batches
+static sample_label_t g_single_labels[BEATS], g_batch_labels[BEATS];
+static uint8_t g_single_confidences[BEATS], g_batch_confidences[BEATS];
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns the beats per second of the active backend with batches of size n
+static double measure (const beats_t *set, size_t n) {
+	uint64_t best = UINT64_MAX;
+
+	for (int r = 0; r < ROUNDS; ++r) {
+		uint64_t start = host_ns(), elapsed;
+
+		// Batches of one go through classify, like the per-beat path did
+		for (size_t i = 0; i < set->n; i += n) {
+			if (n == 1) {
+				g_single_labels[i] = classify(set->features[i].amplitude,
+					set->features[i].rr_period, g_single_confidences + i);
+			} else {
+				classify_batch(set->features + i, n, g_batch_labels + i,
+					g_batch_confidences + i);
+			}
+		}
+		if ((elapsed = host_ns() - start) < best) {
+			best = elapsed;
+		}
+	}
+
+	return (1e9 * set->n) / best;
+}
+
+
+int main (void) {
+	const beats_model_t model = {.seed = 3, .abnormal = 30};
+	const size_t sizes[] = {1, 2, 4, 8, 16, 32, 64};
+	uint8_t blob[KNN_BLOB_SIZE];
+	beats_t set;
+
+	beats_generate(&set, BEATS, &model);
+	CHECK(classifier_init() == ESP_OK);
+	CHECK(beats_blob(&set, blob) == ESP_OK);
+	CHECK(classifier_load(CLASSIFIER_KNN, blob, sizeof(blob)) == ESP_OK);
+	CHECK(classifier_load(CLASSIFIER_NCM, blob, sizeof(blob)) == ESP_OK);
+
+	printf("Beats per second (millions) by batch size\n%-6s", "");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		printf(" %7zu", sizes[s]);
+	}
+	printf("\n");
+
+	for (size_t t = 0; t < CLASSIFIER_TYPE_MAX; ++t) {
+		CHECK(classifier_select(t) == ESP_OK);
+		printf("%-6s", classifier_get(t)->name);
+
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+			printf(" %7.2f", measure(&set, sizes[s]) / 1e6);
+
+			// Batching must not change any label or confidence
+			if (sizes[s] > 1) {
+				CHECK(memcmp(g_single_labels, g_batch_labels, 
+					sizeof(g_batch_labels)) == 0);
+				CHECK(memcmp(g_single_confidences, g_batch_confidences,
+					sizeof(g_batch_confidences)) == 0);
+			}
+		}
+		printf("\n");
+	}
+
+	beats_free(&set);
+	return TEST_RESULT();
+}
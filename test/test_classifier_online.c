@@ -0,0 +1,193 @@
+#include "test.h"
+#include "beats.h"
+#include "classifier.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Beats in the drifting stream, and in each reported window of it
+#define STREAM_BEATS                6000
+#define WINDOW_BEATS                500
+
+// Shift of every class mean by the end of the drift (or at the step)
+#define DRIFT_AMPLITUDE             700
+#define DRIFT_PERIOD                (-200)
+
+// Windowed accuracy (percent) counted as recovered after the step
+#define RECOVERED                   90
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a run of a backend over the stream
+typedef struct {
+	const char        *name;
+	classifier_type_t  type;
+	int                learn;      // Nonzero if labeled beats are learned
+} run_t;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+/* Scores a backend on a stream, beat by beat. Each beat is classified before 
+ * its label is learned (if at all). Writes the accuracy (percent) of every 
+ * window, and returns the beats taken from the given beat to the end of the
+ * first window that recovered (the stream length if none did)
+*/
+static size_t run_stream (const run_t *run, const uint8_t *blob, 
+	const beats_t *stream, double *windows, size_t from) {
+	size_t right = 0, recovered = stream->n;
+
+	CHECK(classifier_init() == ESP_OK);
+	CHECK(classifier_load(run->type, blob, KNN_BLOB_SIZE) == ESP_OK);
+	CHECK(classifier_select(run->type) == ESP_OK);
+
+	for (size_t i = 0; i < stream->n; ++i) {
+		const beat_features_t *f = stream->features + i;
+
+		right += classify(f->amplitude, f->rr_period, NULL) == 
+			stream->labels[i];
+		if (run->learn) {
+			CHECK(classifier_update(f, stream->labels[i]) == ESP_OK);
+		}
+
+		// Close the window
+		if ((i + 1) % WINDOW_BEATS == 0) {
+			windows[i / WINDOW_BEATS] = (100.0 * right) / WINDOW_BEATS;
+			right = 0;
+		}
+	}
+
+	// Recovery is the end of the first good window after the step
+	for (size_t w = from / WINDOW_BEATS; w < stream->n / WINDOW_BEATS; ++w) {
+		if (windows[w] >= RECOVERED) {
+			recovered = (w + 1) * WINDOW_BEATS - from;
+			break;
+		}
+	}
+
+	return recovered;
+}
+
+
+// Returns the mean time (ns) taken by an update of a backend
+static double update_cost (classifier_type_t type, const uint8_t *blob,
+	const beats_t *stream) {
+	const classifier_t *c = classifier_get(type);
+	uint64_t start;
+
+	CHECK(c->load(blob, KNN_BLOB_SIZE) == ESP_OK);
+
+	start = host_ns();
+	for (size_t i = 0; i < stream->n; ++i) {
+		c->update(stream->features + i, stream->labels[i]);
+	}
+	return (double)(host_ns() - start) / stream->n;
+}
+
+
+// Prints the windowed accuracy of the runs over a stream
+static void report (const char *title, const run_t *runs, size_t n_runs, 
+	double windows[][STREAM_BEATS / WINDOW_BEATS], const size_t *recovered) {
+	printf("%s: accuracy (%%) per %u beats\n%-14s", title, WINDOW_BEATS, "");
+	for (size_t w = 0; w < STREAM_BEATS / WINDOW_BEATS; ++w) {
+		printf(" %5zu", (w + 1) * WINDOW_BEATS);
+	}
+	printf("  recovery\n");
+
+	for (size_t r = 0; r < n_runs; ++r) {
+		printf("%-14s", runs[r].name);
+		for (size_t w = 0; w < STREAM_BEATS / WINDOW_BEATS; ++w) {
+			printf(" %5.1f", windows[r][w]);
+		}
+		if (recovered == NULL) {
+			printf("\n");
+		} else if (recovered[r] < STREAM_BEATS) {
+			printf("  %zu beats\n", recovered[r]);
+		} else {
+			printf("  never\n");
+		}
+	}
+	printf("\n");
+}
+
+
+int main (void) {
+	const run_t runs[] = {
+		{"KNN (static)", CLASSIFIER_KNN, 0},
+		{"KNN (online)", CLASSIFIER_KNN, 1},
+		{"NCM (static)", CLASSIFIER_NCM, 0},
+		{"NCM (online)", CLASSIFIER_NCM, 1}
+	};
+	const size_t n_runs = sizeof(runs) / sizeof(runs[0]);
+	const size_t step = STREAM_BEATS / 4;
+	const beats_model_t train_model = {.seed = 4, .abnormal = 30};
+	const beats_model_t drift_model = {
+		.seed = 5, 
+		.abnormal = 20,
+		.drift_amplitude = DRIFT_AMPLITUDE,
+		.drift_period = DRIFT_PERIOD
+	};
+	const beats_model_t step_model = {.seed = 6, .abnormal = 20};
+	static double windows[4][STREAM_BEATS / WINDOW_BEATS];
+	size_t recovered[4];
+	uint8_t blob[KNN_BLOB_SIZE];
+	beats_t train, drift, shift;
+
+	beats_generate(&train, 400, &train_model);
+	beats_generate(&drift, STREAM_BEATS, &drift_model);
+	beats_generate(&shift, STREAM_BEATS, &step_model);
+	CHECK(beats_blob(&train, blob) == ESP_OK);
+
+	// The step stream shifts every class at once, a quarter of the way in
+	for (size_t i = step; i < shift.n; ++i) {
+		shift.features[i].amplitude += DRIFT_AMPLITUDE;
+		shift.features[i].rr_period += DRIFT_PERIOD;
+	}
+
+	// Gradual drift: learning keeps the accuracy up to the end
+	for (size_t r = 0; r < n_runs; ++r) {
+		run_stream(runs + r, blob, &drift, windows[r], 0);
+	}
+	report("Linear drift", runs, n_runs, windows, NULL);
+	CHECK(windows[1][STREAM_BEATS / WINDOW_BEATS - 1] >= RECOVERED);
+	CHECK(windows[3][STREAM_BEATS / WINDOW_BEATS - 1] >= RECOVERED);
+	CHECK(windows[3][STREAM_BEATS / WINDOW_BEATS - 1] > 
+		windows[2][STREAM_BEATS / WINDOW_BEATS - 1] + 10);
+
+	/* Step: learning recovers, static models never do. Rare classes move the
+	 * NCM means and prototypes slowly, so it takes several times as long
+	*/
+	for (size_t r = 0; r < n_runs; ++r) {
+		recovered[r] = run_stream(runs + r, blob, &shift, windows[r], step);
+	}
+	report("Step at 1500 beats", runs, n_runs, windows, recovered);
+	CHECK(recovered[1] <= 2 * WINDOW_BEATS);
+	CHECK(recovered[3] <= 5 * WINDOW_BEATS);
+	CHECK(recovered[2] == STREAM_BEATS);
+
+	// Mean cost of an update over the stream
+	printf("Update cost (ns): KNN %.1f, NCM %.1f\n", 
+		update_cost(CLASSIFIER_KNN, blob, &drift),
+		update_cost(CLASSIFIER_NCM, blob, &drift));
+
+	beats_free(&train);
+	beats_free(&drift);
+	beats_free(&shift);
+	return TEST_RESULT();
+}
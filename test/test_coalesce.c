@@ -0,0 +1,189 @@
+#include "test.h"
+#include "msgs.h"
+#include "link.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Beats relayed per run, and per send pass of the BLE task
+#define BEATS                       1000
+#define BEATS_PER_PASS              4
+
+// Simulated time (us) between two send passes, and given to the device to
+// settle after the client acts
+#define PASS_US                     (1000 * 1000)
+#define SETTLE_US                   (1000 * 1000)
+
+// Size of a beat frame
+#define BEAT_FRAME_SIZE             (MSG_HEADER_SIZE + \
+	MSG_SAMPLE_DATA_BODY_MAX + MSG_TRAILER_SIZE)
+
+// Size of the notifications sent before frames were coalesced (one per
+// frame, always this long)
+#define FIXED_NOTIFY_SIZE           20
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing what a run put on air
+typedef struct {
+	uint32_t notifications;                 // Notifications delivered
+	uint64_t bytes;                         // Bytes of those
+	uint64_t radio_bytes;                   // Bytes on air
+	uint32_t frames;                        // Frames the client took
+	uint16_t longest;                       // Longest notification
+} run_result_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Longest notification delivered
+static uint16_t g_longest;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Keeps the longest notification delivered
+static void on_notify (const uint8_t *value, size_t len) {
+	g_longest = (len > g_longest) ? len : g_longest;
+}
+
+
+/* Connects a client with an MTU, and relays frames of a type through the BLE
+ * task a few at a time. Counts what was on air for those frames only
+*/
+static run_result_t run (uint16_t mtu, msg_type_t type, uint32_t frames,
+	uint32_t per_pass) {
+	link_config_t config = {.mtu = mtu};
+	msg_t hello = {
+		.type = MSG_TYPE_HELLO,
+		.body.msg_hello = {
+			.version   = MSG_PROTOCOL_VERSION,
+			.types     = (1 << MSG_TYPE_MAX) - 1,
+			.encodings = (1 << MSG_ENCODING_MAX) - 1,
+			.batch_max = MSG_BATCH_MAX,
+			.mtu       = mtu
+		}
+	};
+	run_result_t r;
+	msg_t msg;
+
+	link_boot(&config);
+	g_link.on_notify = on_notify;
+	link_connect();
+	link_send(&hello);
+	link_run(SETTLE_US);
+
+	r = (run_result_t) {
+		.notifications = g_link.delivered,
+		.bytes         = g_link.bytes,
+		.radio_bytes   = g_link.radio_bytes,
+		.frames        = g_link.frames[type]
+	};
+	g_longest = 0;
+	for (uint32_t i = 0; i < frames; i += per_pass) {
+		for (uint32_t j = i; j < i + per_pass && j < frames; ++j) {
+			msgs_example(&msg, type, j);
+			CHECK(ipc_send_msg(MSG_CHANNEL_BEATS, &msg) == ESP_OK);
+		}
+		xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+		link_run(PASS_US);
+	}
+
+	r.notifications = g_link.delivered - r.notifications;
+	r.bytes = g_link.bytes - r.bytes;
+	r.radio_bytes = g_link.radio_bytes - r.radio_bytes;
+	r.frames = g_link.frames[type] - r.frames;
+	r.longest = g_longest;
+	CHECK(g_link.parser.crc_errors == 0 && g_link.parser.lost == 0);
+	return r;
+}
+
+
+/* A thousand beats go out in notifications filled up to the MTU less the
+ * ATT header, each no longer than the frames it carries. Before, each frame
+ * took a notification of 20 bytes
+*/
+static void test_beats (void) {
+	const uint16_t mtus[] = {23, 185, 247, 512};
+	uint32_t per_notify, passes = BEATS / BEATS_PER_PASS;
+	size_t fixed_air;
+	run_result_t r;
+
+	// One notification per frame, 27-byte link-layer packets
+	fixed_air = BEATS * (FIXED_NOTIFY_SIZE + 3 + 4 + LINK_PACKET_OVERHEAD);
+	printf("%-9s %13s %9s %12s %9s\n", "mtu", "notifications", "bytes",
+		"air bytes", "longest");
+	printf("%-9s %13u %9u %12zu %9u\n", "fixed", BEATS, BEATS *
+		FIXED_NOTIFY_SIZE, fixed_air, FIXED_NOTIFY_SIZE);
+
+	for (size_t i = 0; i < sizeof(mtus) / sizeof(mtus[0]); ++i) {
+		r = run(mtus[i], MSG_TYPE_SAMPLE_DATA, BEATS, BEATS_PER_PASS);
+		printf("%-9u %13u %9llu %12llu %9u\n", mtus[i], r.notifications,
+			(unsigned long long)r.bytes, (unsigned long long)r.radio_bytes,
+			r.longest);
+
+		// Every frame arrived, and no padding went with it
+		CHECK(r.frames == BEATS);
+		CHECK(r.bytes == BEATS * BEAT_FRAME_SIZE);
+		CHECK(r.longest <= mtus[i] - BLE_ATT_HEADER_SIZE);
+
+		// The frames of a pass fill as few notifications as they can
+		per_notify = mtus[i] - BLE_ATT_HEADER_SIZE;
+		CHECK(r.notifications == passes * ((BEATS_PER_PASS * BEAT_FRAME_SIZE +
+			per_notify - 1) / per_notify));
+		CHECK(r.radio_bytes <= fixed_air);
+	}
+	printf("\n");
+}
+
+
+/* Frames longer than a notification (which used to be refused) are split
+ * across notifications, and reassembled by the client
+*/
+static void test_split (void) {
+	const uint16_t mtus[] = {23, 247};
+	size_t z;
+	run_result_t r;
+	msg_t msg;
+
+	msgs_example(&msg, MSG_TYPE_SAMPLE_BATCH, 0);
+	z = msg_size(&msg);
+	for (size_t i = 0; i < sizeof(mtus) / sizeof(mtus[0]); ++i) {
+		r = run(mtus[i], MSG_TYPE_SAMPLE_BATCH, 20, 1);
+		printf("Split: 20 batches of %zu bytes in %u notifications of up to "
+			"%u bytes (MTU %u)\n", z, r.notifications, r.longest, mtus[i]);
+		CHECK(r.frames == 20);
+		CHECK(r.bytes == 20 * z);
+		CHECK(r.longest <= mtus[i] - BLE_ATT_HEADER_SIZE);
+		CHECK(r.notifications == 20 * ((z + mtus[i] - BLE_ATT_HEADER_SIZE - 1) /
+			(mtus[i] - BLE_ATT_HEADER_SIZE)));
+	}
+}
+
+
+int main (void) {
+	test_beats();
+	test_split();
+	return TEST_RESULT();
+}
@@ -0,0 +1,226 @@
+#include "test.h"
+#include "msgs.h"
+#include "link.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Simulated time (us) a load runs before it is measured, and measured
+#define WARMUP_US                   (15 * 1000 * 1000)
+#define MEASURE_US                  (60 * 1000 * 1000)
+
+// Simulated time (us) between two beats, and two waveform frames
+#define BEAT_PERIOD_US              (1000 * 1000)
+#define WAVE_PERIOD_US              (100 * 1000)
+
+// Radio time (us) of an attended connection event besides its packets (the
+// wake-up and the empty packets), and of each packet besides its bits (the
+// client's empty packet and the two inter-frame spaces), at 1 bit per us
+#define EVENT_ON_US                 300
+#define PACKET_ON_US                (80 + 2 * 150)
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Enumeration of the loads offered to the link
+typedef enum {
+	LOAD_BEATS,                             // A beat a second
+	LOAD_WAVEFORM,                          // Beats, and the waveform
+	LOAD_BULK,                              // As much as the channels hold
+	LOAD_MAX
+} load_t;
+
+
+// Structure describing what a load got from the link
+typedef struct {
+	ble_link_t link;                        // Parameters in effect at the end
+	double   bytes_s;                       // Bytes delivered per second
+	double   events_s, attended_s;          // Events per second
+	double   duty;                          // Fraction of time the radio is on
+} run_result_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Names of the loads
+static const char *g_load_names[LOAD_MAX] = {"beats", "waveform", "bulk"};
+
+// The load offered, and when the next beat and waveform frame are due
+static load_t g_load;
+static int64_t g_beat_due, g_wave_due;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Queues an example frame on a channel, unless it is full
+static void send_example (uint8_t channel, msg_type_t type) {
+	msg_t msg;
+
+	if (!ipc_full(channel)) {
+		msgs_example(&msg, type, ipc_sequence(channel));
+		CHECK(ipc_send_msg(channel, &msg) == ESP_OK);
+	}
+}
+
+
+// Offers the load to the BLE task
+static void on_step (void) {
+	if (g_load == LOAD_BULK) {
+		while (!ipc_full(MSG_CHANNEL_BEATS)) {
+			send_example(MSG_CHANNEL_BEATS, MSG_TYPE_SAMPLE_DATA);
+		}
+		while (!ipc_full(MSG_CHANNEL_WAVEFORM)) {
+			send_example(MSG_CHANNEL_WAVEFORM, MSG_TYPE_WAVEFORM);
+		}
+	}
+	if (g_host_time_us >= g_beat_due) {
+		send_example(MSG_CHANNEL_BEATS, MSG_TYPE_SAMPLE_DATA);
+		g_beat_due += BEAT_PERIOD_US;
+	}
+	if (g_load == LOAD_WAVEFORM && g_host_time_us >= g_wave_due) {
+		send_example(MSG_CHANNEL_WAVEFORM, MSG_TYPE_WAVEFORM);
+		g_wave_due += WAVE_PERIOD_US;
+	}
+	xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+}
+
+
+/* Connects a client (which refuses parameter requests if fixed), offers a
+ * load, and measures the throughput and the radio time once it settled
+*/
+static run_result_t run (load_t load, uint8_t fixed) {
+	link_config_t config = {
+		.mtu           = 247,
+		.ll_len        = BLE_DATA_LEN_MAX,
+		.refuse_params = fixed
+	};
+	msg_t hello = {
+		.type = MSG_TYPE_HELLO,
+		.body.msg_hello = {
+			.version   = MSG_PROTOCOL_VERSION,
+			.types     = (1 << MSG_TYPE_MAX) - 1,
+			.encodings = (1 << MSG_ENCODING_MAX) - 1,
+			.batch_max = MSG_BATCH_MAX,
+			.mtu       = 247
+		}
+	};
+	uint64_t bytes, packets, radio_bytes;
+	uint32_t events, attended;
+	double seconds = MEASURE_US / 1e6, on_us;
+	run_result_t r;
+
+	g_load = load;
+	link_boot(&config);
+	link_connect();
+	link_send(&hello);
+	g_beat_due = g_wave_due = g_host_time_us;
+	g_link.on_step = on_step;
+	link_run(WARMUP_US);
+
+	bytes = g_link.bytes;
+	packets = g_link.packets;
+	radio_bytes = g_link.radio_bytes;
+	events = g_link.events;
+	attended = g_link.attended;
+	link_run(MEASURE_US);
+	g_link.on_step = NULL;
+
+	ble_get_link(&r.link);
+	on_us = (g_link.attended - attended) * EVENT_ON_US +
+		(g_link.packets - packets) * PACKET_ON_US +
+		(g_link.radio_bytes - radio_bytes) * 8;
+	r.bytes_s = (g_link.bytes - bytes) / seconds;
+	r.events_s = (g_link.events - events) / seconds;
+	r.attended_s = (g_link.attended - attended) / seconds;
+	r.duty = on_us / MEASURE_US;
+
+	printf("%-9s %-8s %8.1f %7u %9.0f %9.1f %9.2f %8.2f%%\n",
+		g_load_names[load], fixed ? "fixed" : "managed",
+		r.link.interval * 1.25, r.link.latency, r.bytes_s, r.events_s,
+		r.attended_s, 100 * r.duty);
+	CHECK(g_link.parser.crc_errors == 0 && g_link.parser.lost == 0);
+	return r;
+}
+
+
+/* The parameters the client connected with are in effect until the first
+ * update, and stay so if the client refuses every request
+*/
+static void test_initial (void) {
+	link_config_t config = {.mtu = 247, .interval = 40, .refuse_params = 1};
+	ble_link_t link;
+
+	link_boot(&config);
+	link_connect();
+	ble_get_link(&link);
+	CHECK(link.interval == 40 && link.latency == 0);
+	CHECK(link.timeout == BLE_CONN_TIMEOUT);
+	CHECK(link.updates == 0);
+
+	link_run(10 * 1000 * 1000);
+	ble_get_link(&link);
+	CHECK(link.interval == 40 && link.timeout == BLE_CONN_TIMEOUT);
+	CHECK(link.updates == 0 && link.rejected > 0);
+	printf("Initial: interval %.2f ms from the connection, kept through %u "
+		"refusals\n\n", link.interval * 1.25, link.rejected);
+}
+
+
+/* Each load runs with the parameters the client picked (it refuses every
+ * request), then with those the device asks for. Beats alone get long
+ * intervals and slave latency, cutting the radio time; bulk transfers get
+ * short intervals, and more throughput; the waveform gets all through either
+ * way
+*/
+static void test_modes (void) {
+	run_result_t fixed[LOAD_MAX], managed[LOAD_MAX];
+
+	printf("%-9s %-8s %8s %7s %9s %9s %9s %9s\n", "load", "params",
+		"int(ms)", "latency", "B/s", "events/s", "attended", "radio on");
+	for (load_t l = 0; l < LOAD_MAX; ++l) {
+		fixed[l] = run(l, 1);
+		managed[l] = run(l, 0);
+	}
+
+	// Beats alone: monitoring parameters, a fraction of the radio time
+	CHECK(managed[LOAD_BEATS].link.interval == BLE_CONN_MONITOR_MIN_INT);
+	CHECK(managed[LOAD_BEATS].link.latency == BLE_CONN_MONITOR_LATENCY);
+	CHECK(managed[LOAD_BEATS].duty * 4 < fixed[LOAD_BEATS].duty);
+	CHECK(managed[LOAD_BEATS].bytes_s == fixed[LOAD_BEATS].bytes_s);
+
+	// The waveform: stream parameters, and all of it delivered
+	CHECK(managed[LOAD_WAVEFORM].link.interval == BLE_CONN_STREAM_MIN_INT);
+	CHECK(managed[LOAD_WAVEFORM].bytes_s >= 0.99 *
+		fixed[LOAD_WAVEFORM].bytes_s);
+
+	// Bulk: stream parameters, and more throughput
+	CHECK(managed[LOAD_BULK].link.interval == BLE_CONN_STREAM_MIN_INT);
+	CHECK(managed[LOAD_BULK].bytes_s > 1.5 * fixed[LOAD_BULK].bytes_s);
+}
+
+
+int main (void) {
+	test_initial();
+	test_modes();
+	return TEST_RESULT();
+}
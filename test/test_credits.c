@@ -0,0 +1,191 @@
+#include "test.h"
+#include "msgs.h"
+#include "link.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Simulated time (us) the bulk channels are kept full, and given to the
+// device to settle after the client acts
+#define RUN_US                      (20 * 1000 * 1000)
+#define SETTLE_US                   (1000 * 1000)
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a run with the bulk channels kept full
+typedef struct {
+	ble_tx_stats_t tx;                      // Counters of the sender
+	uint8_t  in_flight_max;                 // Most notifications in flight
+	uint32_t early;                         // Sends during a pause
+	uint32_t frames;                        // Frames the client took
+	uint64_t bytes;                         // Bytes delivered
+} run_result_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Losses seen so far, when the last was seen, and the notifications the stack
+// had taken by then
+static uint32_t g_failed;
+static int64_t g_failed_at;
+static uint32_t g_failed_notes;
+
+// What the run saw
+static run_result_t g_result;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+/* Keeps the beat and waveform channels full (short of their policies), and
+ * watches the credits and the pause after a loss
+*/
+static void on_step (void) {
+	msg_t msg;
+
+	while (!ipc_full(MSG_CHANNEL_BEATS)) {
+		msgs_example(&msg, MSG_TYPE_SAMPLE_DATA, 
+			ipc_sequence(MSG_CHANNEL_BEATS));
+		CHECK(ipc_send_msg(MSG_CHANNEL_BEATS, &msg) == ESP_OK);
+	}
+	while (!ipc_full(MSG_CHANNEL_WAVEFORM)) {
+		msgs_example(&msg, MSG_TYPE_WAVEFORM, 
+			ipc_sequence(MSG_CHANNEL_WAVEFORM));
+		CHECK(ipc_send_msg(MSG_CHANNEL_WAVEFORM, &msg) == ESP_OK);
+	}
+	xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+
+	g_result.in_flight_max = (g_ble_in_flight > g_result.in_flight_max) ?
+		g_ble_in_flight : g_result.in_flight_max;
+
+	// Nothing reaches the stack for a while after a notification was lost
+	if (g_ble_tx_stats.failed != g_failed) {
+		g_failed = g_ble_tx_stats.failed;
+		g_failed_at = g_host_time_us;
+		g_failed_notes = g_link.notifications;
+	} else if (g_failed > 0 && g_host_time_us < g_failed_at +
+		BLE_TX_RETRY_MS * 1000 && g_link.notifications != g_failed_notes) {
+		g_result.early++;
+		g_failed_notes = g_link.notifications;
+	}
+}
+
+
+// Connects a client, says hello, and keeps the bulk channels full for a while
+static run_result_t run (const link_config_t *config) {
+	msg_t hello = {
+		.type = MSG_TYPE_HELLO,
+		.body.msg_hello = {
+			.version   = MSG_PROTOCOL_VERSION,
+			.types     = (1 << MSG_TYPE_MAX) - 1,
+			.encodings = (1 << MSG_ENCODING_MAX) - 1,
+			.batch_max = MSG_BATCH_MAX,
+			.mtu       = config->mtu
+		}
+	};
+	uint32_t frames;
+	uint64_t bytes;
+
+	g_failed = g_failed_notes = 0;
+	g_failed_at = 0;
+	link_boot(config);
+	link_connect();
+	link_send(&hello);
+	link_run(SETTLE_US);
+
+	g_result = (run_result_t) {0};
+	frames = g_link.frames[MSG_TYPE_SAMPLE_DATA] +
+		g_link.frames[MSG_TYPE_WAVEFORM];
+	bytes = g_link.bytes;
+	g_link.on_step = on_step;
+	link_run(RUN_US);
+	g_link.on_step = NULL;
+	link_run(SETTLE_US);
+
+	ble_tx_stats(&g_result.tx);
+	g_result.frames = g_link.frames[MSG_TYPE_SAMPLE_DATA] +
+		g_link.frames[MSG_TYPE_WAVEFORM] - frames;
+	g_result.bytes = g_link.bytes - bytes;
+	printf("%-10s %6u %8u %6u %9u %6u %6u %8u %6u %9.1f\n",
+		(config->l2cap_queue == 0) ? "congests" : "overflows",
+		g_result.tx.sent, g_result.tx.deferred, g_result.tx.failed,
+		g_result.tx.congested, g_result.in_flight_max, g_link.refused,
+		g_result.frames, g_link.parser.lost,
+		g_result.bytes / (RUN_US / 1e6) / 1e3);
+	return g_result;
+}
+
+
+/* The radio carries less than the device would send. No more than
+ * BLE_TX_CREDITS notifications are in flight, so the stack never refuses
+ * one, and sending stops while the link is congested: nothing is lost
+*/
+static void test_congestion (void) {
+	link_config_t config = {.mtu = 247, .packets = 2};
+	run_result_t r;
+
+	r = run(&config);
+	CHECK(r.in_flight_max == BLE_TX_CREDITS);
+	CHECK(r.tx.congested > 0 && r.tx.deferred > 0);
+	CHECK(r.tx.failed == 0 && r.tx.rejected == 0);
+	CHECK(g_link.refused == 0 && g_link.dropped == 0);
+	CHECK(g_link.parser.lost == 0 && g_link.parser.crc_errors == 0);
+	CHECK(r.frames > 0);
+}
+
+
+/* The L2CAP queue fills up before the link reports congestion, and the
+ * stack drops notifications. Each loss is counted, and sending pauses after
+ * it (longer after losses in a row). Then the lost notification and every one
+ * after it are sent again in order, so the client loses no frame
+*/
+static void test_loss (void) {
+	link_config_t config = {.mtu = 247, .packets = 1, .l2cap_queue = 2};
+	run_result_t r;
+
+	r = run(&config);
+	CHECK(r.tx.failed > 0);
+	CHECK(r.tx.failed == g_link.dropped);
+	CHECK(r.tx.resent > 0);
+	CHECK(r.early == 0);
+	CHECK(r.in_flight_max <= BLE_TX_CREDITS);
+
+	// Every frame arrives, whole and in order
+	CHECK(r.frames > 0);
+	CHECK(g_link.parser.lost == 0 && g_link.parser.reordered == 0);
+	CHECK(g_link.parser.crc_errors == 0 && g_link.parser.skipped == 0);
+	printf("Loss: %u notifications dropped, %u sent again; %u frames lost, "
+		"%u duplicates, %u corrupt\n", r.tx.failed, r.tx.resent,
+		g_link.parser.lost, g_link.parser.duplicates, 
+		g_link.parser.crc_errors);
+}
+
+
+int main (void) {
+	printf("%-10s %6s %8s %6s %9s %6s %6s %8s %6s %9s\n", "stack", "sent",
+		"deferred", "failed", "congested", "flight", "refused", "frames",
+		"lost", "kB/s");
+	test_congestion();
+	test_loss();
+	return TEST_RESULT();
+}
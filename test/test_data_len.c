@@ -0,0 +1,200 @@
+#include "test.h"
+#include "msgs.h"
+#include "link.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Frames relayed per run
+#define FRAMES                      4000
+
+// Simulated time (us) between two send passes (the channel is topped up
+// before each), and given to the device to settle after the client acts
+#define PASS_US                     (100 * 1000)
+#define SETTLE_US                   (1000 * 1000)
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing what a run put on air
+typedef struct {
+	double packets_kb;                      // Link-layer packets per KB
+	double radio_kb;                        // Bytes on air per KB
+	uint32_t frames;                        // Frames the client took
+} run_result_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// The last link status taken by the client, and the reports taken
+static msg_link_status_data_t g_status;
+static uint32_t g_status_count;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Keeps the link status reports taken by the client
+static void on_frame (const msg_view_t *view, void *ctx) {
+	msg_t msg;
+
+	if (view->type == MSG_TYPE_LINK_STATUS && msg_decode(&msg, view) ==
+		ESP_OK) {
+		g_status = msg.body.msg_link_status;
+		g_status_count++;
+	}
+}
+
+
+// Connects a client with an MTU and the longest link-layer payload it takes
+static void connect (uint16_t mtu, uint16_t ll_len) {
+	link_config_t config = {.mtu = mtu, .ll_len = ll_len};
+	msg_t hello = {
+		.type = MSG_TYPE_HELLO,
+		.body.msg_hello = {
+			.version   = MSG_PROTOCOL_VERSION,
+			.types     = (1 << MSG_TYPE_MAX) - 1,
+			.encodings = (1 << MSG_ENCODING_MAX) - 1,
+			.batch_max = MSG_BATCH_MAX,
+			.mtu       = mtu
+		}
+	};
+
+	link_boot(&config);
+	g_link.on_frame = on_frame;
+	link_connect();
+	link_send(&hello);
+	link_run(SETTLE_US);
+}
+
+
+/* Relays frames of a type through the BLE task, keeping the channel topped
+ * up, and counts the packets and bytes on air per KB of notifications
+*/
+static run_result_t run (uint16_t mtu, uint16_t ll_len, msg_type_t type) {
+	uint64_t bytes, packets, radio_bytes;
+	uint32_t frames, sent = 0;
+	run_result_t r;
+	msg_t msg;
+
+	connect(mtu, ll_len);
+	bytes = g_link.bytes;
+	packets = g_link.packets;
+	radio_bytes = g_link.radio_bytes;
+	frames = g_link.frames[type];
+	while (sent < FRAMES) {
+		for (; sent < FRAMES && !ipc_full(MSG_CHANNEL_BEATS); ++sent) {
+			msgs_example(&msg, type, sent);
+			CHECK(ipc_send_msg(MSG_CHANNEL_BEATS, &msg) == ESP_OK);
+		}
+		xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+		link_run(PASS_US);
+	}
+	link_run(SETTLE_US);
+
+	bytes = g_link.bytes - bytes;
+	r.packets_kb = (g_link.packets - packets) * 1024.0 / bytes;
+	r.radio_kb = (g_link.radio_bytes - radio_bytes) * 1024.0 / bytes;
+	r.frames = g_link.frames[type] - frames;
+	CHECK(g_link.parser.crc_errors == 0 && g_link.parser.lost == 0);
+	return r;
+}
+
+
+/* Notifications take a packet per 27 bytes without data length extension,
+ * and a packet per 251 bytes with it. Packets per KB fall with the larger
+ * payload unless the MTU, not the payload, limits the notifications
+*/
+static void test_packets (void) {
+	const uint16_t mtus[] = {23, 185, 247, 512};
+	const msg_type_t types[] = {MSG_TYPE_SAMPLE_DATA, MSG_TYPE_SAMPLE_BATCH};
+	run_result_t r27, r251;
+
+	printf("%-13s %5s %12s %12s %12s %12s\n", "frames", "mtu", "pkt/KB (27)",
+		"pkt/KB (251)", "air/KB (27)", "air/KB (251)");
+	for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t) {
+		for (size_t i = 0; i < sizeof(mtus) / sizeof(mtus[0]); ++i) {
+			r27 = run(mtus[i], BLE_DATA_LEN_DEFAULT, types[t]);
+			r251 = run(mtus[i], BLE_DATA_LEN_MAX, types[t]);
+			printf("%-13s %5u %12.1f %12.1f %12.0f %12.0f\n",
+				(types[t] == MSG_TYPE_SAMPLE_DATA) ? "beats" : "batches",
+				mtus[i], r27.packets_kb, r251.packets_kb, r27.radio_kb,
+				r251.radio_kb);
+			CHECK(r27.frames == FRAMES && r251.frames == FRAMES);
+
+			// Notifications of the default MTU fit a 27-byte payload
+			if (mtus[i] == BLE_MTU_DEFAULT) {
+				CHECK(r251.packets_kb == r27.packets_kb);
+			} else {
+				CHECK(r251.packets_kb * 4 < r27.packets_kb);
+				CHECK(r251.radio_kb < r27.radio_kb);
+			}
+		}
+	}
+	printf("\n");
+}
+
+
+/* The device asks for the longest payload, and the client settles on the
+ * longest it takes. Telemetry ends with a report of the link: the MTU, the
+ * payloads agreed, the connection parameters and the sender's counters
+*/
+static void test_status (void) {
+	const uint16_t ll_lens[] = {BLE_DATA_LEN_DEFAULT, 123, BLE_DATA_LEN_MAX};
+	msg_t msg = {
+		.type = MSG_TYPE_INSTRUCTION,
+		.body.msg_instruction.inst = INST_EKG_TELEMETRY
+	};
+	ble_tx_stats_t tx;
+	ble_link_t link;
+
+	for (size_t i = 0; i < sizeof(ll_lens) / sizeof(ll_lens[0]); ++i) {
+		connect(247, ll_lens[i]);
+		g_status_count = 0;
+		link_send(&msg);
+		link_run(SETTLE_US);
+		ble_get_link(&link);
+		ble_tx_stats(&tx);
+
+		CHECK(g_status_count == 1);
+		CHECK(g_status.mtu == 247);
+		CHECK(link.tx_len == ll_lens[i] && link.rx_len == ll_lens[i]);
+		CHECK(g_status.tx_len == link.tx_len && g_status.rx_len == link.rx_len);
+		CHECK(g_status.interval == link.interval && g_status.interval > 0);
+		CHECK(g_status.latency == link.latency);
+		CHECK(g_status.timeout == link.timeout && g_status.timeout > 0);
+		CHECK(g_status.mode <= BLE_CONN_MODE_MAX);
+		CHECK(g_status.sent > 0 && g_status.sent <= tx.sent);
+		CHECK(g_status.failed == tx.failed);
+		printf("Link status: MTU %u, payload %u/%u, interval %.2f ms, latency "
+			"%u, timeout %u ms, %u sent\n", g_status.mtu, g_status.tx_len,
+			g_status.rx_len, g_status.interval * 1.25, g_status.latency,
+			g_status.timeout * 10, g_status.sent);
+	}
+}
+
+
+int main (void) {
+	test_packets();
+	test_status();
+	return TEST_RESULT();
+}
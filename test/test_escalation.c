@@ -0,0 +1,171 @@
+#include "test.h"
+#include "replay.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Sample blocks replayed per configuration (about 20 minutes of signal)
+#define REPLAY_BLOCKS               480
+
+// Beats in the replayed set (rendered again once all are used)
+#define REPLAY_BEATS                2000
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a named replay configuration
+typedef struct {
+	const char      *name;
+	replay_config_t  config;
+} run_t;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns the frames queued on all channels during a replay
+static uint32_t total_frames (const replay_result_t *result) {
+	uint32_t frames = 0;
+
+	for (int c = 0; c < MSG_CHANNEL_MAX; ++c) {
+		frames += result->frames[c];
+	}
+	return frames;
+}
+
+
+/* A full beat count is summarized early rather than escalating confident
+ * normal beats. If the beat channel has no room, the beats are dropped
+*/
+static void test_saturation (const beats_t *train) {
+	const beats_model_t normal_model = {.seed = 21, .abnormal = 0};
+	msg_t summary = {.type = MSG_TYPE_SUMMARY};
+	replay_result_t result = {0};
+	beats_signal_t signal;
+	beats_t normal;
+
+	beats_generate(&normal, 100, &normal_model);
+	beats_signal_init(&signal, &normal, 3);
+	CHECK(replay_setup(train));
+	g_local_policy = (msg_policy_data_t) {
+		.enabled        = 1,
+		.min_confidence = 0,
+		.summary_blocks = UINT8_MAX
+	};
+
+	// The beat channel has room: the full count goes out as a summary
+	g_summary_count = UINT16_MAX - 1;
+	replay_block(&signal, 0);
+	CHECK(g_stat_beats > 1);
+	CHECK(g_stat_escalated == 0);
+	CHECK(g_summary_count > 0 && g_summary_count < g_stat_beats);
+	replay_drain(&result);
+	CHECK(result.frames[MSG_CHANNEL_BEATS] == 1);
+	CHECK(result.frames[MSG_CHANNEL_ALERTS] == 0);
+
+	// The beat channel is full: the count stays full, and nothing escalates
+	while (send_msg(MSG_CHANNEL_BEATS, &summary) == ESP_OK);
+	g_summary_count = UINT16_MAX - 1;
+	g_stat_beats = 0;
+	replay_block(&signal, 1);
+	CHECK(g_stat_beats > 1);
+	CHECK(g_stat_escalated == 0);
+	CHECK(g_summary_count == UINT16_MAX);
+	printf("Saturated count: %u beats, none escalated\n\n", g_stat_beats);
+
+	beats_free(&normal);
+}
+
+
+int main (void) {
+	const msg_policy_data_t policy = {
+		.enabled        = 1,
+		.min_confidence = 128,
+		.summary_blocks = 4
+	};
+	const msg_batching_data_t plain = {
+		.count = 1, .age = 2000, .encoding = MSG_ENCODING_PLAIN, .keyframe = 8
+	};
+	const msg_batching_data_t batched = {
+		.count = 16, .age = 5000, .encoding = MSG_ENCODING_PLAIN, .keyframe = 8
+	};
+	const msg_batching_data_t delta = {
+		.count = 16, .age = 5000, .encoding = MSG_ENCODING_DELTA, .keyframe = 8
+	};
+	const run_t runs[] = {
+		{"Every beat",    {.batching = plain,   .blocks = REPLAY_BLOCKS}},
+		{"Batched (16)",  {.batching = batched, .blocks = REPLAY_BLOCKS}},
+		{"Delta (16)",    {.batching = delta,   .blocks = REPLAY_BLOCKS}},
+		{"Policy",        {.policy = policy, .batching = plain, 
+			.blocks = REPLAY_BLOCKS}},
+		{"Policy + 32",   {.policy = {1, 128, 32, 4}, .batching = plain,
+			.blocks = REPLAY_BLOCKS}},
+		{"Waveform",      {.batching = plain, .wave = 1, 
+			.blocks = REPLAY_BLOCKS}}
+	};
+	const size_t n_runs = sizeof(runs) / sizeof(runs[0]);
+	const beats_model_t train_model = {.seed = 4, .abnormal = 30};
+	const beats_model_t replay_model = {.seed = 11, .abnormal = 10};
+	replay_result_t results[sizeof(runs) / sizeof(runs[0])];
+	beats_t train, replay;
+
+	beats_generate(&train, 400, &train_model);
+	beats_generate(&replay, REPLAY_BEATS, &replay_model);
+
+	printf("Replay: %u blocks (%.0f s), %u%% abnormal beats\n", REPLAY_BLOCKS,
+		REPLAY_BLOCKS * DEVICE_SENSOR_PUSH_BUF_SIZE * 
+		DEVICE_SENSOR_POLL_PERIOD_MS / 1000.0, replay_model.abnormal);
+	printf("%-14s %7s %9s %10s %12s %10s\n", "", "beats", "escalated",
+		"frames/h", "bytes/h", "wakeups/h");
+	for (size_t r = 0; r < n_runs; ++r) {
+		const replay_result_t *x = results + r;
+		double hours;
+
+		CHECK(replay_setup(&train));
+		replay_run(&runs[r].config, &replay, results + r);
+		hours = x->seconds / 3600.0;
+		printf("%-14s %7u %8.1f%% %10.0f %12.0f %10.0f\n", runs[r].name, 
+			x->beats, (100.0 * x->escalated) / x->beats,
+			total_frames(x) / hours, replay_bytes(x) / hours, 
+			x->wakeups / hours);
+		CHECK(x->beats > 0);
+	}
+	printf("\n");
+
+	// Without a policy nothing escalates, and every beat is a frame
+	CHECK(results[0].escalated == 0);
+	CHECK(results[0].frames[MSG_CHANNEL_BEATS] == results[0].beats);
+
+	// Batching and coding cut the frames and bytes of the same beats
+	CHECK(results[1].beats == results[0].beats);
+	CHECK(results[1].frames[MSG_CHANNEL_BEATS] * 4 < results[0].beats);
+	CHECK(replay_bytes(results + 1) < replay_bytes(results + 0));
+	CHECK(replay_bytes(results + 2) < replay_bytes(results + 1));
+
+	// The policy escalates the abnormal beats (and few others), and sends less
+	CHECK(results[3].escalated * 100 >= results[3].beats * 5);
+	CHECK(results[3].escalated * 100 <= results[3].beats * 25);
+	CHECK(replay_bytes(results + 3) < replay_bytes(results + 0) / 2);
+	CHECK(results[4].escalated == results[3].escalated);
+	CHECK(replay_bytes(results + 4) > replay_bytes(results + 3));
+
+	test_saturation(&train);
+
+	beats_free(&train);
+	beats_free(&replay);
+	return TEST_RESULT();
+}
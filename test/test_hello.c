@@ -0,0 +1,248 @@
+#include "test.h"
+#include "msgs.h"
+#include "link.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Simulated time (us) given to the device to settle after a client acts
+// (longer than an interval of the monitor connection parameters)
+#define SETTLE_US                   (1000 * 1000)
+
+// Amplitude of the sample the device relays
+#define SAMPLE_AMPLITUDE            1234
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Hello of the device, as taken by the client
+static msg_hello_data_t g_device_hello;
+
+// Messages decoded by a client of protocol version 1 (the last of each), and
+// notifications it couldn't decode
+static uint32_t g_v1_samples, g_v1_statuses, g_v1_unknown;
+static msg_sample_data_t g_v1_sample;
+static uint8_t g_v1_status;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Keeps the hello of the device
+static void on_frame (const msg_view_t *view, void *ctx) {
+	msg_t msg;
+
+	if (view->type == MSG_TYPE_HELLO && msg_decode(&msg, view) == ESP_OK) {
+		g_device_hello = msg.body.msg_hello;
+	}
+}
+
+
+/* Decodes notifications as a client of protocol version 1 did: a message at
+ * the start of each, of two markers, the type, and the body right after it
+*/
+static void on_notify_v1 (const uint8_t *value, size_t len) {
+	if (len < 3 || value[0] != 0xFF || value[1] != 0xFF) {
+		g_v1_unknown++;
+	} else if (value[2] == MSG_TYPE_STATUS && len >= 3 + 1) {
+		g_v1_status = value[3];
+		g_v1_statuses++;
+	} else if (value[2] == MSG_TYPE_SAMPLE_DATA && len >= 3 + 5) {
+		g_v1_sample.label = value[3];
+		g_v1_sample.amplitude = value[4] | (value[5] << 8);
+		g_v1_sample.period = value[6] | (value[7] << 8);
+		g_v1_samples++;
+	} else {
+		g_v1_unknown++;
+	}
+}
+
+
+// Relays a status, a sample and a beat stream from the device
+static void relay_beats (void) {
+	msg_t msg = MSG_STATUS(0x5A);
+
+	CHECK(ipc_send_msg(MSG_CHANNEL_CONTROL, &msg) == ESP_OK);
+	msg = (msg_t) {
+		.type = MSG_TYPE_SAMPLE_DATA,
+		.body.msg_sample = {
+			.label = 0, .amplitude = SAMPLE_AMPLITUDE, .period = 250
+		}
+	};
+	CHECK(ipc_send_msg(MSG_CHANNEL_BEATS, &msg) == ESP_OK);
+	msgs_example(&msg, MSG_TYPE_BEAT_STREAM, 7);
+	CHECK(ipc_send_msg(MSG_CHANNEL_BEATS, &msg) == ESP_OK);
+	xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+	link_run(SETTLE_US);
+}
+
+
+// Sends a hello from the client
+static void say_hello (uint8_t encodings, uint8_t batch_max) {
+	msg_t msg = {
+		.type = MSG_TYPE_HELLO,
+		.body.msg_hello = {
+			.version   = MSG_PROTOCOL_VERSION,
+			.types     = (1 << MSG_TYPE_MAX) - 1,
+			.encodings = encodings,
+			.batch_max = batch_max,
+			.mtu       = g_link.config.mtu
+		}
+	};
+
+	link_send(&msg);
+	link_run(SETTLE_US);
+}
+
+
+// Asks for batches of a count and encoding, and returns what was buffered
+static msg_batching_data_t ask_batching (uint8_t count, uint8_t encoding) {
+	msg_t msg = {
+		.type = MSG_TYPE_BATCHING,
+		.body.msg_batching = {
+			.count = count, .age = 1000, .encoding = encoding, .keyframe = 8
+		}
+	};
+
+	link_send(&msg);
+	link_run(SETTLE_US);
+	return g_batching;
+}
+
+
+// Boots the device and connects a client
+static void start (void) {
+	link_config_t config = {.mtu = 185};
+
+	memset(&g_device_hello, 0, sizeof(g_device_hello));
+	g_v1_samples = g_v1_statuses = g_v1_unknown = 0;
+	g_batching = (msg_batching_data_t) {0};
+
+	link_boot(&config);
+	g_link.on_frame = on_frame;
+	link_connect();
+	link_run(SETTLE_US);
+}
+
+
+/* A client of protocol version 1 (which never says hello) talks to the 
+ * device as it always did: its instructions, configuration and training
+ * data are taken, and it is sent the original message types in its own 
+ * framing, a message per notification. Batching stays off for it
+*/
+static void test_v1_client (void) {
+	const uint8_t start_v1[] = {0xFF, 0xFF, MSG_TYPE_INSTRUCTION,
+		INST_EKG_START};
+	const uint8_t config_v1[] = {0xFF, 0xFF, MSG_TYPE_CONFIGURATION, 0x01,
+		0x34, 0x12};
+	uint8_t train_v1[3 + 160] = {0xFF, 0xFF, MSG_TYPE_TRAIN_DATA};
+	msg_batching_data_t batching;
+
+	for (size_t i = 0; i < 80; ++i) {
+		train_v1[3 + 2 * i] = (1000 + i) & 0xFF;
+		train_v1[4 + 2 * i] = (1000 + i) >> 8;
+	}
+
+	start();
+	g_link.on_notify = on_notify_v1;
+	link_write(start_v1, sizeof(start_v1));
+	link_write(config_v1, sizeof(config_v1));
+	link_write(train_v1, sizeof(train_v1));
+	link_run(SETTLE_US);
+	CHECK(g_rx_parser.frames == 3 && g_rx_parser.skipped == 0);
+	CHECK(g_host_event_bits & FLAG_EKG_START);
+	CHECK(g_cfg_comp == 0x01 && g_cfg_val == 0x1234);
+	CHECK(g_n_periods[0] == 1000 && g_n_amplitudes[19] == 1039);
+	CHECK(g_v_amplitudes[9] == 1079);
+
+	relay_beats();
+	CHECK(g_v1_statuses == 1 && g_v1_status == 0x5A);
+	CHECK(g_v1_samples == 1);
+	CHECK(g_v1_sample.label == 0 && g_v1_sample.period == 250);
+	CHECK(g_v1_sample.amplitude == SAMPLE_AMPLITUDE);
+	CHECK(g_v1_unknown == 0);
+	CHECK(g_withheld == 1);
+
+	batching = ask_batching(MSG_BATCH_MAX, MSG_ENCODING_DELTA);
+	CHECK(batching.count == 1);
+	CHECK(batching.encoding == MSG_ENCODING_PLAIN);
+
+	printf("Version 1 client: %u frames accepted, %u notifications read "
+		"(%u unreadable), %u withheld, sample amplitude %u (sent %u)\n",
+		g_rx_parser.frames, g_link.delivered, g_v1_unknown, g_withheld,
+		g_v1_sample.amplitude, SAMPLE_AMPLITUDE);
+}
+
+
+/* A client that says hello (framed as version 1) gets the hello of the 
+ * device framed so, then frames of the protocol version: every type it 
+ * understands, and batching restricted to what both support
+*/
+static void test_hello_client (void) {
+	msg_batching_data_t batching;
+	uint32_t frames;
+
+	start();
+	relay_beats();
+	CHECK(g_link.frames[MSG_TYPE_SAMPLE_DATA] == 1);
+	CHECK(g_link.parser.frames == 0);
+
+	say_hello((1 << MSG_ENCODING_PLAIN) | (1 << MSG_ENCODING_DELTA), 16);
+	CHECK(g_link.v2);
+	CHECK(g_link.frames[MSG_TYPE_HELLO] == 1);
+	CHECK(g_device_hello.version == MSG_PROTOCOL_VERSION);
+	CHECK(g_device_hello.batch_max == MSG_BATCH_MAX);
+	CHECK(g_device_hello.mtu == g_link.config.mtu);
+
+	relay_beats();
+	CHECK(g_link.frames[MSG_TYPE_SAMPLE_DATA] == 2);
+	CHECK(g_link.frames[MSG_TYPE_BEAT_STREAM] == 1);
+	CHECK(g_link.parser.frames == 3 && g_link.parser.skipped == 0);
+	CHECK(g_withheld == 1);
+
+	batching = ask_batching(MSG_BATCH_MAX, MSG_ENCODING_DELTA);
+	CHECK(batching.count == 16);
+	CHECK(batching.encoding == MSG_ENCODING_DELTA);
+	printf("Hello client:     %u frames taken, batching %u (encoding %u)\n",
+		g_link.parser.frames, batching.count, batching.encoding);
+
+	// A client without the delta coder falls back to plain batches
+	say_hello(1 << MSG_ENCODING_PLAIN, MSG_BATCH_MAX);
+	batching = ask_batching(MSG_BATCH_MAX, MSG_ENCODING_DELTA);
+	CHECK(batching.count == MSG_BATCH_MAX);
+	CHECK(batching.encoding == MSG_ENCODING_PLAIN);
+
+	// The next client starts out assumed of version 1
+	link_disconnect();
+	link_run(SETTLE_US);
+	link_connect();
+	link_run(SETTLE_US);
+	batching = ask_batching(MSG_BATCH_MAX, MSG_ENCODING_DELTA);
+	CHECK(batching.count == 1);
+	CHECK(batching.encoding == MSG_ENCODING_PLAIN);
+	frames = g_link.parser.frames;
+	relay_beats();
+	CHECK(g_link.parser.frames == frames);
+	CHECK(g_link.frames[MSG_TYPE_STATUS] == 3);
+}
+
+
+int main (void) {
+	test_v1_client();
+	test_hello_client();
+	return TEST_RESULT();
+}
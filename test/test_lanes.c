@@ -0,0 +1,299 @@
+#include "test.h"
+#include "msgs.h"
+#include "link.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Control requests made per run, and the simulated time (us) between them
+#define REQUESTS                    40
+#define REQUEST_PERIOD_US           (250 * 1000)
+
+// Longest wait (us) for a frame before it counts as lost
+#define REPLY_TIMEOUT_US            (2000 * 1000)
+
+// Longest latency (us) of a control reply or an alert while the bulk lane
+// is saturated: the notifications already handed to the stack, and a few
+// intervals besides
+#define REPLY_BOUND_US              (150 * 1000)
+
+// Simulated time (us) between two alerts
+#define ALERT_PERIOD_US             (100 * 1000)
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing the control and alert latencies of a run
+typedef struct {
+	uint32_t replies;                       // Control replies taken
+	int64_t  reply_max_us, reply_total_us;
+	uint32_t alerts;                        // Alerts taken
+	int64_t  alert_max_us, alert_total_us;
+	uint32_t frames[MSG_CHANNEL_MAX];       // Frames taken per channel
+} run_result_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Nonzero while the bulk channels are kept full
+static uint8_t g_saturate;
+
+// Time (us) the next alert is due, and the times alerts were sent (by their
+// sequence number)
+static int64_t g_alert_due;
+static int64_t g_alert_sent[UINT16_MAX + 1];
+
+// What the client took during the run
+static run_result_t g_result;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Queues an example frame on a channel, and returns whether it was queued
+static int send_example (uint8_t channel, msg_type_t type) {
+	msg_t msg;
+
+	msgs_example(&msg, type, ipc_sequence(channel));
+	return ipc_send_msg(channel, &msg) == ESP_OK;
+}
+
+
+// Counts the frames the client took, and the latency of the alerts
+static void on_frame (const msg_view_t *view, void *ctx) {
+	int64_t latency;
+
+	g_result.frames[view->channel]++;
+	if (view->channel != MSG_CHANNEL_ALERTS) {
+		return;
+	}
+	latency = g_host_time_us - g_alert_sent[view->seq];
+	g_result.alerts++;
+	g_result.alert_total_us += latency;
+	g_result.alert_max_us = (latency > g_result.alert_max_us) ? latency :
+		g_result.alert_max_us;
+}
+
+
+/* Keeps the bulk channels (beats, waveform, telemetry) and the backlog full,
+ * and raises an alert now and then
+*/
+static void on_step (void) {
+	if (g_saturate) {
+		while (send_example(MSG_CHANNEL_BEATS, MSG_TYPE_SAMPLE_DATA));
+		while (!ipc_full(MSG_CHANNEL_WAVEFORM) &&
+			send_example(MSG_CHANNEL_WAVEFORM, MSG_TYPE_WAVEFORM));
+		while (!ipc_full(MSG_CHANNEL_TELEMETRY) &&
+			send_example(MSG_CHANNEL_TELEMETRY, MSG_TYPE_TELEMETRY));
+		while (!ipc_full(MSG_CHANNEL_BACKLOG) &&
+			send_example(MSG_CHANNEL_BACKLOG, MSG_TYPE_BEAT_STREAM));
+	}
+	if (g_host_time_us >= g_alert_due) {
+		g_alert_sent[ipc_sequence(MSG_CHANNEL_ALERTS)] = g_host_time_us;
+		send_example(MSG_CHANNEL_ALERTS, MSG_TYPE_ESCALATION);
+		g_alert_due = g_host_time_us + ALERT_PERIOD_US;
+	}
+	xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+}
+
+
+/* Frames are taken lane by lane: no frame leaves while a more urgent lane
+ * holds one. Within the bulk lane the channels take turns, each sending its
+ * window of frames while all have some
+*/
+static void test_schedule (void) {
+	const msg_type_t types[MSG_CHANNEL_MAX] = {
+		[MSG_CHANNEL_CONTROL]   = MSG_TYPE_HELLO,
+		[MSG_CHANNEL_ALERTS]    = MSG_TYPE_ESCALATION,
+		[MSG_CHANNEL_BEATS]     = MSG_TYPE_SAMPLE_DATA,
+		[MSG_CHANNEL_TELEMETRY] = MSG_TYPE_TELEMETRY,
+		[MSG_CHANNEL_WAVEFORM]  = MSG_TYPE_WAVEFORM,
+		[MSG_CHANNEL_BACKLOG]   = MSG_TYPE_BEAT_STREAM
+	};
+	uint8_t channel, last = MSG_CHANNEL_MAX, run = 0, alone;
+	uint32_t taken[MSG_CHANNEL_MAX] = {0}, turns = 0;
+	ipc_buffer_t buffer;
+	size_t n = 0;
+
+	CHECK(ipc_init() == ESP_OK);
+	for (int c = 0; c < MSG_CHANNEL_MAX; ++c) {
+		for (int i = 0; i < g_ipc_channels[c].depth; ++i) {
+			CHECK(send_example(c, types[c]));
+		}
+	}
+
+	while ((buffer = ipc_next(&channel)) != IPC_BUFFER_NONE) {
+		ipc_buffer_release(buffer);
+
+		// Nothing more urgent was waiting
+		alone = 1;
+		for (int c = 0; c < MSG_CHANNEL_MAX; ++c) {
+			CHECK(g_ipc_channels[c].priority >=
+				g_ipc_channels[channel].priority || ipc_pending(c) == 0);
+			alone &= (c == channel || ipc_pending(c) == 0 ||
+				g_ipc_channels[c].priority != g_ipc_channels[channel].priority);
+		}
+
+		// A turn passes on once the channel used its window, or ran dry
+		if (last != MSG_CHANNEL_MAX && channel != last && ipc_pending(last) > 0
+			&& g_ipc_channels[last].priority == g_ipc_channels[channel].priority) {
+			CHECK(run == g_ipc_channels[last].window);
+			turns++;
+		}
+		run = (channel == last) ? run + 1 : 1;
+		last = channel;
+
+		// A channel only takes more than its window if it is alone in its lane
+		CHECK(run <= g_ipc_channels[channel].window || alone);
+		taken[channel]++;
+		n++;
+
+		// A control frame queued in the middle of a turn of the bulk lane goes
+		// next, and the turn then goes on
+		if (n == g_ipc_channels[MSG_CHANNEL_CONTROL].depth +
+			g_ipc_channels[MSG_CHANNEL_ALERTS].depth + 3) {
+			CHECK(send_example(MSG_CHANNEL_CONTROL, MSG_TYPE_HELLO));
+			CHECK((buffer = ipc_next(&channel)) != IPC_BUFFER_NONE);
+			CHECK(channel == MSG_CHANNEL_CONTROL);
+			ipc_buffer_release(buffer);
+		}
+	}
+
+	for (int c = 0; c < MSG_CHANNEL_MAX; ++c) {
+		CHECK(taken[c] == g_ipc_channels[c].depth);
+	}
+	CHECK(turns > 0);
+	printf("Schedule: %u frames taken lane by lane, %u full turns passed on\n\n",
+		n, turns);
+}
+
+
+/* Sends hello requests from the client, and measures how long the device
+ * takes to reply on the control lane, and to deliver alerts on theirs
+*/
+static run_result_t run (uint8_t saturate) {
+	link_config_t config = {.mtu = 247, .ll_len = BLE_DATA_LEN_MAX};
+	msg_t hello = {
+		.type = MSG_TYPE_HELLO,
+		.body.msg_hello = {
+			.version   = MSG_PROTOCOL_VERSION,
+			.types     = (1 << MSG_TYPE_MAX) - 1,
+			.encodings = (1 << MSG_ENCODING_MAX) - 1,
+			.batch_max = MSG_BATCH_MAX,
+			.mtu       = 247
+		}
+	};
+	int64_t start, latency;
+	uint32_t replies;
+
+	g_saturate = 0;
+	g_alert_due = INT64_MAX;
+	link_boot(&config);
+	g_link.on_frame = on_frame;
+	g_link.on_step = on_step;
+	link_connect();
+
+	// The client says hello first, and the link settles on its parameters
+	link_send(&hello);
+	link_run(REQUEST_PERIOD_US);
+	g_saturate = saturate;
+	link_run(REPLY_TIMEOUT_US);
+	g_result = (run_result_t) {0};
+	g_alert_due = g_host_time_us;
+
+	for (int i = 0; i < REQUESTS; ++i) {
+		replies = g_link.frames[MSG_TYPE_HELLO];
+		start = g_host_time_us;
+		link_send(&hello);
+		while (g_link.frames[MSG_TYPE_HELLO] == replies &&
+			g_host_time_us - start < REPLY_TIMEOUT_US) {
+			link_run(LINK_STEP_US);
+		}
+		if (g_link.frames[MSG_TYPE_HELLO] == replies) {
+			continue;
+		}
+		latency = g_host_time_us - start;
+		g_result.replies++;
+		g_result.reply_total_us += latency;
+		g_result.reply_max_us = (latency > g_result.reply_max_us) ? latency :
+			g_result.reply_max_us;
+
+		// The next request comes at an arbitrary point of the interval
+		link_run(REQUEST_PERIOD_US - latency + (i * 7919) % 20000);
+	}
+	g_alert_due = INT64_MAX;
+	link_run(REPLY_TIMEOUT_US);
+
+	printf("%-10s %7u %9.1f %9.1f %7u %9.1f %9.1f %7u %7u %7u %7u\n",
+		saturate ? "Saturated" : "Idle", g_result.replies,
+		g_result.reply_total_us / 1e3 / (g_result.replies + !g_result.replies),
+		g_result.reply_max_us / 1e3, g_result.alerts,
+		g_result.alert_total_us / 1e3 / (g_result.alerts + !g_result.alerts),
+		g_result.alert_max_us / 1e3, g_result.frames[MSG_CHANNEL_BEATS],
+		g_result.frames[MSG_CHANNEL_WAVEFORM],
+		g_result.frames[MSG_CHANNEL_TELEMETRY],
+		g_result.frames[MSG_CHANNEL_BACKLOG]);
+	return g_result;
+}
+
+
+/* Control replies and alerts keep a bounded latency while the bulk lane has
+ * more to send than the link carries. The bulk channels share the rest of
+ * the link by their windows, and the backlog waits for all of them
+*/
+static void test_latency (void) {
+	run_result_t idle, busy;
+	uint32_t *f = busy.frames;
+
+	printf("%-10s %7s %9s %9s %7s %9s %9s %7s %7s %7s %7s\n", "bulk",
+		"replies", "mean(ms)", "max(ms)", "alerts", "mean(ms)", "max(ms)",
+		"beats", "wave", "telem", "backlog");
+	idle = run(0);
+	CHECK(idle.replies == REQUESTS);
+	CHECK(idle.alerts > 0);
+
+	busy = run(1);
+	CHECK(busy.replies == REQUESTS);
+	CHECK(busy.reply_max_us < REPLY_BOUND_US);
+	CHECK(busy.alerts == idle.alerts);
+	CHECK(busy.alert_max_us < REPLY_BOUND_US);
+
+	// Frames of the bulk lane follow the windows (beats 4, waveform 2,
+	// telemetry 1), and the backlog lane only gets what is left
+	CHECK(f[MSG_CHANNEL_BEATS] > 0 && f[MSG_CHANNEL_WAVEFORM] > 0 &&
+		f[MSG_CHANNEL_TELEMETRY] > 0);
+	CHECK(f[MSG_CHANNEL_BEATS] * 10 >= f[MSG_CHANNEL_WAVEFORM] *
+		g_ipc_channels[MSG_CHANNEL_BEATS].window * 9 /
+		g_ipc_channels[MSG_CHANNEL_WAVEFORM].window);
+	CHECK(f[MSG_CHANNEL_WAVEFORM] * 10 >= f[MSG_CHANNEL_TELEMETRY] *
+		g_ipc_channels[MSG_CHANNEL_WAVEFORM].window * 9 /
+		g_ipc_channels[MSG_CHANNEL_TELEMETRY].window);
+	CHECK(f[MSG_CHANNEL_BACKLOG] < f[MSG_CHANNEL_TELEMETRY]);
+	CHECK(g_link.parser.crc_errors == 0);
+}
+
+
+int main (void) {
+	test_schedule();
+	test_latency();
+	return TEST_RESULT();
+}
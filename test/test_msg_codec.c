@@ -0,0 +1,164 @@
+#include "test.h"
+#include "msgs.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Messages packed and unpacked per type and measurement
+#define CODEC_ROUNDS                20000
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Name of each message type (as reported)
+static const char *g_type_names[MSG_TYPE_MAX] = {
+	[MSG_TYPE_STATUS]        = "status",
+	[MSG_TYPE_TRAIN_DATA]    = "train_data",
+	[MSG_TYPE_SAMPLE_DATA]   = "sample_data",
+	[MSG_TYPE_INSTRUCTION]   = "instruction",
+	[MSG_TYPE_CONFIGURATION] = "configuration",
+	[MSG_TYPE_MODEL_DATA]    = "model_data",
+	[MSG_TYPE_FEEDBACK]      = "feedback",
+	[MSG_TYPE_ESCALATION]    = "escalation",
+	[MSG_TYPE_SUMMARY]       = "summary",
+	[MSG_TYPE_POLICY]        = "policy",
+	[MSG_TYPE_SAMPLE_BATCH]  = "sample_batch",
+	[MSG_TYPE_BATCHING]      = "batching",
+	[MSG_TYPE_BEAT_STREAM]   = "beat_stream",
+	[MSG_TYPE_WAVEFORM]      = "waveform",
+	[MSG_TYPE_HELLO]         = "hello",
+	[MSG_TYPE_TELEMETRY]     = "telemetry",
+	[MSG_TYPE_LOG_STATUS]    = "log_status",
+	[MSG_TYPE_LOG_ACK]       = "log_ack",
+	[MSG_TYPE_LINK_STATUS]   = "link_status"
+};
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+/* Packs, parses and decodes a message, and checks that the decoded message 
+ * packs to the same frame. Returns the size of the frame
+*/
+static size_t round_trip (const msg_t *msg, uint8_t *frame) {
+	uint8_t again[MSG_BUFFER_MAX];
+	msg_stream_t stream = {.channel = MSG_CHANNEL_BEATS};
+	msg_view_t view;
+	msg_t decoded;
+	size_t z;
+
+	CHECK((z = msg_pack_into(msg, &stream, frame, MSG_BUFFER_MAX)) > 0);
+	CHECK(z == msg_size(msg));
+	CHECK(msg_parse(&view, frame, z) == ESP_OK);
+
+	// The view borrows the frame, it doesn't copy the body
+	CHECK(view.type == msg->type && view.channel == MSG_CHANNEL_BEATS);
+	CHECK(view.body == frame + MSG_HEADER_SIZE);
+	CHECK(view.size == z - MSG_HEADER_SIZE - MSG_TRAILER_SIZE);
+
+	CHECK(msg_decode(&decoded, &view) == ESP_OK);
+	stream.seq = 0;
+	CHECK(msg_pack_into(&decoded, &stream, again, sizeof(again)) == z);
+	CHECK(memcmp(frame, again, z) == 0);
+
+	return z;
+}
+
+
+// Returns the rate (messages/s) of a codec step over a message
+static double rate (int step, const msg_t *msg, const uint8_t *frame, 
+	size_t z) {
+	uint8_t buffer[MSG_BUFFER_MAX];
+	msg_stream_t stream = {.channel = MSG_CHANNEL_BEATS};
+	volatile size_t sink = 0;
+	msg_view_t view;
+	msg_t decoded;
+	uint64_t start = host_ns();
+
+	for (int i = 0; i < CODEC_ROUNDS; ++i) {
+		switch (step) {
+			case 0:
+				sink += msg_pack_into(msg, &stream, buffer, sizeof(buffer));
+				break;
+			case 1:
+				sink += msg_parse(&view, frame, z);
+				break;
+			default:
+				sink += msg_parse(&view, frame, z);
+				sink += msg_decode(&decoded, &view);
+				break;
+		}
+	}
+
+	return CODEC_ROUNDS * 1e9 / (double)(host_ns() - start + 1);
+}
+
+
+// Views of two frames stay valid together (nothing is shared between calls)
+static void test_reentrant (void) {
+	uint8_t a[MSG_BUFFER_MAX], b[MSG_BUFFER_MAX];
+	msg_stream_t stream = {.channel = MSG_CHANNEL_CONTROL};
+	msg_view_t va, vb;
+	msg_t ma, mb;
+	size_t za, zb;
+
+	msgs_example(&ma, MSG_TYPE_TRAIN_DATA, 1);
+	msgs_example(&mb, MSG_TYPE_SAMPLE_DATA, 2);
+	za = msg_pack_into(&ma, &stream, a, sizeof(a));
+	zb = msg_pack_into(&mb, &stream, b, sizeof(b));
+
+	CHECK(msg_parse(&va, a, za) == ESP_OK);
+	CHECK(msg_parse(&vb, b, zb) == ESP_OK);
+	CHECK(va.type == MSG_TYPE_TRAIN_DATA && vb.type == MSG_TYPE_SAMPLE_DATA);
+	CHECK(va.seq == 0 && vb.seq == 1);
+	CHECK(msg_decode(&ma, &va) == ESP_OK && msg_decode(&mb, &vb) == ESP_OK);
+	CHECK(msg_read_u16(va.body + 2) == ma.body.msg_train.n_periods[1]);
+}
+
+
+// Every instruction a client may send has a name, or is reported invalid
+static void test_inst_names (void) {
+	for (int i = 0; i < INST_TYPE_MAX; ++i) {
+		CHECK(inst_to_str(i) != NULL && strcmp(inst_to_str(i), "<Invalid>"));
+	}
+	CHECK(strcmp(inst_to_str(INST_TYPE_MAX), "<Invalid>") == 0);
+	CHECK(strcmp(inst_to_str(0xFF), "<Invalid>") == 0);
+}
+
+
+int main (void) {
+	uint8_t frame[MSG_BUFFER_MAX];
+	msg_t msg;
+
+	printf("%-14s %6s %12s %12s %12s\n", "type", "bytes", "pack/s", 
+		"parse/s", "unpack/s");
+	for (msg_type_t t = 0; t < MSG_TYPE_MAX; ++t) {
+		size_t z;
+
+		msgs_example(&msg, t, 0x1234 + t);
+		z = round_trip(&msg, frame);
+		printf("%-14s %6zu %12.0f %12.0f %12.0f\n", g_type_names[t], z,
+			rate(0, &msg, frame, z), rate(1, &msg, frame, z), 
+			rate(2, &msg, frame, z));
+	}
+	printf("\n");
+
+	test_reentrant();
+	test_inst_names();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,403 @@
+#include "test.h"
+#include "msgs.h"
+#include "ipc.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Frames in the test stream (a sequence number each)
+#define STREAM_FRAMES               3000
+
+// Largest chunk the stream is fed in (a write may hold many frames)
+#define CHUNK_MAX                   300
+
+// Distance (in bytes) between corrupted bytes
+#define CORRUPT_STRIDE              997
+
+// Random bytes fed to the parser, and the share of them that are markers
+#define FUZZ_BYTES                  (8 * 1024 * 1024)
+#define FUZZ_MARKER_SHARE           4
+
+// Times the stream is parsed for the throughput
+#define PARSE_ROUNDS                20
+
+// Size of the chunks the throughput is measured with (a notification)
+#define PARSE_CHUNK                 244
+
+// Frames sent per channel in the loss simulation, and how often one is
+// dropped (one in DROP_ODDS) or swapped with the next (every SWAP_STRIDE)
+#define LINK_FRAMES                 20000
+#define DROP_ODDS                   40
+#define SWAP_STRIDE                 97
+
+// Device time (us) between frames, and the delay (us) until one arrives
+#define LINK_PERIOD_US              10000
+#define LINK_DELAY_US               35000
+
+// Notifications between two losses in the resend simulation, and those sent
+// again after each (the most the device keeps unconfirmed)
+#define RESEND_STRIDE               50
+#define RESEND_NOTES                4
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing the test stream and what a parser made of it
+typedef struct {
+	uint8_t *bytes;                         // The frames, back to back
+	size_t   len;                           // Size of the stream
+	size_t   offset[STREAM_FRAMES];         // Offset of each frame
+	size_t   accepted;                      // Frames handed to the handler
+	size_t   mismatched;                    // Frames not as they were sent
+	long     last;                          // Sequence number of the last
+} stream_t;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns the next value of a linear congruential generator
+static uint32_t next_random (uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+
+// Checks an accepted frame against the frame of its sequence number
+static void on_frame (const msg_view_t *view, void *ctx) {
+	stream_t *s = ctx;
+	const uint8_t *sent = s->bytes + s->offset[view->seq % STREAM_FRAMES];
+	msg_t msg;
+
+	s->accepted++;
+	s->mismatched += (view->seq >= STREAM_FRAMES || 
+		(long)view->seq <= s->last || sent[2] != view->type ||
+		memcmp(sent + MSG_HEADER_SIZE, view->body, view->size) != 0 ||
+		msg_decode(&msg, view) != ESP_OK);
+	s->last = view->seq;
+}
+
+
+// Ignores an accepted frame (the parser counts it)
+static void on_count (const msg_view_t *view, void *ctx) {
+	(void)view;
+	(void)ctx;
+}
+
+
+// Feeds a buffer to a parser in random chunks. Returns the frames accepted
+static size_t feed (msg_parser_t *parser, const uint8_t *bytes, size_t len,
+	stream_t *s, uint32_t seed) {
+	size_t off = 0, z, frames = 0;
+
+	s->accepted = s->mismatched = 0;
+	s->last = -1;
+	while (off < len) {
+		z = 1 + next_random(&seed) % CHUNK_MAX;
+		z = (z > len - off) ? len - off : z;
+		frames += msg_parser_feed(parser, bytes + off, z, on_frame, s);
+		off += z;
+	}
+	CHECK(frames == s->accepted);
+	return frames;
+}
+
+
+// Packs a stream of every type, with bodies of random bytes (markers included)
+static void make_stream (stream_t *s) {
+	msg_stream_t stream = {.channel = MSG_CHANNEL_BEATS};
+	msg_t msg;
+
+	s->bytes = malloc(STREAM_FRAMES * MSG_BUFFER_MAX);
+	s->len = 0;
+	for (size_t i = 0; i < STREAM_FRAMES; ++i) {
+		msgs_example(&msg, i % MSG_TYPE_MAX, 1 + i);
+		s->offset[i] = s->len;
+		s->len += msg_pack_into(&msg, &stream, s->bytes + s->len, 
+			MSG_BUFFER_MAX);
+	}
+}
+
+
+/* Every frame of a clean stream is accepted in order, whether the stream
+ * comes in one byte at a time, in random chunks or all at once
+*/
+static void test_chunks (stream_t *s) {
+	msg_parser_t parser = {0};
+
+	CHECK(feed(&parser, s->bytes, s->len, s, 3) == STREAM_FRAMES);
+	CHECK(s->mismatched == 0 && parser.skipped == 0 && parser.crc_errors == 0);
+
+	// Each pass starts the stream over (as a new connection would), so its
+	// frames aren't taken for duplicates
+	s->accepted = s->mismatched = 0;
+	s->last = -1;
+	parser.synced = 0;
+	for (size_t i = 0; i < s->len; ++i) {
+		msg_parser_feed(&parser, s->bytes + i, 1, on_frame, s);
+	}
+	CHECK(s->accepted == STREAM_FRAMES && s->mismatched == 0);
+
+	s->accepted = s->mismatched = 0;
+	s->last = -1;
+	parser.synced = 0;
+	CHECK(msg_parser_feed(&parser, s->bytes, s->len, on_frame, s) == 
+		STREAM_FRAMES);
+	CHECK(s->mismatched == 0 && parser.skipped == 0);
+	CHECK(parser.frames == 3 * STREAM_FRAMES && parser.len == 0);
+
+	// A frame cut short waits for the rest, and a reset drops it
+	msg_parser_feed(&parser, s->bytes, s->offset[1] - 1, on_frame, s);
+	CHECK(parser.len == s->offset[1] - 1);
+	msg_parser_reset(&parser);
+	CHECK(parser.len == 0);
+}
+
+
+/* Corrupt bytes cost the frames they fall in (and at most one behind, whose
+ * length they may have changed), but no corrupt frame is accepted and the
+ * parser resynchronizes on the next intact frame
+*/
+static void test_corruption (stream_t *s) {
+	uint8_t *bytes = malloc(s->len);
+	msg_parser_t parser = {0};
+	uint32_t state = 11;
+	size_t flips = 0, frames;
+
+	memcpy(bytes, s->bytes, s->len);
+	for (size_t i = CORRUPT_STRIDE; i < s->len; i += CORRUPT_STRIDE) {
+		bytes[i] ^= 1 << (next_random(&state) % 8);
+		flips++;
+	}
+
+	frames = feed(&parser, bytes, s->len, s, 5);
+	printf("Corrupt stream: %zu of %d frames (%zu bytes flipped), %" PRIu32
+		" skipped, %" PRIu32 " CRC errors\n", frames, STREAM_FRAMES, flips,
+		parser.skipped, parser.crc_errors);
+	CHECK(s->mismatched == 0);
+	CHECK(frames + 2 * flips >= STREAM_FRAMES);
+	CHECK(parser.crc_errors > 0 && parser.skipped > 0);
+
+	// Whatever the corruption left buffered, the clean stream is taken whole
+	parser.synced = 0;
+	CHECK(feed(&parser, s->bytes, s->len, s, 7) == STREAM_FRAMES);
+	free(bytes);
+}
+
+
+/* Random bytes, markers among them, are never taken for frames, and don't
+ * grow the parser beyond its buffer
+*/
+static void test_fuzz (stream_t *s) {
+	uint8_t *bytes = malloc(FUZZ_BYTES);
+	msg_parser_t parser = {0};
+	uint32_t state = 13;
+
+	for (size_t i = 0; i < FUZZ_BYTES; ++i) {
+		uint32_t r = next_random(&state);
+		bytes[i] = (r % FUZZ_MARKER_SHARE == 0) ? MSG_BYTE_HEAD : r >> 8;
+	}
+	CHECK(feed(&parser, bytes, FUZZ_BYTES, s, 17) == 0);
+	CHECK(parser.len <= sizeof(parser.buffer));
+	printf("Random bytes: %d fed, %" PRIu32 " skipped, %" PRIu32 
+		" CRC errors\n", FUZZ_BYTES, parser.skipped, parser.crc_errors);
+
+	// The stream that follows is picked up intact
+	CHECK(feed(&parser, s->bytes, s->len, s, 19) >= STREAM_FRAMES - 1);
+	CHECK(s->mismatched == 0);
+	free(bytes);
+}
+
+
+// Reports the parse rate in notification sized chunks
+static void test_throughput (stream_t *s) {
+	msg_parser_t parser = {0};
+	uint64_t start = host_ns(), ns;
+
+	for (int r = 0; r < PARSE_ROUNDS; ++r) {
+		s->last = -1;
+		parser.synced = 0;
+		for (size_t off = 0, z; off < s->len; off += z) {
+			z = (s->len - off > PARSE_CHUNK) ? PARSE_CHUNK : s->len - off;
+			msg_parser_feed(&parser, s->bytes + off, z, on_frame, s);
+		}
+	}
+	ns = host_ns() - start + 1;
+	printf("Parse rate: %.1f MB/s, %.1f ns/frame (%d byte chunks)\n", 
+		(double)PARSE_ROUNDS * s->len * 1e3 / ns, 
+		(double)ns / (PARSE_ROUNDS * STREAM_FRAMES), PARSE_CHUNK);
+	CHECK(parser.frames == PARSE_ROUNDS * STREAM_FRAMES);
+}
+
+
+/* Frames of two channels are dropped and swapped on their way, with one
+ * channel wrapping its sequence number. Every drop is counted as lost, and
+ * every swap as a frame lost and then a frame reordered. Device timestamps
+ * give the age of each frame on arrival. A reset (a new connection) isn't
+ * taken for loss
+*/
+static void test_sequence (void) {
+	msg_stream_t streams[2] = {
+		{.channel = MSG_CHANNEL_BEATS, .seq = 0},
+		{.channel = MSG_CHANNEL_ALERTS, .seq = UINT16_MAX - LINK_FRAMES / 2}
+	};
+	static uint8_t frames[2 * LINK_FRAMES][MSG_BUFFER_MAX];
+	static size_t sizes[2 * LINK_FRAMES];
+	msg_parser_t parser = {0};
+	uint32_t state = 23, dropped = 0, swapped = 0, stale = 0;
+	msg_view_t view;
+	msg_t msg;
+
+	g_host_time_us = 0;
+	for (size_t i = 0; i < 2 * LINK_FRAMES; ++i) {
+		msgs_example(&msg, MSG_TYPE_SAMPLE_DATA, 1 + i);
+		sizes[i] = msg_pack_into(&msg, streams + (i & 1), frames[i], 
+			MSG_BUFFER_MAX);
+		g_host_time_us += LINK_PERIOD_US / 2;
+	}
+	CHECK(streams[1].seq < LINK_FRAMES);
+
+	// Deliver the frames late, dropping and swapping some
+	for (size_t i = 0; i < 2 * LINK_FRAMES; ++i) {
+		size_t j = i;
+
+		// Not at either end of a channel, where no later or earlier frame
+		// would show the gap
+		if (i % SWAP_STRIDE == 0 && i > 0 && i + 2 < 2 * LINK_FRAMES) {
+			j = i + 2;
+			swapped++;
+		} else if (i % SWAP_STRIDE == 2 && i > 2) {
+			j = i - 2;
+		} else if (next_random(&state) % DROP_ODDS == 0 && i >= 2 &&
+			i + 2 < 2 * LINK_FRAMES) {
+			dropped++;
+			continue;
+		}
+		g_host_time_us = i * (LINK_PERIOD_US / 2) + LINK_DELAY_US;
+		CHECK(msg_parse(&view, frames[j], sizes[j]) == ESP_OK);
+		stale += (g_host_time_us / 1000 - view.time > LINK_DELAY_US / 1000);
+		msg_parser_feed(&parser, frames[j], sizes[j], on_count, NULL);
+	}
+
+	printf("Lossy link: %" PRIu32 " dropped, %" PRIu32 " swapped; counted %"
+		PRIu32 " lost, %" PRIu32 " reordered, %" PRIu32 " stale\n", dropped, 
+		swapped, parser.lost, parser.reordered, stale);
+	CHECK(parser.frames == 2 * LINK_FRAMES - dropped);
+	CHECK(parser.lost == dropped + swapped);
+	CHECK(parser.reordered == swapped);
+	CHECK(stale == swapped);
+
+	// A new connection starts its streams over
+	msg_parser_reset(&parser);
+	streams[0].seq = 0;
+	msg_pack_into(&msg, streams, frames[0], MSG_BUFFER_MAX);
+	msg_parser_feed(&parser, frames[0], sizes[0], on_count, NULL);
+	CHECK(parser.lost == dropped + swapped && parser.reordered == swapped);
+}
+
+
+/* Status frames (from any task) and the replies of the BLE task share the
+ * control channel. Each takes the next sequence number of the channel as it
+ * is queued, so the receiver counts none lost or reordered
+*/
+static void test_control (void) {
+	msg_parser_t parser = {0};
+	ipc_buffer_t buffer;
+	msg_t msg;
+
+	CHECK(ipc_init() == ESP_OK);
+	for (uint32_t i = 0; i < 100; ++i) {
+		if (i % 3 == 0) {
+			msgs_example(&msg, MSG_TYPE_HELLO, i);
+		} else {
+			msg = (msg_t) MSG_STATUS(i);
+		}
+		CHECK(ipc_send_msg(MSG_CHANNEL_CONTROL, &msg) == ESP_OK);
+		while ((buffer = ipc_receive(MSG_CHANNEL_CONTROL)) != 
+			IPC_BUFFER_NONE) {
+			msg_parser_feed(&parser, ipc_buffer_data(buffer), 
+				ipc_buffer_size(buffer), on_count, NULL);
+			ipc_buffer_release(buffer);
+		}
+	}
+
+	printf("Control channel: %" PRIu32 " status and hello frames, %" PRIu32
+		" lost, %" PRIu32 " reordered\n", parser.frames, parser.lost, 
+		parser.reordered);
+	CHECK(parser.frames == 100);
+	CHECK(parser.lost == 0 && parser.reordered == 0);
+	CHECK(parser.seq[MSG_CHANNEL_CONTROL] == 100);
+}
+
+
+/* After a loss the device sends again the notifications it kept, some of
+ * which the client already has. Frames seen before are dropped as duplicates
+ * (also across the wrap of the sequence number), and none are taken for lost
+ * or reordered
+*/
+static void test_resend (void) {
+	msg_stream_t stream = {
+		.channel = MSG_CHANNEL_BEATS, 
+		.seq = UINT16_MAX - LINK_FRAMES / 2
+	};
+	static uint8_t bytes[LINK_FRAMES * MSG_BUFFER_MAX];
+	msg_parser_t parser = {0};
+	size_t len = 0, notes, resent = 0, first;
+	msg_t msg;
+
+	for (size_t i = 0; i < LINK_FRAMES; ++i) {
+		msgs_example(&msg, MSG_TYPE_SAMPLE_DATA, i);
+		len += msg_pack_into(&msg, &stream, bytes + len, MSG_BUFFER_MAX);
+	}
+
+	// Deliver the byte stream in notifications, going back after some
+	notes = (len + PARSE_CHUNK - 1) / PARSE_CHUNK;
+	for (size_t n = 0; n < notes; ++n) {
+		first = (n % RESEND_STRIDE == RESEND_STRIDE - 1 && n >= RESEND_NOTES) ?
+			n + 1 - RESEND_NOTES : n;
+		for (size_t k = first; k <= n; ++k) {
+			msg_parser_feed(&parser, bytes + k * PARSE_CHUNK, 
+				(len - k * PARSE_CHUNK < PARSE_CHUNK) ? len - k * PARSE_CHUNK :
+				PARSE_CHUNK, on_count, NULL);
+		}
+		resent += n - first;
+	}
+
+	printf("Resends: %zu notifications sent again; %" PRIu32 " frames, %"
+		PRIu32 " duplicates, %" PRIu32 " lost, %" PRIu32 " reordered\n", 
+		resent, parser.frames, parser.duplicates, parser.lost, 
+		parser.reordered);
+	CHECK(parser.frames == LINK_FRAMES);
+	CHECK(parser.duplicates > 0);
+	CHECK(parser.lost == 0 && parser.reordered == 0);
+}
+
+
+int main (void) {
+	static stream_t s;
+
+	make_stream(&s);
+	test_chunks(&s);
+	test_corruption(&s);
+	test_fuzz(&s);
+	test_throughput(&s);
+	test_sequence();
+	test_control();
+	test_resend();
+	free(s.bytes);
+	return TEST_RESULT();
+}
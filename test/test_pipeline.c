@@ -0,0 +1,409 @@
+#include <setjmp.h>
+#include "test.h"
+#include "replay.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Sample blocks processed by the EKG task, and simulated per placement
+#define TASK_BLOCKS                 24
+#define SIM_BLOCKS                  48
+
+// Step of the simulation (us)
+#define SIM_STEP_US                 10
+
+// Sampling period, and sample block period (us)
+#define SAMPLE_US                   (1000 * DEVICE_SENSOR_POLL_PERIOD_MS)
+#define BLOCK_US                    (SAMPLE_US * DEVICE_SENSOR_PUSH_BUF_SIZE)
+
+/* Device cost model (us). The process stage runs the firmware code on the
+ * host and takes DEVICE_SLOWDOWN times its host time (an estimate for an
+ * ESP32 at 160 MHz). The rest is estimated: an ADC2 read, the BLE task
+ * handing a frame to the stack, and the stack serving a connection event
+*/
+#define DEVICE_SLOWDOWN             10
+#define ACQUIRE_US                  40
+#define TRANSMIT_US                 200
+#define STACK_US                    800
+#define STACK_PERIOD_US             30000
+
+// Priority of the Bluedroid tasks (configMAX_PRIORITIES - 6 and up)
+#define STACK_PRIORITY              19
+
+/* Factor the process stage is also simulated at. It stands for heavier
+ * processing (filtering, larger models), and takes a block past a period
+*/
+#define HEAVY_LOAD                  100
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Stages of the pipeline, and the radio stack they share the PROTOCOL CPU with
+typedef enum {
+	STAGE_ACQUIRE = 0,
+	STAGE_PROCESS,
+	STAGE_TRANSMIT,
+	STAGE_STACK,
+
+	STAGE_MAX
+} stage_t;
+
+
+// Structure describing where a stage runs
+typedef struct {
+	uint8_t core;
+	uint8_t priority;
+} placement_t;
+
+
+// Structure describing a set of stage placements
+typedef struct {
+	const char  *name;
+	placement_t  stages[STAGE_MAX];
+} layout_t;
+
+
+// Structure describing a job of a stage
+typedef struct {
+	uint32_t work;              // Work left (us)
+	uint64_t born;              // Time its sample block was complete (us)
+	uint8_t  last;              // Nonzero if the last job of its block
+} job_t;
+
+
+// Structure describing the jobs of a stage (a ring)
+typedef struct {
+	job_t    jobs[256];
+	uint16_t head, n;
+} stage_queue_t;
+
+
+// Structure describing the outcome of a simulation
+typedef struct {
+	uint64_t busy[STAGE_MAX];   // Time each stage ran (us)
+	uint64_t idle[2];           // Time each core was idle (us)
+	uint64_t acquire_late;      // Latest a sample was read after its tick
+	uint64_t latency_max;       // Longest block complete to last frame sent
+	uint64_t latency_total;
+	uint32_t blocks;
+	uint64_t time;
+} sim_result_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Host time taken to process each replayed block (ns), and its frames
+static uint64_t g_block_ns[SIM_BLOCKS];
+static uint32_t g_block_frames[SIM_BLOCKS];
+
+// Signal fed to the EKG task, blocks handed over, and the exit of the task
+static beats_signal_t g_task_signal;
+static uint32_t g_task_blocks;
+static jmp_buf g_task_exit;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Adds a job to a stage
+static void stage_push (stage_queue_t *q, uint32_t work, uint64_t born,
+	uint8_t last) {
+	if (q->n < 256) {
+		q->jobs[(q->head + q->n++) % 256] = (job_t) {work, born, last};
+	}
+}
+
+
+/* Simulates the pipeline under a layout with fixed-priority preemptive
+ * scheduling on two cores, with the process stage taking load times its
+ * measured cost. Equal priorities run in stage order
+*/
+static void simulate (const layout_t *layout, uint32_t load, 
+	sim_result_t *result) {
+	static stage_queue_t queues[STAGE_MAX];
+	uint32_t samples = 0, block = 0;
+
+	memset(queues, 0, sizeof(queues));
+	*result = (sim_result_t) {0};
+
+	for (uint64_t t = 0; t < (uint64_t)SIM_BLOCKS * BLOCK_US;
+		t += SIM_STEP_US) {
+
+		// Release the periodic jobs
+		if (t % SAMPLE_US == 0) {
+			stage_push(queues + STAGE_ACQUIRE, ACQUIRE_US, t, 0);
+		}
+		if (t % STACK_PERIOD_US == 0) {
+			stage_push(queues + STAGE_STACK, STACK_US, t, 0);
+		}
+
+		for (uint8_t core = 0; core < 2; ++core) {
+			int run = -1;
+			job_t *job;
+
+			// Pick the highest priority stage with work on the core
+			for (int s = 0; s < STAGE_MAX; ++s) {
+				if (layout->stages[s].core == core && queues[s].n > 0 &&
+					(run < 0 || layout->stages[s].priority >
+					layout->stages[run].priority)) {
+					run = s;
+				}
+			}
+			if (run < 0) {
+				result->idle[core] += SIM_STEP_US;
+				continue;
+			}
+
+			// Run it for a step
+			job = queues[run].jobs + queues[run].head;
+			result->busy[run] += SIM_STEP_US;
+			if ((job->work -= (job->work < SIM_STEP_US) ? job->work :
+				SIM_STEP_US) > 0) {
+				continue;
+			}
+			queues[run].head = (queues[run].head + 1) % 256;
+			queues[run].n--;
+
+			// Hand its output to the next stage
+			if (run == STAGE_ACQUIRE) {
+				if (t + SIM_STEP_US - job->born > result->acquire_late) {
+					result->acquire_late = t + SIM_STEP_US - job->born;
+				}
+				if (++samples % DEVICE_SENSOR_PUSH_BUF_SIZE == 0) {
+					stage_push(queues + STAGE_PROCESS, load * DEVICE_SLOWDOWN *
+						g_block_ns[block % SIM_BLOCKS] / 1000 + 1,
+						t + SIM_STEP_US, 0);
+					block++;
+				}
+			} else if (run == STAGE_PROCESS) {
+				for (uint32_t f = g_block_frames[result->blocks % SIM_BLOCKS];
+					f > 0; --f) {
+					stage_push(queues + STAGE_TRANSMIT, TRANSMIT_US, job->born,
+						f == 1);
+				}
+				result->blocks++;
+			} else if (run == STAGE_TRANSMIT && job->last) {
+				uint64_t latency = t + SIM_STEP_US - job->born;
+
+				result->latency_total += latency;
+				if (latency > result->latency_max) {
+					result->latency_max = latency;
+				}
+			}
+		}
+	}
+	result->time = (uint64_t)SIM_BLOCKS * BLOCK_US;
+}
+
+
+// Prints the outcome of a simulation
+static void report (const layout_t *layout, const sim_result_t *r) {
+	printf("%-18s", layout->name);
+	for (int s = 0; s < STAGE_MAX; ++s) {
+		printf(" %2u/%-2u %5.2f%%", layout->stages[s].core,
+			layout->stages[s].priority, (100.0 * r->busy[s]) / r->time);
+	}
+	printf(" %6.2f%% %6.2f%% %8.1f %8.1f %9.1f\n",
+		(100.0 * r->idle[0]) / r->time, (100.0 * r->idle[1]) / r->time,
+		r->acquire_late / 1000.0, (r->blocks == 0) ? 0.0 :
+		r->latency_total / 1000.0 / r->blocks, r->latency_max / 1000.0);
+}
+
+
+/* Measures the process stage on the host: the host time of each replayed
+ * block, and the frames it queued (beats and waveform)
+*/
+static void measure_blocks (const beats_t *train, const beats_t *set) {
+	const replay_config_t config = {
+		.batching = {.count = 1, .encoding = MSG_ENCODING_PLAIN}
+	};
+	replay_result_t result = {0};
+	beats_signal_t signal;
+
+	CHECK(replay_setup(train));
+	beats_signal_init(&signal, set, 7);
+	g_local_policy   = config.policy;
+	g_local_batching = config.batching;
+
+	for (uint32_t b = 0; b < SIM_BLOCKS; ++b) {
+		uint8_t block = b % DEVICE_SAMPLE_BLOCKS;
+		uint32_t frames = 0;
+		uint64_t start;
+
+		beats_signal_fill(&signal, g_sample_blocks[block],
+			DEVICE_SENSOR_PUSH_BUF_SIZE);
+		start = host_ns();
+		process_block(block, 1, g_cfg_comp, g_cfg_val);
+		send_waveform(block);
+		g_block_ns[b] = host_ns() - start;
+
+		for (int c = 0; c < MSG_CHANNEL_MAX; ++c) {
+			frames -= result.frames[c];
+		}
+		replay_drain(&result);
+		for (int c = 0; c < MSG_CHANNEL_MAX; ++c) {
+			frames += result.frames[c];
+		}
+		g_block_frames[b] = frames;
+	}
+}
+
+
+/* Plays the acquire stage while the EKG task waits: every wait hands it the
+ * next sample block. Leaves the task once enough blocks were handed over
+*/
+static int acquire_hook (EventBits_t bits, TickType_t ticks) {
+	uint8_t block = g_task_blocks % DEVICE_SAMPLE_BLOCKS;
+
+	if (g_task_blocks == TASK_BLOCKS) {
+		longjmp(g_task_exit, 1);
+	}
+
+	// Relaying starts with the first block
+	if (g_task_blocks++ == 0) {
+		xEventGroupSetBits(g_event_group, FLAG_EKG_START);
+	}
+	g_sample_block_time[block] = g_host_time_us / 1000;
+	beats_signal_fill(&g_task_signal, g_sample_blocks[block],
+		DEVICE_SENSOR_PUSH_BUF_SIZE);
+	host_advance_us(BLOCK_US);
+	CHECK(xQueueSendToBack(g_block_queue, &block, 0) == pdPASS);
+	xEventGroupSetBits(g_event_group, FLAG_EKG_TICK);
+
+	return 1;
+}
+
+
+/* Runs the EKG task with the BLE flags set as they are between connections.
+ * The task must block until the next tick, rather than spin on a BLE flag
+*/
+static void test_task_waits (const beats_t *set) {
+	replay_result_t result = {0};
+
+	CHECK(ipc_init() == ESP_OK);
+	beats_signal_init(&g_task_signal, set, 3);
+	g_task_blocks = 0;
+	g_host_wait_spins = 0;
+	g_host_event_bits = FLAG_BLE_DISCONNECTED | FLAG_BLE_SEND_MSG;
+	g_host_wait_hook = acquire_hook;
+	g_policy = (msg_policy_data_t) {0};
+	g_batching = (msg_batching_data_t) {.count = 1, .keyframe = 8};
+
+	if (setjmp(g_task_exit) == 0) {
+		task_ekg_manager(NULL);
+	}
+	g_host_wait_hook = NULL;
+
+	replay_drain(&result);
+	printf("EKG task: %u blocks, %u spinning waits\n\n", TASK_BLOCKS,
+		g_host_wait_spins);
+	CHECK(g_host_wait_spins == 0);
+}
+
+
+int main (void) {
+	const layout_t layouts[] = {
+		{"Configured", {
+			[STAGE_ACQUIRE]  = {CORE_SAMPLE_MANAGER, PRIORITY_SAMPLE_MANAGER},
+			[STAGE_PROCESS]  = {CORE_EKG_MANAGER, PRIORITY_EKG_MANAGER},
+			[STAGE_TRANSMIT] = {CORE_BLE_MANAGER, PRIORITY_BLE_MANAGER},
+			[STAGE_STACK]    = {0, STACK_PRIORITY}
+		}},
+		{"Original", {
+			[STAGE_ACQUIRE]  = {1, 0},
+			[STAGE_PROCESS]  = {0, 0},
+			[STAGE_TRANSMIT] = {0, 0},
+			[STAGE_STACK]    = {0, STACK_PRIORITY}
+		}},
+		{"All on APP CPU", {
+			[STAGE_ACQUIRE]  = {1, PRIORITY_SAMPLE_MANAGER},
+			[STAGE_PROCESS]  = {1, PRIORITY_EKG_MANAGER},
+			[STAGE_TRANSMIT] = {1, PRIORITY_BLE_MANAGER},
+			[STAGE_STACK]    = {0, STACK_PRIORITY}
+		}},
+		{"Process over acq.", {
+			[STAGE_ACQUIRE]  = {1, 1},
+			[STAGE_PROCESS]  = {1, PRIORITY_SAMPLE_MANAGER},
+			[STAGE_TRANSMIT] = {0, PRIORITY_BLE_MANAGER},
+			[STAGE_STACK]    = {0, STACK_PRIORITY}
+		}}
+	};
+	const size_t n_layouts = sizeof(layouts) / sizeof(layouts[0]);
+	const beats_model_t train_model = {.seed = 4, .abnormal = 30};
+	const beats_model_t set_model = {.seed = 11, .abnormal = 10};
+	sim_result_t results[sizeof(layouts) / sizeof(layouts[0])];
+	sim_result_t heavy[sizeof(layouts) / sizeof(layouts[0])];
+	uint64_t process_ns = 0;
+	beats_t train, set;
+
+	beats_generate(&train, 400, &train_model);
+	beats_generate(&set, 1000, &set_model);
+
+	test_task_waits(&set);
+
+	measure_blocks(&train, &set);
+	for (int b = 0; b < SIM_BLOCKS; ++b) {
+		process_ns += g_block_ns[b];
+	}
+	printf("Process stage: %.1f us per block on the host (x%u on the device)"
+		"\n\n", process_ns / 1000.0 / SIM_BLOCKS, DEVICE_SLOWDOWN);
+
+	// Utilization per stage and core, sampling delay and block latency
+	for (uint32_t load = 1; load <= HEAVY_LOAD; load *= HEAVY_LOAD) {
+		printf("Process stage x%u\n%-18s", load, "core/priority:");
+		printf(" %-13s %-13s %-13s %-13s", "acquire", "process", "transmit",
+			"stack");
+		printf(" %7s %7s %8s %8s %9s\n", "idle0", "idle1", "late ms", 
+			"mean ms", "max ms");
+		for (size_t l = 0; l < n_layouts; ++l) {
+			sim_result_t *r = (load == 1) ? results + l : heavy + l;
+
+			simulate(layouts + l, load, r);
+			report(layouts + l, r);
+		}
+		printf("\n");
+	}
+
+	// As configured: processing stays off the radio core
+	CHECK(results[0].busy[STAGE_PROCESS] > 0);
+	CHECK(layouts[0].stages[STAGE_PROCESS].core !=
+		layouts[0].stages[STAGE_STACK].core);
+
+	// Every layout keeps up with the samples (no block waits a block period)
+	for (size_t l = 0; l < n_layouts; ++l) {
+		CHECK(results[l].blocks >= SIM_BLOCKS - 1);
+		CHECK(results[l].latency_max < BLOCK_US);
+		CHECK(results[l].idle[0] > 0 && results[l].idle[1] > 0);
+	}
+
+	/* Samples are read on time unless a heavy process stage preempts them
+	 * (by up to a sample period). Sharing the radio core delays heavy blocks
+	*/
+	CHECK(results[0].acquire_late < SAMPLE_US);
+	CHECK(heavy[0].acquire_late < SAMPLE_US);
+	CHECK(heavy[3].acquire_late > SAMPLE_US / 2);
+	CHECK(heavy[1].latency_max > heavy[0].latency_max);
+
+	beats_free(&train);
+	beats_free(&set);
+	return TEST_RESULT();
+}
@@ -0,0 +1,299 @@
+#include "test.h"
+#include "sdkconfig.h"
+#include "msgs.h"
+#include "replay.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Sample blocks replayed while the client is away (30 minutes of signal)
+#define AWAY_BLOCKS                 ((30 * 60 * 1000) / \
+	(DEVICE_SENSOR_POLL_PERIOD_MS * DEVICE_SENSOR_PUSH_BUF_SIZE))
+
+// Sample blocks between two telemetry frames (about a minute)
+#define TELEMETRY_BLOCKS            23
+
+// Control frames queued as the client goes away (the depth of the channel)
+#define CONTROL_FRAMES              4
+
+// Beats in the replayed set (rendered again once all are used)
+#define REPLAY_BEATS                2000
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing a disconnection, and what the client got afterwards
+typedef struct {
+	uint32_t waits;                         // Waits of the process stage
+	uint32_t late_blocks;                   // Blocks the stage took time over
+	double   mean_ns, max_ns;               // Host time per sample block
+	ipc_queue_stats_t stats[MSG_CHANNEL_MAX];  // Counters while away
+	uint32_t frames[MSG_CHANNEL_MAX];       // Frames taken after reconnecting
+	uint32_t beats;                         // Beats in the beat frames taken
+	uint32_t first_wave, last_telemetry;    // Sequence numbers taken
+} away_result_t;
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Waits of the process stage (it has none: waits end the test run)
+static uint32_t g_waits;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns the host time (ns) as cycles of the device clock
+static double cycles (double ns) {
+	return ns * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ / 1000;
+}
+
+
+// Counts a wait, and gives up on it at once
+static int on_wait (EventBits_t bits, TickType_t ticks) {
+	g_waits++;
+	return 0;
+}
+
+
+/* Takes every queued frame off the channels, as the link does once the
+ * client is back, and counts the beats the beat frames carry
+*/
+static void take_frames (away_result_t *result) {
+	ipc_buffer_t buffer;
+	msg_view_t view;
+	uint8_t channel;
+	msg_t msg;
+
+	while ((buffer = ipc_next(&channel)) != IPC_BUFFER_NONE) {
+		CHECK(msg_parse(&view, ipc_buffer_data(buffer),
+			ipc_buffer_size(buffer)) == ESP_OK);
+		CHECK(msg_decode(&msg, &view) == ESP_OK);
+		result->frames[channel]++;
+
+		if (msg.type == MSG_TYPE_SAMPLE_DATA) {
+			result->beats++;
+		} else if (msg.type == MSG_TYPE_SUMMARY) {
+			result->beats += msg.body.msg_summary.count;
+		} else if (msg.type == MSG_TYPE_WAVEFORM &&
+			result->frames[channel] == 1) {
+			result->first_wave = view.seq;
+		} else if (msg.type == MSG_TYPE_TELEMETRY) {
+			result->last_telemetry = view.seq;
+		}
+		ipc_buffer_release(buffer);
+	}
+}
+
+
+/* Replays half an hour of signal through the process stage (and the
+ * waveform) while nothing is taken off the channels, then has the client
+ * come back: the channels are drained, one more block is replayed, and the
+ * channels are drained again
+*/
+static void away (const beats_t *set, const msg_policy_data_t *policy,
+	away_result_t *result) {
+	const msg_batching_data_t plain = {
+		.count = 1, .age = 2000, .encoding = MSG_ENCODING_PLAIN, .keyframe = 8
+	};
+	uint8_t depth = 0, block = 0;
+	ipc_pool_stats_t pool, before;
+	beats_signal_t signal;
+	int64_t time;
+	uint64_t ns;
+	msg_t msg;
+
+	*result = (away_result_t) {0};
+	beats_signal_init(&signal, set, 7);
+	g_local_policy = *policy;
+	g_local_batching = plain;
+	for (int c = 0; c < MSG_CHANNEL_MAX; ++c) {
+		depth += g_ipc_channels[c].depth;
+	}
+	ipc_pool_stats(&before);
+
+	// Replies the client never took
+	for (int i = 0; i < CONTROL_FRAMES; ++i) {
+		msgs_example(&msg, MSG_TYPE_HELLO, i);
+		CHECK(ipc_send_msg(MSG_CHANNEL_CONTROL, &msg) == ESP_OK);
+	}
+
+	g_waits = 0;
+	g_host_wait_hook = on_wait;
+	for (uint32_t b = 0; b < AWAY_BLOCKS; ++b,
+		block = (block + 1) % DEVICE_SAMPLE_BLOCKS) {
+		time = g_host_time_us;
+		ns = host_ns();
+		replay_block(&signal, block);
+		send_waveform(block);
+		if (b % TELEMETRY_BLOCKS == 0) {
+			msgs_example(&msg, MSG_TYPE_TELEMETRY, b);
+			ipc_send_msg(MSG_CHANNEL_TELEMETRY, &msg);
+		}
+		ns = host_ns() - ns;
+		result->mean_ns += ns;
+		result->max_ns = (ns > result->max_ns) ? ns : result->max_ns;
+
+		// Only the signal itself took simulated time
+		result->late_blocks += (g_host_time_us - time != 1000 *
+			DEVICE_SENSOR_POLL_PERIOD_MS * DEVICE_SENSOR_PUSH_BUF_SIZE);
+
+		// No channel holds more than its depth, nor the pool more than those
+		for (int c = 0; c < MSG_CHANNEL_MAX; ++c) {
+			CHECK(ipc_pending(c) <= g_ipc_channels[c].depth);
+		}
+		ipc_pool_stats(&pool);
+		CHECK(pool.in_use <= depth);
+	}
+	g_host_wait_hook = NULL;
+	result->waits = g_waits;
+	result->mean_ns /= AWAY_BLOCKS;
+	CHECK(pool.exhausted == before.exhausted);
+
+	// A reply made just before the client is back outlives the others
+	msgs_example(&msg, MSG_TYPE_HELLO, CONTROL_FRAMES);
+	CHECK(ipc_send_msg(MSG_CHANNEL_CONTROL, &msg) == ESP_OK);
+	for (int c = 0; c < MSG_CHANNEL_MAX; ++c) {
+		ipc_queue_stats(g_tx_queues + c, result->stats + c);
+	}
+
+	take_frames(result);
+	replay_block(&signal, block);
+	take_frames(result);
+	ipc_pool_stats(&pool);
+	CHECK(pool.in_use == 0);
+}
+
+
+/* Every beat is relayed while the client is away for half an hour. The
+ * process stage never waits, and each channel applies its policy: beats are
+ * coalesced into a summary, the newest waveform is refused, the oldest
+ * telemetry is evicted, and control replies expire. Every beat is accounted
+ * for once the client is back
+*/
+static void test_every_beat (const beats_t *train, const beats_t *set) {
+	const msg_policy_data_t none = {0};
+	ipc_queue_stats_t control;
+	const ipc_queue_stats_t *s;
+	away_result_t r;
+
+	CHECK(replay_setup(train));
+	away(set, &none, &r);
+	s = r.stats;
+
+	printf("%-10s %9s %9s %9s %9s %9s %9s\n", "channel", "queued", "evicted",
+		"refused", "coalesced", "expired", "taken");
+	for (int c = 0; c < MSG_CHANNEL_MAX; ++c) {
+		printf("%-10s %9u %9u %9u %9u %9u %9u\n", g_ipc_channels[c].name,
+			s[c].queued, s[c].evicted, s[c].refused, s[c].coalesced,
+			s[c].expired, r.frames[c]);
+	}
+	printf("(host timings, in cycles of a %d MHz clock)\n",
+		CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+	printf("Every beat: %u blocks away, %u beats, %u waits, %.0f cycles per "
+		"block (at most %.0f)\n\n", AWAY_BLOCKS, g_stat_beats, r.waits,
+		cycles(r.mean_ns), cycles(r.max_ns));
+
+	// The process stage never waited on the link
+	CHECK(r.waits == 0);
+	CHECK(r.late_blocks == 0);
+
+	// The first beats were queued, the rest coalesced into one summary, and
+	// every beat reached the client once it was back
+	CHECK(s[MSG_CHANNEL_BEATS].queued == g_ipc_channels[MSG_CHANNEL_BEATS].depth);
+	CHECK(s[MSG_CHANNEL_BEATS].coalesced > 0);
+	CHECK(s[MSG_CHANNEL_BEATS].refused == 0);
+	CHECK(r.beats == g_stat_beats);
+
+	// The first waveform frames were kept, and the newest refused
+	CHECK(s[MSG_CHANNEL_WAVEFORM].refused > 0);
+	CHECK(s[MSG_CHANNEL_WAVEFORM].evicted == 0);
+	CHECK(r.first_wave == 0);
+
+	// The newest telemetry was kept, and the oldest evicted
+	CHECK(s[MSG_CHANNEL_TELEMETRY].evicted == s[MSG_CHANNEL_TELEMETRY].queued -
+		g_ipc_channels[MSG_CHANNEL_TELEMETRY].depth);
+	CHECK(s[MSG_CHANNEL_TELEMETRY].refused == 0);
+	CHECK(r.frames[MSG_CHANNEL_TELEMETRY] ==
+		g_ipc_channels[MSG_CHANNEL_TELEMETRY].depth);
+	CHECK(r.last_telemetry == ipc_sequence(MSG_CHANNEL_TELEMETRY) - 1);
+
+	// Stale replies expired (one to make room for the last), and the last
+	// reply was taken
+	CHECK(s[MSG_CHANNEL_CONTROL].expired == 1);
+	CHECK(s[MSG_CHANNEL_CONTROL].refused == 0);
+	CHECK(r.frames[MSG_CHANNEL_CONTROL] == 1);
+	ipc_queue_stats(g_tx_queues + MSG_CHANNEL_CONTROL, &control);
+	CHECK(control.expired == CONTROL_FRAMES);
+}
+
+
+/* With the escalation policy, the oldest alerts are evicted while the client
+ * is away, and the summaries refused by the full beat channel keep counting.
+ * Every beat is in a summary taken by the client, or was escalated
+*/
+static void test_policy (const beats_t *train, const beats_t *set) {
+	const msg_policy_data_t policy = {
+		.enabled        = 1,
+		.min_confidence = 128,
+		.snippet_len    = 32,
+		.summary_blocks = 4
+	};
+	const ipc_queue_stats_t *s;
+	away_result_t r;
+
+	CHECK(replay_setup(train));
+	away(set, &policy, &r);
+	s = r.stats;
+
+	printf("Policy: %u beats, %u escalated (%u alerts evicted), %u summaries "
+		"coalesced, %u waits\n\n", g_stat_beats, g_stat_escalated,
+		s[MSG_CHANNEL_ALERTS].evicted, s[MSG_CHANNEL_BEATS].coalesced,
+		r.waits);
+
+	CHECK(r.waits == 0);
+	CHECK(r.late_blocks == 0);
+	CHECK(g_stat_escalated > g_ipc_channels[MSG_CHANNEL_ALERTS].depth);
+	CHECK(s[MSG_CHANNEL_ALERTS].evicted == g_stat_escalated -
+		g_ipc_channels[MSG_CHANNEL_ALERTS].depth);
+	CHECK(r.frames[MSG_CHANNEL_ALERTS] ==
+		g_ipc_channels[MSG_CHANNEL_ALERTS].depth);
+	CHECK(s[MSG_CHANNEL_BEATS].coalesced > 0);
+	CHECK(r.beats + g_stat_escalated == g_stat_beats);
+}
+
+
+int main (void) {
+	const beats_model_t train_model = {.seed = 4, .abnormal = 30};
+	const beats_model_t replay_model = {.seed = 11, .abnormal = 10};
+	beats_t train, replay;
+
+	beats_generate(&train, 400, &train_model);
+	beats_generate(&replay, REPLAY_BEATS, &replay_model);
+
+	test_every_beat(&train, &replay);
+	test_policy(&train, &replay);
+
+	beats_free(&train);
+	beats_free(&replay);
+	return TEST_RESULT();
+}
@@ -0,0 +1,128 @@
+#include "test.h"
+#include "msgs.h"
+#include "ipc.h"
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+/* The largest frame of every type (variable arrays full) is packed into a
+ * transmit buffer, and comes out of its channel whole
+*/
+static void test_largest_frames (void) {
+	const size_t body_max[MSG_TYPE_MAX] = {
+		MSG_STATUS_BODY_MAX, MSG_TRAIN_DATA_BODY_MAX, MSG_SAMPLE_DATA_BODY_MAX,
+		MSG_INSTRUCTION_BODY_MAX, MSG_CONFIGURATION_BODY_MAX,
+		MSG_MODEL_DATA_BODY_MAX, MSG_FEEDBACK_BODY_MAX,
+		MSG_ESCALATION_BODY_MAX, MSG_SUMMARY_BODY_MAX, MSG_POLICY_BODY_MAX,
+		MSG_SAMPLE_BATCH_BODY_MAX, MSG_BATCHING_BODY_MAX,
+		MSG_BEAT_STREAM_BODY_MAX, MSG_WAVEFORM_BODY_MAX, MSG_HELLO_BODY_MAX,
+		MSG_TELEMETRY_BODY_MAX, MSG_LOG_STATUS_BODY_MAX, MSG_LOG_ACK_BODY_MAX,
+		MSG_LINK_STATUS_BODY_MAX
+	};
+	ipc_pool_stats_t pool;
+	ipc_buffer_t buffer;
+	uint8_t body[MSG_BUFFER_MAX];
+	msg_t msg, out;
+	size_t z;
+
+	CHECK(ipc_init() == ESP_OK);
+	for (msg_type_t t = 0; t < MSG_TYPE_MAX; ++t) {
+		msgs_example(&msg, t, 0x42 + t);
+		z = msg_size(&msg);
+		CHECK(z == MSG_HEADER_SIZE + body_max[t] + MSG_TRAILER_SIZE);
+		CHECK(z <= TASK_POOL_LARGE_SIZE);
+
+		CHECK(ipc_send_msg(MSG_CHANNEL_BEATS, &msg) == ESP_OK);
+		CHECK((buffer = ipc_receive(MSG_CHANNEL_BEATS)) != IPC_BUFFER_NONE);
+		if (buffer == IPC_BUFFER_NONE) {
+			continue;
+		}
+		CHECK(ipc_buffer_size(buffer) == z);
+		memset(&out, 0, sizeof(out));
+		CHECK(msg_unpack(&out, ipc_buffer_data(buffer), z) == ESP_OK);
+		CHECK(out.type == t);
+		CHECK(g_msg_codec_tab[t].pack(&out, body) == body_max[t]);
+		CHECK(memcmp(body, ipc_buffer_data(buffer) + MSG_HEADER_SIZE,
+			body_max[t]) == 0);
+		ipc_buffer_release(buffer);
+	}
+
+	// A full batch in particular (the largest frame of all)
+	msgs_example(&msg, MSG_TYPE_SAMPLE_BATCH, 7);
+	CHECK(msg.body.msg_sample_batch.n_beats == MSG_BATCH_MAX);
+	CHECK(ipc_send_msg(MSG_CHANNEL_BEATS, &msg) == ESP_OK);
+	buffer = ipc_receive(MSG_CHANNEL_BEATS);
+	CHECK(buffer >= TASK_POOL_SMALL_COUNT && buffer != IPC_BUFFER_NONE);
+	ipc_buffer_release(buffer);
+
+	ipc_pool_stats(&pool);
+	CHECK(pool.exhausted == 0 && pool.in_use == 0);
+	printf("Largest frame: %u bytes (sample batch of %u beats), large "
+		"buffers of %u bytes\n", MSG_HEADER_SIZE + MSG_SAMPLE_BATCH_BODY_MAX +
+		MSG_TRAILER_SIZE, MSG_BATCH_MAX, TASK_POOL_LARGE_SIZE);
+}
+
+
+/* Small frames take small buffers, then large ones; large frames only take
+ * large ones. Once none is left, requests fail and are counted, and released
+ * buffers (after their last reference) are taken again. Follows the test of
+ * the largest frames, which leaves the pool as ipc_init filled it
+*/
+static void test_exhaustion (void) {
+	ipc_buffer_t taken[TASK_POOL_SMALL_COUNT + TASK_POOL_LARGE_COUNT], small;
+	ipc_pool_stats_t pool;
+	size_t n;
+
+	// Large frames exhaust the large buffers only
+	for (n = 0; (taken[n] = ipc_buffer_alloc(TASK_POOL_LARGE_SIZE)) !=
+		IPC_BUFFER_NONE; ++n) {
+		CHECK(taken[n] >= TASK_POOL_SMALL_COUNT);
+	}
+	CHECK(n == TASK_POOL_LARGE_COUNT);
+	CHECK(ipc_buffer_alloc(TASK_POOL_SMALL_SIZE + 1) == IPC_BUFFER_NONE);
+	CHECK((small = ipc_buffer_alloc(TASK_POOL_SMALL_SIZE)) <
+		TASK_POOL_SMALL_COUNT);
+	ipc_buffer_release(small);
+	for (size_t i = 0; i < n; ++i) {
+		ipc_buffer_release(taken[i]);
+	}
+
+	// A frame larger than any buffer is never given one
+	CHECK(ipc_buffer_alloc(TASK_POOL_LARGE_SIZE + 1) == IPC_BUFFER_NONE);
+
+	// Small frames spill into the large buffers
+	for (n = 0; (taken[n] = ipc_buffer_alloc(1)) != IPC_BUFFER_NONE; ++n) {
+		CHECK(n < TASK_POOL_SMALL_COUNT + TASK_POOL_LARGE_COUNT);
+	}
+	CHECK(n == TASK_POOL_SMALL_COUNT + TASK_POOL_LARGE_COUNT);
+	ipc_pool_stats(&pool);
+	CHECK(pool.in_use == n && pool.peak == n);
+
+	// A buffer held twice returns to the pool after the second release
+	ipc_buffer_retain(taken[0]);
+	ipc_buffer_release(taken[0]);
+	CHECK(ipc_buffer_alloc(1) == IPC_BUFFER_NONE);
+	ipc_buffer_release(taken[0]);
+	CHECK(ipc_buffer_alloc(1) == taken[0]);
+
+	for (size_t i = 0; i < n; ++i) {
+		ipc_buffer_release(taken[i]);
+	}
+	ipc_pool_stats(&pool);
+	CHECK(pool.in_use == 0);
+	CHECK(pool.exhausted == 5);
+	printf("Pool: %u small and %u large buffers, %u requests refused\n",
+		TASK_POOL_SMALL_COUNT, TASK_POOL_LARGE_COUNT, pool.exhausted);
+}
+
+
+int main (void) {
+	test_largest_frames();
+	test_exhaustion();
+	return TEST_RESULT();
+}
@@ -0,0 +1,189 @@
+#include "test.h"
+#include "sdkconfig.h"
+#include "ring.h"
+#include "ipc.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Capacity of the ring stressed with random records, and the records moved
+#define STRESS_CAP                  2048
+#define STRESS_RECORDS              500000
+
+// Largest record of the stress (the largest chunk ipc_enqueue makes)
+#define STRESS_SIZE_MAX             TASK_QUEUE_DATA_MAX
+
+// Messages passed per benchmark run
+#define BENCH_ROUNDS                2000000
+
+// Slots of the FreeRTOS queue the receive ring replaced
+#define QUEUE_SLOTS                 16
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Records expected out of the stressed ring, in order (a ring of its own)
+static uint8_t  g_expect[STRESS_CAP][STRESS_SIZE_MAX];
+static uint16_t g_expect_size[STRESS_CAP];
+static size_t   g_expect_head, g_expect_count;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns the host time (ns) as cycles of the device clock
+static double cycles (double ns) {
+	return ns * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ / 1000;
+}
+
+
+/* Random records, wrapping around the end of the buffer at every offset,
+ * come out whole and in order, and a record is refused exactly when it
+ * doesn't fit
+*/
+static void test_stress (void) {
+	static uint8_t buffer[STRESS_CAP];
+	uint8_t data[STRESS_SIZE_MAX], out[STRESS_SIZE_MAX], id;
+	size_t moved = 0, refused = 0, used = 0, wraps = 0, tail, z;
+	ring_t ring;
+
+	srand(41);
+	ring_init(&ring, buffer, sizeof(buffer));
+	CHECK(ring_get(&ring, &id, out, sizeof(out)) == 0);
+
+	while (moved < STRESS_RECORDS) {
+
+		// Put while there is room, take while there are records (at random)
+		if (rand() % 2) {
+			z = 1 + rand() % STRESS_SIZE_MAX;
+			for (size_t i = 0; i < z; ++i) {
+				data[i] = rand();
+			}
+			tail = (ring.head + ring.used) % ring.cap;
+			CHECK((ring_put(&ring, z & 0xFF, data, z) == 0) ==
+				(RING_HEADER_SIZE + z <= STRESS_CAP - used));
+			if (RING_HEADER_SIZE + z > STRESS_CAP - used) {
+				refused++;
+				continue;
+			}
+			wraps += (tail + RING_HEADER_SIZE + z > ring.cap);
+			used += RING_HEADER_SIZE + z;
+			tail = (g_expect_head + g_expect_count++) % STRESS_CAP;
+			memcpy(g_expect[tail], data, z);
+			g_expect_size[tail] = z;
+		} else if (g_expect_count > 0) {
+			z = g_expect_size[g_expect_head];
+			CHECK(ring_peek(&ring, NULL, NULL, 0) == z);
+			CHECK(ring_get(&ring, &id, out, sizeof(out)) == z);
+			CHECK(id == (z & 0xFF));
+			CHECK(memcmp(out, g_expect[g_expect_head], z) == 0);
+			g_expect_head = (g_expect_head + 1) % STRESS_CAP;
+			g_expect_count--;
+			used -= RING_HEADER_SIZE + z;
+			moved++;
+		}
+		CHECK(ring.used == used && ring.count == g_expect_count);
+	}
+
+	// A payload larger than the buffer given is truncated, but taken whole
+	ring_init(&ring, buffer, sizeof(buffer));
+	CHECK(ring_put(&ring, 1, data, 100) == 0);
+	CHECK(ring_put(&ring, 2, data + 100, 10) == 0);
+	CHECK(ring_get(&ring, &id, out, 40) == 40);
+	CHECK(memcmp(out, data, 40) == 0);
+	CHECK(ring_get(&ring, &id, out, sizeof(out)) == 10 && id == 2);
+	CHECK(memcmp(out, data + 100, 10) == 0);
+	CHECK(ring.used == 0 && ring.count == 0);
+
+	// A record that needs the whole buffer fits an empty ring only
+	CHECK(ring_fits(&ring, STRESS_CAP - RING_HEADER_SIZE));
+	CHECK(!ring_fits(&ring, STRESS_CAP - RING_HEADER_SIZE + 1));
+
+	printf("Stress: %u records moved (%u wrapped, %u refused as full)\n\n",
+		moved, wraps, refused);
+	CHECK(wraps > 0 && refused > 0);
+}
+
+
+/* Messages pass through the receive ring (ipc_enqueue and ipc_dequeue) and
+ * through a FreeRTOS queue of task_queue_msg_t slots, as they did before.
+ * The ring copies the header and payload in and out; the queue copies the
+ * payload into a slot, and the whole slot in and out
+*/
+static void test_bench (void) {
+	const size_t sizes[] = {8, 19, 64, 215, TASK_QUEUE_DATA_MAX};
+	uint8_t data[TASK_QUEUE_DATA_MAX];
+	QueueHandle_t queue;
+	task_queue_msg_t msg;
+	volatile size_t sink = 0;
+	uint64_t start;
+	double ring_ns, queue_ns;
+
+	CHECK(ipc_init() == ESP_OK);
+	CHECK((queue = xQueueCreate(QUEUE_SLOTS, sizeof(task_queue_msg_t))) !=
+		NULL);
+	memset(data, 0x5A, sizeof(data));
+
+	printf("(host timings, in cycles of a %d MHz clock)\n",
+		CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+	printf("%6s %12s %12s %12s %12s %10s %10s\n", "bytes", "ring copied",
+		"queue copied", "ring cyc", "queue cyc", "ring msgs", "queue msgs");
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		size_t z = sizes[i];
+
+		start = host_ns();
+		for (int r = 0; r < BENCH_ROUNDS; ++r) {
+			ipc_enqueue(&g_ble_rx_queue, MSG_CHANNEL_CONTROL, z, data);
+			sink += ipc_dequeue(&g_ble_rx_queue, &msg);
+		}
+		ring_ns = (double)(host_ns() - start) / BENCH_ROUNDS;
+		CHECK(msg.size == z && memcmp(msg.data, data, z) == 0);
+
+		start = host_ns();
+		for (int r = 0; r < BENCH_ROUNDS; ++r) {
+			msg.id = MSG_CHANNEL_CONTROL;
+			msg.size = z;
+			memcpy(msg.data, data, z);
+			xQueueSendToBack(queue, &msg, 0);
+			xQueueReceive(queue, &msg, 0);
+			sink += msg.size;
+		}
+		queue_ns = (double)(host_ns() - start) / BENCH_ROUNDS;
+
+		// Messages of this size each holds (the ring as the receive queue)
+		printf("%6u %12u %12u %12.1f %12.1f %10u %10u\n", z,
+			2 * (RING_HEADER_SIZE + z), z + 2 * sizeof(task_queue_msg_t),
+			cycles(ring_ns), cycles(queue_ns),
+			TASK_QUEUE_RX_SIZE / (RING_HEADER_SIZE + z), QUEUE_SLOTS);
+		CHECK(2 * (RING_HEADER_SIZE + z) < z + 2 * sizeof(task_queue_msg_t));
+	}
+
+	// RAM of the receive queue, as a ring and as the slots it replaced
+	printf("\nReceive queue RAM: ring %u bytes, queue %u bytes (%u slots of "
+		"%u)\n", TASK_QUEUE_RX_SIZE, QUEUE_SLOTS * sizeof(task_queue_msg_t),
+		QUEUE_SLOTS, sizeof(task_queue_msg_t));
+	CHECK(TASK_QUEUE_RX_SIZE < QUEUE_SLOTS * sizeof(task_queue_msg_t));
+	CHECK(sink > 0);
+}
+
+
+int main (void) {
+	test_stress();
+	test_bench();
+	return TEST_RESULT();
+}
@@ -0,0 +1,292 @@
+#include "test.h"
+#include "sdkconfig.h"
+#include "msgs.h"
+#include "link.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Iterations per benchmark run, and the runs (the fastest is kept)
+#define BENCH_ROUNDS                1000000
+#define BENCH_RUNS                  5
+
+// Most the instrumentation may add to the frame path (percent), beyond the
+// noise of host timings
+#define OVERHEAD_MAX_PERCENT        25
+
+// Simulated time (us) given to the device to settle after the client acts
+#define SETTLE_US                   (1000 * 1000)
+
+// Samples relayed before the client asks for telemetry
+#define SAMPLES                     5
+
+
+/*
+ *******************************************************************************
+ *                              Global Variables                               *
+ *******************************************************************************
+*/
+
+
+// Telemetry reports taken by the client (by queue), and the link reports
+static msg_telemetry_data_t g_reports[MSG_CHANNEL_MAX + 1];
+static uint32_t g_report_count[MSG_CHANNEL_MAX + 1];
+static uint32_t g_link_reports;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns the host time (ns) as cycles of the device clock
+static double cycles (double ns) {
+	return ns * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ / 1000;
+}
+
+
+// Returns the messages in the latency histogram of a queue
+static uint32_t histogram_total (const uint32_t *latency) {
+	uint32_t n = 0;
+
+	for (int b = 0; b < MSG_LATENCY_BUCKETS; ++b) {
+		n += latency[b];
+	}
+	return n;
+}
+
+
+// Keeps the telemetry reports taken by the client
+static void on_frame (const msg_view_t *view, void *ctx) {
+	msg_t msg;
+
+	if (msg_decode(&msg, view) != ESP_OK) {
+		return;
+	}
+	if (msg.type == MSG_TYPE_TELEMETRY &&
+		msg.body.msg_telemetry.queue <= MSG_CHANNEL_MAX) {
+		g_reports[msg.body.msg_telemetry.queue] = msg.body.msg_telemetry;
+		g_report_count[msg.body.msg_telemetry.queue]++;
+	} else if (msg.type == MSG_TYPE_LINK_STATUS) {
+		g_link_reports++;
+	}
+}
+
+
+/* Waits land in buckets doubling from 1 ms, and the high-water marks and
+ * byte counts follow the queues. The drop counters are kept either way;
+ * without the instrumentation the rest stays zero
+*/
+static void test_counters (void) {
+	const uint32_t waits_us[] = {0, 999, 1000, 1999, 2000, 3999, 4000,
+		1500000, 5000000};
+	const uint8_t buckets[] = {0, 0, 1, 1, 2, 2, 3, 11, 11};
+	const size_t n = sizeof(waits_us) / sizeof(waits_us[0]);
+	uint32_t expect[MSG_LATENCY_BUCKETS] = {0};
+	uint8_t chunk[TASK_QUEUE_DATA_MAX] = {0};
+	ipc_queue_stats_t beats, rx;
+	ipc_buffer_t buffer;
+	size_t z = 0, chunks = 0;
+	msg_t msg;
+
+	CHECK(ipc_init() == ESP_OK);
+	msgs_example(&msg, MSG_TYPE_SAMPLE_DATA, 1);
+
+	// One frame at a time, each taken after its wait
+	for (size_t i = 0; i < n; ++i) {
+		CHECK(ipc_send_msg(MSG_CHANNEL_BEATS, &msg) == ESP_OK);
+		host_advance_us(waits_us[i]);
+		CHECK((buffer = ipc_receive(MSG_CHANNEL_BEATS)) != IPC_BUFFER_NONE);
+		z += ipc_buffer_size(buffer);
+		ipc_buffer_release(buffer);
+		expect[buckets[i]]++;
+	}
+
+	// The channel filled up, and one more frame coalesced
+	while (ipc_send_msg(MSG_CHANNEL_BEATS, &msg) == ESP_OK);
+	while ((buffer = ipc_receive(MSG_CHANNEL_BEATS)) != IPC_BUFFER_NONE) {
+		z += ipc_buffer_size(buffer);
+		expect[0]++;
+		ipc_buffer_release(buffer);
+	}
+
+	// The receive queue filled up, and one more chunk was refused
+	while (ipc_enqueue(&g_ble_rx_queue, MSG_CHANNEL_CONTROL, sizeof(chunk),
+		chunk) == ESP_OK) {
+		chunks++;
+	}
+
+	ipc_queue_stats(g_tx_queues + MSG_CHANNEL_BEATS, &beats);
+	ipc_queue_stats(&g_ble_rx_queue, &rx);
+	CHECK(beats.queued == n + g_ipc_channels[MSG_CHANNEL_BEATS].depth);
+	CHECK(beats.coalesced == 1);
+	CHECK(rx.queued == chunks && rx.refused == 1);
+
+#if TASK_QUEUE_STATS
+	CHECK(memcmp(beats.latency, expect, sizeof(expect)) == 0);
+	CHECK(beats.bytes == z);
+	CHECK(beats.high_water == g_ipc_channels[MSG_CHANNEL_BEATS].depth);
+	CHECK(rx.high_water == chunks);
+#else
+	CHECK(histogram_total(beats.latency) == 0);
+	CHECK(beats.bytes == 0 && beats.high_water == 0 && rx.high_water == 0);
+#endif
+
+	printf("Counters (instrumentation %s): %u queued, %u coalesced, high "
+		"water %u, %u bytes, %u in the histogram\n",
+		TASK_QUEUE_STATS ? "on" : "off", beats.queued, beats.coalesced,
+		beats.high_water, beats.bytes, histogram_total(beats.latency));
+	while (ipc_dequeue(&g_ble_rx_queue, NULL) > 0);
+}
+
+
+/* The client asks for telemetry, and gets a report of every queue (the
+ * receive queue last) and of the link, with the counters of the queues
+*/
+static void test_telemetry (void) {
+	link_config_t config = {.mtu = 247, .ll_len = BLE_DATA_LEN_MAX};
+	msg_t msg = {
+		.type = MSG_TYPE_HELLO,
+		.body.msg_hello = {
+			.version   = MSG_PROTOCOL_VERSION,
+			.types     = (1 << MSG_TYPE_MAX) - 1,
+			.encodings = (1 << MSG_ENCODING_MAX) - 1,
+			.batch_max = MSG_BATCH_MAX,
+			.mtu       = 247
+		}
+	};
+	const msg_telemetry_data_t *control = g_reports + MSG_CHANNEL_CONTROL;
+	const msg_telemetry_data_t *rx = g_reports + MSG_CHANNEL_MAX;
+	ipc_queue_stats_t before;
+
+	memset(g_reports, 0, sizeof(g_reports));
+	memset(g_report_count, 0, sizeof(g_report_count));
+	g_link_reports = 0;
+	link_boot(&config);
+	g_link.on_frame = on_frame;
+	link_connect();
+	link_send(&msg);
+	link_run(SETTLE_US);
+
+	// Counters run since boot (the test of the counters came first)
+	ipc_queue_stats(g_tx_queues + MSG_CHANNEL_BEATS, &before);
+	for (int i = 0; i < SAMPLES; ++i) {
+		msgs_example(&msg, MSG_TYPE_SAMPLE_DATA, i);
+		CHECK(ipc_send_msg(MSG_CHANNEL_BEATS, &msg) == ESP_OK);
+	}
+	xEventGroupSetBits(g_event_group, FLAG_BLE_SEND_MSG);
+	link_run(SETTLE_US);
+
+	msg = (msg_t) {
+		.type = MSG_TYPE_INSTRUCTION,
+		.body.msg_instruction.inst = INST_EKG_TELEMETRY
+	};
+	link_send(&msg);
+	link_run(SETTLE_US);
+
+	for (int q = 0; q <= MSG_CHANNEL_MAX; ++q) {
+		CHECK(g_report_count[q] == 1);
+	}
+	CHECK(g_link_reports == 1);
+	CHECK(g_reports[MSG_CHANNEL_BEATS].queued == before.queued + SAMPLES);
+	CHECK(control->queued == 1);
+	CHECK(rx->queued >= 2);
+
+#if TASK_QUEUE_STATS
+	CHECK(control->high_water == 1);
+	CHECK(histogram_total(control->latency) == 1);
+	CHECK(g_reports[MSG_CHANNEL_BEATS].high_water >= 1);
+	CHECK(g_reports[MSG_CHANNEL_BEATS].bytes > 0);
+	CHECK(rx->bytes > 0);
+#else
+	CHECK(control->high_water == 0 && control->bytes == 0);
+	CHECK(histogram_total(control->latency) == 0);
+#endif
+
+	printf("Telemetry: %u reports and %u link report, receive queue %u "
+		"queued (%u bytes), control %u in the histogram\n",
+		MSG_CHANNEL_MAX + 1, g_link_reports, rx->queued, rx->bytes,
+		histogram_total(control->latency));
+}
+
+
+/* Times the frame path: two frames packed into buffers on two channels,
+ * taken by the scheduler and released, and a chunk through the receive
+ * queue. The build without instrumentation writes its time to a file, which
+ * the instrumented build compares against
+*/
+static void test_overhead (const char *path) {
+	uint8_t chunk[20] = {0};
+	double ns, best = 0;
+	volatile size_t sink = 0;
+	ipc_buffer_t buffer;
+	uint8_t channel;
+	uint64_t start;
+	msg_t sample, escalation;
+	FILE *file;
+
+	CHECK(ipc_init() == ESP_OK);
+	msgs_example(&sample, MSG_TYPE_SAMPLE_DATA, 1);
+	msgs_example(&escalation, MSG_TYPE_ESCALATION, 1);
+
+	for (int r = 0; r < BENCH_RUNS; ++r) {
+		start = host_ns();
+		for (int i = 0; i < BENCH_ROUNDS; ++i) {
+			ipc_send_msg(MSG_CHANNEL_BEATS, &sample);
+			ipc_send_msg(MSG_CHANNEL_ALERTS, &escalation);
+			while ((buffer = ipc_next(&channel)) != IPC_BUFFER_NONE) {
+				sink += channel;
+				ipc_buffer_release(buffer);
+			}
+			ipc_enqueue(&g_ble_rx_queue, MSG_CHANNEL_CONTROL, sizeof(chunk),
+				chunk);
+			sink += ipc_dequeue(&g_ble_rx_queue, NULL);
+		}
+		ns = (double)(host_ns() - start) / BENCH_ROUNDS;
+		best = (r == 0 || ns < best) ? ns : best;
+	}
+	CHECK(sink > 0);
+
+	printf("(host timings, in cycles of a %d MHz clock)\n",
+		CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+	printf("Frame path (instrumentation %s): %.1f cycles\n",
+		TASK_QUEUE_STATS ? "on" : "off", cycles(best));
+
+	if (path == NULL) {
+		return;
+	}
+#if TASK_QUEUE_STATS
+	double other;
+
+	if ((file = fopen(path, "r")) == NULL || fscanf(file, "%lf", &other) != 1) {
+		CHECK(!"no timing of the build without instrumentation");
+	} else {
+		printf("Frame path (instrumentation off): %.1f cycles, overhead "
+			"%.1f%%\n", cycles(other), 100.0 * (best - other) / other);
+		CHECK(best * 100 < other * (100 + OVERHEAD_MAX_PERCENT));
+	}
+#else
+	if ((file = fopen(path, "w")) != NULL) {
+		fprintf(file, "%f\n", best);
+	}
+	CHECK(file != NULL);
+#endif
+	if (file != NULL) {
+		fclose(file);
+	}
+}
+
+
+int main (int argc, char **argv) {
+	test_counters();
+	test_telemetry();
+	test_overhead((argc > 1) ? argv[1] : NULL);
+	return TEST_RESULT();
+}
@@ -0,0 +1,236 @@
+#include <math.h>
+#include "sdkconfig.h"
+#include "test.h"
+#include "beats.h"
+#include "msg.h"
+#include "wave_codec.h"
+
+
+/*
+ *******************************************************************************
+ *                         Internal Symbolic Constants                         *
+ *******************************************************************************
+*/
+
+
+// Samples coded per signal
+#define SIGNAL_SAMPLES              36000
+
+// Frames a signal may take (all but the last hold two samples or more)
+#define FRAMES_MAX                  (SIGNAL_SAMPLES / 2 + 1)
+
+// Times each signal is coded and decoded for the timings
+#define CODEC_ROUNDS                20
+
+
+/*
+ *******************************************************************************
+ *                              Type Definitions                               *
+ *******************************************************************************
+*/
+
+
+// Structure describing the coding of a signal as waveform frames
+typedef struct {
+	size_t   frames;            // Waveform frames
+	size_t   residual_bytes;    // Bytes of coded residuals
+	size_t   frame_bytes;       // Bytes of the frames (headers included)
+	uint64_t encode_ns;         // Time spent coding
+	uint64_t decode_ns;         // Time spent decoding
+} coding_t;
+
+
+/*
+ *******************************************************************************
+ *                        Internal Function Definitions                        *
+ *******************************************************************************
+*/
+
+
+// Returns the next value of a linear congruential generator
+static uint32_t next_random (uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+
+/* Renders a 12-bit ECG at a given rate: P wave, QRS complex and T wave over a
+ * wandering baseline, with a few LSB of noise
+*/
+static void render_ecg (uint16_t *samples, size_t n, double rate) {
+	uint32_t state = 7;
+
+	for (size_t i = 0; i < n; ++i) {
+		double t = i / rate, phase = fmod(t, 0.8) - 0.4;
+		double v = 2048 + 120 * sin(2 * M_PI * 0.3 * t)
+			+ 100 * exp(-pow((phase + 0.2) / 0.025, 2))
+			+ 900 * exp(-pow(phase / 0.01, 2))
+			- 150 * exp(-pow((phase - 0.015) / 0.008, 2))
+			+ 200 * exp(-pow((phase - 0.25) / 0.04, 2));
+
+		samples[i] = (uint16_t)(v + (next_random(&state) % 7) - 3);
+	}
+}
+
+
+/* Codes a signal as the EKG task does (frames of at most UINT8_MAX samples,
+ * each filling at most MSG_WAVE_MAX bytes), checking every frame decodes
+ * back to the samples it holds
+*/
+static void code_signal (const uint16_t *samples, size_t n, coding_t *c) {
+	msg_stream_t stream = {.channel = MSG_CHANNEL_WAVEFORM};
+	msg_t message = {.type = MSG_TYPE_WAVEFORM};
+	msg_waveform_data_t *f = &message.body.msg_waveform;
+	uint16_t decoded[UINT8_MAX];
+	uint8_t frame[MSG_BUFFER_MAX];
+	size_t off = 0, z;
+
+	memset(c, 0, sizeof(*c));
+	while (off < n) {
+		size_t m = (n - off > UINT8_MAX) ? UINT8_MAX : n - off;
+
+		m = wave_encode(samples + off, m, &f->k, f->data, MSG_WAVE_MAX, &z);
+		f->first = samples[off];
+		f->n_samples = m;
+		f->size = z;
+
+		CHECK(m > 0);
+		CHECK(wave_decode(f->first, f->k, f->data, z, decoded, m) == 0);
+		CHECK(memcmp(decoded, samples + off, m * sizeof(uint16_t)) == 0);
+
+		c->frames++;
+		c->residual_bytes += z;
+		c->frame_bytes += msg_pack_into(&message, &stream, frame, 
+			sizeof(frame));
+		off += m;
+	}
+}
+
+
+// Times coding and decoding a signal in the frames code_signal made
+static void time_signal (const uint16_t *samples, size_t n, coding_t *c) {
+	static uint8_t data[FRAMES_MAX * MSG_WAVE_MAX], k[FRAMES_MAX];
+	static size_t size[FRAMES_MAX], count[FRAMES_MAX];
+	static uint16_t decoded[SIGNAL_SAMPLES];
+	size_t frames = 0;
+	uint64_t start;
+
+	start = host_ns();
+	for (int r = 0; r < CODEC_ROUNDS; ++r) {
+		size_t off = 0, m;
+
+		for (frames = 0; off < n; off += m, ++frames) {
+			m = (n - off > UINT8_MAX) ? UINT8_MAX : n - off;
+			m = wave_encode(samples + off, m, k + frames, 
+				data + frames * MSG_WAVE_MAX, MSG_WAVE_MAX, size + frames);
+			count[frames] = m;
+		}
+	}
+	c->encode_ns = (host_ns() - start) / CODEC_ROUNDS;
+
+	start = host_ns();
+	for (int r = 0; r < CODEC_ROUNDS; ++r) {
+		size_t off = 0;
+
+		for (size_t i = 0; i < frames; off += count[i++]) {
+			wave_decode(samples[off], k[i], data + i * MSG_WAVE_MAX, size[i],
+				decoded + off, count[i]);
+		}
+	}
+	c->decode_ns = (host_ns() - start) / CODEC_ROUNDS;
+	CHECK(memcmp(decoded, samples, n * sizeof(uint16_t)) == 0);
+}
+
+
+/* Codes a signal and reports the bits per sample of the residuals and of the
+ * frames, the link rate at the sample rate given, and the cycles per sample.
+ * Returns the bits per sample of the frames
+*/
+static double run_signal (const char *name, const uint16_t *samples, 
+	size_t n, unsigned rate) {
+	coding_t c;
+	double frame_bits;
+
+	code_signal(samples, n, &c);
+	time_signal(samples, n, &c);
+	frame_bits = 8.0 * c.frame_bytes / n;
+
+	printf("%-24s %6zu %8.2f %8.2f %9.2f %8.1f %8.1f\n", name, c.frames, 
+		8.0 * c.residual_bytes / n, frame_bits, frame_bits * rate / 1000,
+		(double)c.encode_ns * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ / (1000.0 * n),
+		(double)c.decode_ns * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ / (1000.0 * n));
+	return frame_bits;
+}
+
+
+/* A cut short frame, or one with a parameter out of range, is rejected. A
+ * step in a flat signal is escaped rather than coded in unary
+*/
+static void test_malformed (void) {
+	uint16_t samples[128], decoded[128];
+	uint8_t buffer[MSG_WAVE_MAX], k;
+	size_t n, z;
+
+	for (size_t i = 0; i < 128; ++i) {
+		samples[i] = (i < 64) ? 100 : 4000;
+	}
+	n = wave_encode(samples, 128, &k, buffer, sizeof(buffer), &z);
+	CHECK(n == 128 && ((2 * 3900u) >> k) >= WAVE_CODEC_ESCAPE);
+	CHECK(z * 8 >= 2 * (WAVE_CODEC_ESCAPE + WAVE_CODEC_RAW_BITS));
+	CHECK(wave_decode(samples[0], k, buffer, z, decoded, n) == 0);
+	CHECK(memcmp(decoded, samples, sizeof(samples)) == 0);
+	CHECK(wave_decode(samples[0], k, buffer, z - 3, decoded, n) != 0);
+	CHECK(wave_decode(samples[0], WAVE_CODEC_K_MAX + 1, buffer, z, decoded, 
+		n) != 0);
+
+	// A buffer too small for every residual takes as many as fit
+	n = wave_encode(samples, 128, &k, buffer, 4, &z);
+	CHECK(n > 1 && n < 128 && z <= 4);
+	CHECK(wave_decode(samples[0], k, buffer, z, decoded, n) == 0);
+	CHECK(memcmp(decoded, samples, n * sizeof(uint16_t)) == 0);
+}
+
+
+int main (void) {
+	static uint16_t samples[SIGNAL_SAMPLES];
+	const beats_model_t model = {.seed = 17, .abnormal = 10};
+	beats_signal_t signal;
+	uint32_t state = 3;
+	beats_t set;
+
+	test_malformed();
+
+	printf("%-24s %6s %8s %8s %9s %8s %8s\n", "signal", "frames", "res. b/s",
+		"frame b/s", "kbit/s", "enc. cyc", "dec. cyc");
+
+	// The sensor signal the device samples (DEVICE_SENSOR_POLL_PERIOD_MS),
+	// whose wander makes for wider residuals than a filtered ECG
+	beats_generate(&set, 400, &model);
+	beats_signal_init(&signal, &set, 5);
+	beats_signal_fill(&signal, samples, SIGNAL_SAMPLES);
+	CHECK(run_signal("Sensor, 100 Hz", samples, SIGNAL_SAMPLES, 100) < 10);
+	beats_free(&set);
+
+	// A 12-bit ECG at the rates of common recorders
+	render_ecg(samples, SIGNAL_SAMPLES, 360);
+	CHECK(run_signal("12-bit ECG, 360 Hz", samples, SIGNAL_SAMPLES, 360) < 8);
+	render_ecg(samples, SIGNAL_SAMPLES, 500);
+	CHECK(run_signal("12-bit ECG, 500 Hz", samples, SIGNAL_SAMPLES, 500) < 8);
+
+	// Noise doesn't compress, but isn't coded much larger than it is
+	for (size_t i = 0; i < SIGNAL_SAMPLES; ++i) {
+		samples[i] = next_random(&state) & 0xFFF;
+	}
+	CHECK(run_signal("12-bit noise", samples, SIGNAL_SAMPLES, 500) < 16);
+
+	// Samples across the whole range take the largest parameter
+	for (size_t i = 0; i < SIGNAL_SAMPLES; ++i) {
+		samples[i] = next_random(&state);
+	}
+	CHECK(run_signal("16-bit noise", samples, SIGNAL_SAMPLES, 500) < 20);
+
+	printf("(host timings, in cycles of a %u MHz clock; frame bits include "
+		"headers)\n", CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+
+	return TEST_RESULT();
+}
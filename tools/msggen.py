@@ -0,0 +1,603 @@
+#!/usr/bin/env python3
+#
+# Generates the message codec from the message schema (tools/msg_schema.json)
+#
+# Outputs:
+#  - main/include/msg_gen.h: Message types, bodies and the codec table
+#  - main/src/msg_gen.c:     Firmware pack/unpack/size functions
+#  - gateway/ekg_msg.h:      Standalone decoder interface for the gateway
+#  - gateway/ekg_msg.c:      Standalone decoder for the gateway
+#
+# All multi-byte fields are little-endian. A field may be a scalar, a fixed
+# array ("count", a number or the name of a constant) or a variable array
+# whose length is held in an earlier field ("length") and is bounded by "max".
+# Variable arrays must follow all other fields, and may share a length field. Generated code never allocates.
+#
+# Usage: python3 tools/msggen.py (from the project directory)
+#
+
+import json
+import os
+import sys
+
+
+ROOT   = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SCHEMA = os.path.join(ROOT, 'tools', 'msg_schema.json')
+
+# Size (bytes) and C type of each field type
+TYPES = {
+    'u8':  (1, 'uint8_t'),
+    'u16': (2, 'uint16_t'),
+    'u32': (4, 'uint32_t'),
+}
+
+
+def section (*titles):
+    return ('/*\n'
+            ' ' + '*' * 79 + '\n' +
+            ''.join(' *' + t.center(77) + '*\n' for t in titles) +
+            ' ' + '*' * 79 + '\n'
+            '*/\n')
+
+
+BANNER = section('Generated by tools/msggen.py from tools/msg_schema.json',
+                 'Do not edit this file')
+
+
+def comment (code, doc, column):
+    return code.ljust(column) + '// ' + doc
+
+
+def check (schema):
+    constants = {c['name']: c['value'] for c in schema['constants']}
+    for m in schema['messages']:
+        names = [f['name'] for f in m['fields']]
+        for i, f in enumerate(m['fields']):
+            if f['type'] not in TYPES:
+                sys.exit('%s.%s: unknown type %s' % (m['name'], f['name'],
+                    f['type']))
+            if isinstance(f.get('count'), str):
+                if f['count'] not in constants:
+                    sys.exit('%s.%s: unknown count %s' % (m['name'],
+                        f['name'], f['count']))
+                f['count_value'] = constants[f['count']]
+            if 'length' in f:
+                if any('length' not in g for g in m['fields'][i:]):
+                    sys.exit('%s.%s: variable arrays must come last' %
+                        (m['name'], f['name']))
+                if f['length'] not in names[:i] or 'max' not in f:
+                    sys.exit('%s.%s: bad length field or missing max' %
+                        (m['name'], f['name']))
+                f['max_value'] = constants.get(f['max'], f['max'])
+
+
+def fixed_size (m):
+    return sum(TYPES[f['type']][0] * f.get('count_value', f.get('count', 1))
+               for f in m['fields'] if 'length' not in f)
+
+
+def max_size (m):
+    return fixed_size(m) + sum(TYPES[f['type']][0] * f['max_value']
+                               for f in variable(m))
+
+
+def variable (m):
+    return [f for f in m['fields'] if 'length' in f]
+
+
+def variable_size (m, body, indent='\t\t'):
+    return (' +\n' + indent).join('%d * (size_t)%s.%s' % (TYPES[f['type']][0], body,
+                      f['length']) for f in variable(m))
+
+
+# ----------------------------------------------------------------------------
+#                              Shared declarations
+# ----------------------------------------------------------------------------
+
+
+def declarations (schema):
+    out = []
+
+    out.append(section('Generated Symbolic Constants'))
+    out.append('\n\n')
+    for c in schema['constants']:
+        out.append('// %s\n' % c['doc'])
+        out.append('#define     %-36s%d\n\n' % (c['name'], c['value']))
+    out.append('\n')
+
+    out.append(section('Generated Type Definitions'))
+    out.append('\n\n')
+    out.append('// Enumeration describing the type of the message received '
+               '(treated as 8-bits)\n')
+    out.append('typedef enum {\n')
+    for i, m in enumerate(schema['messages']):
+        code = '    %s%s,' % (m['type'], ' = 0' if i == 0 else '')
+        out.append(comment(code, m['doc'], 32) + '\n')
+    out.append('\n')
+    out.append(comment('    MSG_TYPE_MAX', 'Upper boundary value for the '
+                       'message type', 32) + '\n')
+    out.append('} msg_type_t;\n\n\n')
+
+    for m in schema['messages']:
+        out.append('// %s\n' % m['struct_doc'])
+        out.append('typedef struct {\n')
+        codes = []
+        for f in m['fields']:
+            ctype = TYPES[f['type']][1]
+            if 'count' in f:
+                decl = '%s[%s];' % (f['name'], f['count'])
+            elif 'length' in f:
+                decl = '%s[%s];' % (f['name'], f['max'])
+            else:
+                decl = '%s;' % f['name']
+            codes.append('    %-9s%s' % (ctype, decl))
+        column = max([32] + [len(c) + 2 for c in codes])
+        for code, f in zip(codes, m['fields']):
+            out.append(comment(code, f['doc'], column) + '\n')
+        out.append('} %s;\n\n\n' % m['struct'])
+
+    out.append('// Union describing a message body in general (used for '
+               'buffer sizing)\n')
+    out.append('typedef union {\n')
+    for m in schema['messages']:
+        out.append('    %-28s %s;\n' % (m['struct'], m['member']))
+    out.append('} msg_body_t;\n\n\n')
+
+    out.append('// Structure describing the general message\n')
+    out.append('typedef struct {\n')
+    out.append('    msg_type_t type;\n')
+    out.append('    msg_body_t body;\n')
+    out.append('} msg_t;\n\n\n')
+
+    return ''.join(out)
+
+
+# ----------------------------------------------------------------------------
+#                              Pack/unpack bodies
+# ----------------------------------------------------------------------------
+
+
+def pack_value (expr, t):
+    size = TYPES[t][0]
+    if size == 1:
+        return ['\tbuffer[z++] = %s;' % expr]
+    return ['\tbuffer[z++] = (%s >> %d) & 0xFF;' % (expr, 8 * i)
+            for i in range(size)]
+
+
+def unpack_value (target, t):
+    size = TYPES[t][0]
+    if size == 1:
+        return ['\t%s = buffer[offset++];' % target]
+    parts = ['((%s)buffer[offset + %d] << %d)' % (TYPES[t][1], i, 8 * i)
+             if i > 0 else 'buffer[offset]' for i in range(size)]
+    lines = ['\t%s = %s;' % (target, ' | '.join(parts))]
+    if len(lines[0]) > 80:
+        lines = ['\t%s = %s |' % (target, parts[0])]
+        for i, part in enumerate(parts[1:]):
+            lines.append('\t\t' + part + (';' if i == size - 2 else ' |'))
+    lines.append('\toffset += %d;' % size)
+    return lines
+
+
+def indent (lines):
+    return ['\t' + l for l in lines]
+
+
+def pack_function (m, prefix, body):
+    lines = ['// Packs a %s message' % m['name'].replace('_', ' '),
+             'size_t pack_msg_%s (const msg_t *msg, uint8_t *buffer) {'
+             % m['name'],
+             '\tsize_t z = 0;', '']
+    for f in m['fields']:
+        expr = '%s.%s' % (body, f['name'])
+        if 'count' in f or 'length' in f:
+            bound = f['count'] if 'count' in f else '%s.%s' % (body,
+                f['length'])
+            lines.append('\tfor (size_t i = 0; i < %s; ++i) {' % bound)
+            lines += indent(pack_value(expr + '[i]', f['type']))
+            lines.append('\t}')
+        else:
+            lines += pack_value(expr, f['type'])
+    lines += ['', '\treturn z;', '}']
+    return '\n'.join(lines) + '\n'
+
+
+def unpack_function (m, prefix, body, err_ok, err_size, ret):
+    lines = ['// Unpacks a %s message' % m['name'].replace('_', ' '),
+             '%s %sunpack_msg_%s (msg_t *msg, const uint8_t *buffer, '
+             % (ret, prefix, m['name']),
+             '\tsize_t len) {',
+             '\tsize_t offset = 0;', '']
+    for f in m['fields']:
+        target = '%s.%s' % (body, f['name'])
+        if 'length' in f:
+            n = '%s.%s' % (body, f['length'])
+            lines += ['', '\t// Check the array fits both the message and the '
+                      'remaining data',
+                      '\tif (%s > %s ||' % (n, f['max']),
+                      '\t\t%d * (size_t)%s > (len - offset)) {'
+                      % (TYPES[f['type']][0], n),
+                      '\t\treturn %s;' % err_size,
+                      '\t}']
+            bound = n
+        elif 'count' in f:
+            bound = f['count']
+        else:
+            lines += unpack_value(target, f['type'])
+            continue
+        lines.append('\tfor (size_t i = 0; i < %s; ++i) {' % bound)
+        lines += indent(unpack_value(target + '[i]', f['type']))
+        lines.append('\t}')
+    if not variable(m):
+        lines.insert(4, '\t(void)len;')
+    lines += ['', '\treturn %s;' % err_ok, '}']
+    return '\n'.join(lines) + '\n'
+
+
+def extra_function (m, prefix, body):
+    return ('// Size of the variable part of a %s message\n'
+            'size_t %sextra_msg_%s (const msg_t *msg) {\n'
+            '\treturn %s;\n'
+            '}\n' % (m['name'].replace('_', ' '), prefix, m['name'],
+                     variable_size(m, body)))
+
+
+# ----------------------------------------------------------------------------
+#                                  Firmware
+# ----------------------------------------------------------------------------
+
+
+def firmware_header (schema):
+    out = ['#if !defined(MSG_GEN_H)\n#define MSG_GEN_H\n\n\n', BANNER, '\n\n',
+           '#include <inttypes.h>\n#include <stddef.h>\n',
+           '#include "esp_system.h"\n\n\n']
+    out.append(declarations(schema))
+    out.append('// Largest packed body of each message type (bytes)\n')
+    for m in schema['messages']:
+        out.append('#define     %-36s%d\n' % (m['type'].replace('MSG_TYPE_',
+                   'MSG_') + '_BODY_MAX', max_size(m)))
+    out.append('\n\n')
+    out.append('// Structure describing how a message type is serialized\n')
+    out.append('typedef struct {\n')
+    out.append(comment('    size_t size;', 'Fixed body size', 58) + '\n')
+    out.append(comment('    size_t (*pack)(const msg_t *msg, uint8_t *buffer);',
+                       'Packs the body', 58) + '\n')
+    out.append('    esp_err_t (*unpack)(msg_t *msg, const uint8_t *buffer,\n')
+    out.append(comment('        size_t len);', 'Unpacks the body', 58) + '\n')
+    out.append(comment('    size_t (*extra)(const msg_t *msg);',
+                       'Variable size', 58) + '\n')
+    out.append('} msg_codec_t;\n\n\n')
+    out.append(section('Generated Global Variables'))
+    out.append('\n\n')
+    out.append('// Codec of each message type (indexed by msg_type_t)\n')
+    out.append('extern const msg_codec_t g_msg_codec_tab[MSG_TYPE_MAX];\n\n\n')
+    out.append('#endif\n')
+    return ''.join(out)
+
+
+def firmware_source (schema):
+    out = ['#include "msg.h"\n\n\n', BANNER, '\n\n']
+    out.append(section('Message Packing Functions'))
+    for m in schema['messages']:
+        out.append('\n\n' + pack_function(m, '', 'msg->body.' + m['member']))
+    out.append('\n\n' + section('Message Unpacking Functions'))
+    for m in schema['messages']:
+        out.append('\n\n' + unpack_function(m, '', 'msg->body.' + m['member'],
+                   'ESP_OK', 'ESP_ERR_INVALID_SIZE', 'esp_err_t'))
+    out.append('\n\n' + section('Variable Size Functions'))
+    for m in schema['messages']:
+        if variable(m):
+            out.append('\n\n' + extra_function(m, '',
+                       'msg->body.' + m['member']))
+    out.append('\n\n' + section('Message Codec Table'))
+    out.append('\n\n')
+    out.append('const msg_codec_t g_msg_codec_tab[MSG_TYPE_MAX] = {\n')
+    for m in schema['messages']:
+        out.append('    [%s] = {\n' % m['type'])
+        out.append('        %d, pack_msg_%s, unpack_msg_%s,\n'
+                   % (fixed_size(m), m['name'], m['name']))
+        out.append('        %s\n' % ('extra_msg_' + m['name'] if variable(m)
+                                     else 'NULL'))
+        out.append('    },\n')
+    out.append('};\n')
+    return ''.join(out)
+
+
+# ----------------------------------------------------------------------------
+#                                   Gateway
+# ----------------------------------------------------------------------------
+
+
+def gateway_header (schema):
+    out = ['#if !defined(EKG_MSG_H)\n#define EKG_MSG_H\n\n\n', BANNER, '\n\n',
+           '#include <stdint.h>\n#include <stddef.h>\n\n\n']
+    out.append(section('Framing Constants'))
+    out.append('\n\n')
+    out.append('''// Byte value used for marking message headers
+#define     EKG_MSG_HEAD                        0xFF
+
+// Size of the message header (markers, type, channel, sequence, time, length)
+#define     EKG_MSG_HEADER_SIZE                 12
+
+// Size of the message trailer (CRC-16/CCITT of all but the markers)
+#define     EKG_MSG_TRAILER_SIZE                2
+
+// Size of the largest valid frame
+#define     EKG_MSG_FRAME_MAX                   (EKG_MSG_HEADER_SIZE + \\
+                                                 sizeof(msg_body_t) + \\
+                                                 EKG_MSG_TRAILER_SIZE)
+
+// Frames per channel tracked, to drop those received before (more than the
+// notifications the device sends again after a loss may hold)
+#define     EKG_MSG_TRACK_WINDOW                256
+
+
+''')
+    out.append(declarations(schema))
+    out.append('''// Structure describing the header fields of a decoded frame
+typedef struct {
+    uint8_t  channel;               // Logical channel (MSG_CHANNEL_*)
+    uint16_t seq;                   // Sequence number in the channel
+    uint32_t time;                  // Device time (ms since boot) when sent
+} ekg_msg_frame_t;
+
+
+// Structure counting the frames lost or reordered in a received channel
+typedef struct {
+    uint16_t seq;                   // Sequence number expected next
+    uint8_t  seen[EKG_MSG_TRACK_WINDOW / 8]; // Bit s % window if tracked
+    uint8_t  synced;                // Nonzero once a frame was tracked
+    uint32_t frames;                // Frames tracked
+    uint32_t lost;                  // Frames skipped (incl. late ones)
+    uint32_t reordered;             // Frames arriving behind the sequence
+    uint32_t duplicates;            // Frames tracked before (to be dropped)
+} ekg_msg_stats_t;
+
+
+// Callback invoked for each message decoded from a stream
+typedef void (*ekg_msg_handler_t)(const msg_t *msg, 
+    const ekg_msg_frame_t *frame, void *ctx);
+
+
+''')
+    out.append(section('Function Declarations'))
+    out.append('''
+
+/* @brief Decodes the frame at the start of a buffer.
+ *
+ * @param
+ * - buffer: Received data
+ * - len:    Length of the received data
+ * - msg:    Receives the decoded message
+ * - frame:  Receives the header fields of the frame (may be NULL)
+ *
+ * @return Bytes consumed (> 0), 0 if the frame is incomplete, or -1 if the
+ *         buffer doesn't start with an intact frame of a known type
+*/
+int ekg_msg_decode (const uint8_t *buffer, size_t len, msg_t *msg,
+    ekg_msg_frame_t *frame);
+
+
+/* @brief Decodes every complete frame in a buffer, skipping over bytes
+ *        that don't start an intact frame.
+ *
+ * @param
+ * - buffer:  Received data
+ * - len:     Length of the received data
+ * - handler: Invoked with each decoded message
+ * - ctx:     Passed to the handler
+ *
+ * @return Bytes consumed. The rest is an incomplete message to be retried
+ *         once more data is appended
+*/
+size_t ekg_msg_decode_stream (const uint8_t *buffer, size_t len,
+    ekg_msg_handler_t handler, void *ctx);
+
+
+/* @brief Tracks the sequence number of a received frame. Numbers that jump
+ *        ahead count the frames skipped as lost, and numbers that fall
+ *        behind count as reordered. A number tracked before (one of the
+ *        last EKG_MSG_TRACK_WINDOW) is a duplicate: the device sends
+ *        notifications again after a loss, and the client drops the frames
+ *        it already has. Keep one set of counters per channel, and zero
+ *        them to start a new connection
+ *
+ * @param
+ * - stats: The counters of the frame's channel
+ * - seq:   Sequence number of the received frame
+ *
+ * @return 1 to keep the frame, or 0 to drop it (a duplicate)
+*/
+int ekg_msg_track (ekg_msg_stats_t *stats, uint16_t seq);
+
+
+#endif
+''')
+    return ''.join(out)
+
+
+def crc_table ():
+    rows = []
+    for hi in range(0, 256, 8):
+        values = []
+        for i in range(hi, hi + 8):
+            crc = i << 8
+            for _ in range(8):
+                crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            values.append('0x%04X' % (crc & 0xFFFF))
+        rows.append('\t' + ', '.join(values))
+    return ',\n'.join(rows)
+
+
+def gateway_source (schema):
+    out = ['#include "ekg_msg.h"\n\n\n', BANNER, '\n\n']
+    out.append(section('Internal Global Variables'))
+    out.append('''
+
+// CRC-16/CCITT lookup table (polynomial 0x1021)
+static const uint16_t g_ekg_msg_crc_tab[256] = {
+''' + crc_table() + '''
+};
+
+
+''')
+    out.append(section('Internal Function Definitions'))
+    out.append('''
+
+// Computes the CRC-16/CCITT (initial value 0xFFFF) of a buffer, a byte at a
+// time (frames are checked at every offset while resynchronizing)
+static uint16_t ekg_msg_crc (const uint8_t *buffer, size_t len) {
+\tuint16_t crc = 0xFFFF;
+
+\twhile (len-- > 0) {
+\t\tcrc = (crc << 8) ^ g_ekg_msg_crc_tab[(crc >> 8) ^ *buffer++];
+\t}
+
+\treturn crc;
+}
+
+
+''')
+    out.append(section('Message Unpacking Functions'))
+    for m in schema['messages']:
+        out.append('\n\n' + unpack_function(m, 'static ',
+                   'msg->body.' + m['member'], '0', '-1', 'int')
+                   .replace('int static unpack', 'static int unpack'))
+    out.append('\n\n' + section('External Function Definitions'))
+    out.append('\n\n')
+    out.append('int ekg_msg_decode (const uint8_t *buffer, size_t len, '
+               'msg_t *msg,\n    ekg_msg_frame_t *frame) {\n')
+    out.append('''\tsize_t body, z;
+\tint err = -1;
+
+\t// Check the markers as far as they were received
+\tif ((len > 0 && buffer[0] != EKG_MSG_HEAD) ||
+\t\t(len > 1 && buffer[1] != EKG_MSG_HEAD)) {
+\t\treturn -1;
+\t}
+\tif (len < EKG_MSG_HEADER_SIZE) {
+\t\treturn 0;
+\t}
+
+\t// Check the length, then the CRC and type once the frame is complete
+\tbody = buffer[10] | (buffer[11] << 8);
+\tz = EKG_MSG_HEADER_SIZE + body + EKG_MSG_TRAILER_SIZE;
+\tif (z > EKG_MSG_FRAME_MAX) {
+\t\treturn -1;
+\t}
+\tif (len < z) {
+\t\treturn 0;
+\t}
+\tif (ekg_msg_crc(buffer + 2, z - 4) !=
+\t\t(buffer[z - 2] | (buffer[z - 1] << 8)) || buffer[2] >= MSG_TYPE_MAX ||
+\t\tbuffer[3] >= MSG_CHANNEL_MAX) {
+\t\treturn -1;
+\t}
+
+\tmsg->type = buffer[2];
+\tif (frame != NULL) {
+\t\tframe->channel = buffer[3];
+\t\tframe->seq     = buffer[4] | (buffer[5] << 8);
+\t\tframe->time    = buffer[6] | (buffer[7] << 8) |
+\t\t\t((uint32_t)buffer[8] << 16) | ((uint32_t)buffer[9] << 24);
+\t}
+\tbuffer += EKG_MSG_HEADER_SIZE;
+
+\tswitch (msg->type) {
+''')
+    for m in schema['messages']:
+        out.append('\t\tcase %s: {\n' % m['type'])
+        out.append('\t\t\tif (body >= %d) {\n' % fixed_size(m))
+        out.append('\t\t\t\terr = unpack_msg_%s(msg, buffer, body);\n'
+                   % m['name'])
+        out.append('\t\t\t}\n\t\t}\n\t\tbreak;\n')
+    out.append('\t\tdefault:\n\t\tbreak;\n')
+    out.append('\t}\n\n\treturn (err == 0) ? (int)z : -1;\n}\n\n\n')
+    out.append('''size_t ekg_msg_decode_stream (const uint8_t *buffer, size_t len,
+    ekg_msg_handler_t handler, void *ctx) {
+\tsize_t offset = 0;
+\tekg_msg_frame_t frame;
+\tmsg_t msg;
+\tint z;
+
+\twhile (offset < len) {
+\t\tif ((z = ekg_msg_decode(buffer + offset, len - offset, &msg,
+\t\t\t&frame)) == 0) {
+\t\t\tbreak;
+\t\t}
+\t\tif (z < 0) {
+\t\t\toffset++;
+\t\t\tcontinue;
+\t\t}
+\t\thandler(&msg, &frame, ctx);
+\t\toffset += z;
+\t}
+
+\treturn offset;
+}
+
+
+int ekg_msg_track (ekg_msg_stats_t *stats, uint16_t seq) {
+\tuint16_t ahead = seq - stats->seq;
+\tuint8_t bit = 1 << (seq % 8);
+\tuint8_t *byte = stats->seen + (seq % EKG_MSG_TRACK_WINDOW) / 8;
+
+\t// A frame more than half the sequence space ahead is behind instead
+\tif (stats->synced && ahead >= 0x8000) {
+\t\tif ((uint16_t)-ahead <= EKG_MSG_TRACK_WINDOW && (*byte & bit)) {
+\t\t\tstats->duplicates++;
+\t\t\treturn 0;
+\t\t}
+\t\tif ((uint16_t)-ahead <= EKG_MSG_TRACK_WINDOW) {
+\t\t\t*byte |= bit;
+\t\t}
+\t\tstats->frames++;
+\t\tstats->reordered++;
+\t\treturn 1;
+\t}
+\tif (stats->synced) {
+\t\tstats->lost += ahead;
+\t}
+
+\t// Forget the frames the window moves past
+\tif (!stats->synced || ahead >= EKG_MSG_TRACK_WINDOW) {
+\t\tfor (size_t i = 0; i < sizeof(stats->seen); ++i) {
+\t\t\tstats->seen[i] = 0;
+\t\t}
+\t} else {
+\t\tfor (uint16_t s = stats->seq; s != seq; ++s) {
+\t\t\tstats->seen[(s % EKG_MSG_TRACK_WINDOW) / 8] &= ~(1 << (s % 8));
+\t\t}
+\t}
+\t*byte |= bit;
+
+\tstats->frames++;
+\tstats->synced = 1;
+\tstats->seq = seq + 1;
+
+\treturn 1;
+}
+''')
+    return ''.join(out)
+
+
+def write (path, text):
+    with open(os.path.join(ROOT, path), 'w') as f:
+        f.write(text)
+
+
+def main ():
+    with open(SCHEMA) as f:
+        schema = json.load(f)
+    check(schema)
+
+    os.makedirs(os.path.join(ROOT, 'gateway'), exist_ok=True)
+    write('main/include/msg_gen.h', firmware_header(schema))
+    write('main/src/msg_gen.c', firmware_source(schema))
+    write('gateway/ekg_msg.h', gateway_header(schema))
+    write('gateway/ekg_msg.c', gateway_source(schema))
+
+
+if __name__ == '__main__':
+    main()